@@ -5,6 +5,7 @@
 #include <iostream>
 #include <qi/application.hpp>
 #include <qi/log.hpp>
+#include <qi/eventloop.hpp>
 #include <boost/shared_ptr.hpp>
 #include <qi/anyobject.hpp>
 #include <qi/type/dynamicobjectbuilder.hpp>
@@ -133,6 +134,21 @@ void emit_event(int iteration)//test emit empty events.
   }
 }
 
+void post_tasks(int iteration, qi::EventLoop::Backend backend) //test eventloop task throughput.
+{
+  qi::EventLoop el;
+  el.start(0, backend);
+  for (int i = 0; i < iteration; i++)
+  {
+    el.post(&cb);
+  }
+  while (*callbackValue < iteration) //waiting tasks
+  {
+  }
+  el.stop();
+  el.join();
+}
+
 void test_callback()  //test callbacks performances without session
 {
   qi::ObjectTypeBuilder<Service> obt; //advertising Event
@@ -213,6 +229,20 @@ int main(int argc, char* argv[])
   dp.stop();
   out << dp;
 
+  //~~~~~~~~~~~~~~~ EventLoop backends ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  callbackValue = 0;
+  dp.start("eventloop-post-asio", iteration);
+  post_tasks(iteration, qi::EventLoop::Backend_Asio);
+  dp.stop();
+  out << dp;
+
+  callbackValue = 0;
+  dp.start("eventloop-post-workstealing", iteration);
+  post_tasks(iteration, qi::EventLoop::Backend_WorkStealing);
+  dp.stop();
+  out << dp;
+  callbackValue = 0;
+
   //~~~~~~~~~~~~~~~ Event tests(SD and direct mode)~~~~~~~~~~~~~~~~~
   // TODO: Add other mode.
 
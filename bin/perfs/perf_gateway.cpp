@@ -0,0 +1,138 @@
+/*
+** Copyright (C) 2014 Aldebaran Robotics
+** See COPYING for the license
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace po = boost::program_options;
+
+#include <qi/application.hpp>
+#include <qi/session.hpp>
+#include <qi/anyobject.hpp>
+#include <qi/type/dynamicobjectbuilder.hpp>
+#include <qi/messaging/gateway.hpp>
+#include <qi/perf/dataperfsuite.hpp>
+
+qiLogCategory("perf.gateway");
+
+static qi::Buffer replyBuf(const qi::Buffer& buf)
+{
+  return buf;
+}
+
+typedef boost::shared_ptr<qi::Session> SessionPtr;
+
+// Every client keeps `pipeline` calls in flight: the gateway forwards
+// calls from all the clients at once.
+static void runClients(qi::DataPerfSuite& out, std::vector<qi::AnyObject>& objects,
+                       unsigned int clients, unsigned int calls, unsigned int pipeline,
+                       unsigned int numBytes)
+{
+  std::ostringstream name;
+  name << "gateway_" << clients << "_clients_" << numBytes << "b";
+
+  qi::Buffer buf;
+  buf.reserve(numBytes);
+
+  qi::DataPerf dp;
+  dp.start(name.str(), clients * calls, numBytes);
+  for (unsigned int i = 0; i < calls; i += pipeline)
+  {
+    std::vector<qi::Future<qi::Buffer> > replies;
+    for (unsigned int c = 0; c < clients; ++c)
+      for (unsigned int k = 0; k < pipeline && i + k < calls; ++k)
+        replies.push_back(objects[c].async<qi::Buffer>("replyBuf", buf));
+    for (unsigned int r = 0; r < replies.size(); ++r)
+      replies[r].wait();
+  }
+  dp.stop();
+  out << dp;
+}
+
+int main(int argc, char *argv[])
+{
+  qi::Application app(argc, argv);
+
+  po::options_description desc(std::string("Usage:\n ")+argv[0]+"\n");
+  desc.add_options()
+    ("help,h", "Print this help.")
+    ("clients", po::value<unsigned int>()->default_value(1000), "Maximum number of clients connected to the gateway")
+    ("calls", po::value<unsigned int>()->default_value(100), "Number of calls per client")
+    ("pipeline", po::value<unsigned int>()->default_value(4), "Calls in flight per client")
+    ("passthrough-threshold", po::value<size_t>()->default_value(0), "Relay replies of at least that many bytes as they are received (only above 64 KiB)");
+
+  desc.add(qi::details::getPerfOptions());
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv)
+            .options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  unsigned int maxClients = vm["clients"].as<unsigned int>();
+  unsigned int calls = vm["calls"].as<unsigned int>();
+  unsigned int pipeline = std::max(vm["pipeline"].as<unsigned int>(), 1u);
+
+  qi::DataPerfSuite out("qimessaging", "gateway", qi::DataPerfSuite::OutputData_MsgPerSecond, vm["output"].as<std::string>());
+
+  qi::Session sd;
+  sd.listenStandalone("tcp://127.0.0.1:0");
+
+  qi::DynamicObjectBuilder ob;
+  ob.setThreadingModel(qi::ObjectThreadingModel_MultiThread);
+  ob.advertiseMethod("replyBuf", &replyBuf);
+  qi::Session server;
+  server.connect(sd.endpoints()[0]);
+  server.listen("tcp://127.0.0.1:0");
+  server.registerService("serviceTest", ob.object());
+
+  qi::Gateway gateway;
+  gateway.setPassthroughThreshold(vm["passthrough-threshold"].as<size_t>());
+  if (!gateway.attachToServiceDirectory(sd.endpoints()[0]))
+    return EXIT_FAILURE;
+  gateway.listen("tcp://127.0.0.1:0");
+
+  // Each client holds two connections to the gateway: 1000 clients need
+  // more than 4000 file descriptors.
+  std::vector<SessionPtr> sessions;
+  std::vector<qi::AnyObject> objects;
+  for (unsigned int clients = 1; clients <= maxClients; clients *= 10)
+  {
+    while (sessions.size() < clients)
+    {
+      SessionPtr session(new qi::Session);
+      if (session->connect(gateway.endpoints()[0]).hasError())
+      {
+        std::cerr << "Client " << sessions.size() << " can't connect to the gateway" << std::endl;
+        return EXIT_FAILURE;
+      }
+      qi::Future<qi::AnyObject> obj = session->service("serviceTest");
+      if (obj.hasError())
+      {
+        std::cerr << "Client " << sessions.size() << " can't get serviceTest: " << obj.error() << std::endl;
+        return EXIT_FAILURE;
+      }
+      sessions.push_back(session);
+      objects.push_back(obj.value());
+    }
+    runClients(out, objects, clients, calls, pipeline, 4);
+    runClients(out, objects, clients, calls, pipeline, 4096);
+    // Camera-like payloads
+    if (clients <= 10)
+      runClients(out, objects, clients, calls, pipeline, 1024 * 1024);
+  }
+
+  objects.clear();
+  sessions.clear();
+  return EXIT_SUCCESS;
+}
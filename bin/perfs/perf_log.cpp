@@ -0,0 +1,95 @@
+/*
+** Copyright (C) 2014 Aldebaran Robotics
+** See COPYING for the license
+*/
+
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace po = boost::program_options;
+
+#include <qi/application.hpp>
+#include <qi/log.hpp>
+#include <qi/perf/dataperfsuite.hpp>
+
+qiLogCategory("perf.log");
+
+static const unsigned int nthreads = 16;
+static const unsigned int niter = 20000; // per thread
+
+static void nullHandler(const qi::LogLevel, const qi::os::timeval,
+                        const char*, const char*, const char*, const char*, int)
+{
+}
+
+static void logLoop()
+{
+  for (unsigned int i = 0; i < niter; ++i)
+    qiLogInfo() << "message number " << i << " from a benchmark thread";
+}
+
+static void logLoopDeferred()
+{
+  for (unsigned int i = 0; i < niter; ++i)
+    qiLogInfoF("message number %d from a benchmark thread", i);
+}
+
+// Time nthreads threads logging concurrently: the period is the wall-clock
+// cost of one qiLogInfo as seen by the application.
+static void runThreads(qi::DataPerfSuite& out, const std::string& name,
+                       void (*loop)() = &logLoop)
+{
+  qi::DataPerf dp;
+  dp.start(name, nthreads * niter);
+  boost::thread_group threads;
+  for (unsigned int i = 0; i < nthreads; ++i)
+    threads.create_thread(loop);
+  threads.join_all();
+  dp.stop();
+  out << dp;
+  qi::log::flush();
+}
+
+int main(int argc, char *argv[])
+{
+  qi::Application app(argc, argv);
+
+  po::options_description desc(std::string("Usage:\n ")+argv[0]+"\n");
+  desc.add_options()
+    ("help,h", "Print this help.");
+
+  desc.add(qi::details::getPerfOptions());
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv)
+            .options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  qi::DataPerfSuite out("qi", "log", qi::DataPerfSuite::OutputData_Period, vm["output"].as<std::string>());
+
+  // Measure the logging path, not the terminal
+  qi::log::removeLogHandler("consoleloghandler");
+  qi::log::addLogHandler("null", &nullHandler);
+
+  qi::log::setSynchronousLog(true);
+  runThreads(out, "Sync_16_threads");
+
+  qi::log::setSynchronousLog(false);
+  qi::log::setAsyncLogOverflowPolicy(qi::LogOverflowPolicy_Block);
+  runThreads(out, "Async_block_16_threads");
+  runThreads(out, "Async_deferred_16_threads", &logLoopDeferred);
+
+  qi::log::setAsyncLogOverflowPolicy(qi::LogOverflowPolicy_Drop);
+  runThreads(out, "Async_drop_16_threads");
+  std::cout << qi::log::droppedLogs() << " messages dropped" << std::endl;
+
+  qi::log::removeLogHandler("null");
+  return EXIT_SUCCESS;
+}
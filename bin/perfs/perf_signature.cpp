@@ -0,0 +1,68 @@
+/*
+** Copyright (C) 2014 Aldebaran Robotics
+** See COPYING for the license
+*/
+
+#include <iostream>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+#include <qi/application.hpp>
+#include <qi/signature.hpp>
+#include <qi/perf/dataperfsuite.hpp>
+
+static const unsigned int niter = 1000000;
+
+int main(int argc, char *argv[])
+{
+  qi::Application app(argc, argv);
+
+  po::options_description desc(std::string("Usage:\n ")+argv[0]+"\n");
+  desc.add_options()
+    ("help,h", "Print this help.");
+
+  desc.add(qi::details::getPerfOptions());
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv)
+            .options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  qi::DataPerfSuite out("qi", "signature", qi::DataPerfSuite::OutputData_Period, vm["output"].as<std::string>());
+
+  qi::DataPerf dp;
+  float score = 0;
+
+  // Typical return type check done by RemoteObject::metaCall
+  qi::Signature simpleFrom("i");
+  qi::Signature simpleTo("l");
+  dp.start("Convertible_simple", niter);
+  for (unsigned int i = 0; i < niter; ++i)
+    score += simpleFrom.isConvertibleTo(simpleTo);
+  dp.stop();
+  out << dp;
+
+  // Typical overload resolution done by MetaObjectPrivate::findMethod
+  qi::Signature tupleFrom("(s[i]{sm}(ff)<Point,x,y>)");
+  qi::Signature tupleTo("(s[l]{sm}(dd)<Point,x,y>)");
+  dp.start("Convertible_tuple", niter);
+  for (unsigned int i = 0; i < niter; ++i)
+    score += tupleFrom.isConvertibleTo(tupleTo);
+  dp.stop();
+  out << dp;
+
+  // Signatures built from strings on the call path
+  dp.start("Construct_and_convert", niter);
+  for (unsigned int i = 0; i < niter; ++i)
+    score += qi::Signature("(s[i]{sm})").isConvertibleTo(qi::Signature("(s[l]{sm})"));
+  dp.stop();
+  out << dp;
+
+  return score > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -22,11 +22,13 @@ namespace po = boost::program_options;
 #include <qi/os.hpp>
 #include <qi/application.hpp>
 #include <qi/url.hpp>
+#include <qi/buffer.hpp>
 #include <qi/session.hpp>
 #include <qi/perf/dataperfsuite.hpp>
 #include <qi/perf/dataperf.hpp>
 
 #include <qi/messaging/gateway.hpp>
+#include <qi/messaging/transportstats.hpp>
 #include <qi/anyobject.hpp>
 #include <qi/type/dynamicobjectbuilder.hpp>
 
@@ -124,13 +126,25 @@ int run_client(qi::AnyObject obj)
 
     qi::Buffer buf;
     buf.reserve(numBytes);
+    qi::resetTransportWriteStats();
+    qi::resetTransportReadStats();
     dp.start(oss.str(), gLoopCount, numBytes);
     unsigned long long latencySum = 0;
-    for (int j = 0; j < gLoopCount; ++j)
+    for (int j = 0; j < gLoopCount; j += pipeline)
     {
       qi::os::timeval tstart, tstop;
       qi::os::gettimeofday(&tstart);
-      obj.call<qi::Buffer>("replyBuf", buf);
+      if (pipeline <= 1)
+        obj.call<qi::Buffer>("replyBuf", buf);
+      else
+      {
+        // Keep pipeline calls in flight so that sends can be coalesced
+        std::vector<qi::Future<qi::Buffer> > calls;
+        for (int k = 0; k < pipeline && j + k < gLoopCount; ++k)
+          calls.push_back(obj.async<qi::Buffer>("replyBuf", buf));
+        for (unsigned k = 0; k < calls.size(); ++k)
+          calls[k].wait();
+      }
       qi::os::gettimeofday(&tstop);
       latencySum += (tstop.tv_sec - tstart.tv_sec)* 1000000LL
         + (tstop.tv_usec - tstart.tv_usec);
@@ -140,11 +154,24 @@ int run_client(qi::AnyObject obj)
     dp.stop();
     *out << dp;
 
+    qi::TransportWriteStats ws = qi::transportWriteStats();
+    if (ws.writes)
+      std::cerr << "Messages per write " << (double)ws.messages / ws.writes
+                << " (" << ws.messages << " messages, " << ws.writes << " writes)" << std::endl;
+    qi::TransportReadStats rs = qi::transportReadStats();
+    if (rs.reads)
+      std::cerr << "Messages per read " << (double)rs.messages / rs.reads
+                << " (" << rs.messages << " messages, " << rs.reads << " reads)" << std::endl;
+    qi::BufferPoolStats ps = qi::bufferPoolStats();
+    if (ps.allocations)
+      std::cerr << "Buffer pool hit rate " << (double)ps.hits / ps.allocations
+                << " (peak " << ps.peakCachedBytes << " bytes cached)" << std::endl;
+
     numBytes <<= 2;
 
     // We expect latency to be dp.meanInterval, but just to be sure also show
     // latency.
-    std::cerr << "Average latency " << (latencySum / gLoopCount) << std::endl;
+    std::cerr << "Average latency " << (latencySum * std::max(pipeline, 1) / gLoopCount) << std::endl;
   }
   return 0;
 }
@@ -120,7 +120,8 @@ void main_loop()
      << "  %CPU  " << "COUNT         "
      << "USER" << std::string(6*3 - 2, ' ')
      << "SYS " << std::string(6*3 - 2, ' ')
-     << "WALL"
+     << "WALL" << std::string(6*3 - 2, ' ')
+     << "WALL P50/P99/P999"
      << std::endl;
     foreach(const Stat& s, stats)
     {
@@ -144,6 +145,7 @@ void main_loop()
         << "   "
         << us(ms.wall().cumulatedValue() / (float)ms.count()) << ' ' << us(ms.wall().minValue()) << ' ' << us(ms.wall().maxValue())
         << "   "
+        << us(ms.wallPercentiles().p50()) << ' ' << us(ms.wallPercentiles().p99()) << ' ' << us(ms.wallPercentiles().p999())
         << std::endl;
     }
   }
@@ -30,7 +30,11 @@ int main(int argc, char *argv[])
        "The gateway address")
       ("gateway-type",
        po::value<std::string>()->default_value(std::string("local")),
-       "The gateway type");
+       "The gateway type")
+      ("passthrough-threshold",
+       po::value<size_t>()->default_value(0),
+       "Relay replies of at least that many bytes as they are received (local gateway only, 0 to disable)."
+       " Only replies bigger than 64 KiB are relayed, and none with QI_TCP_BUFFERED_READ=0");
 
   // allow master address to be specified as the first arg
   po::positional_options_description pos;
@@ -53,10 +57,12 @@ int main(int argc, char *argv[])
     std::string gatewayAddress = vm["gateway-address"].as<std::string>();
     std::string masterAddress = vm["master-address"].as<std::string>();
     std::string gatewayType = vm["gateway-type"].as<std::string>();
+    size_t passthroughThreshold = vm["passthrough-threshold"].as<size_t>();
 
     if (gatewayType == "local")
     {
       qi::Gateway gateway;
+      gateway.setPassthroughThreshold(passthroughThreshold);
       if (!gateway.attachToServiceDirectory(masterAddress) ||
           !gateway.listen(gatewayAddress))
       {
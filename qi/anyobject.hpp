@@ -101,11 +101,23 @@ QI_TYPE_STRUCT_AGREGATE_CONSTRUCTOR(qi::MinMaxSum,
   ("maxValue",       maxValue),
   ("cumulatedValue", cumulatedValue));
 
+QI_TYPE_STRUCT_AGREGATE_CONSTRUCTOR(qi::Percentiles,
+  ("p50",  p50),
+  ("p99",  p99),
+  ("p999", p999));
+
+// Percentiles are missing when talking to older versions
+QI_TYPE_STRUCT_EXTENSION_FIELDS(qi::MethodStatistics,
+  "wallPercentiles", "userPercentiles", "systemPercentiles");
+
 QI_TYPE_STRUCT_AGREGATE_CONSTRUCTOR(qi::MethodStatistics,
-  ("count",  count),
-  ("wall",   wall),
-  ("user",   user),
-  ("system", system));
+  ("count",             count),
+  ("wall",              wall),
+  ("user",              user),
+  ("system",            system),
+  ("wallPercentiles",   wallPercentiles),
+  ("userPercentiles",   userPercentiles),
+  ("systemPercentiles", systemPercentiles));
 
 QI_TYPE_STRUCT_AGREGATE_CONSTRUCTOR(qi::EventTrace,
   ("id",            id),
@@ -11,6 +11,7 @@
 # include <qi/types.hpp>
 # include <boost/shared_ptr.hpp>
 # include <vector>
+# include <string>
 # include <cstddef>
 
 #ifdef _MSC_VER
@@ -196,6 +197,7 @@ namespace qi
 
   private:
     friend class BufferReader;
+    friend class BufferPrivate;
     // CS4251
     boost::shared_ptr<BufferPrivate> _p;
   };
@@ -249,6 +251,17 @@ namespace qi
     void  *peek(size_t offset) const;
 
 
+    /**
+     * \brief Read data from buffer without copying it.
+     * \param length Number of bytes to read.
+     * \param result Set to a Buffer sharing the read bytes with this buffer,
+     * or holding a copy of them for small buffers. From then on, modifying
+     * either buffer moves it to new memory and leaves the shared bytes
+     * untouched.
+     * \return false if less than \a length bytes are available.
+     */
+    bool   readSlice(size_t length, Buffer& result);
+
     /**
      * \brief Check if there is sub-buffer at the actual position.
      * \return true if there is sub-buffer, false otherwise.
@@ -272,6 +285,53 @@ namespace qi
     size_t _subCursor; // position in sub-buffers
   };
 
+  /**
+   * \brief Read-only string that can share memory with a Buffer.
+   * \includename{qi/buffer.hpp}
+   *
+   * It has the signature of a string. When used as a method or signal argument,
+   * it is deserialized without copy: it points to the received message data,
+   * which stays valid as long as the StringView or a copy of it exists.
+   */
+  class QI_API StringView
+  {
+  public:
+    /// \brief Empty string.
+    StringView();
+    /// \brief Copy of \a str.
+    StringView(const std::string& str);
+    /// \brief Copy of the \a size bytes at \a data.
+    StringView(const char* data, size_t size);
+    /// \brief Use \a owner data, whose size is the string length, without copy.
+    explicit StringView(const Buffer& owner);
+
+    const char* data() const { return _size ? (const char*)_owner.data() : ""; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    /// \brief Return a copy as a std::string.
+    std::string str() const { return std::string(data(), _size); }
+
+  private:
+    Buffer _owner;
+    size_t _size;
+  };
+
+  QI_API bool operator==(const StringView& a, const StringView& b);
+  QI_API inline bool operator!=(const StringView& a, const StringView& b)
+  { return !(a == b); }
+
+  /// Counters of the pool Buffer and Message storage is allocated from.
+  struct BufferPoolStats
+  {
+    qi::int64_t allocations;     ///< Allocations small enough to be pooled
+    qi::int64_t hits;            ///< Those served by recycling a block
+    qi::int64_t cachedBytes;     ///< Bytes currently kept for reuse
+    qi::int64_t peakCachedBytes; ///< Highest value of cachedBytes
+  };
+
+  /// Counters accumulated since process start.
+  QI_API BufferPoolStats bufferPoolStats();
+
   namespace detail {
     QI_API void printBuffer(std::ostream& stream, const Buffer& buffer);
   }
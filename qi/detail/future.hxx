@@ -85,22 +85,10 @@ namespace qi {
 
       void callCbNotify(qi::Future<T>& future)
       {
-        for(unsigned i = 0; i<_onResult.size(); ++i)
-        {
-          try {
-            if (_async == FutureCallbackType_Async)
-              getEventLoop()->post(boost::bind(_onResult[i], future));
-            else
-              _onResult[i](future);
-          } catch(const qi::PointerLockException&) { // do nothing
-          } catch(const std::exception& e) {
-            qiLogError("qi.future") << "Exception caught in future callback "
-                                    << e.what();
-          } catch (...) {
-            qiLogError("qi.future")
-                << "Unknown exception caught in future callback";
-          }
-        }
+        if (!_onResult.callback.empty())
+          callCb(future, _onResult);
+        for(unsigned i = 0; i<_onResultMore.size(); ++i)
+          callCb(future, _onResultMore[i]);
         notifyFinish();
       }
 
@@ -154,14 +142,21 @@ namespace qi {
       }
 
 
+      /* inlined callbacks are called by the thread finishing the future even
+       * if the promise is asynchronous.
+       */
       void connect(qi::Future<T> future,
           const boost::function<void (qi::Future<T>)> &s,
-          FutureCallbackType type)
+          FutureCallbackType type,
+          bool inlined = false)
       {
         bool ready;
         {
           boost::recursive_mutex::scoped_lock lock(mutex());
-          _onResult.push_back(s);
+          if (_onResult.callback.empty())
+            _onResult = Callback(s, inlined);
+          else
+            _onResultMore.push_back(Callback(s, inlined));
           ready = isFinished();
         }
         //result already ready, notify the callback
@@ -191,8 +186,40 @@ namespace qi {
 
     private:
       friend class Promise<T>;
-      typedef std::vector<boost::function<void (qi::Future<T>)> > Callbacks;
-      Callbacks                _onResult;
+      struct Callback
+      {
+        Callback()
+          : inlined(false)
+        {}
+        Callback(const boost::function<void (qi::Future<T>)>& callback, bool inlined)
+          : callback(callback)
+          , inlined(inlined)
+        {}
+        boost::function<void (qi::Future<T>)> callback;
+        bool                                  inlined;
+      };
+      typedef std::vector<Callback> Callbacks;
+
+      void callCb(qi::Future<T>& future, const Callback& cb)
+      {
+        try {
+          if (_async == FutureCallbackType_Async && !cb.inlined)
+            getEventLoop()->post(boost::bind(cb.callback, future));
+          else
+            cb.callback(future);
+        } catch(const qi::PointerLockException&) { // do nothing
+        } catch(const std::exception& e) {
+          qiLogError("qi.future") << "Exception caught in future callback "
+                                  << e.what();
+        } catch (...) {
+          qiLogError("qi.future")
+              << "Unknown exception caught in future callback";
+        }
+      }
+
+      // Most futures have a single callback: keep it out of the vector
+      Callback                 _onResult;
+      Callbacks                _onResultMore;
       ValueType                _value;
       boost::function<void (Promise<T>)> _onCancel;
       FutureCallbackType       _async;
@@ -291,6 +318,121 @@ namespace qi {
       if (boost::shared_ptr<FutureBaseTyped<FT> > f = wf.lock())
         Future<FT>(f).cancel();
     }
+
+    template<typename FT, typename PT>
+    void forwardCancel(const Future<FT>& f, Promise<PT>& p)
+    {
+      if (f.isCancelable())
+        p.setup(boost::bind(&detail::futureCancelAdapter<FT>,
+              boost::weak_ptr<detail::FutureBaseTyped<FT> >(f._p)));
+    }
+
+    // Promise of a continuation, canceling it cancels f
+    template<typename R, typename T>
+    Promise<R> continuationPromise(Future<T> f, FutureCallbackType type)
+    {
+      if (!f.isCancelable())
+        return Promise<R>(type);
+      return Promise<R>(boost::bind(&detail::futureCancelAdapter<T>,
+            boost::weak_ptr<detail::FutureBaseTyped<T> >(f.impl())), type);
+    }
+
+    // Store the result of a continuation in place, trigger() is left to the caller
+    template<typename R>
+    struct ContinuationResult
+    {
+      template<typename F, typename A>
+      static void call(Promise<R>& p, const F& fun, const A& arg)
+      {
+        p.value() = fun(arg);
+      }
+    };
+
+    template<>
+    struct ContinuationResult<void>
+    {
+      template<typename F, typename A>
+      static void call(Promise<void>& p, const F& fun, const A& arg)
+      {
+        fun(arg);
+      }
+    };
+
+    template<typename R, typename F, typename A>
+    void continuationCall(Promise<R>& p, const F& fun, const A& arg)
+    {
+      try {
+        ContinuationResult<R>::call(p, fun, arg);
+      }
+      catch (const std::exception& e)
+      {
+        p.setError(e.what());
+        return;
+      }
+      catch (...)
+      {
+        p.setError("Unknown exception caught in future continuation");
+        return;
+      }
+      p.trigger();
+    }
+
+    template<typename T, typename R>
+    void futureThen(Future<T> f, Promise<R> p,
+                    const boost::function<R (Future<T>)>& fun)
+    {
+      continuationCall(p, fun, f);
+    }
+
+    template<typename T, typename R>
+    void futureAndThen(Future<T> f, Promise<R> p,
+        const boost::function<R (const typename FutureType<T>::type&)>& fun)
+    {
+      if (f.hasError())
+        p.setError(f.error());
+      else if (f.isCanceled())
+        p.setCanceled();
+      else
+        continuationCall(p, fun, f.value());
+    }
+
+    template<typename T>
+    void futureUnwrap(Future<Future<T> > f, Promise<T> p)
+    {
+      if (f.hasError())
+        p.setError(f.error());
+      else if (f.isCanceled())
+        p.setCanceled();
+      else
+      {
+        Future<T> inner = f.value();
+        inner.impl()->connect(inner,
+            boost::bind(&detail::futureAdapter<T, T, FutureValueConverter<T, T> >,
+                        _1, p, FutureValueConverter<T, T>()),
+            FutureCallbackType_Sync, true);
+      }
+    }
+
+    // Cancel the outer future while it runs, then the inner one
+    template<typename T>
+    void futureUnwrapCancel(boost::weak_ptr<FutureBaseTyped<Future<T> > > wf)
+    {
+      boost::shared_ptr<FutureBaseTyped<Future<T> > > fp = wf.lock();
+      if (!fp)
+        return;
+      Future<Future<T> > f(fp);
+      if (f.isRunning())
+      {
+        if (f.isCancelable())
+          f.cancel();
+        return;
+      }
+      if (!f.hasValue(FutureTimeout_None))
+        return;
+      Future<T> inner = f.value();
+      if (inner.isCancelable())
+        inner.cancel();
+    }
   }
 
   template <>
@@ -320,9 +462,7 @@ namespace qi {
   template<typename FT, typename PT>
   void adaptFuture(const Future<FT>& f, Promise<PT>& p)
   {
-    if (f.isCancelable())
-      p.setup(boost::bind(&detail::futureCancelAdapter<FT>,
-            boost::weak_ptr<detail::FutureBaseTyped<FT> >(f._p)));
+    detail::forwardCancel(f, p);
     const_cast<Future<FT>&>(f).connect(boost::bind(detail::futureAdapter<FT, PT, FutureValueConverter<FT, PT> >, _1, p,
       FutureValueConverter<FT, PT>()));
   }
@@ -330,11 +470,75 @@ namespace qi {
   template<typename FT, typename PT, typename CONV>
   void adaptFuture(const Future<FT>& f, Promise<PT>& p, CONV converter)
   {
-    if (f.isCancelable())
-      p.setup(boost::bind(&detail::futureCancelAdapter<FT>,
-            boost::weak_ptr<detail::FutureBaseTyped<FT> >(f._p)));
+    detail::forwardCancel(f, p);
     const_cast<Future<FT>&>(f).connect(boost::bind(detail::futureAdapter<FT, PT, CONV>, _1, p, converter));
   }
+
+  template<typename T>
+  template<typename R>
+  Future<R> Future<T>::then(const boost::function<R (Future<T>)>& fun,
+                            FutureCallbackType type)
+  {
+    Promise<R> promise = detail::continuationPromise<R>(*this, type);
+    _p->connect(*this, boost::bind(&detail::futureThen<T, R>, _1, promise, fun),
+                type, type == FutureCallbackType_Sync);
+    return promise.future();
+  }
+
+  template<typename T>
+  template<typename R>
+  Future<R> Future<T>::andThen(const boost::function<R (const ValueType&)>& fun,
+                               FutureCallbackType type)
+  {
+    Promise<R> promise = detail::continuationPromise<R>(*this, type);
+    _p->connect(*this, boost::bind(&detail::futureAndThen<T, R>, _1, promise, fun),
+                type, type == FutureCallbackType_Sync);
+    return promise.future();
+  }
+
+  template<typename T>
+  Future<T> unwrapFuture(const Future<Future<T> >& f, FutureCallbackType type)
+  {
+    Future<Future<T> > outer = f;
+    Promise<T> promise(boost::bind(&detail::futureUnwrapCancel<T>,
+          boost::weak_ptr<detail::FutureBaseTyped<Future<T> > >(outer.impl())),
+        type);
+    outer.impl()->connect(outer, boost::bind(&detail::futureUnwrap<T>, _1, promise),
+                          FutureCallbackType_Sync, true);
+    return promise.future();
+  }
+
+  namespace detail
+  {
+    // First of the future and its timer to finish sets the promise
+    template<typename T> void timedFutureFinished(qi::Future<T> f, qi::Promise<T> p,
+        boost::shared_ptr<qi::Atomic<int> > done, qi::Future<void> timer)
+    {
+      if (!done->setIfEquals(0, 1))
+        return;
+      timer.cancel();
+      futureAdapter(f, p, FutureValueConverter<T, T>());
+    }
+    template<typename T> void timedFutureExpired(qi::Future<T> f, qi::Promise<T> p,
+        boost::shared_ptr<qi::Atomic<int> > done)
+    {
+      if (!done->setIfEquals(0, 1))
+        return;
+      p.setError("Call timed out.");
+      if (f.isCancelable())
+        f.cancel();
+    }
+  }
+
+  template<typename T> Future<T> cancelOnTimeout(Future<T> f, qi::Duration timeout)
+  {
+    qi::Promise<T> promise = detail::continuationPromise<T>(f, FutureCallbackType_Async);
+    boost::shared_ptr<qi::Atomic<int> > done(new qi::Atomic<int>());
+    qi::Future<void> timer = getEventLoop()->async(boost::function<void()>(
+          boost::bind(&detail::timedFutureExpired<T>, f, promise, done)), timeout);
+    f.connect(boost::bind(&detail::timedFutureFinished<T>, _1, promise, done, timer));
+    return promise.future();
+  }
 }
 
 #endif  // _QI_DETAILS_FUTURE_HXX_
@@ -88,6 +88,43 @@
   while (false)
 #endif
 
+/* qiLog*F: capture the format and arguments, format them where the
+ * message is dispatched (the log thread in asynchronous mode).
+ */
+#  define _QI_LOG_DEFER_ELEM(_, a, elem) % (elem)
+
+#  define _QI_LOG_MESSAGE_DEFERRED(Type, Msg, ...)                    \
+  QI_CAT(_QI_LOG_MESSAGE_DEFERRED_HASARG_, _QI_LOG_ISEMPTY(__VA_ARGS__))(Type, Msg, __VA_ARGS__)
+
+// No argument: the message is not a format
+#define _QI_LOG_MESSAGE_DEFERRED_HASARG_1(Type, Msg, ...) _QI_LOG_MESSAGE(Type, Msg)
+
+#if defined(NO_QI_LOG_DETAILED_CONTEXT) || defined(NDEBUG)
+#  define _QI_LOG_MESSAGE_DEFERRED_HASARG_0(Type, Msg, ...)                \
+  do                                                                      \
+  {                                                                       \
+    if (::qi::log::detail::isVisible(_QI_LOG_CATEGORY_GET(), ::qi::Type)) \
+      ::qi::log::detail::DeferredLog(::qi::Type,                          \
+                                     _QI_LOG_CATEGORY_GET(),              \
+                                     Msg,                                 \
+                                     "", __FUNCTION__, 0)                 \
+        QI_VAARGS_APPLY(_QI_LOG_DEFER_ELEM, _, __VA_ARGS__ /**/);         \
+  }                                                                       \
+  while (false)
+#else
+#  define _QI_LOG_MESSAGE_DEFERRED_HASARG_0(Type, Msg, ...)                \
+  do                                                                      \
+  {                                                                       \
+    if (::qi::log::detail::isVisible(_QI_LOG_CATEGORY_GET(), ::qi::Type)) \
+      ::qi::log::detail::DeferredLog(::qi::Type,                          \
+                                     _QI_LOG_CATEGORY_GET(),              \
+                                     Msg,                                 \
+                                     __FILE__, __FUNCTION__, __LINE__)    \
+        QI_VAARGS_APPLY(_QI_LOG_DEFER_ELEM, _, __VA_ARGS__ /**/);         \
+  }                                                                       \
+  while (false)
+#endif
+
 /* Tricky, we do not want to hit category_get if a category is specified
 * Usual glitch of off-by-one list size: put argument 'TypeCased' in the vaargs
 * Basically we want variadic macro, but it does not exist, so emulate it using _QI_LOG_EMPTY.
@@ -205,9 +242,260 @@ namespace qi {
       {
         return category && level <= category->maxLevel;
       }
+
+      // Type of each argument captured by DeferredLog and LogStream
+      enum LogArgTag
+      {
+        LogArgTag_Bool,
+        LogArgTag_Char,
+        LogArgTag_SignedChar,
+        LogArgTag_UnsignedChar,
+        LogArgTag_Short,
+        LogArgTag_UnsignedShort,
+        LogArgTag_Int,
+        LogArgTag_UnsignedInt,
+        LogArgTag_Long,
+        LogArgTag_UnsignedLong,
+        LogArgTag_LongLong,
+        LogArgTag_UnsignedLongLong,
+        LogArgTag_Float,
+        LogArgTag_Double,
+        LogArgTag_LongDouble,
+        LogArgTag_String,
+        LogArgTag_Text,  // stream only: already formatted text
+        LogArgTag_State  // stream only: LogStreamState of the next values
+      };
+
+      // Format size marking arguments captured by LogStream
+      static const qi::uint32_t LogStreamFormat = 0xFFFFFFFF;
+
+      // Formatting state of a LogStream, replayed before the values it applies to
+      struct LogStreamState
+      {
+        std::ios_base::fmtflags flags;
+        std::streamsize         precision;
+        std::streamsize         width;
+        char                    fill;
+      };
+
+      /* Arguments of a log call, copied once as raw bytes:
+       * [format size][format] then [tag][value] per argument, strings being
+       * [tag][size][bytes]. LogStream uses LogStreamFormat as format size and
+       * has no format.
+       */
+      class LogArgs
+      {
+      public:
+        LogArgs()
+          : _size(0)
+        {
+        }
+
+        void append(const void* bytes, size_t size)
+        {
+          if (_heap.empty() && _size + size <= sizeof(_inline))
+          {
+            memcpy(_inline + _size, bytes, size);
+          }
+          else
+          {
+            if (_heap.empty())
+              _heap.assign(_inline, _inline + _size);
+            const char* b = static_cast<const char*>(bytes);
+            _heap.insert(_heap.end(), b, b + size);
+          }
+          _size += size;
+        }
+
+        void appendTag(LogArgTag tag)
+        {
+          unsigned char t = static_cast<unsigned char>(tag);
+          append(&t, 1);
+        }
+
+        void appendString(const char* str, size_t size, LogArgTag tag = LogArgTag_String)
+        {
+          appendTag(tag);
+          qi::uint32_t s = static_cast<qi::uint32_t>(size);
+          append(&s, sizeof(s));
+          append(str, size);
+        }
+
+        void appendFormat(const char* format, size_t size)
+        {
+          qi::uint32_t s = static_cast<qi::uint32_t>(size);
+          append(&s, sizeof(s));
+          append(format, size);
+        }
+
+        const char* data() const
+        {
+          return _heap.empty() ? _inline : &_heap[0];
+        }
+
+        size_t size() const
+        {
+          return _size;
+        }
+
+      private:
+        size_t            _size;
+        char              _inline[256];
+        std::vector<char> _heap;
+
+        LogArgs(const LogArgs&);
+        LogArgs& operator=(const LogArgs&);
+      };
+
+      // Captures the arguments of a qiLog*F call
+      class DeferredLog
+      {
+      public:
+        DeferredLog(qi::LogLevel level,
+                    CategoryType category,
+                    const char*  format,
+                    const char*  file,
+                    const char*  function,
+                    int          line)
+          : _level(level)
+          , _category(category)
+          , _file(file)
+          , _function(function)
+          , _line(line)
+        {
+          _args.appendFormat(format, strlen(format));
+        }
+
+        DeferredLog(qi::LogLevel       level,
+                    CategoryType       category,
+                    const std::string& format,
+                    const char*        file,
+                    const char*        function,
+                    int                line)
+          : _level(level)
+          , _category(category)
+          , _file(file)
+          , _function(function)
+          , _line(line)
+        {
+          _args.appendFormat(format.data(), format.size());
+        }
+
+        ~DeferredLog()
+        {
+          qi::log::logDeferred(_level, _category, _args.data(), _args.size(), _file, _function, _line);
+        }
+
+        template <typename T>
+        DeferredLog& operator%(const T& value);
+
+      private:
+        qi::LogLevel      _level;
+        CategoryType      _category;
+        const char*       _file;
+        const char*       _function;
+        int               _line;
+        LogArgs           _args;
+
+        DeferredLog(const DeferredLog&);
+        DeferredLog& operator=(const DeferredLog&);
+      };
+
+      // Types without a tag go through operator<< when they are captured
+      template <typename T>
+      struct LogArg
+      {
+        typedef boost::false_type Tagged;
+
+        static void write(LogArgs& log, const T& value)
+        {
+          std::ostringstream ss;
+          ss << value;
+          const std::string& str = ss.str();
+          log.appendString(str.data(), str.size());
+        }
+      };
+
+#define _QI_LOG_ARG(Type, Tag)                              \
+      template <>                                           \
+      struct LogArg<Type>                                   \
+      {                                                     \
+        typedef boost::true_type Tagged;                    \
+                                                            \
+        static void write(LogArgs& log, const Type& value)  \
+        {                                                   \
+          log.appendTag(Tag);                               \
+          log.append(&value, sizeof(Type));                 \
+        }                                                   \
+      }
+
+      _QI_LOG_ARG(bool,               LogArgTag_Bool);
+      _QI_LOG_ARG(char,               LogArgTag_Char);
+      _QI_LOG_ARG(signed char,        LogArgTag_SignedChar);
+      _QI_LOG_ARG(unsigned char,      LogArgTag_UnsignedChar);
+      _QI_LOG_ARG(short,              LogArgTag_Short);
+      _QI_LOG_ARG(unsigned short,     LogArgTag_UnsignedShort);
+      _QI_LOG_ARG(int,                LogArgTag_Int);
+      _QI_LOG_ARG(unsigned int,       LogArgTag_UnsignedInt);
+      _QI_LOG_ARG(long,               LogArgTag_Long);
+      _QI_LOG_ARG(unsigned long,      LogArgTag_UnsignedLong);
+      _QI_LOG_ARG(long long,          LogArgTag_LongLong);
+      _QI_LOG_ARG(unsigned long long, LogArgTag_UnsignedLongLong);
+      _QI_LOG_ARG(float,              LogArgTag_Float);
+      _QI_LOG_ARG(double,             LogArgTag_Double);
+      _QI_LOG_ARG(long double,        LogArgTag_LongDouble);
+
+#undef _QI_LOG_ARG
+
+      template <>
+      struct LogArg<std::string>
+      {
+        typedef boost::true_type Tagged;
+
+        static void write(LogArgs& log, const std::string& value)
+        {
+          log.appendString(value.data(), value.size());
+        }
+      };
+
+      template <>
+      struct LogArg<const char*>
+      {
+        typedef boost::true_type Tagged;
+
+        static void write(LogArgs& log, const char* value)
+        {
+          if (!value)
+            value = "(null)";
+          log.appendString(value, strlen(value));
+        }
+      };
+
+      template <>
+      struct LogArg<char*>: public LogArg<const char*>
+      {
+      };
+
+      template <size_t N>
+      struct LogArg<char[N]>: public LogArg<const char*>
+      {
+      };
+
+      template <typename T>
+      inline DeferredLog& DeferredLog::operator%(const T& value)
+      {
+        LogArg<T>::write(_args, value);
+        return *this;
+      }
     }
 
     typedef detail::Category* CategoryType;
+
+    /* Values with a tag are captured with the stream state they are written
+     * with, and formatted where the message is dispatched (the log thread in
+     * asynchronous mode). Other values and manipulators are applied to the
+     * stream right away.
+     */
     class LogStream: public std::stringstream
     {
     public:
@@ -223,6 +511,7 @@ namespace qi {
         , _function(function)
         , _line(line)
       {
+        init();
       }
       LogStream(const qi::LogLevel level,
                 const char         *file,
@@ -236,6 +525,7 @@ namespace qi {
         , _function(function)
         , _line(line)
       {
+        init();
       }
       LogStream(const qi::LogLevel  level,
                 const char         *file,
@@ -250,28 +540,98 @@ namespace qi {
         , _function(function)
         , _line(line)
       {
+        init();
         *this << message;
       }
 
       ~LogStream()
       {
+        flushText();
         if (_category)
-          qi::log::log(_logLevel, _category, this->str().c_str(), _file, _function, _line);
+          qi::log::logDeferred(_logLevel, _category, _args.data(), _args.size(), _file, _function, _line);
         else
-          qi::log::log(_logLevel, _categoryType, this->str(), _file, _function, _line);
+          qi::log::logDeferred(_logLevel, _categoryType, _args.data(), _args.size(), _file, _function, _line);
       }
 
       LogStream& self() {
         return *this;
       }
 
+      template <typename T>
+      LogStream& operator<<(const T& value)
+      {
+        capture(value, typename detail::LogArg<T>::Tagged());
+        return *this;
+      }
+
+      LogStream& operator<<(std::ostream& (*manip)(std::ostream&))
+      {
+        manip(*this);
+        flushText();
+        return *this;
+      }
+
+      LogStream& operator<<(std::ios_base& (*manip)(std::ios_base&))
+      {
+        manip(*this);
+        return *this;
+      }
+
     private:
-      qi::LogLevel  _logLevel;
-      const char   *_category;
-      CategoryType  _categoryType;
-      const char   *_file;
-      const char   *_function;
-      int           _line;
+      void init()
+      {
+        qi::uint32_t format = detail::LogStreamFormat;
+        _args.append(&format, sizeof(format));
+        _state.flags = flags();
+        _state.precision = precision();
+        _state.width = width();
+        _state.fill = fill();
+      }
+
+      template <typename T>
+      void capture(const T& value, boost::true_type)
+      {
+        flushText();
+        if (flags() != _state.flags || precision() != _state.precision
+            || width() != _state.width || fill() != _state.fill)
+        {
+          _state.flags = flags();
+          _state.precision = precision();
+          _state.width = width();
+          _state.fill = fill();
+          _args.appendTag(detail::LogArgTag_State);
+          _args.append(&_state, sizeof(_state));
+        }
+        detail::LogArg<T>::write(_args, value);
+        // like any formatted output
+        width(0);
+      }
+
+      template <typename T>
+      void capture(const T& value, boost::false_type)
+      {
+        static_cast<std::ostream&>(*this) << value;
+        flushText();
+      }
+
+      // Move what was written to the stream itself to the captured values
+      void flushText()
+      {
+        if (tellp() <= 0)
+          return;
+        const std::string& text = str();
+        _args.appendString(text.data(), text.size(), detail::LogArgTag_Text);
+        str(std::string());
+      }
+
+      qi::LogLevel     _logLevel;
+      const char      *_category;
+      CategoryType     _categoryType;
+      const char      *_file;
+      const char      *_function;
+      int              _line;
+      detail::LogArgs  _args;
+      detail::LogStreamState _state;
 
       //avoid copy
       LogStream(const LogStream &rhs);
@@ -48,6 +48,16 @@ namespace qi
      */
     EventLoop(const std::string& name = "eventloop");
 
+    /// Implementation used to run tasks.
+    enum Backend
+    {
+      /// Run everything from a single boost::asio::io_service.
+      Backend_Asio = 0,
+      /// Run tasks from per-worker queues with work stealing, use
+      /// boost::asio::io_service only for I/O and timers.
+      Backend_WorkStealing = 1,
+    };
+
     /// \brief Default destructor.
     ~EventLoop();
     /**
@@ -58,8 +68,17 @@ namespace qi
     /**
      * \brief Start the eventloop in threaded mode.
      * \param nthreads Numbers of threads.
+     *
+     * The backend is read from QI_EVENTLOOP_BACKEND ("asio" or
+     * "workstealing"), and defaults to Backend_Asio.
      */
     void start(int nthreads = 0);
+    /**
+     * \brief Start the eventloop in threaded mode with given backend.
+     * \param nthreads Numbers of threads.
+     * \param backend Implementation to use.
+     */
+    void start(int nthreads, Backend backend);
 
     /// \brief Wait for run thread to terminate.
     void join();
@@ -73,6 +92,9 @@ namespace qi
 
     /**
      * \brief Set the maximum number of threads in the pool.
+     *
+     * Can be changed while running. The work stealing backend never runs
+     * more than 1024 workers, or the number it was started with if greater.
      * \param max Maximum number of threads.
      */
     void setMaxThreads(unsigned int max);
@@ -141,6 +163,15 @@ namespace qi
     return qi::getEventLoop()->async(callback, timepoint);
   }
 
+  /**
+   * \brief Give up waiting for \p f after \p timeout.
+   * \return A future finishing like \p f, or with a "Call timed out." error
+   *         if \p f did not finish within \p timeout. \p f is then canceled,
+   *         which for a remote call asks the service to drop it.
+   */
+  template<typename T>
+  Future<T> cancelOnTimeout(Future<T> f, qi::Duration timeout);
+
   /**
    * \brief Start the eventloop with nthread threads. No-op if already started.
    * \param nthread Set the minimum number of worker threads in the pool.
@@ -57,6 +57,9 @@ namespace qi {
     template<typename FT>
     void futureCancelAdapter(
                              boost::weak_ptr<detail::FutureBaseTyped<FT> > wf);
+    // Make canceling p's future cancel f, if f is cancelable.
+    template<typename FT, typename PT>
+    void forwardCancel(const Future<FT>& f, Promise<PT>& p);
   }
 
   /** State of the future.
@@ -334,6 +337,30 @@ namespace qi {
       connect(boost::bind(s));
     }
 
+    /** Call fun with this future once it finishes, and return a future set
+     * with its result, or with an error if fun throws.
+     *
+     * If type is sync, fun is called by the thread finishing this future,
+     * even if the promise is asynchronous, and the returned future calls its
+     * own callbacks synchronously: a chain of sync continuations runs without
+     * any thread switch. Such a callback must not block.
+     *
+     * Canceling the returned future cancels this one.
+     * \code
+     * qi::Future<int> length = name.then<int>(&computeLength, qi::FutureCallbackType_Sync);
+     * \endcode
+     */
+    template<typename R>
+    Future<R> then(const boost::function<R (Future<T>)>& fun,
+                   FutureCallbackType type = FutureCallbackType_Async);
+
+    /** Same as then() but fun is only called with the value if this future
+     * has one. Errors and cancelation are forwarded to the returned future.
+     */
+    template<typename R>
+    Future<R> andThen(const boost::function<R (const ValueType&)>& fun,
+                      FutureCallbackType type = FutureCallbackType_Async);
+
     boost::shared_ptr<detail::FutureBaseTyped<T> > impl() { return _p;}
     Future(boost::shared_ptr<detail::FutureBaseTyped<T> > p) :
       _p(p)
@@ -355,6 +382,8 @@ namespace qi {
     template<typename FT>
     friend void detail::futureCancelAdapter(
         boost::weak_ptr<detail::FutureBaseTyped<FT> > wf);
+    template<typename FT, typename PT>
+    friend void detail::forwardCancel(const Future<FT>& f, Promise<PT>& p);
   };
 
   /** This class allow throwing on error and being synchronous
@@ -446,6 +475,22 @@ namespace qi {
     void connect(const Connection& s)                                  { _sync = false; _future.connect(s);}
     void _connect(const boost::function<void()>& s)                    { _sync = false; _future._connect(s);}
 
+    template<typename R>
+    Future<R> then(const boost::function<R (Future<T>)>& fun,
+                   FutureCallbackType type = FutureCallbackType_Async)
+    {
+      _sync = false;
+      return _future.template then<R>(fun, type);
+    }
+
+    template<typename R>
+    Future<R> andThen(const boost::function<R (const ValueType&)>& fun,
+                      FutureCallbackType type = FutureCallbackType_Async)
+    {
+      _sync = false;
+      return _future.template andThen<R>(fun, type);
+    }
+
 #ifdef DOXYGEN
     /** Connect a callback with binding and tracking support.
      *
@@ -573,6 +618,8 @@ namespace qi {
     template<typename FT, typename PT, typename CONV>
     friend void adaptFuture(const Future<FT>& f, Promise<PT>& p,
                             CONV converter);
+    template<typename FT, typename PT>
+    friend void detail::forwardCancel(const Future<FT>& f, Promise<PT>& p);
   };
 
   /**
@@ -815,6 +862,18 @@ namespace qi {
   /// Similar to adaptFuture(f, p) but with a custom converter
   template<typename FT, typename PT, typename CONV>
   void adaptFuture(const Future<FT>& f, Promise<PT>& p, CONV converter);
+
+  /**
+   * \brief Flatten a future of future.
+   *
+   * The returned future is set with the state of the inner future once it
+   * finishes, or with the error or cancelation of \p f. Canceling it cancels
+   * \p f, or the inner future if \p f has already finished.
+   * \param type how callbacks of the returned future are called.
+   */
+  template<typename T>
+  Future<T> unwrapFuture(const Future<Future<T> >& f,
+                         FutureCallbackType type = FutureCallbackType_Async);
 }
 
 #ifdef _MSC_VER
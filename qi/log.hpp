@@ -20,8 +20,11 @@
 # include <sstream>
 # include <cstdarg>
 # include <cstdio>
+# include <cstring>
+# include <vector>
 
 # include <boost/format.hpp>
+# include <boost/type_traits/integral_constant.hpp>
 # include <boost/function/function_fwd.hpp>
 
 # include <qi/os.hpp>
@@ -67,7 +70,7 @@
 # define qiLogDebugF(Msg, ...)
 #else
 # define qiLogDebug(...)   _QI_LOG_MESSAGE_STREAM(LogLevel_Debug,   Debug ,  __VA_ARGS__)
-# define qiLogDebugF(Msg, ...)   _QI_LOG_MESSAGE(LogLevel_Debug,   _QI_LOG_FORMAT(Msg, __VA_ARGS__))
+# define qiLogDebugF(Msg, ...)   _QI_LOG_MESSAGE_DEFERRED(LogLevel_Debug, Msg, __VA_ARGS__)
 #endif
 
 /**
@@ -78,7 +81,7 @@
 # define qiLogVerboseF(Msg, ...)
 #else
 # define qiLogVerbose(...) _QI_LOG_MESSAGE_STREAM(LogLevel_Verbose, Verbose, __VA_ARGS__)
-# define qiLogVerboseF(Msg, ...)   _QI_LOG_MESSAGE(LogLevel_Verbose,   _QI_LOG_FORMAT(Msg, __VA_ARGS__))
+# define qiLogVerboseF(Msg, ...)   _QI_LOG_MESSAGE_DEFERRED(LogLevel_Verbose, Msg, __VA_ARGS__)
 #endif
 
 /**
@@ -89,7 +92,7 @@
 # define qiLogInfoF(Msg, ...)
 #else
 # define qiLogInfo(...)    _QI_LOG_MESSAGE_STREAM(LogLevel_Info,    Info,    __VA_ARGS__)
-# define qiLogInfoF(Msg, ...)   _QI_LOG_MESSAGE(LogLevel_Info,   _QI_LOG_FORMAT(Msg, __VA_ARGS__))
+# define qiLogInfoF(Msg, ...)   _QI_LOG_MESSAGE_DEFERRED(LogLevel_Info, Msg, __VA_ARGS__)
 #endif
 
 /**
@@ -100,7 +103,7 @@
 # define qiLogWarningF(Msg, ...)
 #else
 # define qiLogWarning(...) _QI_LOG_MESSAGE_STREAM(LogLevel_Warning, Warning, __VA_ARGS__)
-# define qiLogWarningF(Msg, ...)   _QI_LOG_MESSAGE(LogLevel_Warning,   _QI_LOG_FORMAT(Msg, __VA_ARGS__))
+# define qiLogWarningF(Msg, ...)   _QI_LOG_MESSAGE_DEFERRED(LogLevel_Warning, Msg, __VA_ARGS__)
 #endif
 
 /**
@@ -111,7 +114,7 @@
 # define qiLogErrorF(Msg, ...)
 #else
 # define qiLogError(...)   _QI_LOG_MESSAGE_STREAM(LogLevel_Error,   Error,   __VA_ARGS__)
-# define qiLogErrorF(Msg, ...)   _QI_LOG_MESSAGE(LogLevel_Error,   _QI_LOG_FORMAT(Msg, __VA_ARGS__))
+# define qiLogErrorF(Msg, ...)   _QI_LOG_MESSAGE_DEFERRED(LogLevel_Error, Msg, __VA_ARGS__)
 #endif
 
 /**
@@ -122,7 +125,7 @@
 # define qiLogFatalF(Msg, ...)
 #else
 # define qiLogFatal(...)   _QI_LOG_MESSAGE_STREAM(LogLevel_Fatal,   Fatal,   __VA_ARGS__)
-# define qiLogFatalF(Msg, ...)   _QI_LOG_MESSAGE(LogLevel_Fatal,   _QI_LOG_FORMAT(Msg, __VA_ARGS__))
+# define qiLogFatalF(Msg, ...)   _QI_LOG_MESSAGE_DEFERRED(LogLevel_Fatal, Msg, __VA_ARGS__)
 #endif
 
 
@@ -149,6 +152,14 @@ namespace qi {
     LogColor_Always ///< Always show color
   };
 
+  /**
+   * \brief Behavior of asynchronous logs when a thread buffer is full.
+   */
+  enum LogOverflowPolicy {
+    LogOverflowPolicy_Block, ///< Wait for the log thread to make room
+    LogOverflowPolicy_Drop   ///< Discard the message and count it
+  };
+
   /**
    * \brief Logs context attribute.
    */
@@ -274,6 +285,41 @@ namespace qi {
                     const char*        fct = "",
                     const int          line = 0);
 
+    /**
+     * \brief Log a message whose formatting was deferred. You should call
+     *        qiLog*F macros instead.
+     *
+     * \param verb The verbosity of the message.
+     * \param category Log category.
+     * \param args Format and arguments as captured by detail::DeferredLog
+     *        or LogStream.
+     * \param argsSize Size of args in bytes.
+     * \param file Filename from which this function was called.
+     * \param fct Function name from which this function was called.
+     * \param line Line from which this function was called.
+     *
+     * In asynchronous mode the captured arguments are queued as is and
+     * formatted by the log thread.
+     */
+    QI_API void logDeferred(const qi::LogLevel verb,
+                            CategoryType       category,
+                            const char        *args,
+                            size_t             argsSize,
+                            const char        *file,
+                            const char        *fct,
+                            const int          line);
+
+    /**
+     * \copydoc logDeferred
+     */
+    QI_API void logDeferred(const qi::LogLevel verb,
+                            const char        *category,
+                            const char        *args,
+                            size_t             argsSize,
+                            const char        *file,
+                            const char        *fct,
+                            const int          line);
+
 
     /**
      * \brief Convert log verbosity to a readable string.
@@ -445,6 +491,28 @@ namespace qi {
      */
     QI_API void setSynchronousLog(bool sync);
 
+    /**
+     * \brief Set what asynchronous logging does when a thread outpaces the
+     *        log thread.
+     * \param policy Block the logging thread or drop the message.
+     *
+     * Each thread owns a buffer that only the log thread reads, so logging
+     * never contends with other threads unless its buffer is full.
+     */
+    QI_API void setAsyncLogOverflowPolicy(LogOverflowPolicy policy);
+
+    /**
+     * \brief Get the asynchronous log overflow policy.
+     * \return The current policy, LogOverflowPolicy_Block by default.
+     */
+    QI_API LogOverflowPolicy asyncLogOverflowPolicy();
+
+    /**
+     * \brief Get the number of asynchronous messages dropped so far.
+     * \return Total count of messages discarded by LogOverflowPolicy_Drop.
+     */
+    QI_API qi::uint64_t droppedLogs();
+
     /**
      * \brief Add a log handler.
      * \param name Name of the handler, useful to remove handler (prefer lowercase).
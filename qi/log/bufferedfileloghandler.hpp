@@ -0,0 +1,113 @@
+#pragma once
+/*
+ * Copyright (c) 2014 Aldebaran Robotics. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the COPYING file.
+ */
+
+#ifndef _QI_LOG_BUFFEREDFILELOGHANDLER_HPP_
+# define _QI_LOG_BUFFEREDFILELOGHANDLER_HPP_
+
+# include <boost/noncopyable.hpp>
+# include <qi/log.hpp>
+# include <string>
+
+namespace qi {
+  namespace log {
+    class PrivateBufferedFileLogHandler;
+
+    /**
+     * \brief Writes logs to a file in batches, with size-based rotation.
+     * \includename{qi/log/bufferedfileloghandler.hpp}
+     *
+     * \verbatim
+     * Log lines are appended to an in-memory buffer. A background thread
+     * writes the buffer with a single write when it is full or when the
+     * flush interval expires, so logging never waits on the disk.
+     *
+     * When *maxFileSize* is set, the file is rotated after the batch that
+     * makes it exceed that size: *filePath* becomes *filePath*.1, the
+     * previous *filePath*.1 becomes *filePath*.2 and so on, keeping at
+     * most *maxBackups* files. Rotated files can be gzip compressed, on
+     * another background thread: writing goes on to the new file meanwhile.
+     * \endverbatim
+     */
+    class QI_API BufferedFileLogHandler : private boost::noncopyable
+    {
+    public:
+      /**
+       * \brief Open the file and start the writer thread.
+       * \param filePath path to the file.
+       * \param maxFileSize size in bytes after which the file is rotated,
+       *        0 to never rotate.
+       * \param maxBackups number of rotated files to keep.
+       *
+       * \verbatim
+       * .. warning::
+       *
+       *      If the file could not be opened, it logs a warning and every log call
+       *      will silently fail.
+       * \endverbatim
+       */
+      explicit BufferedFileLogHandler(const std::string& filePath,
+                                      size_t maxFileSize = 0,
+                                      unsigned int maxBackups = 5);
+
+      /**
+       * \brief Write pending logs, stop the writer thread and close the file.
+       */
+      virtual ~BufferedFileLogHandler();
+
+      /**
+       * \brief Set the size of the in-memory buffer, 256 KiB by default.
+       * \param size buffered bytes that trigger a write.
+       */
+      void setBufferSize(size_t size);
+
+      /**
+       * \brief Set the maximum time logs stay in memory, 1 second by default.
+       * \param msecs interval between writes of a partially filled buffer.
+       */
+      void setFlushInterval(unsigned int msecs);
+
+      /**
+       * \brief Compress rotated files with gzip, to *filePath*.N.gz.
+       * \param compress enable or disable compression.
+       * \return false if compression is not available in this build.
+       */
+      bool setCompression(bool compress);
+
+      /**
+       * \brief Write all buffered logs to the file before returning.
+       */
+      void flush();
+
+      /**
+       * \brief Buffer a log message.
+       * \param verb verbosity of the log message.
+       * \param date date at which the log message was issued.
+       * \param category category of the log message.
+       * \param msg actual message to log.
+       * \param file filename from which this log message was issued.
+       * \param fct function name from which this log message was issued.
+       * \param line line number in the issuer file.
+       *
+       * Only waits if both the buffer being filled and the one being
+       * written are full.
+       */
+      void log(const qi::LogLevel    verb,
+               const qi::os::timeval date,
+               const char            *category,
+               const char            *msg,
+               const char            *file,
+               const char            *fct,
+               const int             line);
+
+    private:
+      PrivateBufferedFileLogHandler* _p;
+    }; // !BufferedFileLogHandler
+
+  }; // !log
+}; // !qi
+
+#endif  // _QI_LOG_BUFFEREDFILELOGHANDLER_HPP_
@@ -23,6 +23,21 @@ namespace qi
     bool listen(const qi::Url &address);
     std::vector<qi::Url> endpoints() const;
 
+    /**
+     * \brief Relay big replies without gathering them in the gateway.
+     * \param bytes payload size from which a reply from a service is written
+     *        to the client as it is read, 0 (the default) to disable.
+     *
+     * Only payloads that do not fit in a 64 KiB read chunk with their header
+     * can be relayed, so smaller values behave like that limit. Nothing is
+     * relayed when buffered reads are disabled (QI_TCP_BUFFERED_READ=0).
+     *
+     * Only the header of relayed replies is rewritten. If the service
+     * disconnects in the middle of a reply, the client is disconnected too.
+     * Must be called before attachToServiceDirectory.
+     */
+    void setPassthroughThreshold(size_t bytes);
+
   private:
     GatewayPrivate *_p;
   };
@@ -0,0 +1,38 @@
+#pragma once
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#ifndef _QIMESSAGING_TRANSPORTSTATS_HPP_
+#define _QIMESSAGING_TRANSPORTSTATS_HPP_
+
+#include <qi/api.hpp>
+#include <qi/types.hpp>
+
+namespace qi
+{
+  /// Process-wide counters of the tcp and unix transports send path.
+  struct TransportWriteStats
+  {
+    qi::int64_t messages; ///< Messages sent
+    qi::int64_t writes;   ///< Gathered writes issued to carry them
+    qi::int64_t bytes;    ///< Bytes sent, headers included
+  };
+
+  /// Process-wide counters of the tcp and unix transports receive path.
+  struct TransportReadStats
+  {
+    qi::int64_t messages; ///< Messages received
+    qi::int64_t reads;    ///< Socket reads completed to get them
+    qi::int64_t bytes;    ///< Bytes received, headers included
+  };
+
+  /// Counters accumulated since process start or last reset.
+  QI_API TransportWriteStats transportWriteStats();
+  QI_API void resetTransportWriteStats();
+  QI_API TransportReadStats transportReadStats();
+  QI_API void resetTransportReadStats();
+}
+
+#endif  // _QIMESSAGING_TRANSPORTSTATS_HPP_
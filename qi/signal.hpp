@@ -232,6 +232,14 @@ namespace qi {
      * - Be asynchronous
      */
     void call(const GenericFunctionParameters& args, MetaCallType callType);
+    /** Perform the call, sharing argument copies between queued calls.
+     *
+     * \p sharedArgs is set to a copy of \p args by the first queued call and
+     * reused by the next ones: pass the same one for all subscribers of a
+     * single trigger. Queued subscribers must not modify their arguments.
+     */
+    void call(const GenericFunctionParameters& args, MetaCallType callType,
+              boost::shared_ptr<GenericFunctionParameters>& sharedArgs);
 
     SignalSubscriber& setCallType(MetaCallType ct);
 
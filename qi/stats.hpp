@@ -73,6 +73,34 @@ namespace qi
     float _cumulatedValue;
   };
 
+  /// Stores the median, 99th and 99.9th percentiles of a distribution
+  class Percentiles
+  {
+  public:
+    /// Default constructor
+    Percentiles() : _p50(0), _p99(0), _p999(0) {}
+    /**
+     * \brief Constructor
+     * \param p50 Median value.
+     * \param p99 Value under which 99% of the values are.
+     * \param p999 Value under which 99.9% of the values are.
+     */
+    Percentiles(float p50, float p99, float p999)
+      : _p50(p50), _p99(p99), _p999(p999)
+    {}
+
+    /// Get the median value
+    const float& p50()  const { return _p50;}
+    /// Get the 99th percentile
+    const float& p99()  const { return _p99;}
+    /// Get the 99.9th percentile
+    const float& p999() const { return _p999;}
+  private:
+    float _p50;
+    float _p99;
+    float _p999;
+  };
+
   /// Store statistics about method calls.
   class MethodStatistics
   {
@@ -90,12 +118,30 @@ namespace qi
     MethodStatistics(unsigned count, MinMaxSum wall, MinMaxSum user, MinMaxSum system)
       : _count(count), _wall(wall), _user(user), _system(system)
     {}
+    /**
+     * \brief Constructor and Set, with percentiles.
+     * \param count Number of value added.
+     * \param wall Wall statistics.
+     * \param user User statistics.
+     * \param system System statistics.
+     * \param wallPercentiles Wall percentiles.
+     * \param userPercentiles User percentiles.
+     * \param systemPercentiles System percentiles.
+     */
+    MethodStatistics(unsigned count, MinMaxSum wall, MinMaxSum user, MinMaxSum system,
+                     Percentiles wallPercentiles, Percentiles userPercentiles,
+                     Percentiles systemPercentiles)
+      : _count(count), _wall(wall), _user(user), _system(system)
+      , _wallPercentiles(wallPercentiles), _userPercentiles(userPercentiles)
+      , _systemPercentiles(systemPercentiles)
+    {}
 
     /**
      * \brief Add value for all tree statistics values.
      *
      *        If it's the fist time that push is call, min, max and cumulated
-     *        will be set to the value added.
+     *        will be set to the value added. Percentiles are not
+     *        computed by push, only by Manageable::stats().
      *
      * \param wall Value to add to wall statistics.
      * \param user Value to add to user statistics.
@@ -123,6 +169,12 @@ namespace qi
      * \return Return MinMaxSum value.
      */
     const MinMaxSum& system() const   { return _system;}
+    /// Get wall time percentiles.
+    const Percentiles& wallPercentiles() const   { return _wallPercentiles;}
+    /// Get user time percentiles.
+    const Percentiles& userPercentiles() const   { return _userPercentiles;}
+    /// Get system time percentiles.
+    const Percentiles& systemPercentiles() const { return _systemPercentiles;}
     /**
      * \brief Get number of value added.
      * \return Return number of value pushed.
@@ -137,12 +189,16 @@ namespace qi
       _wall.reset();
       _user.reset();
       _system.reset();
+      _wallPercentiles = _userPercentiles = _systemPercentiles = Percentiles();
     }
   private:
     unsigned int _count;
     MinMaxSum _wall;
     MinMaxSum _user;
     MinMaxSum _system;
+    Percentiles _wallPercentiles;
+    Percentiles _userPercentiles;
+    Percentiles _systemPercentiles;
   };
 }
 
@@ -93,6 +93,14 @@ public:
    */
   int findMethod(const std::string& name, const GenericFunctionParameters& parameters);
 
+  /** Find method named name callable with arguments of types argTypes.
+   * The result can be reused for all calls with such arguments through
+   * metaCall(unsigned int, ...), without resolving the name again.
+   * @return the method id, or a negative value if none or an ambiguous set
+   * was found.
+   */
+  int resolve(const std::string& name, const std::vector<TypeInterface*>& argTypes);
+
   /** Resolve the method Id and bounces to metaCall
    * @param nameWithOptionalSignature method name or method signature
    * 'name::(args)' if signature is given, an exact match is required
@@ -313,6 +321,10 @@ namespace detail
       promise.setError(metaFut.error());
       return;
     }
+    if (metaFut.isCanceled()) {
+      promise.setCanceled();
+      return;
+    }
 
     AnyReference val =  metaFut.value();
     if (handleFuture(val, promise))
@@ -348,6 +360,10 @@ namespace detail
       promise.setError(metaFut.error());
       return;
     }
+    if (metaFut.isCanceled()) {
+      promise.setCanceled();
+      return;
+    }
     AnyReference val =  metaFut.value();
     if (handleFuture(val, promise))
       return;
@@ -426,6 +442,7 @@ QI_GEN(genCall)
     qi::Promise<R> res;                                                  \
     qi::Future<AnyReference> fmeta = metaCall(methodName, params,        \
         MetaCallType_Queued, typeOf<R>()->signature());                  \
+    detail::forwardCancel(fmeta, res);                                   \
     fmeta.connect(boost::bind<void>(&detail::futureAdapter<R>, _1, res), \
         FutureCallbackType_Sync);                                        \
     return res.future();                                                 \
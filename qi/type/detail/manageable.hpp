@@ -116,8 +116,9 @@ namespace qi {
     bool isStatsEnabled() const;
     /// Set statistics gathering status
     void enableStats(bool enable);
-    /// Push statistics information about \p slotId.
+    /// Push statistics information about \p slotId, times are in seconds. Lock-free once \p slotId is known.
     void pushStats(int slotId, float wallTime, float userTime, float systemTime);
+    ///@return a snapshot of the statistics of each method and signal, with latency percentiles
     ObjectStatistics stats() const;
     /// Reset all statistical data
     void clearStats();
@@ -60,6 +60,10 @@ namespace detail {
     {
       return go()->findMethod(name, parameters);
     }
+    inline int resolve(const std::string& name, const std::vector<TypeInterface*>& argTypes) const
+    {
+      return go()->resolve(name, argTypes);
+    }
     inline qi::Future<AnyReference> metaCall(const std::string &nameWithOptionalSignature, const GenericFunctionParameters& params, MetaCallType callType = MetaCallType_Auto, Signature returnSignature=Signature()) const
     {
       return go()->metaCall(nameWithOptionalSignature, params, callType, returnSignature);
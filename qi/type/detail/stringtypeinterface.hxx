@@ -7,6 +7,7 @@
 #ifndef _QITYPE_DETAILS_TYPESTRING_HXX_
 #define _QITYPE_DETAILS_TYPESTRING_HXX_
 #include <qi/os.hpp>
+#include <qi/buffer.hpp>
 #include <qi/type/detail/structtypeinterface.hxx>
 
 namespace qi
@@ -50,6 +51,31 @@ namespace qi
   class TypeImpl<std::string>: public StringTypeInterfaceImpl
   {};
 
+  class QI_API TypeStringViewImpl: public StringTypeInterface
+  {
+  public:
+    typedef DefaultTypeImplMethods<StringView,
+            TypeByPointerPOD<StringView>
+              > Methods;
+    virtual ManagedRawString get(void* storage)
+    {
+      StringView* ptr = (StringView*)Methods::ptrFromStorage(&storage);
+      return ManagedRawString(RawString((char*)ptr->data(), ptr->size()),
+          Deleter());
+    }
+    virtual void set(void** storage, const char* value, size_t sz)
+    {
+      StringView* ptr = (StringView*)Methods::ptrFromStorage(storage);
+      *ptr = StringView(value, sz);
+    }
+
+    _QI_BOUNCE_TYPE_METHODS(Methods);
+  };
+
+  template<>
+  class TypeImpl<StringView>: public TypeStringViewImpl
+  {};
+
   class QI_API TypeCStringImpl: public StringTypeInterface
   {
   public:
@@ -7,9 +7,11 @@
 #ifndef _QITYPE_DETAILS_TYPETUPLE_HXX_
 #define _QITYPE_DETAILS_TYPETUPLE_HXX_
 
+#include <cstring>
 #include <boost/type_traits.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <qi/type/fwd.hpp>
+#include <qi/buffer.hpp>
 #include <qi/type/detail/accessor.hxx>
 #include <qi/preproc.hpp>
 
@@ -25,6 +27,10 @@ namespace qi
     {
       static bool fillMissingFields(StructTypeInterface* type, std::map<std::string, ::qi::AnyValue>& fields, const std::vector<std::string>& missing) { return false;}
     };
+    template<typename T> struct StructBinaryCodecDelegate
+    {
+      static const bool enabled = false;
+    };
     bool QI_API fillMissingFieldsWithDefaultValues(StructTypeInterface* type,
       std::map<std::string, ::qi::AnyValue>& fields,
       const std::vector<std::string>& missing,
@@ -108,6 +114,164 @@ namespace qi
    QI_TYPE_STRUCT_EXTENSION_DROP_FIELDS(name, __VA_ARGS__); \
    QI_TYPE_STRUCT_EXTENSION_FILL_FIELDS(name, __VA_ARGS__)
 
+/** Generate a direct binary encoder and decoder for struct \p name.
+ * encodeBinary() and decodeBinary() will write and read its fields without
+ * going through the generic per-field type dispatch.
+ * It is used only if all fields are bool, numbers, std::string, std::vector
+ * of those, or structs declared with this extension. Otherwise the generic
+ * path is kept.
+ * Like the other extensions, it must be called before QI_TYPE_STRUCT.
+ */
+#define QI_TYPE_STRUCT_EXTENSION_BINARY_CODEC(name) \
+  namespace qi { namespace detail { template<> struct StructBinaryCodecDelegate<name> { \
+    static const bool enabled = true; \
+  };}}
+
+    /* Binary encoding of a single struct field, producing the same data as
+     * BinaryEncoder: host byte order, uint32 size before strings and lists.
+     * The default handles nested structs.
+     */
+    template<typename T, typename Enable = void> struct BinaryCodec
+    {
+      static bool supported()
+      {
+        return StructBinaryCodecDelegate<T>::enabled
+          && static_cast<StructTypeInterface*>(typeOf<T>())->hasBinaryCodec();
+      }
+      static bool write(Buffer& out, const T& v)
+      {
+        TypeInterface* type = typeOf<T>();
+        return static_cast<StructTypeInterface*>(type)->binaryEncode(
+          type->initializeStorage(const_cast<T*>(&v)), out);
+      }
+      static bool read(BufferReader& in, T& v)
+      {
+        TypeInterface* type = typeOf<T>();
+        return static_cast<StructTypeInterface*>(type)->binaryDecode(
+          type->initializeStorage(&v), in);
+      }
+    };
+
+    template<typename T> struct BinaryCodec<T,
+      typename boost::enable_if_c<boost::is_arithmetic<T>::value && sizeof(T) <= 8>::type>
+    {
+      static bool supported() { return true; }
+      static bool write(Buffer& out, const T& v)
+      {
+        return out.write(&v, sizeof(T));
+      }
+      static bool read(BufferReader& in, T& v)
+      {
+        void* data = in.read(sizeof(T));
+        if (!data)
+          return false;
+        memcpy(&v, data, sizeof(T));
+        return true;
+      }
+    };
+
+    template<> struct BinaryCodec<std::string>
+    {
+      static bool supported() { return true; }
+      static bool write(Buffer& out, const std::string& v)
+      {
+        qi::uint32_t sz = v.size();
+        return out.write(&sz, sizeof(sz)) && (!sz || out.write(v.data(), sz));
+      }
+      static bool read(BufferReader& in, std::string& v)
+      {
+        qi::uint32_t sz;
+        if (!BinaryCodec<qi::uint32_t>::read(in, sz))
+          return false;
+        v.clear();
+        if (!sz)
+          return true;
+        void* data = in.read(sz);
+        if (!data)
+          return false;
+        v.assign((const char*)data, sz);
+        return true;
+      }
+    };
+
+    // Lists of numbers are copied in one go, other lists element by element
+    template<typename T, bool Bulk = boost::is_arithmetic<T>::value
+                                    && !boost::is_same<T, bool>::value>
+    struct VectorBinaryCodec
+    {
+      static bool write(Buffer& out, const std::vector<T>& v)
+      {
+        for (unsigned i = 0; i < v.size(); ++i)
+          if (!BinaryCodec<T>::write(out, v[i]))
+            return false;
+        return true;
+      }
+      static bool read(BufferReader& in, std::vector<T>& v, qi::uint32_t sz)
+      {
+        for (unsigned i = 0; i < sz; ++i)
+        {
+          T t = T();
+          if (!BinaryCodec<T>::read(in, t))
+            return false;
+          v.push_back(t);
+        }
+        return true;
+      }
+    };
+
+    template<typename T> struct VectorBinaryCodec<T, true>
+    {
+      static bool write(Buffer& out, const std::vector<T>& v)
+      {
+        return v.empty() || out.write(&v[0], v.size() * sizeof(T));
+      }
+      static bool read(BufferReader& in, std::vector<T>& v, qi::uint32_t sz)
+      {
+        if (!sz)
+          return true;
+        if (sz > (size_t)-1 / sizeof(T))
+          return false;
+        void* data = in.read(sz * sizeof(T));
+        if (!data)
+          return false;
+        v.resize(sz);
+        memcpy(&v[0], data, sz * sizeof(T));
+        return true;
+      }
+    };
+
+    template<typename T> struct BinaryCodec<std::vector<T> >
+    {
+      static bool supported() { return BinaryCodec<T>::supported(); }
+      static bool write(Buffer& out, const std::vector<T>& v)
+      {
+        qi::uint32_t sz = v.size();
+        return out.write(&sz, sizeof(sz)) && VectorBinaryCodec<T>::write(out, v);
+      }
+      static bool read(BufferReader& in, std::vector<T>& v)
+      {
+        qi::uint32_t sz;
+        if (!BinaryCodec<qi::uint32_t>::read(in, sz))
+          return false;
+        v.clear();
+        return VectorBinaryCodec<T>::read(in, v, sz);
+      }
+    };
+
+    // Deduce the field type for the QI_TYPE_STRUCT macros
+    template<typename C, typename T> bool binaryCodecSupported(T C::*)
+    {
+      return BinaryCodec<T>::supported();
+    }
+    template<typename T> bool binaryCodecWrite(Buffer& out, const T& v)
+    {
+      return BinaryCodec<T>::write(out, v);
+    }
+    template<typename T> bool binaryCodecRead(BufferReader& in, T& v)
+    {
+      return BinaryCodec<T>::read(in, v);
+    }
+
     //keep only the class name. (remove :: and namespaces)
     QI_API std::string normalizeClassName(const std::string &name);
 
@@ -156,6 +320,9 @@ namespace qi {                                                            \
     virtual void set(void** storage, unsigned int index, void* valStorage); \
     virtual bool canDropFields(void* storage, const std::vector<std::string>& fieldNames); \
     virtual bool fillMissingFields(std::map<std::string, ::qi::AnyValue>& fields, const std::vector<std::string>& missing); \
+    virtual bool hasBinaryCodec();                                        \
+    virtual bool binaryEncode(void* storage, ::qi::Buffer& out);          \
+    virtual bool binaryDecode(void* storage, ::qi::BufferReader& in);     \
     extra \
     typedef ::qi::DefaultTypeImplMethods<name, ::qi::TypeByPointerPOD<name> > Impl; \
     _QI_BOUNCE_TYPE_METHODS(Impl);            \
@@ -166,6 +333,9 @@ namespace qi {                                                            \
 #define __QI_TUPLE_GET(_, what, field) if (i == index) return ::qi::typeOf(ptr->field)->initializeStorage(&ptr->field); i++;
 #define __QI_TUPLE_SET(_, what, field) if (i == index) ::qi::detail::setFromStorage(ptr->field, valueStorage); i++;
 #define __QI_TUPLE_FIELD_NAME(_, what, field) res.push_back(BOOST_PP_STRINGIZE(QI_DELAY(field)));
+#define __QI_TUPLE_HAS_CODEC(_, what, field) && ::qi::detail::binaryCodecSupported(&what::field)
+#define __QI_TUPLE_ENCODE(_, what, field) if (!::qi::detail::binaryCodecWrite(out, ptr->field)) return false;
+#define __QI_TUPLE_DECODE(_, what, field) if (!::qi::detail::binaryCodecRead(in, ptr->field)) return false;
 #define __QI_TYPE_STRUCT_IMPLEMENT(name, inl, onSet, ...)                                    \
 namespace qi {                                                                        \
   inl TypeImpl<name>::TypeImpl() {                           \
@@ -204,6 +374,29 @@ namespace qi {
   }\
   inl bool TypeImpl<name>::canDropFields(void* storage, const std::vector<std::string>& fieldNames) {return ::qi::detail::StructVersioningDelegateDrop<name>::canDropFields(storage, fieldNames);} \
   inl bool TypeImpl<name>::fillMissingFields(std::map<std::string, ::qi::AnyValue>& fields, const std::vector<std::string>& missing) {return ::qi::detail::StructVersioningDelegateFill<name>::fillMissingFields(this, fields, missing);} \
+  inl bool TypeImpl<name>::hasBinaryCodec()                                           \
+  {                                                                                   \
+    return ::qi::detail::StructBinaryCodecDelegate<name>::enabled                     \
+      QI_VAARGS_APPLY(__QI_TUPLE_HAS_CODEC, name, __VA_ARGS__);                       \
+  }                                                                                   \
+  inl bool TypeImpl<name>::binaryEncode(void* storage, ::qi::Buffer& out)             \
+  {                                                                                   \
+    name* ptr = (name*)ptrFromStorage(&storage);                                      \
+    QI_VAARGS_APPLY(__QI_TUPLE_ENCODE, _, __VA_ARGS__);                               \
+    return true;                                                                      \
+  }                                                                                   \
+  inl bool TypeImpl<name>::binaryDecode(void* storage, ::qi::BufferReader& in)        \
+  {                                                                                   \
+    name* target = (name*)ptrFromStorage(&storage);                                   \
+    /* Leave the instance untouched if the data is truncated */                       \
+    name decoded(*target);                                                            \
+    name* ptr = &decoded;                                                             \
+    QI_VAARGS_APPLY(__QI_TUPLE_DECODE, _, __VA_ARGS__);                               \
+    *target = decoded;                                                                \
+    ptr = target;                                                                     \
+    onSet                                                                             \
+    return true;                                                                      \
+  }                                                                                   \
 }
 
 
@@ -282,6 +475,9 @@ namespace qi {
   } \
   inl bool TypeImpl<name>::canDropFields(void* storage, const std::vector<std::string>& fieldNames) {return ::qi::detail::StructVersioningDelegateDrop<name>::canDropFields(storage, fieldNames);} \
  inl bool TypeImpl<name>::fillMissingFields(std::map<std::string, ::qi::AnyValue>& fields, const std::vector<std::string>& missing) {return ::qi::detail::StructVersioningDelegateFill<name>::fillMissingFields(this, fields, missing);} \
+ inl bool TypeImpl<name>::hasBinaryCodec() { return false; } \
+ inl bool TypeImpl<name>::binaryEncode(void*, ::qi::Buffer&) { return false; } \
+ inl bool TypeImpl<name>::binaryDecode(void*, ::qi::BufferReader&) { return false; } \
  }
 
 
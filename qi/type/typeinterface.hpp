@@ -72,6 +72,8 @@ namespace qi{
 
   class ListTypeInterface;
   class StructTypeInterface;
+  class Buffer;
+  class BufferReader;
 
   // Interfaces for specialized types
   class QI_API IntTypeInterface: public TypeInterface
@@ -287,6 +289,24 @@ namespace qi{
     virtual bool fillMissingFields(std::map<std::string, AnyValue>& fields, const std::vector<std::string>& missing) { return false;}
 
     /// @}
+
+    /** @{
+    *
+    * Direct binary codec support, see QI_TYPE_STRUCT_EXTENSION_BINARY_CODEC.
+    *
+    * When available, the binary codec writes and reads the fields straight
+    * from the struct instead of going through get()/set() and a type dispatch
+    * per field. The produced data is identical.
+    */
+
+    /// Return whether binaryEncode() and binaryDecode() can be used.
+    virtual bool hasBinaryCodec() { return false;}
+    /// Append the serialized fields of \p storage to \p out. Return false on write error.
+    virtual bool binaryEncode(void* storage, Buffer& out) { return false;}
+    /// Read all fields of \p storage from \p in. Return false if data is missing.
+    virtual bool binaryDecode(void* storage, BufferReader& in) { return false;}
+
+    /// @}
   };
 
   /**
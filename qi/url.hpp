@@ -28,6 +28,9 @@ namespace qi {
    *    - :port
    *    - *empty string*
    *
+   *  unix://path urls designate a local socket: the path is returned by host()
+   *  and such urls are valid without a port.
+   *
    *  @note This class is copyable.
    */
   class QI_API Url
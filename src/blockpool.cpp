@@ -0,0 +1,156 @@
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <qi/buffer.hpp>
+
+#include "blockpool_p.hpp"
+
+namespace qi
+{
+  namespace detail
+  {
+    static const unsigned minClassShift = 6; // smallest class is 64 bytes
+    static const unsigned classCount = 11;   // biggest is maxPooledBlock
+    static const size_t maxCachedBytes = 256 * 1024; // per class and thread
+
+    static boost::atomic<qi::int64_t> statAllocations(0);
+    static boost::atomic<qi::int64_t> statHits(0);
+    static boost::atomic<qi::int64_t> statCachedBytes(0);
+    static boost::atomic<qi::int64_t> statPeakCachedBytes(0);
+
+    namespace
+    {
+      struct FreeBlock
+      {
+        FreeBlock* next;
+      };
+
+      struct ThreadCache
+      {
+        ThreadCache()
+        {
+          memset(head, 0, sizeof(head));
+          memset(bytes, 0, sizeof(bytes));
+        }
+
+        ~ThreadCache()
+        {
+          for (unsigned c = 0; c < classCount; ++c)
+          {
+            while (FreeBlock* b = head[c])
+            {
+              head[c] = b->next;
+              free(b);
+            }
+            statCachedBytes.fetch_sub(bytes[c], boost::memory_order_relaxed);
+          }
+        }
+
+        FreeBlock* head[classCount];
+        size_t     bytes[classCount];
+      };
+    }
+
+    static ThreadCache* threadCache()
+    {
+      // Never destroyed: blocks may be released during static destruction
+      static boost::thread_specific_ptr<ThreadCache>* tls =
+        new boost::thread_specific_ptr<ThreadCache>();
+      ThreadCache* cache = tls->get();
+      if (!cache)
+      {
+        cache = new ThreadCache();
+        tls->reset(cache);
+      }
+      return cache;
+    }
+
+    static unsigned sizeClass(size_t size)
+    {
+      unsigned c = 0;
+      while ((size_t(1) << (c + minClassShift)) < size)
+        ++c;
+      return c;
+    }
+
+    void* poolAlloc(size_t& size)
+    {
+      if (size > maxPooledBlock)
+        return malloc(size);
+      unsigned c = sizeClass(size);
+      size = size_t(1) << (c + minClassShift);
+      statAllocations.fetch_add(1, boost::memory_order_relaxed);
+
+      ThreadCache* cache = threadCache();
+      if (FreeBlock* b = cache->head[c])
+      {
+        cache->head[c] = b->next;
+        cache->bytes[c] -= size;
+        statHits.fetch_add(1, boost::memory_order_relaxed);
+        statCachedBytes.fetch_sub(size, boost::memory_order_relaxed);
+        return b;
+      }
+      return malloc(size);
+    }
+
+    void poolFree(void* ptr, size_t size)
+    {
+      if (!ptr)
+        return;
+      if (size > maxPooledBlock)
+      {
+        free(ptr);
+        return;
+      }
+      unsigned c = sizeClass(size);
+      size = size_t(1) << (c + minClassShift);
+
+      ThreadCache* cache = threadCache();
+      if (cache->bytes[c] + size > maxCachedBytes)
+      {
+        free(ptr);
+        return;
+      }
+      FreeBlock* b = static_cast<FreeBlock*>(ptr);
+      b->next = cache->head[c];
+      cache->head[c] = b;
+      cache->bytes[c] += size;
+
+      qi::int64_t cached = statCachedBytes.fetch_add(size, boost::memory_order_relaxed) + size;
+      qi::int64_t peak = statPeakCachedBytes.load(boost::memory_order_relaxed);
+      while (cached > peak && !statPeakCachedBytes.compare_exchange_weak(peak, cached))
+        ;
+    }
+
+    void* poolRealloc(void* ptr, size_t size, size_t& newSize, size_t used)
+    {
+      if (ptr && size > maxPooledBlock && newSize > maxPooledBlock)
+        return realloc(ptr, newSize);
+      void* p = poolAlloc(newSize);
+      if (!p)
+        return 0;
+      if (ptr)
+        memcpy(p, ptr, used);
+      poolFree(ptr, size);
+      return p;
+    }
+  }
+
+  BufferPoolStats bufferPoolStats()
+  {
+    BufferPoolStats s;
+    s.allocations = detail::statAllocations.load(boost::memory_order_relaxed);
+    s.hits = detail::statHits.load(boost::memory_order_relaxed);
+    s.cachedBytes = detail::statCachedBytes.load(boost::memory_order_relaxed);
+    s.peakCachedBytes = detail::statPeakCachedBytes.load(boost::memory_order_relaxed);
+    return s;
+  }
+}
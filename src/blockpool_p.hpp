@@ -0,0 +1,73 @@
+#pragma once
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#ifndef _SRC_BLOCKPOOL_P_HPP_
+#define _SRC_BLOCKPOOL_P_HPP_
+
+#include <cstddef>
+#include <new>
+
+namespace qi
+{
+  namespace detail
+  {
+    /** Size-class allocator for messages, buffers and their payload.
+     *
+     * Requests up to maxPooledBlock bytes are rounded up to a power of two,
+     * and freed blocks are kept in a free list of the freeing thread for the
+     * next allocation of the same class. Bigger requests go to malloc.
+     */
+    static const size_t maxPooledBlock = 64 * 1024;
+
+    /// Allocate at least size bytes. size is set to the usable size.
+    void* poolAlloc(size_t& size);
+    /// Release ptr, size being the requested or the usable size.
+    void  poolFree(void* ptr, size_t size);
+    /// Grow ptr, of usable size size, to at least newSize bytes. The first
+    /// used bytes are preserved. Returns 0 on failure, leaving ptr untouched.
+    void* poolRealloc(void* ptr, size_t size, size_t& newSize, size_t used);
+
+    /// Allocator for boost::allocate_shared over the pool.
+    template<typename T>
+    class PoolAllocator
+    {
+    public:
+      typedef T              value_type;
+      typedef T*             pointer;
+      typedef const T*       const_pointer;
+      typedef T&             reference;
+      typedef const T&       const_reference;
+      typedef std::size_t    size_type;
+      typedef std::ptrdiff_t difference_type;
+      template<typename U> struct rebind { typedef PoolAllocator<U> other; };
+
+      PoolAllocator() {}
+      template<typename U> PoolAllocator(const PoolAllocator<U>&) {}
+
+      pointer allocate(size_type n, const void* = 0)
+      {
+        size_t size = n * sizeof(T);
+        void* p = poolAlloc(size);
+        if (!p)
+          throw std::bad_alloc();
+        return static_cast<pointer>(p);
+      }
+      void deallocate(pointer p, size_type n)
+      {
+        poolFree(p, n * sizeof(T));
+      }
+      void construct(pointer p, const T& v) { new (p) T(v); }
+      void destroy(pointer p) { p->~T(); }
+      size_type max_size() const { return size_t(-1) / sizeof(T); }
+      pointer address(reference r) const { return &r; }
+      const_pointer address(const_reference r) const { return &r; }
+      bool operator==(const PoolAllocator&) const { return true; }
+      bool operator!=(const PoolAllocator&) const { return false; }
+    };
+  }
+}
+
+#endif  // _SRC_BLOCKPOOL_P_HPP_
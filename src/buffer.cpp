@@ -5,16 +5,30 @@
 
 #include <qi/buffer.hpp>
 #include <qi/log.hpp>
+#include <qi/atomic.hpp>
 
 #include <cstdio>
 #include <cstring>
 #include <stdexcept>
 #include <iomanip>
 #include <ctype.h>
+#include <cerrno>
+#include <boost/thread/mutex.hpp>
 
-#include <boost/pool/singleton_pool.hpp>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# if defined(__linux__) && !defined(F_GET_SEALS)
+#  define F_GET_SEALS 1034
+#  define F_SEAL_SHRINK 0x0002
+#  define F_SEAL_WRITE 0x0008
+# endif
+#endif
 
 #include "buffer_p.hpp"
+#include "blockpool_p.hpp"
 
 #include <iostream>
 
@@ -32,25 +46,20 @@ namespace qi
 
   BufferPrivate::~BufferPrivate()
   {
-    if (_bigdata)
-    {
-      free(_bigdata);
-      _bigdata = NULL;
-    }
+    if (_bigdata && !_storage)
+      detail::poolFree(_bigdata, available);
+    _bigdata = NULL;
   }
 
-  struct MyPoolTag { };
-  typedef boost::singleton_pool<MyPoolTag, sizeof(BufferPrivate)> buffer_pool;
-
   void* BufferPrivate::operator new(size_t sz)
   {
     assert(sz <= sizeof(BufferPrivate));
-    return buffer_pool::malloc();
+    return detail::poolAlloc(sz);
   }
 
   void BufferPrivate::operator delete(void* ptr)
   {
-    buffer_pool::free(ptr);
+    detail::poolFree(ptr, sizeof(BufferPrivate));
   }
 
   int BufferPrivate::indexOfSubBuffer(size_t offset) const
@@ -64,6 +73,101 @@ namespace qi
     return -1;
   }
 
+  void BufferPrivate::borrow(Buffer& result, unsigned char* data, size_t size,
+                             const boost::shared_ptr<void>& storage)
+  {
+    BufferPrivate* p = result._p.get();
+    assert(!p->_bigdata && !p->used);
+    p->_bigdata = data;
+    p->_storage = storage;
+    p->used = size;
+    p->available = size;
+  }
+
+  namespace
+  {
+    struct PoolFree
+    {
+      explicit PoolFree(size_t size) : size(size) {}
+      void operator()(void* mem) { detail::poolFree(mem, size); }
+      size_t size;
+    };
+  }
+
+  boost::shared_ptr<void> BufferPrivate::share()
+  {
+    boost::shared_ptr<void> storage = boost::atomic_load(&_storage);
+    if (storage || !_bigdata)
+      return storage;
+    // Copies of a Message share us and may be read by several threads at
+    // once: only one of them hands our block over.
+    static boost::mutex* mutex;
+    QI_THREADSAFE_NEW(mutex);
+    boost::mutex::scoped_lock lock(*mutex);
+    storage = boost::atomic_load(&_storage);
+    if (!storage)
+    {
+      // Hand our block over to a shared owner, and make the next write
+      // resize, which copies to a new block.
+      storage = boost::shared_ptr<void>(_bigdata, PoolFree(available));
+      available = used;
+      boost::atomic_store(&_storage, storage);
+    }
+    return storage;
+  }
+
+#ifndef _WIN32
+  namespace
+  {
+    struct Unmap
+    {
+      explicit Unmap(size_t size) : size(size) {}
+      void operator()(void* mem) { munmap(mem, size); }
+      size_t size;
+    };
+  }
+
+  bool BufferPrivate::fromFd(int fd, size_t size, Buffer& result)
+  {
+    if (!size)
+    {
+      result = Buffer();
+      return true;
+    }
+#ifdef F_GET_SEALS
+    // The sender could otherwise truncate the file under our mapping, or
+    // change bytes we already deserialized.
+    const int required = F_SEAL_SHRINK | F_SEAL_WRITE;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & required) != required)
+    {
+      qiLogVerbose() << "Refusing to map a file that is not sealed";
+      return false;
+    }
+#else
+    qiLogVerbose() << "Refusing to map a file that cannot be sealed";
+    return false;
+#endif
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < size)
+    {
+      qiLogVerbose() << "Refusing to map " << size << " bytes of a smaller file";
+      return false;
+    }
+    void* mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+      qiLogVerbose() << "mmap(" << size << ") failed: " << strerror(errno);
+      return false;
+    }
+    Buffer b;
+    borrow(b, static_cast<unsigned char*>(mem), size,
+           boost::shared_ptr<void>(mem, Unmap(size)));
+    result = b;
+    return true;
+  }
+#endif
+
   Buffer::Buffer()
     : _p(boost::shared_ptr<BufferPrivate>(new BufferPrivate()))
   {
@@ -95,13 +199,26 @@ namespace qi
     qiLogDebug() << "Resizing buffer from " << available << " to " << neededSize;
     unsigned char *newBigdata;
 
-    newBigdata = static_cast<unsigned char *>(realloc(_bigdata, neededSize));
+    if (_storage)
+    {
+      // Borrowed memory cannot grow: move to the heap
+      newBigdata = static_cast<unsigned char *>(detail::poolAlloc(neededSize));
+      if (newBigdata == NULL)
+        return false;
+      ::memcpy(newBigdata, _bigdata, used);
+      _storage.reset();
+      available = neededSize;
+      _bigdata = newBigdata;
+      return true;
+    }
+    newBigdata = static_cast<unsigned char *>(
+      detail::poolRealloc(_bigdata, available, neededSize, used));
     if (newBigdata == NULL)
       return false;
     if (!_bigdata && used > 0)
       ::memcpy(newBigdata, _data, used);
     available = neededSize;
-    _bigdata = newBigdata; // Don't worry, realloc free previous buffer if needed
+    _bigdata = newBigdata; // poolRealloc released the previous block
     return true;
   }
 
@@ -182,6 +299,13 @@ namespace qi
 
   void Buffer::clear()
   {
+    if (_p->_storage)
+    {
+      // Do not write over memory we only borrowed
+      _p->_storage.reset();
+      _p->_bigdata = 0;
+      _p->available = sizeof(_p->_data);
+    }
     _p->used = 0;
     _p->_subBuffers.clear();
     _p->_cachedSubBufferTotalSize = 0;
@@ -221,6 +345,34 @@ namespace qi
     return copy;
   }
 
+  StringView::StringView()
+    : _size(0)
+  {
+  }
+
+  StringView::StringView(const std::string& str)
+    : _size(str.size())
+  {
+    _owner.write(str.data(), str.size());
+  }
+
+  StringView::StringView(const char* data, size_t size)
+    : _size(size)
+  {
+    _owner.write(data, size);
+  }
+
+  StringView::StringView(const Buffer& owner)
+    : _owner(owner)
+    , _size(owner.size())
+  {
+  }
+
+  bool operator==(const StringView& a, const StringView& b)
+  {
+    return a.size() == b.size() && !memcmp(a.data(), b.data(), a.size());
+  }
+
   namespace detail {
     void printBuffer(std::ostream& stream, const Buffer& buffer)
     {
@@ -11,6 +11,7 @@
 #define BLOCK   4096
 
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include <qi/atomic.hpp>
 #include <qi/types.hpp>
 
@@ -27,8 +28,27 @@ namespace qi
     bool            resize(size_t size = 0x100000);
     int             indexOfSubBuffer(size_t offset) const;
 
+#ifndef _WIN32
+    /** Map the first size bytes of fd into a new Buffer (private, copy on write).
+     * fd is not kept open. Returns false on error.
+     */
+    static bool     fromFd(int fd, size_t size, Buffer& result);
+#endif
+    /** Make result, which must be empty, use size bytes at data without copy.
+     * storage owns that memory and is kept alive as long as result uses it.
+     */
+    static void     borrow(Buffer& result, unsigned char* data, size_t size,
+                           const boost::shared_ptr<void>& storage);
+    /** Return an owner of the current bytes, which are never modified
+     * afterwards: later writes move this buffer to new memory. Return an
+     * empty pointer if the bytes are stored inline and must be copied.
+     * Safe to call from concurrent readers.
+     */
+    boost::shared_ptr<void> share();
+
   public:
     unsigned char*  _bigdata;
+    boost::shared_ptr<void> _storage; // if set, _bigdata points into memory it owns
     unsigned char   _data[STATIC_BLOCK];
     size_t          _cachedSubBufferTotalSize;
 
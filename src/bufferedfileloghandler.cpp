@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2014 Aldebaran Robotics. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the COPYING file.
+ */
+
+#include <qi/log/bufferedfileloghandler.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <iostream>
+#include <string>
+#include "log_p.hpp"
+#include <qi/os.hpp>
+#include <cstdio>
+
+#ifdef WITH_ZLIB
+# include <zlib.h>
+#endif
+
+qiLogCategory("qi.log.bufferedfileloghandler");
+
+namespace qi {
+  namespace log {
+    class PrivateBufferedFileLogHandler
+    {
+    public:
+      PrivateBufferedFileLogHandler()
+        : _file(NULL)
+        , _fileSize(0)
+        , _maxFileSize(0)
+        , _maxBackups(0)
+        , _compress(false)
+        , _bufferSize(256 * 1024)
+        , _flushInterval(1000)
+        , _writing(false)
+        , _stopping(false)
+        , _flushRequest(0)
+        , _flushDone(0)
+        , _stopCompressor(false)
+      {
+      }
+
+      void run();
+      void write(const std::string& batch);
+      void rotate();
+      void runCompressor();
+      std::string backupPath(unsigned int index, bool compressed) const;
+
+      // Owned by the writer thread once started
+      FILE*                     _file;
+      std::string               _filePath;
+      size_t                    _fileSize;
+      size_t                    _maxFileSize;
+      unsigned int              _maxBackups;
+
+      // Protected by _mutex
+      bool                      _compress;
+      size_t                    _bufferSize;
+      unsigned int              _flushInterval;
+      std::string               _front;   // filled by log()
+      std::string               _back;    // written by the writer thread
+      bool                      _writing;
+      bool                      _stopping;
+      unsigned int              _flushRequest;
+      unsigned int              _flushDone;
+      boost::mutex              _mutex;
+      boost::condition_variable _wakeWriter;
+      boost::condition_variable _written;
+      std::string               _compressing; // rotated file waiting for gzip
+      bool                      _stopCompressor;
+      boost::condition_variable _wakeCompressor;
+      boost::condition_variable _compressed;
+
+      boost::thread             _thread;
+      boost::thread             _compressor;
+    };
+
+#ifdef WITH_ZLIB
+    static bool gzipFile(const std::string& src, const std::string& dst)
+    {
+      FILE* in = qi::os::fopen(src.c_str(), "rb");
+      if (!in)
+        return false;
+      gzFile out = gzopen(dst.c_str(), "wb");
+      if (!out)
+      {
+        fclose(in);
+        return false;
+      }
+      bool ok = true;
+      char buffer[64 * 1024];
+      size_t read;
+      while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+      {
+        if (gzwrite(out, buffer, static_cast<unsigned int>(read)) != static_cast<int>(read))
+        {
+          ok = false;
+          break;
+        }
+      }
+      fclose(in);
+      if (gzclose(out) != Z_OK)
+        ok = false;
+      return ok;
+    }
+
+    void PrivateBufferedFileLogHandler::runCompressor()
+    {
+      namespace fs = boost::filesystem;
+      boost::mutex::scoped_lock lock(_mutex);
+      while (true)
+      {
+        while (_compressing.empty() && !_stopCompressor)
+          _wakeCompressor.wait(lock);
+        if (_compressing.empty())
+          return;
+
+        std::string path = _compressing;
+        lock.unlock();
+        boost::system::error_code ec;
+        if (gzipFile(path, backupPath(1, true)))
+          fs::remove(fs::path(path), ec);
+        else
+          std::cerr << "Cannot compress " << path << std::endl;
+        lock.lock();
+        _compressing.clear();
+        _compressed.notify_all();
+      }
+    }
+#endif
+
+    void PrivateBufferedFileLogHandler::run()
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      while (true)
+      {
+        if (!_stopping && _flushDone == _flushRequest && _front.size() < _bufferSize)
+          _wakeWriter.timed_wait(lock, boost::posix_time::milliseconds(_flushInterval));
+
+        unsigned int serving = _flushRequest;
+        bool stopping = _stopping;
+        if (!_front.empty())
+        {
+          _back.swap(_front);
+          _writing = true;
+          lock.unlock();
+          write(_back);
+          _back.clear();
+          lock.lock();
+          _writing = false;
+        }
+        _flushDone = serving;
+        _written.notify_all();
+        if (stopping && _front.empty())
+          return;
+      }
+    }
+
+    void PrivateBufferedFileLogHandler::write(const std::string& batch)
+    {
+      size_t pos = 0;
+      while (_file && pos < batch.size())
+      {
+        size_t size = batch.size() - pos;
+        if (_maxFileSize && _fileSize + size > _maxFileSize)
+        {
+          // Cut after the last line that fits. Only a single line bigger
+          // than maxFileSize may exceed it, alone in its file.
+          size_t room = _fileSize < _maxFileSize ? _maxFileSize - _fileSize : 0;
+          size_t cut = room ? batch.rfind('\n', pos + room - 1) : std::string::npos;
+          if (cut != std::string::npos && cut >= pos)
+            size = cut + 1 - pos;
+          else if (_fileSize)
+          {
+            rotate();
+            continue;
+          }
+          else
+          {
+            cut = batch.find('\n', pos);
+            size = (cut == std::string::npos ? batch.size() : cut + 1) - pos;
+          }
+        }
+        // The stream is unbuffered: this is a single write
+        _fileSize += fwrite(batch.data() + pos, 1, size, _file);
+        pos += size;
+        if (_maxFileSize && (_fileSize >= _maxFileSize || pos < batch.size()))
+          rotate();
+      }
+    }
+
+    std::string PrivateBufferedFileLogHandler::backupPath(unsigned int index, bool compressed) const
+    {
+      std::string path = _filePath + "." + boost::lexical_cast<std::string>(index);
+      if (compressed)
+        path += ".gz";
+      return path;
+    }
+
+    void PrivateBufferedFileLogHandler::rotate()
+    {
+      namespace fs = boost::filesystem;
+      boost::system::error_code ec;
+      bool compress = false;
+#ifdef WITH_ZLIB
+      {
+        // Backups are shifted below: let the previous one be compressed
+        boost::mutex::scoped_lock lock(_mutex);
+        while (!_compressing.empty())
+          _compressed.wait(lock);
+        compress = _compress;
+      }
+#endif
+
+      fclose(_file);
+      _file = NULL;
+      _fileSize = 0;
+
+      // Shift backups, whether they were compressed or not
+      for (int gz = 0; gz < 2; ++gz)
+      {
+        if (_maxBackups)
+          fs::remove(fs::path(backupPath(_maxBackups, gz != 0)), ec);
+        for (unsigned int i = _maxBackups; i > 1; --i)
+        {
+          fs::path from(backupPath(i - 1, gz != 0));
+          if (fs::exists(from, ec))
+            fs::rename(from, fs::path(backupPath(i, gz != 0)), ec);
+        }
+      }
+
+      if (_maxBackups)
+      {
+        std::string newest = backupPath(1, false);
+        fs::rename(fs::path(_filePath), fs::path(newest), ec);
+        // cannot qilog here or deadlock with a logger waiting for us
+        if (ec)
+          std::cerr << "Cannot rotate " << _filePath << ": " << ec.message() << std::endl;
+        // Compressed on its own thread, logs go to the new file meanwhile
+        if (!ec && compress)
+        {
+          boost::mutex::scoped_lock lock(_mutex);
+          _compressing = newest;
+          _wakeCompressor.notify_one();
+        }
+      }
+
+      _file = qi::os::fopen(_filePath.c_str(), "w");
+      if (!_file)
+      {
+        std::cerr << "Cannot open " << _filePath << std::endl;
+        return;
+      }
+      setvbuf(_file, NULL, _IONBF, 0);
+    }
+
+    BufferedFileLogHandler::BufferedFileLogHandler(const std::string& filePath,
+                                                   size_t maxFileSize,
+                                                   unsigned int maxBackups)
+      : _p(new PrivateBufferedFileLogHandler)
+    {
+      boost::filesystem::path fPath(filePath);
+      _p->_filePath = fPath.make_preferred().string();
+      _p->_maxFileSize = maxFileSize;
+      _p->_maxBackups = maxBackups;
+
+      // Create the directory!
+      try
+      {
+        if (!boost::filesystem::exists(fPath.make_preferred().parent_path()))
+          boost::filesystem::create_directories(fPath.make_preferred().parent_path());
+      }
+      catch (const boost::filesystem::filesystem_error &e)
+      {
+        qiLogWarning() << e.what();
+      }
+
+      // Open the file.
+      FILE* file = qi::os::fopen(_p->_filePath.c_str(), "w");
+
+      if (file)
+      {
+        setvbuf(file, NULL, _IONBF, 0);
+        _p->_file = file;
+        _p->_front.reserve(_p->_bufferSize);
+        _p->_back.reserve(_p->_bufferSize);
+        _p->_thread = boost::thread(&PrivateBufferedFileLogHandler::run, _p);
+      }
+      else
+        qiLogWarning() << "Cannot open " << filePath;
+    }
+
+    BufferedFileLogHandler::~BufferedFileLogHandler()
+    {
+      if (_p->_thread.joinable())
+      {
+        {
+          boost::mutex::scoped_lock lock(_p->_mutex);
+          _p->_stopping = true;
+          _p->_wakeWriter.notify_one();
+        }
+        _p->_thread.join();
+      }
+      if (_p->_compressor.joinable())
+      {
+        {
+          boost::mutex::scoped_lock lock(_p->_mutex);
+          _p->_stopCompressor = true;
+          _p->_wakeCompressor.notify_one();
+        }
+        _p->_compressor.join();
+      }
+      if (_p->_file != NULL)
+        fclose(_p->_file);
+      delete _p;
+    }
+
+    void BufferedFileLogHandler::setBufferSize(size_t size)
+    {
+      boost::mutex::scoped_lock lock(_p->_mutex);
+      _p->_bufferSize = size;
+      _p->_front.reserve(size);
+    }
+
+    void BufferedFileLogHandler::setFlushInterval(unsigned int msecs)
+    {
+      boost::mutex::scoped_lock lock(_p->_mutex);
+      _p->_flushInterval = msecs;
+      _p->_wakeWriter.notify_one();
+    }
+
+    bool BufferedFileLogHandler::setCompression(bool compress)
+    {
+#ifdef WITH_ZLIB
+      boost::mutex::scoped_lock lock(_p->_mutex);
+      _p->_compress = compress;
+      if (compress && !_p->_compressor.joinable())
+        _p->_compressor = boost::thread(&PrivateBufferedFileLogHandler::runCompressor, _p);
+      return true;
+#else
+      return !compress;
+#endif
+    }
+
+    void BufferedFileLogHandler::flush()
+    {
+      boost::mutex::scoped_lock lock(_p->_mutex);
+      if (!_p->_thread.joinable())
+        return;
+      unsigned int request = ++_p->_flushRequest;
+      _p->_wakeWriter.notify_one();
+      // counters may wrap: wait until the writer served this request
+      while (static_cast<int>(_p->_flushDone - request) < 0)
+        _p->_written.wait(lock);
+    }
+
+    void BufferedFileLogHandler::log(const qi::LogLevel verb,
+                                     const qi::os::timeval   date,
+                                     const char              *category,
+                                     const char              *msg,
+                                     const char              *file,
+                                     const char              *fct,
+                                     const int               line)
+    {
+      if (verb > qi::log::logLevel() || !_p->_thread.joinable())
+        return;
+
+      std::string logline = qi::detail::logline(qi::log::context(), date, category, msg, file, fct, line, verb);
+
+      boost::mutex::scoped_lock lock(_p->_mutex);
+      // Both buffers full: wait for the writer
+      while (_p->_writing && !_p->_front.empty()
+             && _p->_front.size() + logline.size() > _p->_bufferSize)
+        _p->_written.wait(lock);
+      _p->_front.append(logline);
+      if (_p->_front.size() >= _p->_bufferSize)
+        _p->_wakeWriter.notify_one();
+    }
+  }
+}
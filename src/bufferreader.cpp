@@ -83,6 +83,22 @@ namespace qi {
     return _buffer.subBuffers()[_subCursor++].second;
   }
 
+  bool BufferReader::readSlice(size_t length, Buffer& result)
+  {
+    result = Buffer();
+    if (!length)
+      return true;
+    void* data = read(length);
+    if (!data)
+      return false;
+    boost::shared_ptr<void> storage = _buffer._p->share();
+    if (storage)
+      BufferPrivate::borrow(result, static_cast<unsigned char*>(data), length, storage);
+    else
+      result.write(data, length); // small buffer, stored inline
+    return true;
+  }
+
   size_t BufferReader::position() const
   {
     return _cursor;
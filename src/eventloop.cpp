@@ -37,6 +37,17 @@ namespace qi {
       return boost::lexical_cast<T>(sval);
   }
 
+  static int defaultThreadCount()
+  {
+    int nthread = boost::thread::hardware_concurrency();
+    if (nthread < 3)
+      nthread = 3;
+    const char* envNthread = getenv("QI_EVENTLOOP_THREAD_COUNT");
+    if (envNthread)
+      nthread = strtol(envNthread, 0, 0);
+    return nthread;
+  }
+
   EventLoopAsio::EventLoopAsio()
   : _mode(Mode_Unset)
   , _work(NULL)
@@ -51,14 +62,7 @@ namespace qi {
     if (*_running || _mode != Mode_Unset)
       return;
     if (nthread == 0)
-    {
-      nthread = boost::thread::hardware_concurrency();
-      if (nthread < 3)
-        nthread = 3;
-      const char* envNthread = getenv("QI_EVENTLOOP_THREAD_COUNT");
-      if (envNthread)
-        nthread = strtol(envNthread, 0, 0);
-    }
+      nthread = defaultThreadCount();
     _maxThreads = getEnvParam("QI_EVENTLOOP_MAX_THREADS", 150);
     _mode = Mode_Pooled;
     _work = new boost::asio::io_service::work(_io);
@@ -342,6 +346,431 @@ namespace qi {
     return static_cast<void*>(&_io);
   }
 
+  // Worker or I/O thread of an EventLoopWorkStealing
+  struct WorkStealingThread
+  {
+    EventLoopWorkStealing* loop;
+    unsigned int           worker; // noWorker for I/O threads
+  };
+  static const unsigned int noWorker = (unsigned int)-1;
+
+  static boost::thread_specific_ptr<WorkStealingThread>& workStealingThread()
+  {
+    static boost::thread_specific_ptr<WorkStealingThread>* tls;
+    QI_THREADSAFE_NEW(tls);
+    return *tls;
+  }
+
+  static void setWorkStealingThread(EventLoopWorkStealing* loop, unsigned int worker)
+  {
+    WorkStealingThread* t = new WorkStealingThread;
+    t->loop = loop;
+    t->worker = worker;
+    workStealingThread().reset(t);
+  }
+
+  EventLoopWorkStealing::EventLoopWorkStealing()
+  : _work(NULL)
+  , _maxThreads(0)
+  {
+    _name = "wseventloop";
+  }
+
+  EventLoopWorkStealing::~EventLoopWorkStealing()
+  {
+    if (isInEventLoopThread())
+      qiLogError() << "Destroying EventLoopPrivate from itself while running";
+    stop();
+    join();
+    for (unsigned i = 0; i < _workers.size(); ++i)
+      delete _workers[i];
+  }
+
+  // Size of the worker table, which never grows so that thieves can walk it
+  // without locking. Workers themselves are allocated when spawned.
+  static const unsigned int workerSlots = 1024;
+
+  void EventLoopWorkStealing::destroy()
+  {
+    if (isInEventLoopThread())
+      boost::thread(&EventLoopWorkStealing::destroy, this);
+    else
+      delete this;
+  }
+
+  void EventLoopWorkStealing::start(int nthread)
+  {
+    boost::recursive_mutex::scoped_lock sl(_mutex);
+    if (!_workers.empty())
+      return;
+    if (nthread <= 0)
+      nthread = defaultThreadCount();
+    _maxThreads = getEnvParam("QI_EVENTLOOP_MAX_THREADS", 150);
+    int ioThreads = getEnvParam("QI_EVENTLOOP_IO_THREADS", 2);
+    _workers.resize(std::max(workerSlots, (unsigned int)nthread), 0);
+    _work = new boost::asio::io_service::work(_io);
+    for (int i = 0; i < nthread; ++i)
+      spawnWorker();
+    for (int i = 0; i < ioThreads; ++i)
+    {
+      ++_ioThreads;
+      ++_nThreads;
+      boost::thread(&EventLoopWorkStealing::_runIo, this);
+    }
+    ++_nThreads;
+    boost::thread(&EventLoopWorkStealing::_pingThread, this);
+  }
+
+  void EventLoopWorkStealing::spawnWorker()
+  {
+    boost::recursive_mutex::scoped_lock sl(_mutex);
+    unsigned int index = *_nWorkers;
+    if (index >= _workers.size())
+      return;
+    // Published by the increment of _nWorkers
+    _workers[index] = new Worker();
+    ++_nThreads;
+    ++_nWorkers;
+    boost::thread(&EventLoopWorkStealing::_runWorker, this, index);
+  }
+
+  void EventLoopWorkStealing::schedule(const Task& task)
+  {
+    // Tasks posted from a worker stay on it, unless someone steals them.
+    WorkStealingThread* current = workStealingThread().get();
+    unsigned int index;
+    if (current && current->loop == this && current->worker != noWorker)
+      index = current->worker;
+    else
+    {
+      // Worker 0 is spawned first, its slot exists as soon as we are started
+      unsigned int n = *_nWorkers;
+      index = n ? ++_nextWorker % n : 0;
+    }
+    Worker& worker = *_workers[index];
+    {
+      boost::mutex::scoped_lock l(worker.mutex);
+      worker.tasks.push_back(task);
+    }
+    ++_pending;
+    // Sleepers register before checking _pending, so either they see our
+    // task or we see them.
+    if (*_sleeping)
+    {
+      boost::mutex::scoped_lock l(_idleMutex);
+      _idleCond.notify_one();
+    }
+  }
+
+  bool EventLoopWorkStealing::popTask(unsigned int self, Task& task)
+  {
+    // Own queue is consumed in FIFO order, so that a single worker runs tasks
+    // in the order they were posted. Steal from the other end.
+    {
+      Worker& worker = *_workers[self];
+      boost::mutex::scoped_lock l(worker.mutex);
+      if (!worker.tasks.empty())
+      {
+        task.swap(worker.tasks.front());
+        worker.tasks.pop_front();
+        --_pending;
+        return true;
+      }
+    }
+    unsigned int n = *_nWorkers;
+    for (unsigned int i = 1; i < n; ++i)
+    {
+      Worker& victim = *_workers[(self + i) % n];
+      boost::mutex::scoped_lock l(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task.swap(victim.tasks.back());
+        victim.tasks.pop_back();
+        --_pending;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void EventLoopWorkStealing::_runWorker(unsigned int index)
+  {
+    qiLogDebug() << this << " worker " << index << " starting";
+    qi::os::setCurrentThreadName(_name);
+    setWorkStealingThread(this, index);
+    Task task;
+    while (true)
+    {
+      if (popTask(index, task))
+      {
+        try
+        {
+          task();
+        } catch(const detail::TerminateThread& e) {
+          break;
+        } catch(const std::exception& e) {
+          qiLogWarning() << "Error caught in eventloop(" << _name << ").async: " << e.what();
+        } catch(...) {
+          qiLogWarning() << "Uncaught exception in eventloop(" << _name << ")";
+        }
+        task.clear();
+        continue;
+      }
+      boost::mutex::scoped_lock l(_idleMutex);
+      ++_sleeping;
+      // Timers can still schedule tasks until the I/O threads are done
+      while (*_pending <= 0 && !(*_stopping && !*_ioThreads))
+        _idleCond.wait(l);
+      --_sleeping;
+      if (*_pending <= 0 && *_stopping && !*_ioThreads)
+        break;
+    }
+    workStealingThread().reset();
+    --_nThreads;
+  }
+
+  void EventLoopWorkStealing::_runIo()
+  {
+    qi::os::setCurrentThreadName(_name + ".io");
+    setWorkStealingThread(this, noWorker);
+    while (true) {
+      try
+      {
+        _io.run();
+        break;
+      } catch(const detail::TerminateThread& e) {
+        break;
+      } catch(const std::exception& e) {
+        qiLogWarning() << "Error caught in eventloop(" << _name << ") I/O: " << e.what();
+      } catch(...) {
+        qiLogWarning() << "Uncaught exception in eventloop(" << _name << ") I/O";
+      }
+    }
+    workStealingThread().reset();
+    {
+      boost::mutex::scoped_lock l(_idleMutex);
+      --_ioThreads;
+      _idleCond.notify_all();
+    }
+    --_nThreads;
+  }
+
+  namespace {
+    struct PingState
+    {
+      PingState() : pong(false), ioPong(false) {}
+      boost::mutex              mutex;
+      boost::condition_variable cond;
+      bool                      pong;
+      bool                      ioPong;
+    };
+  }
+
+  static void pong(boost::shared_ptr<PingState> state, bool io)
+  {
+    boost::mutex::scoped_lock l(state->mutex);
+    (io ? state->ioPong : state->pong) = true;
+    state->cond.notify_all();
+  }
+
+  void EventLoopWorkStealing::_pingThread()
+  {
+    qi::os::setCurrentThreadName("EvLoop.mon");
+    static int msTimeout = getEnvParam("QI_EVENTLOOP_PING_TIMEOUT", 500);
+    static int msGrace = getEnvParam("QI_EVENTLOOP_GRACE_PERIOD", 0);
+    static int maxTimeouts = getEnvParam("QI_EVENTLOOP_MAX_TIMEOUTS", 20);
+    int nbTimeout = 0;
+    while (_work)
+    {
+      qiLogDebug() << "Ping";
+      boost::shared_ptr<PingState> state = boost::make_shared<PingState>();
+      schedule(boost::bind(&pong, state, false));
+      _io.post(boost::bind(&pong, state, true));
+      bool gotPong, gotIoPong;
+      {
+        boost::mutex::scoped_lock l(state->mutex);
+        boost::system_time deadline = boost::get_system_time()
+          + boost::posix_time::milliseconds(msTimeout);
+        while (!(state->pong && state->ioPong) && state->cond.timed_wait(l, deadline))
+          ;
+        gotPong = state->pong;
+        gotIoPong = state->ioPong;
+      }
+      if (!gotIoPong && _maxThreads && *_ioThreads < (int)_maxThreads)
+      {
+        qiLogInfo() << _name << ": Spawning more I/O threads (" << *_ioThreads << ')';
+        ++_ioThreads;
+        ++_nThreads;
+        boost::thread(&EventLoopWorkStealing::_runIo, this);
+      }
+      if (!gotPong)
+      {
+        if (_maxThreads && *_nWorkers >= std::min(_maxThreads, (unsigned int)_workers.size()))
+        {
+          ++nbTimeout;
+          qiLogInfo() << "Thread " << _name << " limit reached (" << nbTimeout << " timeouts)" << *_totalTask << " / " << _maxThreads << " active: " << *_activeTask;
+
+          if (nbTimeout >= maxTimeouts)
+          {
+            qiLogInfo() << "threadpool: " << _name <<
+              ": System seems to be deadlocked, sending emergency signal";
+            if (_emergencyCallback)
+            {
+              try {
+                _emergencyCallback();
+              } catch (...) {
+              }
+            }
+          }
+        }
+        else
+        {
+          qiLogInfo() << _name << ": Spawning more threads (" << *_nWorkers << ')';
+          spawnWorker();
+        }
+      }
+      if (gotPong && gotIoPong)
+      {
+        nbTimeout = 0;
+        qiLogDebug() << "Ping ok";
+        qi::os::msleep(msTimeout);
+      }
+      else
+        qi::os::msleep(msGrace);
+    }
+    --_nThreads;
+  }
+
+  bool EventLoopWorkStealing::isInEventLoopThread()
+  {
+    WorkStealingThread* current = workStealingThread().get();
+    return current && current->loop == this;
+  }
+
+  void EventLoopWorkStealing::stop()
+  {
+    qiLogDebug() << "stopping eventloopworkstealing: " << this;
+    boost::recursive_mutex::scoped_lock sl(_mutex);
+    if (_work)
+    {
+      delete _work;
+      _work = 0;
+    }
+    boost::mutex::scoped_lock l(_idleMutex);
+    _stopping = 1;
+    _idleCond.notify_all();
+  }
+
+  void EventLoopWorkStealing::join()
+  {
+    if (isInEventLoopThread())
+    {
+      qiLogError() << "Cannot join from within event loop thread";
+      return;
+    }
+    qiLogDebug() << "Waiting for threads to terminate...";
+    while (*_nThreads)
+      qi::os::msleep(0);
+    qiLogDebug()  << "Waiting done";
+  }
+
+  void EventLoopWorkStealing::invoke(const Task& task, qi::uint32_t id, qi::Promise<void> p)
+  {
+    ScopedExitDec _(_totalTask);
+    if (p.isCancelRequested())
+    {
+      tracepoint(qi_qi, eventloop_task_cancel, id);
+      p.setCanceled();
+      return;
+    }
+    ScopedIncDec __(_activeTask);
+    tracepoint(qi_qi, eventloop_task_start, id);
+    task();
+    tracepoint(qi_qi, eventloop_task_stop, id);
+    p.setValue(0);
+  }
+
+  void EventLoopWorkStealing::onTimer(const Task& task, qi::uint32_t id, qi::Promise<void> p, const boost::system::error_code& erc)
+  {
+    if (erc)
+    {
+      --_totalTask;
+      tracepoint(qi_qi, eventloop_task_cancel, id);
+      p.setCanceled();
+    }
+    else
+      schedule(boost::bind(&EventLoopWorkStealing::invoke, this, task, id, p));
+  }
+
+  void EventLoopWorkStealing::post(qi::Duration delay,
+      const boost::function<void ()>& cb)
+  {
+    if (delay == qi::Duration(0)) {
+      uint32_t id = ++gTaskId;
+      tracepoint(qi_qi, eventloop_post, id, cb.target_type().name());
+      ++_totalTask;
+      schedule(boost::bind(&EventLoopWorkStealing::invoke, this, cb, id, qi::Promise<void>()));
+    }
+    else
+      asyncCall(delay, cb);
+  }
+
+  qi::Future<void> EventLoopWorkStealing::asyncCall(qi::Duration delay,
+      boost::function<void ()> cb)
+  {
+    if (!_work)
+      return qi::makeFutureError<void>("Schedule attempt on destroyed thread pool");
+
+    uint32_t id = ++gTaskId;
+
+    ++_totalTask;
+    tracepoint(qi_qi, eventloop_delay, id, cb.target_type().name(), boost::chrono::duration_cast<qi::MicroSeconds>(delay).count());
+    if (delay == qi::Duration(0))
+    {
+      // Canceled if still queued when its turn comes
+      qi::Promise<void> prom(&PromiseNoop<void>);
+      schedule(boost::bind(&EventLoopWorkStealing::invoke, this, cb, id, prom));
+      return prom.future();
+    }
+    boost::shared_ptr<boost::asio::steady_timer> timer = boost::make_shared<boost::asio::steady_timer>(boost::ref(_io));
+    timer->expires_from_now(delay);
+    qi::Promise<void> prom(boost::bind(&boost::asio::steady_timer::cancel, timer));
+    timer->async_wait(boost::bind(&EventLoopWorkStealing::onTimer, this, cb, id, prom, _1));
+    return prom.future();
+  }
+
+  void EventLoopWorkStealing::post(qi::SteadyClockTimePoint timepoint,
+      const boost::function<void ()>& cb)
+  {
+    asyncCall(timepoint, cb);
+  }
+
+  qi::Future<void> EventLoopWorkStealing::asyncCall(qi::SteadyClockTimePoint timepoint,
+      boost::function<void ()> cb)
+  {
+    if (!_work)
+      return qi::makeFutureError<void>("Schedule attempt on destroyed thread pool");
+
+    uint32_t id = ++gTaskId;
+
+    ++_totalTask;
+    boost::shared_ptr<SteadyTimer> timer = boost::make_shared<SteadyTimer>(boost::ref(_io));
+    timer->expires_at(timepoint);
+    qi::Promise<void> prom(boost::bind(&SteadyTimer::cancel, timer));
+    timer->async_wait(boost::bind(&EventLoopWorkStealing::onTimer, this, cb, id, prom, _1));
+    return prom.future();
+  }
+
+  void EventLoopWorkStealing::setMaxThreads(unsigned int max)
+  {
+    _maxThreads = max;
+  }
+
+  void* EventLoopWorkStealing::nativeHandle()
+  {
+    return static_cast<void*>(&_io);
+  }
+
   EventLoop::EventLoop(const std::string& name)
   : _p(0)
   , _name(name)
@@ -376,14 +805,36 @@ namespace qi {
     qiLogDebug() << this << " EventLoop join done";
   }
 
+  static EventLoop::Backend defaultBackend()
+  {
+    std::string backend = qi::os::getenv("QI_EVENTLOOP_BACKEND");
+    if (backend == "workstealing")
+      return EventLoop::Backend_WorkStealing;
+    if (!backend.empty() && backend != "asio")
+      qiLogWarning() << "Unknown QI_EVENTLOOP_BACKEND '" << backend << "', using asio";
+    return EventLoop::Backend_Asio;
+  }
+
   void EventLoop::start(int nthreads)
+  {
+    start(nthreads, defaultBackend());
+  }
+
+  void EventLoop::start(int nthreads, Backend backend)
   {
     qiLogDebug() << this << " EventLoop start";
     if (_p)
       return;
-    _p = new EventLoopAsio();
-    _p->_name = _name;
-    _p->start(nthreads);
+    // Only publish a started backend: post() from an other thread must not
+    // see it half initialized.
+    EventLoopPrivate* p;
+    if (backend == Backend_WorkStealing)
+      p = new EventLoopWorkStealing();
+    else
+      p = new EventLoopAsio();
+    p->_name = _name;
+    p->start(nthreads);
+    _p = p;
     qiLogDebug() << this << " EventLoop start done";
   }
 
@@ -7,6 +7,9 @@
 #ifndef _SRC_EVENTLOOP_P_HPP_
 #define _SRC_EVENTLOOP_P_HPP_
 
+#include <deque>
+#include <vector>
+
 #include <boost/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 
@@ -100,6 +103,69 @@ namespace qi {
     qi::Atomic<uint32_t> _totalTask;
     qi::Atomic<uint32_t> _activeTask;
   };
+
+  /* Thread pool where each worker has its own task queue, and idle workers
+   * steal from the others. The io_service is only used for I/O and timers,
+   * and is run by its own threads.
+   */
+  class EventLoopWorkStealing: public EventLoopPrivate
+  {
+  public:
+    EventLoopWorkStealing();
+    virtual bool isInEventLoopThread();
+    virtual void start(int nthreads);
+    virtual void join();
+    virtual void stop();
+    virtual qi::Future<void> asyncCall(qi::Duration delay,
+      boost::function<void ()> callback);
+    virtual void post(qi::Duration delay,
+      const boost::function<void ()>& callback);
+    virtual qi::Future<void> asyncCall(qi::SteadyClockTimePoint timepoint,
+        boost::function<void ()> callback);
+    virtual void post(qi::SteadyClockTimePoint timepoint,
+        const boost::function<void ()>& callback);
+    virtual void destroy();
+    virtual void* nativeHandle();
+    virtual void setMaxThreads(unsigned int max);
+  private:
+    typedef boost::function<void ()> Task;
+    struct Worker
+    {
+      boost::mutex     mutex;
+      std::deque<Task> tasks;
+    };
+
+    void schedule(const Task& task);
+    bool popTask(unsigned int self, Task& task);
+    void spawnWorker();
+    void onTimer(const Task& task, qi::uint32_t id, qi::Promise<void> p, const boost::system::error_code& erc);
+    void invoke(const Task& task, qi::uint32_t id, qi::Promise<void> p);
+    void _runWorker(unsigned int index);
+    void _runIo();
+    void _pingThread();
+    virtual ~EventLoopWorkStealing();
+
+    // Sized by start(), only the first _nWorkers are allocated and running.
+    std::vector<Worker*>        _workers;
+    qi::Atomic<unsigned int>    _nWorkers;
+    qi::Atomic<unsigned int>    _nextWorker;
+    // Number of queued tasks, can be transiently off by a few.
+    qi::Atomic<int>             _pending;
+    qi::Atomic<int>             _sleeping;
+    boost::mutex                _idleMutex;
+    boost::condition_variable   _idleCond;
+
+    boost::asio::io_service        _io;
+    boost::asio::io_service::work* _work; // keep io.run() alive
+    qi::Atomic<int>    _ioThreads;
+    qi::Atomic<int>    _nThreads;
+    qi::Atomic<int>    _stopping;
+    boost::recursive_mutex _mutex;
+    unsigned int _maxThreads;
+
+    qi::Atomic<uint32_t> _totalTask;
+    qi::Atomic<uint32_t> _activeTask;
+  };
 }
 
 #endif  // _SRC_EVENTLOOP_P_HPP_
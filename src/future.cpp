@@ -20,11 +20,16 @@ namespace qi {
       void* operator new(size_t);
       void operator delete(void*);
       FutureBasePrivate();
-      boost::condition_variable_any _cond;
+      ~FutureBasePrivate();
+      boost::condition_variable_any& cond();
+      // Only created when a thread has to block in wait()
+      boost::condition_variable_any* _cond;
       boost::recursive_mutex    _mutex;
       std::string               _error;
       qi::Atomic<int>           _state;
       qi::Atomic<int>           _cancelRequested;
+      // Set once the callbacks of the finished future ran
+      qi::Atomic<int>           _notified;
     };
 
     struct FutureBasePrivatePoolTag { };
@@ -41,12 +46,26 @@ namespace qi {
     }
 
     FutureBasePrivate::FutureBasePrivate()
-      : _cond(),
+      : _cond(0),
         _mutex(),
         _error()
     {
       _state = FutureState_None;
       _cancelRequested = false;
+      _notified = false;
+    }
+
+    FutureBasePrivate::~FutureBasePrivate()
+    {
+      delete _cond;
+    }
+
+    // _mutex must be held
+    boost::condition_variable_any& FutureBasePrivate::cond()
+    {
+      if (!_cond)
+        _cond = new boost::condition_variable_any();
+      return *_cond;
     }
 
     FutureBase::FutureBase()
@@ -69,28 +88,38 @@ namespace qi {
       return *p->_state != FutureState_Running;
     }
 
+    /* The future is set with the mutex held and the synchronous callbacks run
+     * before it is released: wait() only skips the mutex once they are done,
+     * so it never returns while they are still running.
+     */
     FutureState FutureBase::wait(int msecs) const {
+      if (*_p->_notified)
+        return FutureState(*_p->_state);
       boost::recursive_mutex::scoped_lock lock(_p->_mutex);
+      // msecs <= 0 : do nothing just return the state
+      if (msecs <= 0)
+        return FutureState(*_p->_state);
       if (msecs == FutureTimeout_Infinite)
-        _p->_cond.wait(lock, boost::bind(&waitFinished, _p));
-      else if (msecs > 0)
-        _p->_cond.wait_for(lock, qi::MilliSeconds(msecs),
+        _p->cond().wait(lock, boost::bind(&waitFinished, _p));
+      else
+        _p->cond().wait_for(lock, qi::MilliSeconds(msecs),
             boost::bind(&waitFinished, _p));
-      // msecs <= 0 : do nothing just return the state
       return FutureState(*_p->_state);
     }
 
     FutureState FutureBase::wait(qi::Duration duration) const {
+      if (*_p->_notified)
+        return FutureState(*_p->_state);
       boost::recursive_mutex::scoped_lock lock(_p->_mutex);
-      _p->_cond.wait_for(lock, duration, boost::bind(&waitFinished, _p));
+      _p->cond().wait_for(lock, duration, boost::bind(&waitFinished, _p));
       return FutureState(*_p->_state);
     }
 
     FutureState FutureBase::wait(qi::SteadyClock::time_point timepoint) const {
-      boost::recursive_mutex::scoped_lock lock(_p->_mutex);
-      if (*_p->_state != FutureState_Running)
+      if (*_p->_notified)
         return FutureState(*_p->_state);
-      _p->_cond.wait_until(lock, timepoint, boost::bind(&waitFinished, _p));
+      boost::recursive_mutex::scoped_lock lock(_p->_mutex);
+      _p->cond().wait_until(lock, timepoint, boost::bind(&waitFinished, _p));
       return FutureState(*_p->_state);
     }
 
@@ -113,8 +142,8 @@ namespace qi {
     void FutureBase::reportError(const std::string &message) {
       //always set by setError
       //boost::recursive_mutex::scoped_lock lock(_p->_mutex);
-      _p->_state = FutureState_FinishedWithError;
       _p->_error = message;
+      _p->_state = FutureState_FinishedWithError;
     }
 
     void FutureBase::reportStart() {
@@ -122,7 +151,10 @@ namespace qi {
     }
 
     void FutureBase::notifyFinish() {
-      _p->_cond.notify_all();
+      // called with the mutex held, like cond(), after the callbacks
+      _p->_notified = true;
+      if (_p->_cond)
+        _p->_cond->notify_all();
     }
 
     bool FutureBase::isFinished() const {
@@ -168,6 +200,7 @@ namespace qi {
       _p->_state = FutureState_Running;
       _p->_error = std::string();
       _p->_cancelRequested = false;
+      _p->_notified = false;
     }
 
     boost::recursive_mutex& FutureBase::mutex()
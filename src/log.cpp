@@ -7,6 +7,7 @@
 #include <qi/log.hpp>
 #include "log_p.hpp"
 #include <qi/os.hpp>
+#include <algorithm>
 #include <list>
 #include <map>
 #include <cstring>
@@ -19,13 +20,13 @@
 #include <boost/thread/thread.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/program_options.hpp>
 #include <boost/unordered_map.hpp>
-
-#ifndef ANDROID
-# include <boost/lockfree/queue.hpp>
-#endif
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/bind.hpp>
 
 #ifdef ANDROID
 # include <android/log.h>
@@ -39,13 +40,6 @@
 #endif
 
 
-#define RTLOG_BUFFERS (128)
-
-#define CAT_SIZE 64
-#define FILE_SIZE 128
-#define FUNC_SIZE 64
-#define LOG_SIZE 2048
-
 qiLogCategory("qi.log");
 
 namespace qi {
@@ -124,16 +118,172 @@ namespace qi {
 
   namespace log {
 
-    typedef struct sPrivateLog
+    // Asynchronous log storage of one thread: a single-producer
+    // single-consumer ring of variable-length records. Only the owning
+    // thread pushes, only the holder of Log::LogHandlerLock pops, so
+    // neither side ever takes a lock.
+    class ThreadLogBuffer
     {
-      qi::LogLevel    _logLevel;
-      char            _category[CAT_SIZE];
-      char            _file[FILE_SIZE];
-      char            _function[FUNC_SIZE];
-      int             _line;
-      char            _log[LOG_SIZE];
-      qi::os::timeval _date;
-    } privateLog;
+    public:
+      static const size_t bufferSize = 64 * 1024; // must be a power of two
+      static const size_t alignment = 8;
+
+      struct Record
+      {
+        qi::uint32_t      size;         // aligned size, 0 pads to buffer end
+        qi::uint32_t      fileSize;     // including terminating nul
+        qi::uint32_t      functionSize; // including terminating nul
+        qi::uint32_t      messageSize;
+        int               line;
+        qi::LogLevel      level;
+        detail::Category* category;
+        qi::os::timeval   date;
+        bool              deferred;     // message holds DeferredLog data
+
+        const char* file() const     { return reinterpret_cast<const char*>(this + 1); }
+        const char* function() const { return file() + fileSize; }
+        const char* message() const  { return function() + functionSize; }
+      };
+
+      // Records larger than this are not buffered
+      static const size_t maxRecordSize = bufferSize / 4;
+
+      static size_t recordSize(size_t fileSize, size_t functionSize, size_t messageSize)
+      {
+        size_t size = sizeof(Record) + fileSize + functionSize + messageSize;
+        return (size + alignment - 1) & ~(alignment - 1);
+      }
+
+      ThreadLogBuffer()
+        : consuming(false)
+        , _buffer(new char[bufferSize])
+        , _head(0)
+        , _tail(0)
+      {
+      }
+
+      ~ThreadLogBuffer()
+      {
+        delete[] _buffer;
+      }
+
+      // Producer side: false if there is not enough room right now
+      bool push(qi::LogLevel level, const qi::os::timeval& date,
+                detail::Category* category, size_t size,
+                const char* msg, size_t msgSize, bool deferred,
+                const char* file, size_t fileSize,
+                const char* fct, size_t fctSize,
+                int line)
+      {
+        size_t head = _head.load(boost::memory_order_relaxed);
+        size_t tail = _tail.load(boost::memory_order_acquire);
+        size_t offset = head & (bufferSize - 1);
+        size_t contiguous = bufferSize - offset;
+        size_t needed = size <= contiguous ? size : contiguous + size;
+        if (bufferSize - (head - tail) < needed)
+          return false;
+        if (size > contiguous)
+        {
+          // records are never split: pad to the end and restart at 0
+          reinterpret_cast<Record*>(_buffer + offset)->size = 0;
+          head += contiguous;
+          offset = 0;
+        }
+        Record* r = reinterpret_cast<Record*>(_buffer + offset);
+        r->size = static_cast<qi::uint32_t>(size);
+        r->fileSize = static_cast<qi::uint32_t>(fileSize);
+        r->functionSize = static_cast<qi::uint32_t>(fctSize);
+        r->messageSize = static_cast<qi::uint32_t>(msgSize);
+        r->line = line;
+        r->level = level;
+        r->category = category;
+        r->date = date;
+        r->deferred = deferred;
+        char* data = reinterpret_cast<char*>(r + 1);
+        memcpy(data, file, fileSize);
+        memcpy(data + fileSize, fct, fctSize);
+        memcpy(data + fileSize + fctSize, msg, msgSize);
+        _head.store(head + size, boost::memory_order_release);
+        return true;
+      }
+
+      // Consumer side: position up to which records are currently readable
+      size_t end() const
+      {
+        return _head.load(boost::memory_order_acquire);
+      }
+
+      // Consumer side: oldest record before end, or 0
+      Record* front(size_t end)
+      {
+        size_t tail = _tail.load(boost::memory_order_relaxed);
+        while (tail != end)
+        {
+          size_t offset = tail & (bufferSize - 1);
+          Record* r = reinterpret_cast<Record*>(_buffer + offset);
+          if (r->size)
+            return r;
+          tail += bufferSize - offset;
+          _tail.store(tail, boost::memory_order_release);
+        }
+        return 0;
+      }
+
+      // Consumer side: release the record returned by front()
+      void pop()
+      {
+        size_t tail = _tail.load(boost::memory_order_relaxed);
+        Record* r = reinterpret_cast<Record*>(_buffer + (tail & (bufferSize - 1)));
+        _tail.store(tail + r->size, boost::memory_order_release);
+      }
+
+      bool empty() const
+      {
+        return _head.load(boost::memory_order_acquire) == _tail.load(boost::memory_order_relaxed);
+      }
+
+      // Set while the owning thread dispatches logs: it must not wait on
+      // itself if its own buffer fills up from a handler.
+      bool consuming;
+
+    private:
+      char*               _buffer;
+      boost::atomic<size_t> _head;
+      boost::atomic<size_t> _tail;
+    };
+
+    typedef std::vector<boost::shared_ptr<ThreadLogBuffer> > ThreadLogBuffers;
+
+    // Buffers outlive both their thread, until drained, and the Log instance
+    struct ThreadLogBufferRegistry
+    {
+      boost::mutex     mutex;
+      ThreadLogBuffers buffers;
+    };
+
+    static ThreadLogBufferRegistry& threadLogBufferRegistry()
+    {
+      static ThreadLogBufferRegistry* registry;
+      QI_THREADSAFE_NEW(registry);
+      return *registry;
+    }
+
+    static ThreadLogBuffer* threadLogBuffer()
+    {
+      // Never destroyed: threads may log during static destruction
+      static boost::thread_specific_ptr<boost::shared_ptr<ThreadLogBuffer> >* tls;
+      QI_THREADSAFE_NEW(tls);
+      boost::shared_ptr<ThreadLogBuffer>* buffer = tls->get();
+      if (!buffer)
+      {
+        buffer = new boost::shared_ptr<ThreadLogBuffer>(new ThreadLogBuffer());
+        tls->reset(buffer);
+        ThreadLogBufferRegistry& registry = threadLogBufferRegistry();
+        boost::mutex::scoped_lock lock(registry.mutex);
+        registry.buffers.push_back(*buffer);
+      }
+      return buffer->get();
+    }
 
     class Log
     {
@@ -149,6 +299,17 @@ namespace qi {
 
       void run();
       void printLog();
+      // Queue a message for the log thread
+      void push(const qi::LogLevel level,
+                const qi::os::timeval& date,
+                detail::Category* category,
+                const char* log,
+                size_t logSize,
+                bool deferred,
+                const char* file,
+                const char* function,
+                int line);
+      void wakeLogThread();
       // Invoke handlers who enabled given level/category
       void dispatch(const qi::LogLevel,
                     const qi::os::timeval,
@@ -164,6 +325,15 @@ namespace qi {
                     const char* file,
                     const char* function,
                     int line);
+      // Same for queued logs: LogHandlerLock must be held, which serializes
+      // handlers without blocking loggers on the category lock.
+      void dispatchQueued(const qi::LogLevel level,
+                          const qi::os::timeval date,
+                          detail::Category& category,
+                          const char* log,
+                          const char* file,
+                          const char* function,
+                          int line);
       Handler* logHandler(SubscriberId id);
 
       void setSynchronousLog(bool sync);
@@ -173,12 +343,16 @@ namespace qi {
       boost::mutex               LogWriteLock;
       boost::mutex               LogHandlerLock;
       boost::condition_variable  LogReadyCond;
+      // Producers blocked on a full buffer wait for LogDrains to change
+      boost::condition_variable  LogDrainedCond;
+      boost::atomic<unsigned int> LogDrains;
+      boost::atomic<int>         LogBlockedWriters;
       bool                       SyncLog;
       bool                       AsyncLogInit;
-
-#ifndef ANDROID
-      boost::lockfree::queue<privateLog*>     logs;
-#endif
+      boost::atomic<bool>        LogThreadSleeping;
+      boost::atomic<int>         OverflowPolicy;
+      boost::atomic<qi::uint64_t> DroppedLogs;
+      qi::uint64_t               ReportedDrops; // protected by LogHandlerLock
 
       typedef std::map<std::string, Handler> LogHandlerMap;
       LogHandlerMap logHandlers;
@@ -233,8 +407,6 @@ namespace qi {
     static LogColor               _glColorWhen = LogColor_Auto;
 
     static Log                   *LogInstance;
-    static privateLog             LogBuffer[RTLOG_BUFFERS];
-    static volatile unsigned long LogPush = 0;
 
     namespace detail {
 
@@ -284,6 +456,123 @@ namespace qi {
             return result;
           }
       }
+
+      // Replays captured values on a stream the way boost::format takes them
+      struct StreamFeeder
+      {
+        explicit StreamFeeder(std::ostream& os)
+          : os(os)
+        {
+        }
+
+        template <typename T>
+        StreamFeeder& operator%(const T& value)
+        {
+          os << value;
+          return *this;
+        }
+
+        std::ostream& os;
+      };
+
+      template <typename T, typename Out>
+      static void feedValue(Out& out, const char*& data)
+      {
+        T value;
+        memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        out % value;
+      }
+
+      // Feed the tagged value at data to out, false if there is none
+      template <typename Out>
+      static bool feedArg(Out& out, LogArgTag tag, const char*& data)
+      {
+        switch (tag)
+        {
+        case LogArgTag_Bool:             feedValue<bool>(out, data); break;
+        case LogArgTag_Char:             feedValue<char>(out, data); break;
+        case LogArgTag_SignedChar:       feedValue<signed char>(out, data); break;
+        case LogArgTag_UnsignedChar:     feedValue<unsigned char>(out, data); break;
+        case LogArgTag_Short:            feedValue<short>(out, data); break;
+        case LogArgTag_UnsignedShort:    feedValue<unsigned short>(out, data); break;
+        case LogArgTag_Int:              feedValue<int>(out, data); break;
+        case LogArgTag_UnsignedInt:      feedValue<unsigned int>(out, data); break;
+        case LogArgTag_Long:             feedValue<long>(out, data); break;
+        case LogArgTag_UnsignedLong:     feedValue<unsigned long>(out, data); break;
+        case LogArgTag_LongLong:         feedValue<long long>(out, data); break;
+        case LogArgTag_UnsignedLongLong: feedValue<unsigned long long>(out, data); break;
+        case LogArgTag_Float:            feedValue<float>(out, data); break;
+        case LogArgTag_Double:           feedValue<double>(out, data); break;
+        case LogArgTag_LongDouble:       feedValue<long double>(out, data); break;
+        case LogArgTag_String:
+        {
+          qi::uint32_t strSize;
+          memcpy(&strSize, data, sizeof(strSize));
+          data += sizeof(strSize);
+          out % std::string(data, strSize);
+          data += strSize;
+          break;
+        }
+        default:
+          return false;
+        }
+        return true;
+      }
+
+      static std::string formatStream(const char* data, const char* end)
+      {
+        std::ostringstream ss;
+        StreamFeeder feeder(ss);
+        while (data < end)
+        {
+          LogArgTag tag = static_cast<LogArgTag>(static_cast<unsigned char>(*data++));
+          if (tag == LogArgTag_Text)
+          {
+            qi::uint32_t textSize;
+            memcpy(&textSize, data, sizeof(textSize));
+            data += sizeof(textSize);
+            ss.write(data, textSize);
+            data += textSize;
+          }
+          else if (tag == LogArgTag_State)
+          {
+            LogStreamState state;
+            memcpy(&state, data, sizeof(state));
+            data += sizeof(state);
+            ss.flags(state.flags);
+            ss.precision(state.precision);
+            ss.width(state.width);
+            ss.fill(state.fill);
+          }
+          else if (!feedArg(feeder, tag, data))
+          {
+            // corrupted data, keep what we have
+            break;
+          }
+        }
+        return ss.str();
+      }
+
+      static std::string formatDeferred(const char* data, size_t size)
+      {
+        const char* end = data + size;
+        qi::uint32_t formatSize;
+        memcpy(&formatSize, data, sizeof(formatSize));
+        data += sizeof(formatSize);
+        if (formatSize == LogStreamFormat)
+          return formatStream(data, end);
+        boost::format format = getFormat(std::string(data, formatSize));
+        data += formatSize;
+        while (data < end)
+        {
+          LogArgTag tag = static_cast<LogArgTag>(static_cast<unsigned char>(*data++));
+          // corrupted data, keep what we have
+          if (!feedArg(format, tag, data))
+            break;
+        }
+        return format.str();
+      }
     }
 
     namespace detail {
@@ -365,25 +654,203 @@ namespace qi {
       };
     } synchLog;
 
+    static inline bool isBefore(const qi::os::timeval& a, const qi::os::timeval& b)
+    {
+      return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_usec < b.tv_usec);
+    }
+
     void Log::printLog()
     {
 // Logs are handled in qi::log in Android
 #ifndef ANDROID
-      privateLog* pl = 0;
+      ThreadLogBuffer* own = threadLogBuffer();
       boost::mutex::scoped_lock lock(LogHandlerLock);
-      while (logs.pop(pl))
+      own->consuming = true;
+
+      ThreadLogBuffers buffers;
+      {
+        ThreadLogBufferRegistry& registry = threadLogBufferRegistry();
+        boost::mutex::scoped_lock l(registry.mutex);
+        // forget buffers of exited threads once drained
+        for (unsigned i = 0; i < registry.buffers.size();)
+        {
+          if (registry.buffers[i].unique() && registry.buffers[i]->empty())
+          {
+            registry.buffers[i] = registry.buffers.back();
+            registry.buffers.pop_back();
+          }
+          else
+            ++i;
+        }
+        buffers = registry.buffers;
+      }
+
+      // Only drain what is there now: handlers may log too. Records are
+      // merged by date so that threads interleave as they were logged.
+      std::vector<size_t> ends(buffers.size());
+      for (unsigned i = 0; i < buffers.size(); ++i)
+        ends[i] = buffers[i]->end();
+      while (true)
+      {
+        ThreadLogBuffer::Record* oldest = 0;
+        unsigned from = 0;
+        for (unsigned i = 0; i < buffers.size(); ++i)
+        {
+          ThreadLogBuffer::Record* r = buffers[i]->front(ends[i]);
+          if (r && (!oldest || isBefore(r->date, oldest->date)))
+          {
+            oldest = r;
+            from = i;
+          }
+        }
+        if (!oldest)
+          break;
+        if (oldest->deferred)
+        {
+          dispatchQueued(oldest->level,
+                         oldest->date,
+                         *oldest->category,
+                         detail::formatDeferred(oldest->message(), oldest->messageSize).c_str(),
+                         oldest->file(),
+                         oldest->function(),
+                         oldest->line);
+        }
+        else
+        {
+          dispatchQueued(oldest->level,
+                         oldest->date,
+                         *oldest->category,
+                         oldest->message(),
+                         oldest->file(),
+                         oldest->function(),
+                         oldest->line);
+        }
+        buffers[from]->pop();
+      }
+
+      qi::uint64_t dropped = DroppedLogs.load();
+      if (dropped != ReportedDrops)
+      {
+        std::stringstream ss;
+        ss << (dropped - ReportedDrops) << " log messages dropped, log buffers were full";
+        ReportedDrops = dropped;
+        qi::os::timeval tv;
+        qi::os::gettimeofday(&tv);
+        dispatchQueued(LogLevel_Warning, tv, *addCategory("qi.log"), ss.str().c_str(),
+                       __FILE__, __FUNCTION__, __LINE__);
+      }
+      own->consuming = false;
+
+      ++LogDrains;
+      if (LogBlockedWriters.load())
       {
-        dispatch(pl->_logLevel,
-                 pl->_date,
-                 pl->_category,
-                 pl->_log,
-                 pl->_file,
-                 pl->_function,
-                 pl->_line);
+        boost::mutex::scoped_lock lock(LogWriteLock);
+        LogDrainedCond.notify_all();
       }
 #endif
     }
 
+    void Log::wakeLogThread()
+    {
+      boost::mutex::scoped_lock lock(LogWriteLock);
+      LogReadyCond.notify_one();
+    }
+
+    void Log::push(const qi::LogLevel level,
+                   const qi::os::timeval& date,
+                   detail::Category* category,
+                   const char* log,
+                   size_t logSize,
+                   bool deferred,
+                   const char* file,
+                   const char* function,
+                   int line)
+    {
+      if (!file)
+        file = "(null)";
+      if (!function)
+        function = "(null)";
+      size_t fileSize = strlen(file) + 1;
+      size_t functionSize = strlen(function) + 1;
+      size_t size = ThreadLogBuffer::recordSize(fileSize, functionSize, logSize);
+
+      ThreadLogBuffer* buffer = threadLogBuffer();
+      if (size > ThreadLogBuffer::maxRecordSize)
+      {
+        // Too big to buffer: dispatch it whole, after what this thread
+        // already queued unless we are the ones dispatching.
+        std::string formatted;
+        if (deferred)
+        {
+          formatted = detail::formatDeferred(log, logSize);
+          log = formatted.c_str();
+        }
+        if (buffer->consuming)
+        {
+          dispatchQueued(level, date, *category, log, file, function, line);
+          return;
+        }
+        printLog();
+        boost::mutex::scoped_lock lock(LogHandlerLock);
+        dispatchQueued(level, date, *category, log, file, function, line);
+        return;
+      }
+
+      unsigned int drains = LogDrains.load();
+      while (!buffer->push(level, date, category, size,
+                           log, logSize, deferred,
+                           file, fileSize, function, functionSize,
+                           line))
+      {
+        if (OverflowPolicy.load(boost::memory_order_relaxed) == LogOverflowPolicy_Drop
+            || buffer->consuming || !LogInit)
+        {
+          ++DroppedLogs;
+          return;
+        }
+        // Sleep until the log thread drained the buffers. It checks for
+        // blocked writers after counting the drain, so one of us sees the
+        // other.
+        ++LogBlockedWriters;
+        {
+          boost::mutex::scoped_lock lock(LogWriteLock);
+          LogReadyCond.notify_one();
+          while (LogDrains.load() == drains && LogInit)
+            LogDrainedCond.wait(lock);
+        }
+        --LogBlockedWriters;
+        drains = LogDrains.load();
+      }
+      if (LogThreadSleeping.load())
+        wakeLogThread();
+    }
+
+    // Categories are never deleted: each thread remembers the ones it
+    // logged to by name, so that it does not take _mutex() to find them.
+    struct CategoryCache
+    {
+      static const unsigned int size = 64;
+      CategoryCache() { std::fill(slots, slots + size, CategoryType(0)); }
+      CategoryType slots[size];
+    };
+
+    static CategoryType findCategory(const char* name)
+    {
+      static boost::thread_specific_ptr<CategoryCache>* tls;
+      QI_THREADSAFE_NEW(tls);
+      CategoryCache* cache = tls->get();
+      if (!cache)
+      {
+        cache = new CategoryCache();
+        tls->reset(cache);
+      }
+      // Names are usually literals: their address is a good hash
+      CategoryType& slot = cache->slots[(reinterpret_cast<size_t>(name) >> 3) % CategoryCache::size];
+      if (!slot || slot->name != name)
+        slot = addCategory(name);
+      return slot;
+    }
+
     void Log::dispatch(const qi::LogLevel level,
                        const qi::os::timeval date,
                        const char*  category,
@@ -392,7 +859,7 @@ namespace qi {
                        const char* function,
                        int line)
     {
-      dispatch(level, date, *addCategory(category), log, file, function, line);
+      dispatch(level, date, *findCategory(category), log, file, function, line);
     }
 
     void Log::dispatch(const qi::LogLevel level,
@@ -417,16 +884,41 @@ namespace qi {
       }
     }
 
-    void Log::run()
+    void Log::dispatchQueued(const qi::LogLevel level,
+                             const qi::os::timeval date,
+                             detail::Category& category,
+                             const char* log,
+                             const char* file,
+                             const char* function,
+                             int line)
     {
-      while (LogInit)
+      for (LogHandlerMap::iterator it = logHandlers.begin(); it != logHandlers.end(); ++it)
       {
+        Handler& h = it->second;
+        unsigned int index = h.index;
+        bool enabled;
         {
-          boost::mutex::scoped_lock lock(LogWriteLock);
-          LogReadyCond.wait(lock);
+          boost::recursive_mutex::scoped_lock lock(_mutex());
+          enabled = category.levels.size() <= index || category.levels[index] >= level;
         }
+        if (enabled)
+          h.func(level, date, category.name.c_str(), log, file, function, line);
+      }
+    }
 
+    void Log::run()
+    {
+      while (LogInit)
+      {
         printLog();
+
+        boost::mutex::scoped_lock lock(LogWriteLock);
+        // Producers only signal a sleeping log thread; the timeout bounds
+        // the latency of a wakeup racing with going to sleep.
+        LogThreadSleeping = true;
+        if (LogInit)
+          LogReadyCond.timed_wait(lock, boost::posix_time::milliseconds(10));
+        LogThreadSleeping = false;
       }
     }
 
@@ -438,14 +930,19 @@ namespace qi {
         AsyncLogInit = true;
         LogThread = boost::thread(&Log::run, this);
       }
+      else if (SyncLog && AsyncLogInit)
+        printLog();
     };
 
     inline Log::Log() :
+      LogDrains(0),
+      LogBlockedWriters(0),
       SyncLog(true),
-      AsyncLogInit(false)
-#ifndef ANDROID
-      , logs(50)
-#endif
+      AsyncLogInit(false),
+      LogThreadSleeping(false),
+      OverflowPolicy(LogOverflowPolicy_Block),
+      DroppedLogs(0),
+      ReportedDrops(0)
     {
       LogInit = true;
     };
@@ -458,6 +955,7 @@ namespace qi {
 
       if (AsyncLogInit)
       {
+        wakeLogThread();
         LogThread.interrupt();
         LogThread.join();
 
@@ -465,17 +963,6 @@ namespace qi {
       }
     }
 
-    static void my_strcpy(char *dst, const char *src, int len) {
-      if (!src)
-        src = "(null)";
-#ifdef _MSV_VER
-      strncpy_s(dst, len, src, _TRUNCATE);
-#else
-      strncpy(dst, src, len);
-      dst[len - 1] = 0;
-#endif
-    }
-
     static void doInit() {
       //if init has already been called, we are set here. (reallocating all globals
       // will lead to racecond)
@@ -528,20 +1015,21 @@ namespace qi {
              const int             line)
     {
 #ifndef ANDROID
+      if (!LogInstance || !LogInstance->LogInit)
+        return;
+      if (!detail::isVisible(category, verb))
+        return;
+      qi::os::timeval tv;
+      qi::os::gettimeofday(&tv);
       if (LogInstance->SyncLog)
-      {
-        if (!detail::isVisible(category, verb))
-          return;
-        qi::os::timeval tv;
-        qi::os::gettimeofday(&tv);
         LogInstance->dispatch(verb, tv, *category, msg.c_str(), file, fct, line);
-      }
       else
-#endif
-      // FIXME suboptimal
+        LogInstance->push(verb, tv, category, msg.c_str(), msg.size() + 1, false, file, fct, line);
+#else
       // log is also a qi namespace, this line confuses some compilers if
       // namespace is not explicit
       ::qi::log::log(verb, category->name.c_str(), msg.c_str(), file, fct, line);
+#endif
     }
 
     void log(const qi::LogLevel    verb,
@@ -580,23 +1068,51 @@ namespace qi {
       }
       else
       {
-        int tmpRtLogPush = ++LogPush % RTLOG_BUFFERS;
-        privateLog* pl = &(LogBuffer[tmpRtLogPush]);
-
-
-
-        pl->_logLevel = verb;
-        pl->_line = line;
-        pl->_date.tv_sec = tv.tv_sec;
-        pl->_date.tv_usec = tv.tv_usec;
+        if (!msg)
+          msg = "(null)";
+        LogInstance->push(verb, tv, findCategory(category), msg, strlen(msg) + 1, false, file, fct, line);
+      }
+#endif
+    }
 
-        my_strcpy(pl->_category, category, CAT_SIZE);
-        my_strcpy(pl->_file, file, FILE_SIZE);
-        my_strcpy(pl->_function, fct, FUNC_SIZE);
-        my_strcpy(pl->_log, msg, LOG_SIZE);
-        LogInstance->logs.push(pl);
-        LogInstance->LogReadyCond.notify_one();
+    void logDeferred(const qi::LogLevel verb,
+                     CategoryType       category,
+                     const char        *args,
+                     size_t             argsSize,
+                     const char        *file,
+                     const char        *fct,
+                     const int          line)
+    {
+#ifndef ANDROID
+      if (!LogInstance || !LogInstance->LogInit)
+        return;
+      if (!LogInstance->SyncLog)
+      {
+        if (!detail::isVisible(category, verb))
+          return;
+        qi::os::timeval tv;
+        qi::os::gettimeofday(&tv);
+        LogInstance->push(verb, tv, category, args, argsSize, true, file, fct, line);
+        return;
       }
+#endif
+      ::qi::log::log(verb, category, detail::formatDeferred(args, argsSize), file, fct, line);
+    }
+
+    void logDeferred(const qi::LogLevel verb,
+                     const char        *category,
+                     const char        *args,
+                     size_t             argsSize,
+                     const char        *file,
+                     const char        *fct,
+                     const int          line)
+    {
+#ifndef ANDROID
+      if (!LogInstance || !LogInstance->LogInit)
+        return;
+      logDeferred(verb, findCategory(category), args, argsSize, file, fct, line);
+#else
+      ::qi::log::log(verb, category, detail::formatDeferred(args, argsSize).c_str(), file, fct, line);
 #endif
     }
 
@@ -718,6 +1234,26 @@ namespace qi {
       LogInstance->setSynchronousLog(sync);
     };
 
+    void setAsyncLogOverflowPolicy(LogOverflowPolicy policy)
+    {
+      if (LogInstance)
+        LogInstance->OverflowPolicy = policy;
+    }
+
+    LogOverflowPolicy asyncLogOverflowPolicy()
+    {
+      if (!LogInstance)
+        return LogOverflowPolicy_Block;
+      return static_cast<LogOverflowPolicy>(LogInstance->OverflowPolicy.load());
+    }
+
+    qi::uint64_t droppedLogs()
+    {
+      if (!LogInstance)
+        return 0;
+      return LogInstance->DroppedLogs.load();
+    }
+
     CategoryType addCategory(const std::string& name)
     {
       boost::recursive_mutex::scoped_lock lock(_mutex());
@@ -4,6 +4,7 @@
 */
 
 #include <boost/make_shared.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <qi/anyobject.hpp>
 #include <qi/type/objecttypebuilder.hpp>
@@ -14,19 +15,45 @@ qiLogCategory("qimessaging.boundobject");
 
 namespace qi {
 
-  static AnyReference forwardEvent(const GenericFunctionParameters& params,
-                                   unsigned int service, unsigned int object,
-                                   unsigned int event, Signature sig,
-                                   TransportSocketPtr client,
-                                   ObjectHost* context,
-                                   const std::string& signature)
+  /* Objects are registered on the receiving socket and dynamic values may
+   * hold some: such payloads cannot be shared between subscribers.
+   */
+  static bool isSocketIndependent(const Signature& sig)
   {
-    qiLogDebug() << "forwardEvent";
-    qi::Message msg;
+    switch (sig.type())
+    {
+    case Signature::Type_None:
+    case Signature::Type_Dynamic:
+    case Signature::Type_Object:
+    case Signature::Type_Pointer:
+    case Signature::Type_VarArgs:
+    case Signature::Type_KwArgs:
+    case Signature::Type_Unknown:
+      return false;
+    default:
+      break;
+    }
+    const SignatureVector& children = sig.children();
+    for (unsigned i = 0; i < children.size(); ++i)
+      if (!isSocketIndependent(children[i]))
+        return false;
+    return true;
+  }
+
+  // Serialize an event payload for a client, with or without MessageFlags
+  // support. streamContext may be null if the payload is socket independent.
+  static void encodeEvent(qi::Message& msg,
+                          const GenericFunctionParameters& params,
+                          const Signature& sig,
+                          const std::string& signature,
+                          bool messageFlags,
+                          ObjectHost* context,
+                          StreamContext* streamContext)
+  {
+    ++ServiceBoundObject::encodedEvents;
     // FIXME: would like to factor with serveresult.hpp convertAndSetValue()
     // but we have a setValue/setValues issue
-    bool processed = false;
-    if (!signature.empty() && client->remoteCapability("MessageFlags", false))
+    if (!signature.empty() && messageFlags)
     {
       qiLogDebug() << "forwardEvent attempting conversion to " << signature;
       try
@@ -45,10 +72,10 @@ namespace qi {
         if (valid)
         {
           qiLogDebug() << "forwardEvent success " << res[0].type()->infoString();
-          msg.setValues(res, "m", context, client.get());
+          msg.setValues(res, "m", context, streamContext);
           msg.addFlags(Message::TypeFlag_DynamicPayload);
           res.destroy();
-          processed = true;
+          return;
         }
       }
       catch(const std::exception& e)
@@ -56,30 +83,175 @@ namespace qi {
         qiLogDebug() << "forwardEvent failed to convert to forced type";
       }
     }
-    if (!processed)
+    try {
+      msg.setValues(params, sig, context, streamContext);
+    }
+    catch (const std::exception& e)
     {
-      try {
-        msg.setValues(params, sig, context, client.get());
+      qiLogVerbose() << "forwardEvent::setValues exception: " << e.what();
+      if (!messageFlags)
+        throw;
+      // Delegate conversion to the remote end.
+      msg.addFlags(Message::TypeFlag_DynamicPayload);
+      msg.setValues(params, "m", context, streamContext);
+    }
+  }
+
+  qi::Atomic<int> ServiceBoundObject::encodedEvents;
+
+  ServiceBoundObject::EventSubscriber::EventSubscriber(TransportSocketPtr socket,
+                                                       SignalLink remoteSignalLinkId,
+                                                       const std::string& signature)
+    : socket(socket)
+    , remoteSignalLinkId(remoteSignalLinkId)
+    , signature(signature)
+    , shareable(signature.empty() || isSocketIndependent(Signature(signature)))
+  {
+  }
+
+  ServiceBoundObject::EventFanOut::EventFanOut(const Signature& signature)
+    : signature(signature)
+    , shareable(isSocketIndependent(signature))
+    , localSignalLinkId(SignalBase::invalidSignalLink)
+    , subscribers(boost::make_shared<EventSubscribers>())
+  {
+  }
+
+  namespace {
+    // A payload serialized once for all subscribers with the same needs
+    struct EncodedEvent
+    {
+      EncodedEvent(const std::string& signature, bool messageFlags)
+        : signature(signature)
+        , messageFlags(messageFlags)
+        , failed(false)
+      {}
+      std::string  signature;
+      bool         messageFlags;
+      bool         failed;
+      qi::Message  msg;
+    };
+  }
+
+  AnyReference ServiceBoundObject::forwardEvent(const GenericFunctionParameters& params,
+                                                unsigned int service, unsigned int object,
+                                                unsigned int event,
+                                                boost::shared_ptr<EventFanOut> fanOut,
+                                                ObjectHost* context)
+  {
+    qiLogDebug() << "forwardEvent";
+    boost::shared_ptr<const EventSubscribers> subscribers;
+    {
+      boost::mutex::scoped_lock lock(fanOut->mutex);
+      subscribers = fanOut->subscribers;
+    }
+    std::vector<EncodedEvent> encoded;
+    for (unsigned i = 0; i < subscribers->size(); ++i)
+    {
+      const EventSubscriber& sub = (*subscribers)[i];
+      bool messageFlags = sub.socket->remoteCapability("MessageFlags", false);
+      qi::Message msg;
+      try
+      {
+        if (fanOut->shareable && sub.shareable)
+        {
+          // Serialize once per (signature, MessageFlags), share the body
+          unsigned j = 0;
+          while (j < encoded.size()
+                 && (encoded[j].messageFlags != messageFlags || encoded[j].signature != sub.signature))
+            ++j;
+          if (j == encoded.size())
+          {
+            encoded.push_back(EncodedEvent(sub.signature, messageFlags));
+            try
+            {
+              encodeEvent(encoded[j].msg, params, fanOut->signature, sub.signature,
+                          messageFlags, context, 0);
+            }
+            catch (...)
+            {
+              encoded[j].failed = true;
+              throw;
+            }
+          }
+          if (encoded[j].failed)
+            continue;
+          msg.setBuffer(encoded[j].msg.buffer());
+          msg.setFlags(encoded[j].msg.flags());
+        }
+        else
+          encodeEvent(msg, params, fanOut->signature, sub.signature,
+                      messageFlags, context, sub.socket.get());
       }
       catch (const std::exception& e)
       {
-        qiLogVerbose() << "forwardEvent::setValues exception: " << e.what();
-        if (!client->remoteCapability("MessageFlags", false))
-          throw e;
-        // Delegate conversion to the remote end.
-        msg.addFlags(Message::TypeFlag_DynamicPayload);
-        msg.setValues(params, "m", context, client.get());
+        qiLogError() << "Cannot forward event " << event << ": " << e.what();
+        continue;
       }
+      msg.setService(service);
+      msg.setFunction(event);
+      msg.setType(Message::Type_Event);
+      msg.setObject(object);
+      sub.socket->send(msg);
     }
-    msg.setService(service);
-    msg.setFunction(event);
-    msg.setType(Message::Type_Event);
-    msg.setObject(object);
-    client->send(msg);
     return AnyReference();
   }
 
 
+  namespace {
+    // Call being dispatched by the current thread
+    struct CallContext
+    {
+      CallContext()
+        : object(0)
+      {}
+      const ServiceBoundObject* object;
+      TransportSocketPtr        socket;
+    };
+
+    boost::thread_specific_ptr<CallContext>& callContext()
+    {
+      static boost::thread_specific_ptr<CallContext>* tls;
+      QI_THREADSAFE_NEW(tls);
+      return *tls;
+    }
+
+    // Set the call context for the duration of a dispatch, restores the
+    // enclosing one for nested calls
+    class CallContextScope : private boost::noncopyable
+    {
+    public:
+      CallContextScope(const ServiceBoundObject* object, TransportSocketPtr socket)
+      {
+        CallContext* ctx = callContext().get();
+        if (!ctx)
+        {
+          ctx = new CallContext();
+          callContext().reset(ctx);
+        }
+        _previous = *ctx;
+        ctx->object = object;
+        ctx->socket = socket;
+      }
+
+      ~CallContextScope()
+      {
+        *callContext().get() = _previous;
+      }
+
+    private:
+      CallContext _previous;
+    };
+  }
+
+  qi::TransportSocketPtr ServiceBoundObject::callerSocket() const
+  {
+    CallContext* ctx = callContext().get();
+    if (!ctx || ctx->object != this)
+      return TransportSocketPtr();
+    return ctx->socket;
+  }
+
   ServiceBoundObject::ServiceBoundObject(unsigned int serviceId, unsigned int objectId,
                                          qi::AnyObject object,
                                          qi::MetaCallType mct,
@@ -92,6 +264,7 @@ namespace qi {
     , _object(object)
     , _callType(mct)
     , _owner(owner)
+    , _pendingCalls(boost::make_shared<PendingCalls>())
   {
     onDestroy.setCallType(MetaCallType_Direct);
     _self = createServiceBoundObjectType(this, bindTerminate);
@@ -134,7 +307,8 @@ namespace qi {
       ob->advertiseMethod("properties",       &ServiceBoundObject::properties, MetaCallType_Auto, qi::Message::BoundObjectFunction_Properties);
       ob->advertiseMethod("registerEventWithSignature"  , &ServiceBoundObject::registerEventWithSignature, MetaCallType_Auto, qi::Message::BoundObjectFunction_RegisterEventWithSignature);
 
-      //global currentSocket: we are not multithread or async capable ob->setThreadingModel(ObjectThreadingModel_MultiThread);
+      // the caller socket is per call, and event links have their own lock
+      ob->setThreadingModel(ObjectThreadingModel_MultiThread);
     }
     AnyObject result = ob->object(self, &AnyObject::deleteGenericObjectOnly);
     return result;
@@ -142,31 +316,79 @@ namespace qi {
 
   //Bound Method
   SignalLink ServiceBoundObject::registerEvent(unsigned int objectId, unsigned int eventId, SignalLink remoteSignalLinkId) {
-    // fetch signature
-    const MetaSignal* ms = _object.metaObject().signal(eventId);
-    if (!ms)
-      throw std::runtime_error("No such signal");
-    AnyFunction mc = AnyFunction::fromDynamicFunction(boost::bind(&forwardEvent, _1, _serviceId, _objectId, eventId, ms->parametersSignature(), _currentSocket, this, ""));
-    SignalLink linkId = _object.connect(eventId, mc);
-    qiLogDebug() << "SBO rl " << remoteSignalLinkId <<" ll " << linkId;
-    _links[_currentSocket][remoteSignalLinkId] = RemoteSignalLink(linkId, eventId);
-    return linkId;
+    return addEventSubscriber(eventId, remoteSignalLinkId, "");
   }
   SignalLink ServiceBoundObject::registerEventWithSignature(unsigned int objectId, unsigned int eventId, SignalLink remoteSignalLinkId, const std::string& signature) {
-    // fetch signature
-    const MetaSignal* ms = _object.metaObject().signal(eventId);
-    if (!ms)
-      throw std::runtime_error("No such signal");
-    AnyFunction mc = AnyFunction::fromDynamicFunction(boost::bind(&forwardEvent, _1, _serviceId, _objectId, eventId, ms->parametersSignature(), _currentSocket, this, signature));
-    SignalLink linkId = _object.connect(eventId, mc);
-    qiLogDebug() << "SBO rl " << remoteSignalLinkId <<" ll " << linkId;
-    _links[_currentSocket][remoteSignalLinkId] = RemoteSignalLink(linkId, eventId);
-    return linkId;
+    return addEventSubscriber(eventId, remoteSignalLinkId, signature);
+  }
+
+  SignalLink ServiceBoundObject::addEventSubscriber(unsigned int eventId, SignalLink remoteSignalLinkId, const std::string& signature)
+  {
+    TransportSocketPtr socket = callerSocket();
+    boost::mutex::scoped_lock lock(_linksMutex);
+    // A link registered twice replaces the previous one
+    BySocketServiceSignalLinks::iterator sit = _links.find(socket);
+    if (sit != _links.end())
+    {
+      ServiceSignalLinks::iterator previous = sit->second.find(remoteSignalLinkId);
+      if (previous != sit->second.end())
+        removeEventSubscriber(socket, remoteSignalLinkId, previous->second.event);
+    }
+
+    EventFanOuts::iterator it = _fanOuts.find(eventId);
+    if (it == _fanOuts.end())
+    {
+      // fetch signature
+      const MetaSignal* ms = _object.metaObject().signal(eventId);
+      if (!ms)
+        throw std::runtime_error("No such signal");
+      boost::shared_ptr<EventFanOut> fanOut = boost::make_shared<EventFanOut>(ms->parametersSignature());
+      AnyFunction mc = AnyFunction::fromDynamicFunction(boost::bind(&ServiceBoundObject::forwardEvent, _1, _serviceId, _objectId, eventId, fanOut, this));
+      fanOut->localSignalLinkId = _object.connect(eventId, mc);
+      it = _fanOuts.insert(std::make_pair(eventId, fanOut)).first;
+    }
+    EventFanOut& fanOut = *it->second;
+    {
+      boost::mutex::scoped_lock lock(fanOut.mutex);
+      boost::shared_ptr<EventSubscribers> subscribers = boost::make_shared<EventSubscribers>(*fanOut.subscribers);
+      subscribers->push_back(EventSubscriber(socket, remoteSignalLinkId, signature));
+      fanOut.subscribers = subscribers;
+    }
+    qiLogDebug() << "SBO rl " << remoteSignalLinkId <<" ll " << fanOut.localSignalLinkId;
+    _links[socket][remoteSignalLinkId] = RemoteSignalLink(fanOut.localSignalLinkId, eventId);
+    return fanOut.localSignalLinkId;
+  }
+
+  // _linksMutex must be held
+  void ServiceBoundObject::removeEventSubscriber(TransportSocketPtr socket, SignalLink remoteSignalLinkId, unsigned int eventId)
+  {
+    EventFanOuts::iterator it = _fanOuts.find(eventId);
+    if (it == _fanOuts.end())
+      return;
+    boost::shared_ptr<EventFanOut> fanOut = it->second;
+    {
+      boost::mutex::scoped_lock lock(fanOut->mutex);
+      boost::shared_ptr<EventSubscribers> subscribers = boost::make_shared<EventSubscribers>();
+      for (unsigned i = 0; i < fanOut->subscribers->size(); ++i)
+      {
+        const EventSubscriber& sub = (*fanOut->subscribers)[i];
+        if (sub.socket != socket || sub.remoteSignalLinkId != remoteSignalLinkId)
+          subscribers->push_back(sub);
+      }
+      fanOut->subscribers = subscribers;
+      if (!subscribers->empty())
+        return;
+    }
+    // last subscriber gone
+    _fanOuts.erase(it);
+    _object.disconnect(fanOut->localSignalLinkId);
   }
 
   //Bound Method
   void ServiceBoundObject::unregisterEvent(unsigned int objectId, unsigned int QI_UNUSED(event), SignalLink remoteSignalLinkId) {
-    ServiceSignalLinks&          sl = _links[_currentSocket];
+    TransportSocketPtr           socket = callerSocket();
+    boost::mutex::scoped_lock    lock(_linksMutex);
+    ServiceSignalLinks&          sl = _links[socket];
     ServiceSignalLinks::iterator it = sl.find(remoteSignalLinkId);
 
     if (it == sl.end())
@@ -176,10 +398,11 @@ namespace qi {
       qiLogError() << ss.str();
       throw std::runtime_error(ss.str());
     }
-    _object.disconnect(it->second.localSignalLinkId);
+    unsigned int eventId = it->second.event;
     sl.erase(it);
     if (sl.empty())
-      _links.erase(_currentSocket);
+      _links.erase(socket);
+    removeEventSubscriber(socket, remoteSignalLinkId, eventId);
   }
 
 
@@ -219,6 +442,12 @@ namespace qi {
         return;
       }
 
+      if (msg.type() == qi::Message::Type_Cancel)
+      {
+        cancelCall(msg, socket);
+        return;
+      }
+
       qi::AnyObject    obj;
       unsigned int     funcId;
       //choose between special function (on BoundObject) or normal calls
@@ -297,36 +526,46 @@ namespace qi {
         value = pContent;
       }
       mfp = value.asTupleValuePtr();
-      /* Because of 'global' _currentSocket, we cannot support parallel
-    * executions at this point.
-    * Both on self, and on obj which can use currentSocket() too.
-    *
-    * So put a lock, and rely on metaCall we invoke being asynchronous for// execution
-    * This is decided by _callType, set from BoundObject ctor argument, passed by Server, which
-    * uses its internal _defaultCallType, passed to its constructor, default
-    * to queued. When Server is instanciated by ObjectHost, it uses the default
-    * value.
-    *
-    * As a consequence, users of currentSocket() must set _callType to Direct.
-    */
+      /* The caller socket is kept in a thread local call context, which
+       * is only visible to direct calls: users of currentSocket() must set
+       * _callType to Direct.
+       * _callType is set from BoundObject ctor argument, passed by Server, which
+       * uses its internal _defaultCallType, passed to its constructor, default
+       * to queued. When Server is instanciated by ObjectHost, it uses the default
+       * value.
+       */
       switch (msg.type())
       {
       case Message::Type_Call: {
-        boost::mutex::scoped_lock lock(_mutex);
-        _currentSocket = socket;
-        qi::Future<AnyReference>  fut = obj.metaCall(funcId, mfp,
-                                                         obj==_self ? MetaCallType_Direct: _callType, returnSignature.empty()?Signature(): Signature(returnSignature));
+        qi::Future<AnyReference>  fut;
+        {
+          CallContextScope scope(this, socket);
+          fut = obj.metaCall(funcId, mfp,
+                             obj==_self ? MetaCallType_Direct: _callType, returnSignature.empty()?Signature(): Signature(returnSignature));
+        }
         Signature retSig;
         const MetaMethod* mm = obj.metaObject().method(funcId);
         if (mm)
           retSig = mm->returnSignature();
-        _currentSocket.reset();
+        if (!fut.isFinished() && fut.isCancelable())
+        {
+          CallKey key(socket.get(), msg.id());
+          {
+            boost::mutex::scoped_lock lock(_pendingCalls->mutex);
+            _pendingCalls->calls[key] = fut;
+          }
+          fut.connect(boost::bind(&ServiceBoundObject::forgetCall, boost::weak_ptr<PendingCalls>(_pendingCalls), key),
+                      FutureCallbackType_Sync);
+        }
         fut.connect(boost::bind<void>(&serverResultAdapter, _1, retSig, _owner?_owner:(ObjectHost*)this, socket, msg.address(),  returnSignature.empty()?Signature(): Signature(returnSignature)));
       }
         break;
       case Message::Type_Post: {
         if (obj == _self) // we need a sync call (see comment above), post does not provide it
+        {
+          CallContextScope scope(this, socket);
           obj.metaCall(funcId, mfp, MetaCallType_Direct);
+        }
         else
           obj.metaPost(funcId, mfp);
       }
@@ -351,11 +590,52 @@ namespace qi {
     }
   }
 
+  void ServiceBoundObject::forgetCall(boost::weak_ptr<PendingCalls> wpending, CallKey key)
+  {
+    boost::shared_ptr<PendingCalls> pending = wpending.lock();
+    if (!pending)
+      return;
+    boost::mutex::scoped_lock lock(pending->mutex);
+    pending->calls.erase(key);
+  }
+
+  void ServiceBoundObject::cancelCall(const qi::Message& msg, TransportSocketPtr socket)
+  {
+    unsigned int id;
+    {
+      AnyReference value = msg.value("I", socket);
+      id = value.to<unsigned int>();
+      value.destroy();
+    }
+    qi::Future<AnyReference> fut;
+    {
+      boost::mutex::scoped_lock lock(_pendingCalls->mutex);
+      std::map<CallKey, qi::Future<AnyReference> >::iterator it =
+        _pendingCalls->calls.find(CallKey(socket.get(), id));
+      if (it == _pendingCalls->calls.end())
+      {
+        qiLogDebug() << "Cancel of unknown or finished call " << id;
+        return;
+      }
+      fut = it->second;
+    }
+    qiLogDebug() << "Canceling call " << id;
+    fut.cancel();
+  }
+
   void ServiceBoundObject::onSocketDisconnected(TransportSocketPtr client, std::string error)
   {
+    {
+      boost::mutex::scoped_lock lock(_pendingCalls->mutex);
+      std::map<CallKey, qi::Future<AnyReference> >::iterator it =
+        _pendingCalls->calls.lower_bound(CallKey(client.get(), 0));
+      while (it != _pendingCalls->calls.end() && it->first.first == client.get())
+        _pendingCalls->calls.erase(it++);
+    }
     // Disconnect event links set for this client.
     if (_onSocketDisconnectedCallback)
       _onSocketDisconnectedCallback(client, error);
+    boost::mutex::scoped_lock lock(_linksMutex);
     BySocketServiceSignalLinks::iterator it = _links.find(client);
     if (it != _links.end())
     {
@@ -363,7 +643,7 @@ namespace qi {
       {
         try
         {
-          _object.disconnect(jt->second.localSignalLinkId);
+          removeEventSubscriber(client, jt->first, jt->second.event);
         }
         catch (const std::runtime_error& e)
         {
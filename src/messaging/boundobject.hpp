@@ -68,12 +68,13 @@ namespace qi {
     void           setProperty(const AnyValue& name, AnyValue value);
     std::vector<std::string> properties();
   public:
+    /// Socket of the call this thread is dispatching on this object, if any
     inline qi::TransportSocketPtr currentSocket() const {
 #ifndef NDEBUG
       if (_callType != MetaCallType_Direct)
         qiLogWarning("qimessaging.boundobject") << " currentSocket() used but callType is not direct";
 #endif
-      return _currentSocket;
+      return callerSocket();
     }
 
     inline AnyObject object() { return _object;}
@@ -83,26 +84,75 @@ namespace qi {
     virtual void onSocketDisconnected(qi::TransportSocketPtr socket, std::string error);
 
     qi::Signal<ServiceBoundObject*> onDestroy;
+
+    /// Event payloads serialized for remote subscribers since process start
+    static qi::Atomic<int> encodedEvents;
   private:
     qi::AnyObject createServiceBoundObjectType(ServiceBoundObject *self, bool bindTerminate = false);
+    qi::TransportSocketPtr callerSocket() const;
+
+    // (socket, message id) -> running call, for Type_Cancel
+    typedef std::pair<TransportSocket*, unsigned int> CallKey;
+    struct PendingCalls
+    {
+      boost::mutex                                    mutex;
+      std::map<CallKey, qi::Future<AnyReference> >    calls;
+    };
+    static void forgetCall(boost::weak_ptr<PendingCalls> pending, CallKey key);
+    void cancelCall(const qi::Message& msg, TransportSocketPtr socket);
+
+    struct EventSubscriber
+    {
+      EventSubscriber(TransportSocketPtr socket, SignalLink remoteSignalLinkId,
+                      const std::string& signature);
+      TransportSocketPtr socket;
+      SignalLink         remoteSignalLinkId;
+      std::string        signature; // forced by registerEventWithSignature
+      bool               shareable; // payload does not depend on the socket
+    };
+    typedef std::vector<EventSubscriber> EventSubscribers;
+
+    // All remote subscribers of an event, fed by a single local connection
+    struct EventFanOut
+    {
+      explicit EventFanOut(const Signature& signature);
+      Signature                                 signature;
+      bool                                      shareable;
+      SignalLink                                localSignalLinkId;
+      boost::mutex                              mutex;
+      // replaced on change so that emitters only copy the pointer
+      boost::shared_ptr<const EventSubscribers> subscribers;
+    };
+    typedef std::map<unsigned int, boost::shared_ptr<EventFanOut> > EventFanOuts;
+
+    static AnyReference forwardEvent(const GenericFunctionParameters& params,
+                                     unsigned int service, unsigned int object,
+                                     unsigned int event,
+                                     boost::shared_ptr<EventFanOut> fanOut,
+                                     ObjectHost* context);
+    SignalLink addEventSubscriber(unsigned int eventId, SignalLink remoteSignalLinkId,
+                                  const std::string& signature);
+    void removeEventSubscriber(TransportSocketPtr socket, SignalLink remoteSignalLinkId,
+                               unsigned int eventId);
 
   private:
     // remote link id -> local link id
     typedef std::map<SignalLink, RemoteSignalLink>             ServiceSignalLinks;
     typedef std::map<qi::TransportSocketPtr, ServiceSignalLinks> BySocketServiceSignalLinks;
 
-    //Event handling (no lock needed)
+    //Event handling
+    boost::mutex                _linksMutex;
     BySocketServiceSignalLinks  _links;
+    EventFanOuts                _fanOuts;
 
   private:
-    qi::TransportSocketPtr _currentSocket;
     unsigned int           _serviceId;
     unsigned int           _objectId;
     qi::AnyObject          _object;
     qi::AnyObject          _self;
     qi::MetaCallType       _callType;
     qi::ObjectHost*        _owner;
-    boost::mutex           _mutex; // prevent parallel onMessage on self execution
+    boost::shared_ptr<PendingCalls> _pendingCalls;
     boost::function<void (TransportSocketPtr, std::string)> _onSocketDisconnectedCallback;
     friend class ::qi::ObjectHost;
     friend class ::qi::ServiceDirectory;
@@ -8,6 +8,10 @@
 #include "transportserver.hpp"
 
 #include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <qi/log.hpp>
 #include "session_p.hpp"
 
@@ -16,6 +20,58 @@ qiLogCategory("qimessaging.gateway");
 namespace qi
 {
 
+class GatewaySocket;
+typedef boost::shared_ptr<GatewaySocket> GatewaySocketPtr;
+
+/* Where the answer to a forwarded call goes */
+struct GatewayRoute
+{
+  enum Kind
+  {
+    Kind_Forward     = 0, // relay the answer to the client
+    Kind_ServiceInfo = 1, // a client resolved a service: point it to us
+    Kind_Lookup      = 2, // our own lookup of lookupServiceId
+  };
+
+  GatewayRoute()
+    : kind(Kind_Forward)
+    , lookupServiceId(0)
+  {}
+
+  Kind                           kind;
+  MessageAddress                 address; // as sent by the client
+  unsigned int                   lookupServiceId;
+  boost::weak_ptr<GatewaySocket> client;
+};
+
+/* Routing state of a socket, bound to its signals */
+class GatewaySocket
+{
+public:
+  enum Role
+  {
+    Role_Client        = 0,
+    Role_Service       = 1,
+    Role_RemoteGateway = 2,
+  };
+
+  GatewaySocket(TransportSocketPtr socket, Role role)
+    : socket(socket)
+    , role(role)
+    , ready(false)
+  {}
+
+  TransportSocketPtr socket;
+  qi::Atomic<int>    role;
+
+  /* Set when pending messages were flushed, protected by GatewayPrivate::_mutex */
+  bool               ready;
+
+  /* Calls forwarded to this service, by rewritten message id */
+  boost::mutex                                     requestsMutex;
+  boost::unordered_map<unsigned int, GatewayRoute> requests;
+};
+
 class GatewayPrivate
 {
 public:
@@ -34,103 +90,192 @@ public:
   bool connect(const Url &address);
 
 protected:
-  void handleMsgFromClient(TransportSocketPtr client, const qi::Message *msg);
-  void handleMsgFromService(TransportSocketPtr service, const qi::Message *msg);
-  void forwardClientMessage(TransportSocketPtr client, TransportSocketPtr service, const Message *msg);
+  typedef std::vector< std::pair<Message, GatewaySocketPtr> > PendingMessages;
+
+  GatewaySocketPtr addSocket(TransportSocketPtr socket, GatewaySocket::Role role);
+  void removeSocket(GatewaySocketPtr socket);
+  TransportSocketPtr relayFromService(MessagePrivate::MessageHeader &header, boost::weak_ptr<GatewaySocket> service);
+
+  void handleConnect(GatewaySocketPtr socket, const qi::Message &msg);
+  void handleMsgFromClient(GatewaySocketPtr client, const qi::Message &msg);
+  void handleMsgFromService(GatewaySocketPtr service, const qi::Message &msg);
+  void forwardClientMessage(GatewaySocketPtr client, GatewaySocketPtr service, const Message &msg);
+  void forwardServiceInfo(GatewaySocketPtr client, const GatewayRoute &route, const Message &msg);
+
+  void lookupService(unsigned int serviceId);
+  void onLookupReply(const GatewayRoute &route, const Message &msg);
+  void onServiceFound(unsigned int serviceId, const qi::UrlVector &endpoints);
+  void flushPendingMessages(unsigned int serviceId, GatewaySocketPtr service, const std::string &error);
 
   //ServerInterface
   void onTransportServerNewConnection(TransportSocketPtr socket);
 
   //SocketInterface
-  void onMessageReady(const qi::Message &msg, TransportSocketPtr socket, unsigned int id);
-  void onSocketConnected(TransportSocketPtr client);
-  void onSocketDisconnected(TransportSocketPtr socket);
+  void onMessageReady(const qi::Message &msg, GatewaySocketPtr socket);
+  void onSocketConnected(GatewaySocketPtr socket);
+  void onSocketDisconnected(GatewaySocketPtr socket, const std::string &error);
 
 public:
   Type                               _type;
   TransportServer                   *_transportServer;
-  Session                            _session;
+  Url                                _attachAddress;
+
+  /* Replies above that size are relayed by the sockets, 0 to disable */
+  size_t                             _passthroughThreshold;
 
-  /* Map from ServiceId to associated TransportSocketPtr */
-  std::map< unsigned int, qi::TransportSocketPtr > _services;
+  /* Ids of the messages sent to services */
+  qi::Atomic<int>                    _lastId;
 
-  /* Vector of all the TransportSocket of the clients */
-  std::list<TransportSocketPtr>                    _clients;
+  /* Protects the members below, never held while sending */
+  boost::mutex                       _mutex;
 
-  /* For each service, map a received Message and its TransportSocket to the rewritten id */
-  std::map< TransportSocketPtr, std::map< int, std::pair<int, TransportSocketPtr> > > _serviceToClient;
+  /* All the sockets, so that they can be closed */
+  boost::unordered_set<GatewaySocketPtr> _sockets;
 
-  /* Map of vectors of pending messages for each service */
-  std::map< unsigned int, std::vector< std::pair<const Message*, TransportSocketPtr> >  >  _pendingMessage;
+  /* Map from ServiceId to the socket of the service */
+  boost::unordered_map<unsigned int, GatewaySocketPtr> _services;
 
-  std::list<TransportSocketPtr> _remoteGateways;
+  /* Endpoints of the services resolved by clients */
+  boost::unordered_map<unsigned int, qi::UrlVector> _serviceEndpoints;
 
-  Url _attachAddress;
+  /* Messages waiting for the connection to their service */
+  boost::unordered_map<unsigned int, PendingMessages> _pendingMessages;
 };
 
+static void sendError(const GatewaySocketPtr &client, const MessageAddress &address, const std::string &error)
+{
+  if (!client)
+    return;
+  Message ans(Message::Type_Error, address);
+  ans.setError(error);
+  client->socket->send(ans);
+}
+
 GatewayPrivate::GatewayPrivate()
 : _type(Type_LocalGateway)
 , _transportServer(0)
+, _passthroughThreshold(0)
 {
 }
 
 GatewayPrivate::~GatewayPrivate()
 {
-  std::list<TransportSocketPtr>::iterator clientIt;
-  for (clientIt = _clients.begin(); clientIt != _clients.end(); ++clientIt) {
-    (*clientIt)->disconnect();
+  if (_transportServer)
+  {
+    _transportServer->newConnection.disconnectAll();
+    _transportServer->close();
   }
-  _clients.clear();
 
-  std::map< unsigned int, qi::TransportSocketPtr >::iterator servicesIt;
-  for (servicesIt = _services.begin(); servicesIt != _services.end(); ++servicesIt) {
-    servicesIt->second->disconnect();
+  boost::unordered_set<GatewaySocketPtr> sockets;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    std::swap(sockets, _sockets);
+    _services.clear();
+    _serviceEndpoints.clear();
+    _pendingMessages.clear();
   }
-  _services.clear();
-
-  std::list<TransportSocketPtr>::iterator remoteGatewaysIt;
-  for (remoteGatewaysIt = _remoteGateways.begin(); remoteGatewaysIt != _remoteGateways.end(); ++remoteGatewaysIt) {
-    (*remoteGatewaysIt)->disconnect();
+  for (boost::unordered_set<GatewaySocketPtr>::iterator it = sockets.begin(); it != sockets.end(); ++it)
+  {
+    (*it)->socket->connected.disconnectAll();
+    (*it)->socket->disconnected.disconnectAll();
+    (*it)->socket->messageReady.disconnectAll();
+    (*it)->socket->disconnect();
   }
-  _remoteGateways.clear();
 
+  delete _transportServer;
+}
+
+/*
+ * The routing state is bound to the socket callbacks: dispatching a
+ * message needs no lookup, and sockets are handled by as many threads
+ * as the event loop has.
+ */
+GatewaySocketPtr GatewayPrivate::addSocket(TransportSocketPtr socket, GatewaySocket::Role role)
+{
+  GatewaySocketPtr state = boost::make_shared<GatewaySocket>(socket, role);
+  if (role == GatewaySocket::Role_Service && _passthroughThreshold)
+    socket->setRelayHook(_passthroughThreshold,
+                         boost::bind(&GatewayPrivate::relayFromService, this, _1, boost::weak_ptr<GatewaySocket>(state)));
+  socket->connected.connect(&GatewayPrivate::onSocketConnected, this, state);
+  socket->disconnected.connect(&GatewayPrivate::onSocketDisconnected, this, state, _1);
+  socket->messageReady.connect(&GatewayPrivate::onMessageReady, this, _1, state);
+
+  boost::mutex::scoped_lock lock(_mutex);
+  _sockets.insert(state);
+  return state;
+}
+
+void GatewayPrivate::removeSocket(GatewaySocketPtr socket)
+{
+  // The callbacks hold the routing state
+  socket->socket->connected.disconnectAll();
+  socket->socket->disconnected.disconnectAll();
+  socket->socket->messageReady.disconnectAll();
+
+  boost::mutex::scoped_lock lock(_mutex);
+  _sockets.erase(socket);
+}
 
+/*
+ * Called by a service socket before reading a big payload: the reply is
+ * written to the client as it is read, only its id is rewritten.
+ */
+TransportSocketPtr GatewayPrivate::relayFromService(MessagePrivate::MessageHeader &header, boost::weak_ptr<GatewaySocket> weakService)
+{
+  if (header.type != Message::Type_Reply && header.type != Message::Type_Error)
+    return TransportSocketPtr();
+  GatewaySocketPtr service = weakService.lock();
+  if (!service)
+    return TransportSocketPtr();
 
-  for (std::map< unsigned int, std::vector< std::pair<const Message*, TransportSocketPtr> > >::iterator _pendingMessageIt = _pendingMessage.begin();
-       _pendingMessageIt != _pendingMessage.end();
-       _pendingMessageIt++)
+  GatewaySocketPtr client;
   {
-    for (std::vector< std::pair<const Message*, TransportSocketPtr> >::iterator msgTsVecIt = _pendingMessageIt->second.begin();
-         msgTsVecIt != _pendingMessageIt->second.end();
-         msgTsVecIt++)
-    {
-      delete msgTsVecIt->first;
-    }
+    boost::mutex::scoped_lock lock(service->requestsMutex);
+    boost::unordered_map<unsigned int, GatewayRoute>::iterator it = service->requests.find(header.id);
+    // Lookups and ServiceInfo replies are decoded by handleMsgFromService
+    if (it == service->requests.end() || it->second.kind != GatewayRoute::Kind_Forward)
+      return TransportSocketPtr();
+    client = it->second.client.lock();
+    if (!client)
+      return TransportSocketPtr();
+    header.id = it->second.address.messageId;
+    service->requests.erase(it);
   }
-
-  delete _transportServer;
+  return client->socket;
 }
 
 void GatewayPrivate::onTransportServerNewConnection(TransportSocketPtr socket)
 {
   if (!socket)
     return;
-  // FIXME: set callbacks on socket then call startReading()
-  _clients.push_back(socket);
+  addSocket(socket, GatewaySocket::Role_Client);
+  socket->startReading();
 }
 
-void GatewayPrivate::forwardClientMessage(TransportSocketPtr client, TransportSocketPtr service, const Message *msg)
+/*
+ * Only the header is rewritten: the payload buffer is shared with the
+ * received message and relayed without being decoded.
+ */
+void GatewayPrivate::forwardClientMessage(GatewaySocketPtr client, GatewaySocketPtr service, const Message &msg)
 {
-  // Create new message with unique ID
-  Message  msgToService(Message::Type_Reply, msg->address());
-  msgToService.setBuffer(msg->buffer());
+  Message msgToService(msg);
+  msgToService.setId(static_cast<unsigned int>(++_lastId));
 
-  // Store message to map call msg with return msg from the service
-  std::map< int, std::pair<int, TransportSocketPtr> > &reqIdMap = _serviceToClient[service];
-  reqIdMap[msgToService.id()] = std::make_pair(msg->id(), client);
+  // Posts get no answer
+  if (msg.type() == Message::Type_Call)
+  {
+    GatewayRoute route;
+    if (msg.service() == Message::Service_ServiceDirectory &&
+        msg.function() == Message::ServiceDirectoryAction_Service)
+      route.kind = GatewayRoute::Kind_ServiceInfo;
+    route.address = msg.address();
+    route.client = client;
+
+    boost::mutex::scoped_lock lock(service->requestsMutex);
+    service->requests[msgToService.id()] = route;
+  }
 
-  // Send to the service
-  service->send(msgToService);
+  service->socket->send(msgToService);
 }
 
 /*
@@ -139,226 +284,347 @@ void GatewayPrivate::forwardClientMessage(TransportSocketPtr client, TransportSo
  * C2: the destination service is unknown, we try to establish connection,
  *     and we enqueue the message, which will be sent in S2.
  */
-void GatewayPrivate::handleMsgFromClient(TransportSocketPtr client, Message const* msg)
+void GatewayPrivate::handleMsgFromClient(GatewaySocketPtr client, const Message &msg)
 {
-  // Search service
-  std::map<unsigned int, TransportSocketPtr>::iterator it = _services.find(msg->service());
-
-  /* C1 */
-  if (it != _services.end() && it->second->isConnected())
+  if (msg.type() != Message::Type_Call && msg.type() != Message::Type_Post)
   {
-    forwardClientMessage(client, it->second, msg);
+    // Cancels carry the id known by the client, and calls from services to
+    // clients are not routed.
+    qiLogVerbose() << "Dropping " << Message::typeToString(msg.type())
+                   << " from client: " << msg.address();
     return;
   }
-  /* C2 */
-  else
-  {
-    /*
-     * The service is unknown to the Gateway. We will have to query
-     * the Service Directory.
-     */
-    // store the pending message until connection to the service is established (S2)
-    _pendingMessage[msg->service()].push_back(std::make_pair(msg, client));
 
-    if (_services.find(Message::Service_ServiceDirectory) == _services.end())
+  unsigned int serviceId = msg.service();
+  GatewaySocketPtr service;
+  bool lookup = false;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    boost::unordered_map<unsigned int, GatewaySocketPtr>::iterator it = _services.find(serviceId);
+    if (it != _services.end() && it->second->ready)
     {
-      qiLogError() << "Not connected to Service Directory";
-      if (_attachAddress.isValid())
-      {
-        qiLogInfo() << "Retry to connect to Service Directory on "
-                             << _attachAddress.str();
-        TransportSocketPtr sdSocket = qi::makeTransportSocket(_attachAddress.protocol());
-        _services[qi::Message::Service_ServiceDirectory] = sdSocket;
-//        for (std::list<TransportSocketInterface*>::iterator it = _transportSocketCallbacks.begin();
-//             it != _transportSocketCallbacks.end();
-//             ++it)
-//        {
-//          sdSocket->addCallbacks(*it);
-//        }
-        sdSocket->connect(_attachAddress);
-      }
-      return;
+      service = it->second;
+    }
+    else
+    {
+      // store the pending message until connection to the service is established (S2)
+      PendingMessages &pending = _pendingMessages[serviceId];
+      pending.push_back(std::make_pair(msg, client));
+      // only the first message starts a lookup
+      lookup = pending.size() == 1 && it == _services.end();
     }
+  }
 
-    Message sdMsg;
-    unsigned int service = msg->service();
-    sdMsg.setValue(AnyReference::from(service), "I");
+  /* C1 */
+  if (service)
+    forwardClientMessage(client, service, msg);
+  /* C2 */
+  else if (lookup)
+    lookupService(serviceId);
+}
 
-    // associate the transportSoket client = 0
-    // this will allow S.1 to be handle correctly
-    sdMsg.setType(Message::Type_Call);
-    sdMsg.setService(Message::Service_ServiceDirectory);
-    sdMsg.setObject(Message::GenericObject_Main);
-    //TODO: rewrite to use ServiceDirectoryClient
-    sdMsg.setFunction(10);
+/*
+ * The service is unknown to the Gateway: look it up in the endpoints
+ * seen by clients, or ask the Service Directory.
+ */
+void GatewayPrivate::lookupService(unsigned int serviceId)
+{
+  if (serviceId == Message::Service_ServiceDirectory)
+  {
+    if (!_attachAddress.isValid())
+    {
+      flushPendingMessages(serviceId, GatewaySocketPtr(), "Not connected to Service Directory");
+      return;
+    }
+    qiLogInfo() << "Retry to connect to Service Directory on " << _attachAddress.str();
+    GatewaySocketPtr sdSocket = addSocket(qi::makeTransportSocket(_attachAddress.protocol()),
+                                          GatewaySocket::Role_Service);
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      _services[Message::Service_ServiceDirectory] = sdSocket;
+    }
+    sdSocket->socket->connect(_attachAddress).async();
+    return;
+  }
 
-    _serviceToClient[_services[Message::Service_ServiceDirectory]][sdMsg.id()] = std::make_pair(0, TransportSocketPtr());
+  qi::UrlVector endpoints;
+  GatewaySocketPtr sdSocket;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    boost::unordered_map<unsigned int, qi::UrlVector>::const_iterator itEndpoints = _serviceEndpoints.find(serviceId);
+    if (itEndpoints != _serviceEndpoints.end())
+      endpoints = itEndpoints->second;
+    boost::unordered_map<unsigned int, GatewaySocketPtr>::const_iterator itSd = _services.find(Message::Service_ServiceDirectory);
+    if (itSd != _services.end() && itSd->second->ready)
+      sdSocket = itSd->second;
+  }
 
-    _services[Message::Service_ServiceDirectory]->send(sdMsg);
+  if (!endpoints.empty())
+  {
+    onServiceFound(serviceId, endpoints);
+    return;
+  }
 
+  if (!sdSocket)
+  {
+    qiLogError() << "Not connected to Service Directory";
+    flushPendingMessages(serviceId, GatewaySocketPtr(), "Not connected to Service Directory");
     return;
   }
+
+  // ServiceDirectory.services(), the reply is handled in S.1
+  Message sdMsg;
+  sdMsg.setType(Message::Type_Call);
+  sdMsg.setService(Message::Service_ServiceDirectory);
+  sdMsg.setObject(Message::GenericObject_Main);
+  sdMsg.setFunction(Message::ServiceDirectoryAction_Services);
+  sdMsg.setId(static_cast<unsigned int>(++_lastId));
+
+  GatewayRoute route;
+  route.kind = GatewayRoute::Kind_Lookup;
+  route.lookupServiceId = serviceId;
+  {
+    boost::mutex::scoped_lock lock(sdSocket->requestsMutex);
+    sdSocket->requests[sdMsg.id()] = route;
+  }
+  sdSocket->socket->send(sdMsg);
 }
 
-// S.1/ New message from sd for us => Change endpoint (gateway), enter S.3
-// S.2/ New service connected          => forward pending msg to service, enter S.3
-// S.3/ New message from service       => forward to client, (end)
-void GatewayPrivate::handleMsgFromService(TransportSocketPtr service, const Message *msg)
+// S.1/ Lookup reply from the sd    => connect to the service, enter S.2
+// S.2/ New service connected       => forward pending msg to service, enter S.3
+// S.3/ New message from service    => forward to client, (end)
+void GatewayPrivate::handleMsgFromService(GatewaySocketPtr service, const Message &msg)
 {
-  // get the map of request => client
-  std::map< TransportSocketPtr, std::map< int, std::pair<int, TransportSocketPtr> > >::iterator it;
-  it = _serviceToClient.find(service);
-  // Must not fail
-  if (it == _serviceToClient.end())
+  if (msg.type() != Message::Type_Reply && msg.type() != Message::Type_Error)
   {
-    qiLogError();
+    qiLogVerbose() << "Dropping " << Message::typeToString(msg.type())
+                   << " from service: " << msg.address();
     return;
   }
 
-  std::map< int, std::pair<int, TransportSocketPtr> > &request = it->second;
-  std::map< int, std::pair<int, TransportSocketPtr> >::const_iterator itReq;
-  itReq = request.find(msg->id());
-  if (itReq != request.end())
+  GatewayRoute route;
   {
-    //// S.1/
-    if (msg->service() == Message::Service_ServiceDirectory &&
-        msg->function() == 10 &&
-        msg->type() == Message::Type_Reply)
+    boost::mutex::scoped_lock lock(service->requestsMutex);
+    boost::unordered_map<unsigned int, GatewayRoute>::iterator it = service->requests.find(msg.id());
+    if (it == service->requests.end())
     {
-      // Get serviceId
-      ServiceInfo    result;
-      //yes it works!
-      result = msg->value(qi::typeOf<ServiceInfo>()->signature(), qi::TransportSocketPtr()).as<ServiceInfo>();
+      qiLogVerbose() << "No route for " << msg.address();
+      return;
+    }
+    route = it->second;
+    service->requests.erase(it);
+  }
 
-      if (result.name() == "")
-      {
-        qiLogError() << "Could not find requested service";
-        Message ans(Message::Type_Error, msg->address());
-        ans.setId(itReq->second.first);
-        if (itReq->second.second)
-          itReq->second.second->send(ans);
-        return;
-      }
+  //// S.1/
+  if (route.kind == GatewayRoute::Kind_Lookup)
+  {
+    onLookupReply(route, msg);
+    return;
+  }
 
-      // save address of the new service
-      qi::UrlVector endpoints = result.endpoints();
-      // Construct reply with serviceId
-      // and gateway endpoint
-      result.setEndpoints(_transportServer->endpoints());
-      result.setMachineId(qi::os::getMachineId());
+  //// S.3/
+  GatewaySocketPtr client = route.client.lock();
+  if (!client)
+    return;
 
-      // create new message for the client
-      Message  ans(Message::Type_Reply, msg->address());
-      ans.setValue(result, typeOf<ServiceInfo>()->signature() );
+  // The ReverseGateway has no endpoint of its own: the RemoteGateway does the rewriting
+  if (route.kind == GatewayRoute::Kind_ServiceInfo &&
+      msg.type() == Message::Type_Reply && _transportServer)
+  {
+    forwardServiceInfo(client, route, msg);
+    return;
+  }
 
-      // id should be rewritten then sent to the client
-      ans.setId(itReq->second.first);
-      itReq->second.second->send(ans);
+  // id should be rewritten then sent to the client
+  Message ans(msg);
+  ans.setId(route.address.messageId);
+  client->socket->send(ans);
+}
 
-      unsigned int serviceId = result.serviceId();
+void GatewayPrivate::forwardServiceInfo(GatewaySocketPtr client, const GatewayRoute &route, const Message &msg)
+{
+  ServiceInfo result;
+  try
+  {
+    AnyReference ref = msg.value(typeOf<ServiceInfo>()->signature(), TransportSocketPtr());
+    result = ref.to<ServiceInfo>();
+    ref.destroy();
+  }
+  catch (const std::exception &e)
+  {
+    qiLogError() << "Invalid ServiceInfo from Service Directory: " << e.what();
+    sendError(client, route.address, e.what());
+    return;
+  }
 
-      // Check if the gateway is connected to the requested service
-      std::map<unsigned int, TransportSocketPtr>::const_iterator it;
-      it = _services.find(serviceId);
-      // Service connected
-      if (it != _services.end())
-        return;
+  // save address of the service, the client will call it through us
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _serviceEndpoints[result.serviceId()] = result.endpoints();
+  }
+
+  // Construct reply with the gateway endpoint
+  result.setEndpoints(_transportServer->endpoints());
+  result.setMachineId(qi::os::getMachineId());
 
-      if (_type == Type_RemoteGateway)
+  Message ans(Message::Type_Reply, route.address);
+  ans.setValue(result, typeOf<ServiceInfo>()->signature());
+  client->socket->send(ans);
+}
+
+void GatewayPrivate::onLookupReply(const GatewayRoute &route, const Message &msg)
+{
+  unsigned int serviceId = route.lookupServiceId;
+  qi::UrlVector endpoints;
+  if (msg.type() == Message::Type_Reply)
+  {
+    try
+    {
+      AnyReference ref = msg.value(typeOf<std::vector<ServiceInfo> >()->signature(), TransportSocketPtr());
+      std::vector<ServiceInfo> services = ref.to<std::vector<ServiceInfo> >();
+      ref.destroy();
+      for (unsigned int i = 0; i < services.size(); ++i)
       {
-        _services[serviceId] = _services[Message::Service_ServiceDirectory];
+        if (services[i].serviceId() == serviceId)
+        {
+          endpoints = services[i].endpoints();
+          break;
+        }
       }
-      else
-      {
-        qi::Url url(endpoints[0]);
-        // Connect to the service
-        TransportSocketPtr service = qi::makeTransportSocket(url.protocol());
-        service->connect(url);
+    }
+    catch (const std::exception &e)
+    {
+      qiLogError() << "Invalid services from Service Directory: " << e.what();
+    }
+  }
 
-        _services[serviceId] = service;
-      }
+  if (endpoints.empty())
+  {
+    qiLogError() << "Could not find requested service #" << serviceId;
+    flushPendingMessages(serviceId, GatewaySocketPtr(), "Could not find requested service");
+    return;
+  }
+  onServiceFound(serviceId, endpoints);
+}
 
-      // We will be called back when the connection is established (S2).
-    }
-    else //// S.3/
+void GatewayPrivate::onServiceFound(unsigned int serviceId, const qi::UrlVector &endpoints)
+{
+  if (_type == Type_RemoteGateway)
+  {
+    // Every service is reached through the ReverseGateway
+    GatewaySocketPtr sdSocket;
     {
-      // id should be rewritten then sent to the client
-      Message ans(Message::Type_Reply, msg->address());
-      ans.setBuffer(msg->buffer());
-      ans.setId(itReq->second.first);
-      itReq->second.second->send(ans);
+      boost::mutex::scoped_lock lock(_mutex);
+      boost::unordered_map<unsigned int, GatewaySocketPtr>::const_iterator it = _services.find(Message::Service_ServiceDirectory);
+      if (it != _services.end())
+      {
+        sdSocket = it->second;
+        _services[serviceId] = sdSocket;
+      }
     }
+    flushPendingMessages(serviceId, sdSocket, "Not connected to Service Directory");
+    return;
+  }
+
+  // Connect to the service
+  qi::Url url(endpoints[0]);
+  GatewaySocketPtr service = addSocket(qi::makeTransportSocket(url.protocol()),
+                                       GatewaySocket::Role_Service);
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    _services[serviceId] = service;
+  }
+  // We will be called back when the connection is established (S2).
+  service->socket->connect(url).async();
+}
+
+void GatewayPrivate::flushPendingMessages(unsigned int serviceId, GatewaySocketPtr service, const std::string &error)
+{
+  PendingMessages pending;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (service)
+      service->ready = true;
+    boost::unordered_map<unsigned int, PendingMessages>::iterator it = _pendingMessages.find(serviceId);
+    if (it == _pendingMessages.end())
+      return;
+    std::swap(pending, it->second);
+    _pendingMessages.erase(it);
+  }
+
+  for (PendingMessages::const_iterator it = pending.begin(); it != pending.end(); ++it)
+  {
+    if (service)
+      forwardClientMessage(it->second, service, it->first);
+    else if (it->first.type() == Message::Type_Call)
+      sendError(it->second, it->first.address(), error);
   }
 }
 
 /*
- * Called for any incoming message.
+ * A ReverseGateway connected. This is our endpoint for the Service
+ * Directory.
+ * A RemoteGateway can be connected to only one ReverseGateway.
  */
-void GatewayPrivate::onMessageReady(const qi::Message &msg, qi::TransportSocketPtr socket, unsigned int id)
+void GatewayPrivate::handleConnect(GatewaySocketPtr socket, const Message &msg)
 {
-  /*
-   * A ReverseGateway connected. This is our endpoint for the Service
-   * Directory.
-   * A RemoteGateway can be connected to only one ReverseGateway.
-   */
-  if (msg.service() == Message::Service_Server &&
-      msg.function() == Message::ServerFunction_Connect)
+  if (_type == Type_RemoteGateway && msg.type() == Message::Type_Call)
   {
-    if (_type == Type_RemoteGateway && msg.type() == Message::Type_Call)
     {
-      /*
-       * Since the ReverseGateway connected itself to the RemoteGateway,
-       * it is known as a client. We need to fix it by removing its
-       * TransportSocket fro the _clients vector.
-       */
-      std::list<TransportSocketPtr>::iterator it = std::find(_clients.begin(), _clients.end(), socket);
-      _clients.erase(it);
-
-      if (_services.find(Message::Service_ServiceDirectory) == _services.end())
-      {
-        qiLogInfo() << "Attached to ReverseGateway";
-
-        _services[Message::Service_ServiceDirectory] = socket;
-        qi::Buffer buf;
-        qi::Message ans;
-        ans.setService(qi::Message::Service_Server);
-        ans.setType(qi::Message::Type_Reply);
-        ans.setFunction(qi::Message::ServerFunction_Connect);
-        ans.setObject(qi::Message::GenericObject_Main);
-        std::string empty;
-        ans.setValue(empty, "s");
-        socket->send(ans);
-      }
-      else
+      boost::mutex::scoped_lock lock(_mutex);
+      if (_services.find(Message::Service_ServiceDirectory) != _services.end())
       {
         qiLogError() << "Already connected to Service Directory";
+        return;
       }
+      // It connected as a client, it is now a service
+      socket->role = GatewaySocket::Role_Service;
+      socket->ready = true;
+      _services[Message::Service_ServiceDirectory] = socket;
     }
-    else if (_type == Type_ReverseGateway && msg.type() == Message::Type_Reply)
-    {
-      std::string endpoint;
-      endpoint = msg.value("s", qi::TransportSocketPtr()).asString();
+    qiLogInfo() << "Attached to ReverseGateway";
+
+    qi::Message ans;
+    ans.setService(qi::Message::Service_Server);
+    ans.setType(qi::Message::Type_Reply);
+    ans.setFunction(qi::Message::ServerFunction_Connect);
+    ans.setObject(qi::Message::GenericObject_Main);
+    std::string empty;
+    ans.setValue(empty, "s");
+    socket->socket->send(ans);
+    flushPendingMessages(Message::Service_ServiceDirectory, socket, std::string());
+  }
+  else if (_type == Type_ReverseGateway && msg.type() == Message::Type_Reply)
+  {
+    std::string endpoint;
+    endpoint = msg.value("s", qi::TransportSocketPtr()).asString();
 
-      if (endpoint != "")
-      {
-        connect(endpoint);
-      }
+    if (endpoint != "")
+    {
+      connect(endpoint);
     }
+  }
+}
 
+/*
+ * Called for any incoming message, from any thread of the event loop.
+ */
+void GatewayPrivate::onMessageReady(const qi::Message &msg, GatewaySocketPtr socket)
+{
+  if (msg.service() == Message::Service_Server &&
+      msg.function() == Message::ServerFunction_Connect)
+  {
+    handleConnect(socket, msg);
     return; // nothing more to do here
   }
 
   /*
    * Routing will depend on where the package comes from.
    */
-  if (std::find(_clients.begin(), _clients.end(), socket) != _clients.end())
-  {
-    handleMsgFromClient(socket, &msg);
-  }
+  if (*socket->role == GatewaySocket::Role_Client)
+    handleMsgFromClient(socket, msg);
   else
-  {
-    handleMsgFromService(socket, &msg);
-  }
+    handleMsgFromService(socket, msg);
 }
 
 /*
@@ -367,111 +633,108 @@ void GatewayPrivate::onMessageReady(const qi::Message &msg, qi::TransportSocketP
  * the ReverseGateway has reached a RemoteGateway.
  */
 // S.2/
-void GatewayPrivate::onSocketConnected(TransportSocketPtr service)
+void GatewayPrivate::onSocketConnected(GatewaySocketPtr socket)
 {
-  for (std::map< unsigned int, TransportSocketPtr >::const_iterator it = _services.begin();
-       it != _services.end();
-       ++it)
+  if (socket->role.setIfEquals(GatewaySocket::Role_RemoteGateway, GatewaySocket::Role_Client))
   {
-    // handle pending messages
-    if (it->second == service)
-    {
-      unsigned int serviceId = it->first;
-      qiLogInfo() << "Connected to service #" << serviceId;
-      std::vector< std::pair<const qi::Message*, TransportSocketPtr> >  &pmv = _pendingMessage[serviceId];
-      std::vector< std::pair<const qi::Message*, TransportSocketPtr> > ::iterator itPending;
-
-      for (itPending = pmv.begin(); itPending != pmv.end(); ++itPending)
-      {
-        forwardClientMessage(itPending->second, service, itPending->first);
-      }
-      return;
-    }
+    // Its clients will reach the services through us
+    qi::Message msg;
+    msg.setService(qi::Message::Service_Server);
+    msg.setType(qi::Message::Type_Call);
+    msg.setFunction(qi::Message::ServerFunction_Connect);
+    msg.setObject(qi::Message::GenericObject_Main);
+    socket->socket->send(msg);
+    return;
   }
 
-  for (std::list<TransportSocketPtr>::iterator it = _remoteGateways.begin();
-       it != _remoteGateways.end();
-       ++it)
+  std::vector<unsigned int> serviceIds;
   {
-    if (*it == service)
+    boost::mutex::scoped_lock lock(_mutex);
+    for (boost::unordered_map<unsigned int, GatewaySocketPtr>::const_iterator it = _services.begin();
+         it != _services.end();
+         ++it)
     {
-      TransportSocketPtr socket = *it;
-
-      qi::Message msg;
-      msg.setService(qi::Message::Service_Server);
-      msg.setType(qi::Message::Type_Call);
-      msg.setFunction(qi::Message::ServerFunction_Connect);
-      msg.setObject(qi::Message::GenericObject_Main);
-
-      socket->send(msg);
-      _clients.push_back(socket);
-      _remoteGateways.erase(it);
-      break;
+      if (it->second == socket)
+        serviceIds.push_back(it->first);
     }
   }
 
-  if (_type != Type_ReverseGateway)
+  for (unsigned int i = 0; i < serviceIds.size(); ++i)
   {
-    qiLogError() << "Unknown service TransportSocket " << service;
+    qiLogInfo() << "Connected to service #" << serviceIds[i];
+    flushPendingMessages(serviceIds[i], socket, std::string());
   }
 }
 
-void GatewayPrivate::onSocketDisconnected(TransportSocketPtr socket)
+void GatewayPrivate::onSocketDisconnected(GatewaySocketPtr socket, const std::string &error)
 {
+  removeSocket(socket);
+
   // Was it a Service?
-  for (std::map< unsigned int, qi::TransportSocketPtr >::iterator it = _services.begin();
-       it != _services.end();
-       )
+  std::vector<unsigned int> serviceIds;
   {
-    if (it->second == socket)
+    boost::mutex::scoped_lock lock(_mutex);
+    for (boost::unordered_map<unsigned int, GatewaySocketPtr>::iterator it = _services.begin();
+         it != _services.end();
+         )
     {
-      unsigned int sid = it->first;
-      if (sid == Message::Service_ServiceDirectory)
+      if (it->second == socket)
       {
-        qiLogError() << "Connection to the Service Directory was lost!";
+        serviceIds.push_back(it->first);
+        it = _services.erase(it);
       }
       else
       {
-        qiLogInfo() << "Connection to service #" << it->first
-                             << " was lost!";
-      }
-      // Remove the service from the _services map
-      _services.erase(it++);
-
-      // Remove the corresponding message routing table
-      std::map< TransportSocketPtr, std::map< int, std::pair<int, TransportSocketPtr> > >::iterator it2 = _serviceToClient.find(socket);
-      if (it2 != _serviceToClient.end())
-      {
-        _serviceToClient.erase(it2);
-        _pendingMessage[sid].clear();
+        ++it;
       }
     }
+  }
+
+  for (unsigned int i = 0; i < serviceIds.size(); ++i)
+  {
+    if (serviceIds[i] == Message::Service_ServiceDirectory)
+      qiLogError() << "Connection to the Service Directory was lost: " << error;
     else
-    {
-      ++it;
-    }
+      qiLogInfo() << "Connection to service #" << serviceIds[i] << " was lost: " << error;
+    flushPendingMessages(serviceIds[i], GatewaySocketPtr(), "Connection to the service was lost");
   }
 
-  // Was it a Client?
-  _clients.remove(socket); // this stupid STL doesn't have list::find()
+  // Fail the calls it did not answer
+  boost::unordered_map<unsigned int, GatewayRoute> requests;
+  {
+    boost::mutex::scoped_lock lock(socket->requestsMutex);
+    std::swap(requests, socket->requests);
+  }
+  for (boost::unordered_map<unsigned int, GatewayRoute>::const_iterator it = requests.begin();
+       it != requests.end();
+       ++it)
+  {
+    if (it->second.kind == GatewayRoute::Kind_Lookup)
+      flushPendingMessages(it->second.lookupServiceId, GatewaySocketPtr(), "Connection to the Service Directory was lost");
+    else
+      sendError(it->second.client.lock(), it->second.address, "Connection to the service was lost");
+  }
 }
 
 bool GatewayPrivate::attachToServiceDirectory(const Url &address)
 {
   _attachAddress = address;
 
-  TransportSocketPtr sdSocket = qi::makeTransportSocket(address.protocol());
-  _services[qi::Message::Service_ServiceDirectory] = sdSocket;
-
-  sdSocket->connect(address);
+  GatewaySocketPtr sdSocket = addSocket(qi::makeTransportSocket(address.protocol()),
+                                        GatewaySocket::Role_Service);
+  sdSocket->socket->connect(address);
 
-  if (!sdSocket->isConnected())
+  if (!sdSocket->socket->isConnected())
   {
     qiLogError() << "Could not attach to Service Directory "
                           << address.str();
+    removeSocket(sdSocket);
     return false;
   }
 
+  boost::mutex::scoped_lock lock(_mutex);
+  sdSocket->ready = true;
+  _services[qi::Message::Service_ServiceDirectory] = sdSocket;
   return true;
 }
 
@@ -487,10 +750,9 @@ bool GatewayPrivate::connect(const qi::Url &connectURL)
 {
   qiLogInfo() << "Connecting to remote gateway: " << connectURL.str();
 
-  qi::TransportSocketPtr socket = qi::makeTransportSocket(connectURL.protocol());
-
-  socket->connect(connectURL);
-  _remoteGateways.push_back(socket);
+  GatewaySocketPtr socket = addSocket(qi::makeTransportSocket(connectURL.protocol()),
+                                      GatewaySocket::Role_RemoteGateway);
+  socket->socket->connect(connectURL);
 
   return true;
 }
@@ -517,6 +779,11 @@ bool Gateway::listen(const qi::Url &address)
   return _p->listen(address);
 }
 
+void Gateway::setPassthroughThreshold(size_t bytes)
+{
+  _p->_passthroughThreshold = bytes;
+}
+
 std::vector<qi::Url> Gateway::endpoints() const
 {
   return _p->_transportServer->endpoints();
@@ -11,6 +11,7 @@
 
 #include <qi/anyvalue.hpp>
 #include "message.hpp"
+#include "../blockpool_p.hpp"
 
 #include <qi/atomic.hpp>
 #include <qi/log.hpp>
@@ -49,6 +50,10 @@ namespace qi {
       return "Post";
     case Type_Event:
       return "Event";
+    case Type_Capability:
+      return "Capability";
+    case Type_Cancel:
+      return "Cancel";
     default:
       return "Unknown";
     }
@@ -122,7 +127,7 @@ namespace qi {
   }
 
   Message::Message()
-    : _p(boost::make_shared<MessagePrivate>())
+    : _p(boost::allocate_shared<MessagePrivate>(detail::PoolAllocator<MessagePrivate>()))
   {
 
   }
@@ -134,7 +139,7 @@ namespace qi {
   void Message::cow()
   {
     if (_p.use_count() > 1)
-      _p = boost::make_shared<MessagePrivate>(*_p.get());
+      _p = boost::allocate_shared<MessagePrivate>(detail::PoolAllocator<MessagePrivate>(), *_p.get());
   }
 
   Message& Message::operator=(const Message& msg)
@@ -145,7 +150,7 @@ namespace qi {
   }
 
   Message::Message(Type type, const MessageAddress &address)
-    : _p(new qi::MessagePrivate())
+    : _p(boost::allocate_shared<MessagePrivate>(detail::PoolAllocator<MessagePrivate>()))
   {
     setType(type);
     setAddress(address);
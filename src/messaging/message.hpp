@@ -144,6 +144,9 @@ namespace qi {
       Type_Event = 5,
       // Advertise capabilities, Server<->Client
       Type_Capability = 6,
+      // Cancel the call whose id is the payload, Client->Server (No answer:
+      // the call itself gets a Type_Error if it did not run)
+      Type_Cancel = 7,
     };
     // If flag set, payload is of type m instead of expected type
     static const unsigned int TypeFlag_DynamicPayload = 1;
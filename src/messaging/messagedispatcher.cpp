@@ -2,88 +2,161 @@
 **  Copyright (C) 2012 Aldebaran Robotics
 **  See COPYING for the license
 */
+#include <algorithm>
+#include <cstdlib>
+#include <qi/os.hpp>
+#include <boost/make_shared.hpp>
 #include "messagedispatcher.hpp"
 
 qiLogCategory("qimessaging.messagedispatcher");
 
 namespace qi {
 
-#if 0
-  //Needed for handling message Timeout
-  static int _gst()
+  // Call timeout in seconds, fractions allowed. Unset or 0: no timeout.
+  static qi::Duration callTimeout()
   {
-    static const std::string st = qi::os::getenv("QI_MESSAGE_TIMEOUT");
-    if (st != "")
-    {
-      return atoi(st.c_str());
-    }
-    else
-    {
-      // Default timeout in NAOqi 1
-      return 5 * 60;
-    }
+    std::string st = qi::os::getenv("QI_MESSAGE_TIMEOUT");
+    if (st.empty())
+      return qi::Duration(0);
+    return qi::Duration(static_cast<qi::int64_t>(strtod(st.c_str(), 0) * 1e9));
   }
 
-  static inline unsigned int getSocketTimeout()
+  const unsigned int MessageDispatcher::ALL_OBJECTS = -1;
+
+  static const qi::uint64_t SlotBusy = 1;
+
+  static inline qi::uint64_t slotState(unsigned int id)
   {
-    static int _socket_timeout = _gst();
-    return _socket_timeout;
+    return (qi::uint64_t(id) + 1) << 1;
   }
-#endif
 
-  const unsigned int MessageDispatcher::ALL_OBJECTS = -1;
+  static inline qi::uint64_t routeKey(unsigned int service, unsigned int object)
+  {
+    return (qi::uint64_t(service) << 32) | object;
+  }
+
+  static bool routeKeyLess(const std::pair<qi::uint64_t, boost::shared_ptr<MessageDispatcher::OnMessageSignal> >& r, qi::uint64_t key)
+  {
+    return r.first < key;
+  }
+
+  static boost::shared_ptr<MessageDispatcher::OnMessageSignal> findRoute(const MessageDispatcher::RouteTable& routes, qi::uint64_t key)
+  {
+    MessageDispatcher::RouteTable::const_iterator it = std::lower_bound(routes.begin(), routes.end(), key, &routeKeyLess);
+    if (it != routes.end() && it->first == key)
+      return it->second;
+    return boost::shared_ptr<MessageDispatcher::OnMessageSignal>();
+  }
 
   MessageDispatcher::MessageDispatcher()
+    : _timeout(callTimeout())
   {
+    if (_timeout > qi::Duration(0))
+    {
+      // Expire calls with a precision of a quarter of the timeout, within
+      // reasonable bounds.
+      qi::int64_t usPeriod = boost::chrono::duration_cast<qi::MicroSeconds>(_timeout).count() / 4;
+      usPeriod = std::min(std::max(usPeriod, (qi::int64_t)10000), (qi::int64_t)1000000);
+      _expireTask.setName("MessageDispatcher timeout");
+      _expireTask.setCallback(boost::bind(&MessageDispatcher::expirePendingMessages, this));
+      _expireTask.setUsPeriod(usPeriod);
+    }
+  }
+
+  MessageDispatcher::~MessageDispatcher()
+  {
+    _expireTask.stop();
   }
 
   void MessageDispatcher::dispatch(const qi::Message& msg) {
     //remove the address from the messageSent map
-    if (msg.type() == qi::Message::Type_Reply)
+    if (msg.type() == qi::Message::Type_Reply || msg.type() == qi::Message::Type_Error)
     {
-      boost::mutex::scoped_lock sl(_messageSentMutex);
-      MessageSentMap::iterator it;
-      it = _messageSent.find(msg.id());
-      if (it != _messageSent.end())
-        _messageSent.erase(it);
-      else
+      if (!removeSent(msg.id()))
         qiLogDebug() << "Message " << msg.id() <<  " is not in the messageSent map";
     }
 
     {
       boost::shared_ptr<OnMessageSignal> sig[2];
-      bool hit = false;
+      boost::shared_ptr<const RouteTable> routes = boost::atomic_load(&_routes);
+      if (routes)
       {
-        boost::recursive_mutex::scoped_lock sl(_signalMapMutex);
-        SignalMap::iterator it;
-        it = _signalMap.find(Target(msg.service(), msg.object()));
-        if (it != _signalMap.end())
-        {
-          hit = true;
-          sig[0] = it->second;
-        }
-        it = _signalMap.find(Target(msg.service(), ALL_OBJECTS));
-        if (it != _signalMap.end())
-        {
-          hit = true;
-          sig[1] = it->second;
-        }
+        sig[0] = findRoute(*routes, routeKey(msg.service(), msg.object()));
+        sig[1] = findRoute(*routes, routeKey(msg.service(), ALL_OBJECTS));
       }
       if (sig[0])
         (*sig[0])(msg);
       if (sig[1])
         (*sig[1])(msg);
-      if (!hit) // FIXME: that should probably never happen, raise log level
+      if (!sig[0] && !sig[1]) // FIXME: that should probably never happen, raise log level
         qiLogDebug() << "No listener for service " << msg.service();
     }
   }
 
+  void MessageDispatcher::updateRoutes()
+  {
+    boost::shared_ptr<RouteTable> routes = boost::make_shared<RouteTable>();
+    routes->reserve(_signalMap.size());
+    // _signalMap order is the packed key order
+    for (SignalMap::iterator it = _signalMap.begin(); it != _signalMap.end(); ++it)
+      routes->push_back(std::make_pair(routeKey(it->first.first, it->first.second), it->second));
+    boost::atomic_store(&_routes, boost::shared_ptr<const RouteTable>(routes));
+  }
+
+  bool MessageDispatcher::addSent(unsigned int id, const SentMessage& sm)
+  {
+    SentSlot& slot = _sentSlots[id % SentSlotCount];
+    qi::uint64_t expected = 0;
+    if (slot.state.compare_exchange_strong(expected, slotState(id) | SlotBusy))
+    {
+      slot.message = sm;
+      slot.state.store(slotState(id));
+      return true;
+    }
+    if ((expected & ~SlotBusy) == slotState(id))
+      return false;
+    boost::mutex::scoped_lock l(_messageSentMutex);
+    if (_messageSent.find(id) != _messageSent.end())
+      return false;
+    _messageSent[id] = sm;
+    ++_messageSentCount;
+    return true;
+  }
+
+  bool MessageDispatcher::removeSent(unsigned int id)
+  {
+    SentSlot& slot = _sentSlots[id % SentSlotCount];
+    const qi::uint64_t state = slotState(id);
+    while (true)
+    {
+      qi::uint64_t expected = state;
+      if (slot.state.compare_exchange_strong(expected, 0))
+        return true;
+      if (expected != (state | SlotBusy))
+        break;
+      // Being written by sent() or checked by the expiration task
+      boost::this_thread::yield();
+    }
+    if (!*_messageSentCount)
+      return false;
+    boost::mutex::scoped_lock l(_messageSentMutex);
+    MessageSentMap::iterator it = _messageSent.find(id);
+    if (it == _messageSent.end())
+      return false;
+    _messageSent.erase(it);
+    --_messageSentCount;
+    return true;
+  }
+
   qi::SignalLink
   MessageDispatcher::messagePendingConnect(unsigned int serviceId, unsigned int objectId, boost::function<void (const qi::Message&)> fun) {
     boost::recursive_mutex::scoped_lock sl(_signalMapMutex);
     boost::shared_ptr<OnMessageSignal> &sig = _signalMap[Target(serviceId, objectId)];
     if (!sig)
+    {
       sig.reset(new OnMessageSignal());
+      updateRoutes();
+    }
     // Ensure calls will be asynchronous
     sig->setCallType(MetaCallType_Queued);
     return sig->connect(fun);
@@ -112,7 +185,10 @@ namespace qi {
        SignalMap::iterator it;
        it = _signalMap.find(Target(serviceId, objectId));
        if (it != _signalMap.end() && !it->second->hasSubscribers())
+       {
          _signalMap.erase(it);
+         updateRoutes();
+       }
     }
     return ok;
   }
@@ -120,37 +196,99 @@ namespace qi {
   void MessageDispatcher::cleanPendingMessages()
   {
     //we are deleting the Socket and want to timeout all pending request
-    //or the cleanup timer ask us to remove pending request that timed out
-    while (true)
+    std::vector<MessageAddress> pending;
+    for (unsigned int i = 0; i < SentSlotCount; ++i)
     {
-      MessageAddress ma;
+      SentSlot& slot = _sentSlots[i];
+      while (true)
       {
-        boost::mutex::scoped_lock l(_messageSentMutex);
-        MessageSentMap::iterator it = _messageSent.begin();
-        if (it == _messageSent.end())
+        qi::uint64_t state = slot.state.load();
+        if (!state)
+          break;
+        if (!(state & SlotBusy) && slot.state.compare_exchange_strong(state, state | SlotBusy))
+        {
+          pending.push_back(slot.message.address);
+          slot.state.store(0);
           break;
-        ma = it->second;
-        _messageSent.erase(it);
+        }
+        // Being written by sent() or checked by the expiration task: it
+        // must not be missed, its caller would wait forever
+        boost::this_thread::yield();
       }
+    }
+    {
+      boost::mutex::scoped_lock l(_messageSentMutex);
+      for (MessageSentMap::iterator it = _messageSent.begin(); it != _messageSent.end(); ++it)
+        pending.push_back(it->second.address);
+      _messageSent.clear();
+      _messageSentCount = 0;
+    }
+    for (unsigned i = 0; i < pending.size(); ++i)
+    {
       //generate an error message for the caller.
-      qi::Message msg(qi::Message::Type_Error, ma);
+      qi::Message msg(qi::Message::Type_Error, pending[i]);
       msg.setError("Endpoint disconnected, message dropped.");
       dispatch(msg);
     }
   }
 
+  void MessageDispatcher::expirePendingMessages()
+  {
+    std::vector<MessageAddress> expired;
+    qi::SteadyClockTimePoint now = qi::SteadyClock::now();
+    for (unsigned int i = 0; i < SentSlotCount; ++i)
+    {
+      SentSlot& slot = _sentSlots[i];
+      qi::uint64_t state = slot.state.load();
+      if (!state || (state & SlotBusy) || !slot.state.compare_exchange_strong(state, state | SlotBusy))
+        continue;
+      if (slot.message.deadline <= now)
+      {
+        expired.push_back(slot.message.address);
+        slot.state.store(0);
+      }
+      else
+        slot.state.store(state);
+    }
+    {
+      boost::mutex::scoped_lock l(_messageSentMutex);
+      MessageSentMap::iterator it = _messageSent.begin();
+      while (it != _messageSent.end())
+      {
+        if (it->second.deadline <= now)
+        {
+          expired.push_back(it->second.address);
+          _messageSent.erase(it++);
+          --_messageSentCount;
+        }
+        else
+          ++it;
+      }
+    }
+    for (unsigned i = 0; i < expired.size(); ++i)
+    {
+      qiLogVerbose() << "Call " << expired[i] << " timed out";
+      qi::Message msg(qi::Message::Type_Error, expired[i]);
+      msg.setError("Call timed out.");
+      dispatch(msg);
+    }
+  }
+
   void MessageDispatcher::sent(const qi::Message& msg) {
     //store Call id, we can use them later to notify the client
     //if the call did not succeed. (network disconnection, message lost)
     if (msg.type() == qi::Message::Type_Call)
     {
-      boost::mutex::scoped_lock l(_messageSentMutex);
-      MessageSentMap::iterator it = _messageSent.find(msg.id());
-      if (it != _messageSent.end()) {
+      SentMessage sm;
+      sm.address = msg.address();
+      if (_timeout > qi::Duration(0))
+        sm.deadline = qi::SteadyClock::now() + _timeout;
+      if (!addSent(msg.id(), sm)) {
         qiLogInfo() << "Message ID conflict. A message with the same Id is already in flight" << msg.id();
         return;
       }
-      _messageSent[msg.id()] = msg.address();
+      if (_timeout > qi::Duration(0) && _expireTaskStarted.setIfEquals(0, 1))
+        _expireTask.start(false);
     }
     return;
   }
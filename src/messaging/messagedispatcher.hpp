@@ -9,7 +9,10 @@
 
 #include <qi/anyobject.hpp>
 #include <qi/signal.hpp>
+#include <qi/clock.hpp>
+#include <qi/periodictask.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
 #include "message.hpp"
 
 namespace qi {
@@ -21,19 +24,21 @@ namespace qi {
    * Receive message from a TransportSocket and send them on the appropriate
    * signal, based on the serviceId of the message.
    *
-   * This class generate an error message for all pending message that have timed out.
-   * at the moment it only generate message if the socket have been disconnected.
-   *
-   * TODO: handle timeout on request taking too long to complete
+   * This class generate an error message for all pending calls when the
+   * socket is disconnected, and for calls not answered within
+   * QI_MESSAGE_TIMEOUT seconds (if set, read when the dispatcher is created).
    */
   class MessageDispatcher {
   public:
     MessageDispatcher();
+    ~MessageDispatcher();
 
     //internal: called by Socket to tell the class that we sent a message
     void sent(const qi::Message& msg);
     //internal: called by Socket to tell the class a message have been receive
     void dispatch(const qi::Message& msg);
+    //internal: called by Socket for a reply it forwards instead of dispatching it
+    bool removeSent(unsigned int id);
     void cleanPendingMessages();
 
     static const unsigned int ALL_OBJECTS;
@@ -45,13 +50,45 @@ namespace qi {
     typedef Signal<const qi::Message&> OnMessageSignal;
     // use shared-ptr on signal so that we may hold it without holding the map lock
     typedef std::map<Target, boost::shared_ptr<OnMessageSignal> > SignalMap;
-    typedef std::map<unsigned int, MessageAddress>                   MessageSentMap;
+    // Read-only copy of _signalMap used by dispatch(), sorted by packed
+    // (service, object)
+    typedef std::vector<std::pair<qi::uint64_t, boost::shared_ptr<OnMessageSignal> > > RouteTable;
+    struct SentMessage
+    {
+      MessageAddress           address;
+      qi::SteadyClockTimePoint deadline;
+    };
+    typedef std::map<unsigned int, SentMessage>                      MessageSentMap;
 
     SignalMap              _signalMap;
     boost::recursive_mutex _signalMapMutex;
 
+    // Calls in flight whose slot in _sentSlots was taken
     MessageSentMap         _messageSent;
     boost::mutex           _messageSentMutex;
+
+  private:
+    // Slot of a call in flight, at index id % SentSlotCount.
+    struct SentSlot
+    {
+      SentSlot() : state(0) {}
+      // 0 if free, else (id + 1) << 1, with SlotBusy set while the message
+      // is being written or read.
+      boost::atomic<qi::uint64_t> state;
+      SentMessage                 message;
+    };
+    static const unsigned int SentSlotCount = 256;
+
+    void updateRoutes();
+    bool addSent(unsigned int id, const SentMessage& sm);
+    void expirePendingMessages();
+
+    boost::shared_ptr<const RouteTable> _routes; // use atomic_load/store
+    SentSlot               _sentSlots[SentSlotCount];
+    qi::Atomic<int>        _messageSentCount; // size of _messageSent
+    qi::Duration           _timeout; // zero if calls never time out
+    qi::PeriodicTask       _expireTask;
+    qi::Atomic<int>        _expireTaskStarted;
   };
 
 }
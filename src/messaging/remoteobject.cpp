@@ -135,6 +135,40 @@ namespace qi {
     return prom.future();
   }
 
+  static void onCallCancelRequested(boost::weak_ptr<RemoteObject> wro, unsigned int id, qi::Promise<AnyReference> promise)
+  {
+    if (boost::shared_ptr<RemoteObject> ro = wro.lock())
+      ro->cancelCall(id, promise);
+  }
+
+  void RemoteObject::cancelCall(unsigned int id, qi::Promise<AnyReference> promise)
+  {
+    {
+      boost::mutex::scoped_lock lock(_promisesMutex);
+      // Already answered, or answer being handled: too late to cancel.
+      if (!_promises.erase(id))
+        return;
+    }
+    promise.setCanceled();
+
+    TransportSocketPtr sock;
+    {
+      boost::mutex::scoped_lock lock(_socketMutex);
+      sock = _socket;
+    }
+    // Older peers would not understand the message, the call just runs to
+    // completion there and its reply gets dropped.
+    if (!sock || !sock->isConnected() || !sock->remoteCapability("RemoteCancelableCalls", false))
+      return;
+    qi::Message msg;
+    msg.setType(qi::Message::Type_Cancel);
+    msg.setService(_service);
+    msg.setObject(_object);
+    msg.setValue(id, Signature("I"));
+    qiLogDebug() << "Requesting cancel of call id:" << id;
+    sock->send(msg);
+  }
+
   //should be done in the object thread
   void RemoteObject::onMessagePending(const qi::Message &msg)
   {
@@ -204,7 +238,8 @@ namespace qi {
         _promises.erase(it);
         qiLogDebug() << "Handling promise id:" << msg.id();
       } else  {
-        qiLogError() << "no promise found for req id:" << msg.id()
+        // Normal for late answers to canceled or timed out calls
+        qiLogVerbose() << "no promise found for req id:" << msg.id()
                      << "  obj: " << msg.service() << "  func: " << msg.function() << " type: " << msg.type();
         return;
       }
@@ -288,8 +323,10 @@ namespace qi {
      - From a network callback, called asynchronously in thread pool
      So it is safe to use a sync promise.
      */
-    qi::Promise<AnyReference> out(FutureCallbackType_Sync);
     qi::Message msg;
+    qi::Promise<AnyReference> out(
+      boost::bind(&onCallCancelRequested, weakPtr(), msg.id(), _1),
+      FutureCallbackType_Sync);
    // qiLogDebug() << this << " metacall " << msg.service() << " " << msg.function() <<" " << msg.id();
     {
       boost::mutex::scoped_lock lock(_promisesMutex);
@@ -48,6 +48,8 @@ namespace qi {
     // Set fromSignal if close is invoked from disconnect signal callback
     void close(bool fromSignal = false);
     unsigned int service() const { return _service;}
+    // Cancel the pending call id, whose future is promise's.
+    void cancelCall(unsigned int id, qi::Promise<AnyReference> promise);
 
   protected:
     //TransportSocket.messagePending
@@ -92,6 +92,9 @@ namespace qi {
     if (future.hasError()) {
       ret.setType(qi::Message::Type_Error);
       ret.setError(future.error());
+    } else if (future.isCanceled()) {
+      ret.setType(qi::Message::Type_Error);
+      ret.setError("Call canceled.");
     } else {
       try {
         qi::AnyReference val = future.value();
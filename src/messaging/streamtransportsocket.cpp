@@ -0,0 +1,773 @@
+/*
+**  Copyright (C) 2012, 2013, 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include "streamtransportsocket.hpp"
+#include "../buffer_p.hpp"
+
+#include <qi/log.hpp>
+#include <qi/os.hpp>
+#include <qi/messaging/transportstats.hpp>
+
+qiLogCategory("qimessaging.transportsocket");
+
+/*
+ * Pending messages are coalesced into one gathered write, within these bounds.
+ * asio issues one writev per 64 buffers, so more would not save syscalls.
+ */
+static const size_t maxWriteBuffers = 64;
+static const size_t maxWriteBytes = 256 * 1024;
+
+/* Corking window: when a write starts on an idle socket, wait that many
+ * microseconds for more messages to batch with it.
+ */
+static qi::uint64_t corkDelay()
+{
+  static qi::uint64_t delay = qi::os::getenv("QI_TCP_CORK_US").empty()
+    ? 0 : strtol(qi::os::getenv("QI_TCP_CORK_US").c_str(), 0, 0);
+  return delay;
+}
+
+/*
+ * Buffered read: data is read by chunks of readChunkSize bytes, payloads up
+ * to maxSlicedPayload bytes keep a reference to the chunk instead of being
+ * copied, and reads of less than minReadSize bytes are avoided by moving the
+ * pending bytes to the front of a chunk first.
+ */
+static const size_t readChunkSize = 64 * 1024;
+static const size_t maxSlicedPayload = 4096;
+static const size_t minReadSize = 4096;
+
+static bool bufferedRead()
+{
+  static bool enabled = qi::os::getenv("QI_TCP_BUFFERED_READ") != "0";
+  return enabled;
+}
+
+static boost::shared_ptr<void> newChunk()
+{
+  void* p = malloc(readChunkSize);
+  if (!p)
+    throw std::bad_alloc();
+  return boost::shared_ptr<void>(p, free);
+}
+
+static boost::atomic<qi::int64_t> statMessages(0);
+static boost::atomic<qi::int64_t> statWrites(0);
+static boost::atomic<qi::int64_t> statBytes(0);
+static boost::atomic<qi::int64_t> statReadMessages(0);
+static boost::atomic<qi::int64_t> statReads(0);
+static boost::atomic<qi::int64_t> statReadBytes(0);
+
+namespace qi
+{
+  TransportWriteStats transportWriteStats()
+  {
+    TransportWriteStats s;
+    s.messages = statMessages.load(boost::memory_order_relaxed);
+    s.writes = statWrites.load(boost::memory_order_relaxed);
+    s.bytes = statBytes.load(boost::memory_order_relaxed);
+    return s;
+  }
+
+  void resetTransportWriteStats()
+  {
+    statMessages = 0;
+    statWrites = 0;
+    statBytes = 0;
+  }
+
+  TransportReadStats transportReadStats()
+  {
+    TransportReadStats s;
+    s.messages = statReadMessages.load(boost::memory_order_relaxed);
+    s.reads = statReads.load(boost::memory_order_relaxed);
+    s.bytes = statReadBytes.load(boost::memory_order_relaxed);
+    return s;
+  }
+
+  void resetTransportReadStats()
+  {
+    statReadMessages = 0;
+    statReads = 0;
+    statReadBytes = 0;
+  }
+
+  /**
+   * ###
+   * connect/disconnect promise could be called multiple times.
+   * (error could be handled twice for example)
+   * so catch the error and continue, only the first set is taken into account
+   */
+  void StreamTransportSocket::pSetError(qi::Promise<void> prom, const std::string &error)
+  {
+    try { //could have already been set.
+      prom.setError(error);
+    } catch (const qi::FutureException &fe) {
+      if (fe.state() != qi::FutureException::ExceptionState_PromiseAlreadySet)
+        throw;
+      qiLogVerbose() << "Error already set on promise.";
+    }
+  }
+
+  void StreamTransportSocket::pSetValue(qi::Promise<void> prom)
+  {
+    try { //could have already been set.
+      prom.setValue(0);
+    } catch (const qi::FutureException &fe) {
+      if (fe.state() != qi::FutureException::ExceptionState_PromiseAlreadySet)
+        throw;
+      qiLogVerbose() << "Value already set on promise.";
+    }
+  }
+
+  StreamTransportSocket::StreamTransportSocket(EventLoop* eventLoop)
+    : TransportSocket()
+    , _abort(false)
+    , _connecting(false)
+    , _msg(0)
+    , _bufferedRead(bufferedRead())
+    , _chunkBegin(0)
+    , _chunkEnd(0)
+    , _relayLeft(0)
+    , _sending(false)
+  {
+    _eventLoop = eventLoop;
+    _err = 0;
+    _status = qi::TransportSocket::Status_Disconnected;
+  }
+
+  StreamTransportSocket::~StreamTransportSocket()
+  {
+    delete _msg;
+  }
+
+  void StreamTransportSocket::startReading()
+  {
+    _continueReading();
+    advertiseCapabilities(defaultCapabilities());
+  }
+
+  void StreamTransportSocket::_continueReading()
+  {
+    qiLogDebug() << this;
+
+    boost::recursive_mutex::scoped_lock l(_closingMutex);
+
+    if (_abort)
+    {
+      error("Aborted");
+      return;
+    }
+
+    if (_bufferedRead)
+    {
+      readChunk();
+      return;
+    }
+
+    _msg = new qi::Message();
+    asyncRead(_msg->_p->getHeader(), sizeof(MessagePrivate::MessageHeader),
+      boost::bind(&StreamTransportSocket::onReadHeader, shared_from_this(), _1, _2));
+  }
+
+  bool StreamTransportSocket::checkHeader(const MessagePrivate::MessageHeader& header)
+  {
+    // check magic
+    if (header.magic != MessagePrivate::magic)
+    {
+      qiLogWarning() << "Incorrect magic from "
+        << remoteEndpoint().str()
+        << ", disconnecting"
+           " (expected " << MessagePrivate::magic
+        << ", got " << header.magic << ").";
+      error("Protocol error");
+      return false;
+    }
+
+    size_t payload = header.size;
+    if (payload)
+    {
+      static size_t maxPayload = 0;
+      static bool init = false;
+      // Not thread-safe, limited consequences
+      // worst case: first received messages will not honor limit)
+      if (!init)
+      {
+        init = true;
+        std::string l = os::getenv("QI_MAX_MESSAGE_PAYLOAD");
+        if (!l.empty())
+          maxPayload = strtol(l.c_str(), 0, 0);
+        else
+          maxPayload = 50000000; // reasonable default
+      }
+      if (maxPayload && payload > maxPayload)
+      {
+        qiLogWarning() << "Receiving message of size " << payload
+          << " above maximum configured payload " << maxPayload << ", closing link."
+             " (configure with environment variable QI_MAX_MESSAGE_PAYLOAD)";
+        error("Message too big");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void StreamTransportSocket::onReadHeader(const boost::system::error_code& erc,
+    std::size_t len)
+  {
+    if (erc)
+    {
+      error("System error: " + erc.message());
+      return;
+    }
+    statReads.fetch_add(1, boost::memory_order_relaxed);
+    statReadBytes.fetch_add(len, boost::memory_order_relaxed);
+    if (!checkHeader(_msg->_p->header))
+      return;
+
+    size_t payload = _msg->_p->header.size;
+    if (payload)
+    {
+      void* ptr = _msg->_p->buffer.reserve(payload);
+
+      boost::recursive_mutex::scoped_lock l(_closingMutex);
+
+      if (_abort)
+      {
+        error("Aborted");
+        return;
+      }
+      asyncRead(ptr, payload,
+        boost::bind(&StreamTransportSocket::onReadData, shared_from_this(), _1, _2));
+    }
+    else
+      onReadData(boost::system::error_code(), 0);
+  }
+
+  void StreamTransportSocket::onReadData(const boost::system::error_code& erc,
+    std::size_t len)
+  {
+    if (erc)
+    {
+      error("System error: " + erc.message());
+      return;
+    }
+    if (len)
+    {
+      statReads.fetch_add(1, boost::memory_order_relaxed);
+      statReadBytes.fetch_add(len, boost::memory_order_relaxed);
+    }
+    if (_relayTo)
+    {
+      statReadMessages.fetch_add(1, boost::memory_order_relaxed);
+      TransportSocketPtr to;
+      to.swap(_relayTo);
+      to->send(*_msg);
+    }
+    else if (!dispatchMessage(*_msg))
+      return;
+    delete _msg;
+    _msg = 0;
+    _continueReading();
+  }
+
+  void StreamTransportSocket::readChunk()
+  {
+    // Called with _closingMutex held. Bytes before _chunkEnd may still be
+    // referenced by received messages: only the chunk tail is written to.
+    if (!_chunk)
+      _chunk = newChunk();
+    if (_chunkBegin == _chunkEnd && _chunk.unique())
+      _chunkBegin = _chunkEnd = 0;
+    if (readChunkSize - _chunkEnd < minReadSize)
+    {
+      size_t pending = _chunkEnd - _chunkBegin;
+      unsigned char* from = static_cast<unsigned char*>(_chunk.get()) + _chunkBegin;
+      if (_chunk.unique())
+        memmove(_chunk.get(), from, pending);
+      else
+      {
+        boost::shared_ptr<void> chunk = newChunk();
+        memcpy(chunk.get(), from, pending);
+        _chunk = chunk;
+      }
+      _chunkBegin = 0;
+      _chunkEnd = pending;
+    }
+
+    asyncReadSome(static_cast<unsigned char*>(_chunk.get()) + _chunkEnd, readChunkSize - _chunkEnd,
+      boost::bind(&StreamTransportSocket::onReadChunk, shared_from_this(), _1, _2));
+  }
+
+  void StreamTransportSocket::onReadChunk(const boost::system::error_code& erc,
+    std::size_t len)
+  {
+    if (erc)
+    {
+      error("System error: " + erc.message());
+      return;
+    }
+    statReads.fetch_add(1, boost::memory_order_relaxed);
+    statReadBytes.fetch_add(len, boost::memory_order_relaxed);
+    _chunkEnd += len;
+    parseChunk();
+  }
+
+  /*
+   * Dispatch the messages in _chunk[_chunkBegin, _chunkEnd) and read more.
+   */
+  void StreamTransportSocket::parseChunk()
+  {
+    static const size_t headerSize = sizeof(MessagePrivate::MessageHeader);
+    unsigned char* base = static_cast<unsigned char*>(_chunk.get());
+    while (!_abort && _chunkEnd - _chunkBegin >= headerSize)
+    {
+      MessagePrivate::MessageHeader header;
+      memcpy(&header, base + _chunkBegin, headerSize);
+      if (!checkHeader(header))
+        return;
+      size_t payload = header.size;
+      size_t available = _chunkEnd - _chunkBegin - headerSize;
+
+      if (headerSize + payload > readChunkSize)
+      {
+        if (_relayHook && payload >= _relayThreshold && canRelay(header))
+        {
+          // The hook may rewrite the id of a reply to one of our calls
+          unsigned int id = header.id;
+          _relayTo = _relayHook(header);
+          if (_relayTo && (header.type == Message::Type_Reply || header.type == Message::Type_Error))
+            _dispatcher.removeSent(id);
+          if (relayPayload(header))
+            return;
+        }
+        // Cannot fit in a chunk: read the remaining bytes in the message
+        _msg = new qi::Message();
+        memcpy(_msg->_p->getHeader(), &header, headerSize);
+        unsigned char* ptr = static_cast<unsigned char*>(_msg->_p->buffer.reserve(payload));
+        memcpy(ptr, base + _chunkBegin + headerSize, available);
+        _chunkBegin = _chunkEnd;
+
+        boost::recursive_mutex::scoped_lock l(_closingMutex);
+        if (_abort)
+        {
+          error("Aborted");
+          return;
+        }
+        asyncRead(ptr + available, payload - available,
+          boost::bind(&StreamTransportSocket::onReadData, shared_from_this(), _1, _2));
+        return;
+      }
+      if (available < payload)
+        break;
+
+      qi::Message msg;
+      memcpy(msg._p->getHeader(), &header, headerSize);
+      unsigned char* data = base + _chunkBegin + headerSize;
+      if (payload > maxSlicedPayload)
+        msg._p->buffer.write(data, payload);
+      else if (payload)
+        BufferPrivate::borrow(msg._p->buffer, data, payload, _chunk);
+      _chunkBegin += headerSize + payload;
+      if (!dispatchMessage(msg))
+        return;
+    }
+    _continueReading();
+  }
+
+  /*
+   * Write the payload of a message that does not fit in a chunk to _relayTo
+   * as it is read. Returns false if the message must be read as usual.
+   */
+  bool StreamTransportSocket::relayPayload(const MessagePrivate::MessageHeader& header)
+  {
+    static const size_t headerSize = sizeof(MessagePrivate::MessageHeader);
+    boost::shared_ptr<StreamTransportSocket> out = boost::dynamic_pointer_cast<StreamTransportSocket>(_relayTo);
+    if (!out || out.get() == this)
+      return false;
+    _relayTo.reset();
+
+    // All the bytes after the header belong to the payload
+    size_t available = _chunkEnd - _chunkBegin - headerSize;
+    Message head;
+    memcpy(head._p->getHeader(), &header, headerSize);
+    if (available)
+      BufferPrivate::borrow(head._p->buffer,
+        static_cast<unsigned char*>(_chunk.get()) + _chunkBegin + headerSize, available, _chunk);
+    _chunkBegin = _chunkEnd;
+
+    _relayLeft = header.size - available;
+    _relayOut = out;
+    // No relay if out is closed: the payload is read and dropped
+    _relay = out->relayBegin(head, _relayLeft);
+
+    boost::recursive_mutex::scoped_lock l(_closingMutex);
+    if (_abort)
+    {
+      error("Aborted");
+      return true;
+    }
+    readRelay();
+    return true;
+  }
+
+  void StreamTransportSocket::readRelay()
+  {
+    // Called with _closingMutex held. Like readChunk, only the chunk tail is
+    // written to: the relayed pieces refer to the bytes before it.
+    if (_chunkBegin == _chunkEnd && _chunk.unique())
+      _chunkBegin = _chunkEnd = 0;
+    if (readChunkSize - _chunkEnd < minReadSize)
+    {
+      _chunk = newChunk();
+      _chunkBegin = _chunkEnd = 0;
+    }
+
+    asyncReadSome(static_cast<unsigned char*>(_chunk.get()) + _chunkEnd, readChunkSize - _chunkEnd,
+      boost::bind(&StreamTransportSocket::onReadRelay, shared_from_this(), _1, _2));
+  }
+
+  void StreamTransportSocket::onReadRelay(const boost::system::error_code& erc,
+    std::size_t len)
+  {
+    if (erc)
+    {
+      error("System error: " + erc.message());
+      return;
+    }
+    statReads.fetch_add(1, boost::memory_order_relaxed);
+    statReadBytes.fetch_add(len, boost::memory_order_relaxed);
+
+    // Bytes after the payload belong to the next messages
+    size_t size = std::min(len, _relayLeft);
+    if (_relay)
+    {
+      Message piece;
+      BufferPrivate::borrow(piece._p->buffer,
+        static_cast<unsigned char*>(_chunk.get()) + _chunkEnd, size, _chunk);
+      _relayOut->relayWrite(_relay, piece);
+    }
+    _chunkEnd += len;
+    _chunkBegin += size;
+    _relayLeft -= size;
+
+    {
+      boost::recursive_mutex::scoped_lock l(_closingMutex);
+      if (_abort)
+      {
+        error("Aborted");
+        return;
+      }
+      if (_relayLeft)
+      {
+        readRelay();
+        return;
+      }
+      statReadMessages.fetch_add(1, boost::memory_order_relaxed);
+      _relay.reset();
+      _relayOut.reset();
+    }
+    parseChunk();
+  }
+
+  bool StreamTransportSocket::dispatchMessage(qi::Message& msg)
+  {
+    if (!finishMessage(msg))
+    {
+      error("Protocol error");
+      return false;
+    }
+    statReadMessages.fetch_add(1, boost::memory_order_relaxed);
+    qiLogDebug() << this << " Recv (" << msg.type() << "):" << msg.address();
+    static int usWarnThreshold = os::getenv("QIMESSAGING_SOCKET_DISPATCH_TIME_WARN_THRESHOLD").empty()?0:strtol(os::getenv("QIMESSAGING_SOCKET_DISPATCH_TIME_WARN_THRESHOLD").c_str(),0,0);
+    qi::int64_t start = 0;
+    if (usWarnThreshold)
+      start = os::ustime(); // call might be not that cheap
+    if (msg.type() == Message::Type_Capability)
+    {
+      // This one is for us
+      AnyReference cmRef = msg.value(typeOf<CapabilityMap>()->signature(), shared_from_this());
+      CapabilityMap cm = cmRef.to<CapabilityMap>();
+      cmRef.destroy();
+      boost::mutex::scoped_lock lock(_contextMutex);
+      _remoteCapabilityMap.insert(cm.begin(), cm.end());
+    }
+    else
+    {
+      messageReady(msg);
+      _dispatcher.dispatch(msg);
+    }
+    if (usWarnThreshold)
+    {
+      qi::int64_t duration = os::ustime() - start;
+      if (duration > usWarnThreshold)
+        qiLogWarning() << "Dispatch to user took " << duration << "us";
+    }
+    return true;
+  }
+
+  void StreamTransportSocket::error(const std::string& erc)
+  {
+    qiLogVerbose() << "Socket error: " << erc;
+    boost::recursive_mutex::scoped_lock lock(_closingMutex);
+    _abort = true;
+    _status = qi::TransportSocket::Status_Disconnected;
+    disconnected(erc);
+
+    // The message being relayed will never be complete
+    if (_relay)
+      _relayOut->disconnect().async();
+
+    if (_connecting)
+    {
+      _connecting = false;
+    }
+
+    {
+      boost::mutex::scoped_lock l(_sendQueueMutex);
+      // Unconditionally try to shutdown if socket is present, it might be in connecting state.
+      closeSocket();
+    }
+  }
+
+  qi::FutureSync<void> StreamTransportSocket::disconnect()
+  {
+    if (_status == qi::TransportSocket::Status_Disconnected)
+      return qi::Future<void>(0);
+
+    return _eventLoop->async(boost::bind(&StreamTransportSocket::error,
+                                         shared_from_this(),
+                                         "Disconnection requested"));
+  }
+
+  bool StreamTransportSocket::send(const qi::Message &msg)
+  {
+    // Check that once before locking in case some idiot tries to send
+    // from a disconnect notification.
+    if (_status != qi::TransportSocket::Status_Connected)
+      return false;
+    boost::recursive_mutex::scoped_lock lockc(_closingMutex);
+
+    if (!isOpen() || _status != qi::TransportSocket::Status_Connected)
+    {
+      qiLogDebug() << this << "Send on closed socket";
+      return false;
+    }
+
+    qiLogDebug() << this << " Send (" << msg.type() << "):" << msg.address();
+    boost::mutex::scoped_lock lock(_sendQueueMutex);
+
+    _sendQueue.push_back(msg);
+    if (!_sending)
+    {
+      _sending = true;
+      if (corkDelay())
+        _eventLoop->post(boost::bind(&StreamTransportSocket::uncork, shared_from_this()), corkDelay());
+      else
+        send_();
+    }
+    return true;
+  }
+
+  /*
+   * Queue the header of a relayed message. Its payload is written with
+   * relayWrite, and nothing else is written until it is complete.
+   */
+  StreamTransportSocket::RelayPtr StreamTransportSocket::relayBegin(const Message& head, size_t left)
+  {
+    if (_status != qi::TransportSocket::Status_Connected)
+      return RelayPtr();
+    boost::recursive_mutex::scoped_lock lockc(_closingMutex);
+
+    if (!isOpen() || _status != qi::TransportSocket::Status_Connected)
+      return RelayPtr();
+
+    qiLogDebug() << this << " Relay (" << head.type() << "):" << head.address();
+    RelayPtr relay = boost::make_shared<Relay>();
+    relay->head = head;
+    relay->left = left;
+
+    boost::mutex::scoped_lock lock(_sendQueueMutex);
+    _relays.push_back(relay);
+    _sendQueue.push_back(head);
+    if (!_sending)
+    {
+      _sending = true;
+      send_();
+    }
+    return relay;
+  }
+
+  void StreamTransportSocket::relayWrite(const RelayPtr& relay, const Message& piece)
+  {
+    boost::recursive_mutex::scoped_lock lockc(_closingMutex);
+    if (!isOpen() || _status != qi::TransportSocket::Status_Connected)
+      return;
+
+    boost::mutex::scoped_lock lock(_sendQueueMutex);
+    relay->pieces.push_back(piece);
+    if (!_sending)
+    {
+      _sending = true;
+      send_();
+    }
+  }
+
+  void StreamTransportSocket::uncork()
+  {
+    boost::recursive_mutex::scoped_lock lockc(_closingMutex);
+    boost::mutex::scoped_lock lock(_sendQueueMutex);
+    send_();
+  }
+
+  /*
+   * Write as much of _sendQueue as fits the batch bounds in one gathered
+   * write. Must be called with _sendQueueMutex held and _sending set.
+   */
+  void StreamTransportSocket::send_()
+  {
+    using boost::asio::buffer;
+    std::vector<boost::asio::const_buffer> b;
+    MessageBatch batch = boost::make_shared<std::vector<Message> >();
+    size_t bytes = 0;
+    size_t messages = 0;
+    while (true)
+    {
+      if (_sendingRelay)
+      {
+        // Only the rest of the relayed payload may follow its header
+        if (_sendingRelay->pieces.empty()
+            || (!batch->empty() && (b.size() + 1 > maxWriteBuffers || bytes >= maxWriteBytes)))
+          break;
+        qi::Message piece = _sendingRelay->pieces.front();
+        _sendingRelay->pieces.pop_front();
+        batch->push_back(piece);
+        const qi::Buffer& buf = piece.buffer();
+        b.push_back(buffer(buf.data(), buf.size()));
+        bytes += buf.size();
+        _sendingRelay->left -= buf.size();
+        if (!_sendingRelay->left)
+          _sendingRelay.reset();
+        continue;
+      }
+      if (_sendQueue.empty())
+        break;
+
+      qi::Message msg = _sendQueue.front();
+      const qi::Buffer& buf = msg.buffer();
+      const std::vector<std::pair<size_t, Buffer> >& subs = buf.subBuffers();
+      bool relayHead = !_relays.empty() && _relays.front()->head._p == msg._p;
+      if (!relayHead && writesAlone(msg))
+      {
+        if (!batch->empty())
+          break; // written once the batch is
+        msg._p->complete();
+        boost::recursive_mutex::scoped_lock l(_closingMutex);
+        if (_abort)
+        {
+          qiLogWarning() << "send aborted";
+          return;
+        }
+        MessageBatch alone = boost::make_shared<std::vector<Message> >(1, msg);
+        if (writeAlone(msg, boost::bind(&StreamTransportSocket::sendCont, shared_from_this(), _1, alone)))
+        {
+          _sendQueue.pop_front();
+          statMessages.fetch_add(1, boost::memory_order_relaxed);
+          statBytes.fetch_add(sizeof(qi::MessagePrivate::MessageHeader) + buf.totalSize(), boost::memory_order_relaxed);
+          statWrites.fetch_add(1, boost::memory_order_relaxed);
+          return;
+        }
+      }
+      // A message takes at most header + 2 per subbuffer + tail buffers
+      if (!batch->empty()
+          && (b.size() + 2 * subs.size() + 2 > maxWriteBuffers || bytes >= maxWriteBytes))
+        break;
+      _sendQueue.pop_front();
+      batch->push_back(msg);
+      ++messages;
+
+      // The header of a relayed message has the size of the whole payload
+      if (relayHead)
+      {
+        if (_relays.front()->left)
+          _sendingRelay = _relays.front();
+        _relays.pop_front();
+      }
+      else
+        msg._p->complete();
+      // Send header
+      b.push_back(buffer(msg._p->getHeader(), sizeof(qi::MessagePrivate::MessageHeader)));
+      size_t sz = buf.size();
+      size_t pos = 0;
+      // Handle subbuffers
+      for (unsigned i=0; i< subs.size(); ++i)
+      {
+        // Send parent buffer between pos and start of sub
+        size_t end = subs[i].first+4;
+        if (end != pos)
+          b.push_back(buffer((const char*)buf.data() + pos, end-pos));
+        pos = end;
+        // Send subbuffer
+        b.push_back(buffer(subs[i].second.data(), subs[i].second.size()));
+      }
+      if (sz != pos)
+        b.push_back(buffer((const char*)buf.data() + pos, sz - pos));
+      bytes += sizeof(qi::MessagePrivate::MessageHeader) + buf.totalSize();
+    }
+    if (batch->empty())
+    {
+      _sending = false;
+      return;
+    }
+
+    boost::recursive_mutex::scoped_lock l(_closingMutex);
+
+    if (_abort)
+    {
+      qiLogWarning() << "send aborted";
+      return;
+    }
+
+    for (unsigned i = 0; i < batch->size(); ++i)
+      _dispatcher.sent((*batch)[i]);
+    statMessages.fetch_add(messages, boost::memory_order_relaxed);
+    statBytes.fetch_add(bytes, boost::memory_order_relaxed);
+    statWrites.fetch_add(1, boost::memory_order_relaxed);
+
+    asyncWrite(b, boost::bind(&StreamTransportSocket::sendCont, shared_from_this(), _1, batch));
+  }
+
+  /*
+   * warning: batch is given to the callback so as not to drop buffers refcount
+   */
+  void StreamTransportSocket::sendCont(const boost::system::error_code& erc, MessageBatch)
+  {
+    // The class does not wait for us to terminate, but it will set abort to true.
+    // So do not use this before checking abort.
+    if (erc || _abort)
+      return; // read-callback will also get the error, avoid dup and ignore it
+
+    boost::recursive_mutex::scoped_lock lockc(_closingMutex);
+    boost::mutex::scoped_lock lock(_sendQueueMutex);
+    send_();
+  }
+
+  void StreamTransportSocket::advertiseCapabilities(const CapabilityMap& cm)
+  {
+    Message msg;
+    msg.setType(Message::Type_Capability);
+    msg.setValue(cm, typeOf<CapabilityMap>()->signature());
+    send(msg);
+    boost::mutex::scoped_lock lock(_contextMutex);
+    _localCapabilityMap.insert(cm.begin(), cm.end());
+  }
+}
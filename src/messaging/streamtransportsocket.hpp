@@ -0,0 +1,140 @@
+#pragma once
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#ifndef _SRC_STREAMTRANSPORTSOCKET_HPP_
+#define _SRC_STREAMTRANSPORTSOCKET_HPP_
+
+# include <deque>
+# include <vector>
+# include <boost/enable_shared_from_this.hpp>
+# include <boost/function.hpp>
+# include <boost/thread/mutex.hpp>
+# include <boost/thread/recursive_mutex.hpp>
+# include <boost/asio/buffer.hpp>
+# include <boost/system/error_code.hpp>
+# include <qi/eventloop.hpp>
+# include "message.hpp"
+# include "transportsocket.hpp"
+
+namespace qi
+{
+  /** Message framing shared by the transports over a byte stream.
+   *
+   * Implements the read loop, the batched send queue and the relay of big
+   * payloads on top of a few I/O primitives provided by the protocol
+   * specific subclass, which also handles connection establishment.
+   *
+   * Unless QI_TCP_BUFFERED_READ is set to 0, incoming data is read in large
+   * chunks holding as many messages as available, and small payloads refer to
+   * the chunk instead of being copied out of it. Relayed payloads bigger than
+   * a chunk are written to the other socket chunk by chunk.
+   */
+  class StreamTransportSocket : public TransportSocket, public boost::enable_shared_from_this<StreamTransportSocket>
+  {
+  public:
+    explicit StreamTransportSocket(EventLoop* eventloop);
+    virtual ~StreamTransportSocket();
+
+    virtual qi::FutureSync<void> disconnect();
+    virtual bool send(const qi::Message &msg);
+    virtual void startReading();
+    virtual void advertiseCapabilities(const CapabilityMap& map);
+
+  protected:
+    typedef boost::function<void (const boost::system::error_code&, std::size_t)> IoHandler;
+
+    /// Read at least one and at most \p size bytes. Called with _closingMutex held.
+    virtual void asyncReadSome(void* data, size_t size, const IoHandler& handler) = 0;
+    /// Read exactly \p size bytes. Called with _closingMutex held.
+    virtual void asyncRead(void* data, size_t size, const IoHandler& handler) = 0;
+    /// Write all \p buffers. Called with _closingMutex held.
+    virtual void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, const IoHandler& handler) = 0;
+    /// Shut down and release the socket. Called with _closingMutex and _sendQueueMutex held.
+    virtual void closeSocket() = 0;
+    /// Whether the socket is still there, called with _closingMutex held.
+    virtual bool isOpen() const = 0;
+
+    /// Last step before a received message is dispatched, false on protocol error.
+    virtual bool finishMessage(qi::Message&) { return true; }
+    /// Whether the payload of the message with \p header can be relayed as it is read.
+    virtual bool canRelay(const MessagePrivate::MessageHeader&) { return true; }
+    /// Whether \p msg may need to be written on its own by writeAlone.
+    virtual bool writesAlone(const qi::Message&) { return false; }
+    /** Write \p msg alone and call \p done, or return false to batch it as
+     * usual. Called with both mutexes held, _dispatcher.sent(msg) must be
+     * called before the write starts.
+     */
+    virtual bool writeAlone(const qi::Message&, const IoHandler&) { return false; }
+
+    /// Keep \p t alive until an asynchronous operation calls \p handler.
+    template <typename T>
+    static void holding(const IoHandler& handler, const T&,
+                        const boost::system::error_code& erc, std::size_t len)
+    {
+      handler(erc, len);
+    }
+
+    static void pSetError(qi::Promise<void> prom, const std::string &error);
+    static void pSetValue(qi::Promise<void> prom);
+
+    void error(const std::string& erc);
+    void _continueReading();
+
+    bool                _abort; // used to notify send callback sendCont that we are dead
+    bool                _connecting;
+    mutable boost::recursive_mutex _closingMutex;
+    boost::mutex        _sendQueueMutex; // protects _sendQueue, _sending and closing
+
+  private:
+    void onReadHeader(const boost::system::error_code& erc, std::size_t);
+    void onReadData(const boost::system::error_code& erc, std::size_t);
+    void readChunk();
+    void onReadChunk(const boost::system::error_code& erc, std::size_t);
+    void parseChunk();
+    bool relayPayload(const MessagePrivate::MessageHeader& header);
+    void readRelay();
+    void onReadRelay(const boost::system::error_code& erc, std::size_t);
+    bool checkHeader(const MessagePrivate::MessageHeader& header);
+    bool dispatchMessage(qi::Message& msg);
+    typedef boost::shared_ptr<std::vector<Message> > MessageBatch;
+    void send_();
+    void uncork();
+    void sendCont(const boost::system::error_code& erc, MessageBatch batch);
+
+    // Payload of a message relayed from another socket, written as it is read
+    struct Relay
+    {
+      Message             head;   // header and the first payload bytes
+      std::deque<Message> pieces; // payload bytes read and not yet written
+      size_t              left;   // payload bytes not yet written
+    };
+    typedef boost::shared_ptr<Relay> RelayPtr;
+    RelayPtr relayBegin(const Message& head, size_t left);
+    void relayWrite(const RelayPtr& relay, const Message& piece);
+
+    // data to rebuild message
+    qi::Message        *_msg;
+
+    // buffered read: frames are parsed from _chunk[_chunkBegin, _chunkEnd)
+    bool                    _bufferedRead;
+    boost::shared_ptr<void> _chunk;
+    size_t                  _chunkBegin;
+    size_t                  _chunkEnd;
+
+    // relay of the message being read, see setRelayHook
+    TransportSocketPtr                        _relayTo;
+    boost::shared_ptr<StreamTransportSocket>  _relayOut;
+    RelayPtr                                  _relay;
+    size_t                                    _relayLeft;
+
+    std::deque<Message> _sendQueue;
+    bool                _sending;
+    std::deque<RelayPtr> _relays;      // relays whose head is in _sendQueue
+    RelayPtr            _sendingRelay; // relay being written, blocks _sendQueue
+  };
+}
+
+#endif  // _SRC_STREAMTRANSPORTSOCKET_HPP_
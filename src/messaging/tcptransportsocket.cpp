@@ -18,8 +18,9 @@
 #include <linux/in.h> // for  IPPROTO_TCP
 #endif
 
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "tcptransportsocket.hpp"
 
@@ -28,51 +29,16 @@
 
 qiLogCategory("qimessaging.transportsocket");
 
-/**
- * ###
- * connect/disconnect promise could be called multiple times.
- * (error could be handled twice for example)
- * so catch the error and continue, only the first set is taken into account
- */
-
-static void pSetError(qi::Promise<void> prom, const std::string &error) {
-  try { //could have already been set.
-    prom.setError(error);
-  } catch (const qi::FutureException &fe) {
-    if (fe.state() != qi::FutureException::ExceptionState_PromiseAlreadySet)
-      throw;
-    qiLogVerbose() << "Error already set on promise.";
-  }
-}
-
-static void pSetValue(qi::Promise<void> prom) {
-  try { //could have already been set.
-    prom.setValue(0);
-  } catch (const qi::FutureException &fe) {
-    if (fe.state() != qi::FutureException::ExceptionState_PromiseAlreadySet)
-      throw;
-    qiLogVerbose() << "Value already set on promise.";
-  }
-}
-
 namespace qi
 {
   TcpTransportSocket::TcpTransportSocket(EventLoop* eventLoop, bool ssl, void* s)
-    : TransportSocket()
+    : StreamTransportSocket(eventLoop)
     , _ssl(ssl)
     , _sslHandshake(false)
 #ifdef WITH_SSL
     , _sslContext(boost::asio::ssl::context::sslv23)
 #endif
-    , _abort(false)
-    , _msg(0)
-    , _connecting(false)
-    , _sending(false)
   {
-    _eventLoop = eventLoop;
-    _err = 0;
-    _status = qi::TransportSocket::Status_Disconnected;
-
     if (s != 0)
     {
 #ifdef WITH_SSL
@@ -86,215 +52,114 @@ namespace qi
     }
   }
 
-
-
   TcpTransportSocket::~TcpTransportSocket()
   {
     qiLogDebug() << this;
     error("Destroying TcpTransportSocket");
-    delete _msg;
     qiLogVerbose() << "deleted " << this;
   }
 
-  void TcpTransportSocket::startReading()
+  boost::shared_ptr<TcpTransportSocket> TcpTransportSocket::self()
   {
-    _continueReading();
-    advertiseCapabilities(defaultCapabilities());
+    return boost::static_pointer_cast<TcpTransportSocket>(shared_from_this());
   }
 
-  void TcpTransportSocket::_continueReading()
+  void TcpTransportSocket::startReading()
   {
-    qiLogDebug() << this;
-
-    _msg = new qi::Message();
-    boost::recursive_mutex::scoped_lock l(_closingMutex);
-
-    if (_abort)
+#ifdef WITH_SSL
+    if (_ssl && !_sslHandshake)
     {
-      error("Aborted");
+      boost::recursive_mutex::scoped_lock l(_closingMutex);
+      if (_abort)
+      {
+        error("Aborted");
+        return;
+      }
+      _socket->async_handshake(boost::asio::ssl::stream_base::server,
+        boost::bind(&TcpTransportSocket::handshake, self(), _1, _socket, qi::Promise<void>()));
       return;
     }
+#endif
+    StreamTransportSocket::startReading();
+  }
 
+  void TcpTransportSocket::asyncReadSome(void* data, size_t size, const IoHandler& handler)
+  {
+    boost::asio::mutable_buffers_1 buf = boost::asio::buffer(data, size);
 #ifdef WITH_SSL
     if (_ssl)
     {
-      if (!_sslHandshake)
-      {
-        _socket->async_handshake(boost::asio::ssl::stream_base::server,
-          boost::bind(&TcpTransportSocket::handshake, shared_from_this(), _1, _socket));
-        return;
-      }
-
-      boost::asio::async_read(*_socket,
-        boost::asio::buffer(_msg->_p->getHeader(), sizeof(MessagePrivate::MessageHeader)),
-        boost::bind(&TcpTransportSocket::onReadHeader, shared_from_this(), _1, _2, _socket));
+      _socket->async_read_some(buf, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
     }
     else
     {
-      boost::asio::async_read(_socket->next_layer(),
-        boost::asio::buffer(_msg->_p->getHeader(), sizeof(MessagePrivate::MessageHeader)),
-        boost::bind(&TcpTransportSocket::onReadHeader, shared_from_this(), _1, _2, _socket));
+      _socket->next_layer().async_read_some(buf, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
     }
 #else
-    boost::asio::async_read(*_socket,
-      boost::asio::buffer(_msg->_p->getHeader(), sizeof(MessagePrivate::MessageHeader)),
-      boost::bind(&TcpTransportSocket::onReadHeader, shared_from_this(), _1, _2, _socket));
+    _socket->async_read_some(buf, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
 #endif
   }
 
-  qi::Url TcpTransportSocket::remoteEndpoint() const
+  void TcpTransportSocket::asyncRead(void* data, size_t size, const IoHandler& handler)
   {
-    boost::recursive_mutex::scoped_lock lock(_closingMutex);
-    if (!_socket)
-      return qi::Url();
-    return qi::Url(
-      _socket->lowest_layer().remote_endpoint().address().to_string(),
-      "tcp",
-      _socket->lowest_layer().remote_endpoint().port());
-  }
-
-  void TcpTransportSocket::onReadHeader(const boost::system::error_code& erc,
-    std::size_t len, SocketPtr)
-  {
-    if (erc)
+    boost::asio::mutable_buffers_1 buf = boost::asio::buffer(data, size);
+#ifdef WITH_SSL
+    if (_ssl)
     {
-      error("System error: " + erc.message());
-      return;
+      boost::asio::async_read(*_socket, buf, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
     }
-    // check magic
-    if (_msg->_p->header.magic != MessagePrivate::magic)
+    else
     {
-      qiLogWarning() << "Incorrect magic from "
-        << _socket->lowest_layer().remote_endpoint().address().to_string()
-        << ", disconnecting"
-           " (expected " << MessagePrivate::magic
-        << ", got " << _msg->_p->header.magic << ").";
-      error("Protocol error");
-      return;
+      boost::asio::async_read(_socket->next_layer(), buf, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
     }
-
-    size_t payload = _msg->_p->header.size;
-    if (payload)
-    {
-      static size_t maxPayload = 0;
-      static bool init = false;
-      // Not thread-safe, limited consequences
-      // worst case: first received messages will not honor limit)
-      if (!init)
-      {
-        init = true;
-        std::string l = os::getenv("QI_MAX_MESSAGE_PAYLOAD");
-        if (!l.empty())
-          maxPayload = strtol(l.c_str(), 0, 0);
-        else
-          maxPayload = 50000000; // reasonable default
-      }
-      if (maxPayload && payload > maxPayload)
-      {
-        qiLogWarning() << "Receiving message of size " << payload
-          << " above maximum configured payload " << maxPayload << ", closing link."
-             " (configure with environment variable QI_MAX_MESSAGE_PAYLOAD)";
-        error("Message too big");
-        return;
-      }
-
-      void* ptr = _msg->_p->buffer.reserve(payload);
-
-      boost::recursive_mutex::scoped_lock l(_closingMutex);
-
-      if (_abort)
-      {
-        error("Aborted");
-        return;
-      }
-
-#ifdef WITH_SSL
-      if (_ssl)
-      {
-        boost::asio::async_read(*_socket,
-          boost::asio::buffer(ptr, payload),
-          boost::bind(&TcpTransportSocket::onReadData, shared_from_this(), _1, _2, _socket));
-      }
-      else
-      {
-        boost::asio::async_read(_socket->next_layer(),
-          boost::asio::buffer(ptr, payload),
-          boost::bind(&TcpTransportSocket::onReadData, shared_from_this(), _1, _2, _socket));
-      }
 #else
-      boost::asio::async_read(*_socket,
-        boost::asio::buffer(ptr, payload),
-        boost::bind(&TcpTransportSocket::onReadData, shared_from_this(), _1, _2, _socket));
+    boost::asio::async_read(*_socket, buf, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
 #endif
-    }
-    else
-      onReadData(boost::system::error_code(), 0, _socket);
   }
 
-  void TcpTransportSocket::onReadData(const boost::system::error_code& erc,
-    std::size_t len, SocketPtr)
+  void TcpTransportSocket::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, const IoHandler& handler)
   {
-    if (erc)
-    {
-      error("System error: " + erc.message());
-      return;
-    }
-    qiLogDebug() << this << " Recv (" << _msg->type() << "):" << _msg->address();
-    static int usWarnThreshold = os::getenv("QIMESSAGING_SOCKET_DISPATCH_TIME_WARN_THRESHOLD").empty()?0:strtol(os::getenv("QIMESSAGING_SOCKET_DISPATCH_TIME_WARN_THRESHOLD").c_str(),0,0);
-    qi::int64_t start = 0;
-    if (usWarnThreshold)
-      start = os::ustime(); // call might be not that cheap
-    if (_msg->type() == Message::Type_Capability)
+#ifdef WITH_SSL
+    if (_ssl)
     {
-      // This one is for us
-      AnyReference cmRef = _msg->value(typeOf<CapabilityMap>()->signature(), shared_from_this());
-      CapabilityMap cm = cmRef.to<CapabilityMap>();
-      cmRef.destroy();
-      boost::mutex::scoped_lock lock(_contextMutex);
-      _remoteCapabilityMap.insert(cm.begin(), cm.end());
+      boost::asio::async_write(*_socket, buffers, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
     }
     else
     {
-      messageReady(*_msg);
-      _dispatcher.dispatch(*_msg);
+      boost::asio::async_write(_socket->next_layer(), buffers, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
     }
-    if (usWarnThreshold)
-    {
-      qi::int64_t duration = os::ustime() - start;
-      if (duration > usWarnThreshold)
-        qiLogWarning() << "Dispatch to user took " << duration << "us";
-    }
-    delete _msg;
-    _msg = 0;
-    _continueReading();
+#else
+    boost::asio::async_write(*_socket, buffers, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
+#endif
   }
 
-  void TcpTransportSocket::error(const std::string& erc)
+  void TcpTransportSocket::closeSocket()
   {
-    qiLogVerbose() << "Socket error: " << erc;
-    boost::recursive_mutex::scoped_lock lock(_closingMutex);
-    _abort = true;
-    _status = qi::TransportSocket::Status_Disconnected;
-    disconnected(erc);
-
-    if (_connecting)
-    {
-      _connecting = false;
-    }
-
+    boost::system::error_code er;
+    if (_socket)
     {
-      boost::mutex::scoped_lock l(_sendQueueMutex);
-      boost::system::error_code er;
-      if (_socket)
-      {
-        // Unconditionally try to shutdown if socket is present, it might be in connecting state.
-        _socket->lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, er);
-        _socket->lowest_layer().close(er);
-      }
+      _socket->lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, er);
+      _socket->lowest_layer().close(er);
     }
     _socket.reset();
   }
 
+  bool TcpTransportSocket::isOpen() const
+  {
+    return _socket.get() != 0;
+  }
+
+  qi::Url TcpTransportSocket::remoteEndpoint() const
+  {
+    boost::recursive_mutex::scoped_lock lock(_closingMutex);
+    if (!_socket)
+      return qi::Url();
+    return qi::Url(
+      _socket->lowest_layer().remote_endpoint().address().to_string(),
+      "tcp",
+      _socket->lowest_layer().remote_endpoint().port());
+  }
+
   qi::FutureSync<void> TcpTransportSocket::connect(const qi::Url &url)
   {
     boost::recursive_mutex::scoped_lock l(_closingMutex);
@@ -338,7 +203,7 @@ namespace qi
     qi::Promise<void> connectPromise;
     _r->async_resolve(q,
                       boost::bind(&TcpTransportSocket::onResolved,
-                                  shared_from_this(),
+                                  self(),
                                   boost::asio::placeholders::error,
                                   boost::asio::placeholders::iterator,
                                   connectPromise));
@@ -370,7 +235,7 @@ namespace qi
         // asynchronous connect
         _socket->lowest_layer().async_connect(*it,
                                               boost::bind(&TcpTransportSocket::onConnected,
-                                                          shared_from_this(),
+                                                          self(),
                                                           boost::asio::placeholders::error,
                                                           _socket,
                                                           connectPromise));
@@ -440,7 +305,7 @@ namespace qi
         if (_abort)
           return;
         _socket->async_handshake(boost::asio::ssl::stream_base::client,
-            boost::bind(&TcpTransportSocket::handshake, shared_from_this(), _1,
+            boost::bind(&TcpTransportSocket::handshake, self(), _1,
               _socket, connectPromise));
 #endif
       }
@@ -557,128 +422,4 @@ namespace qi
 #endif
   }
 
-  qi::FutureSync<void> TcpTransportSocket::disconnect()
-  {
-    if (_status == qi::TransportSocket::Status_Disconnected)
-      return qi::Future<void>(0);
-
-    return _eventLoop->async(boost::bind(&TcpTransportSocket::error,
-                                 boost::static_pointer_cast<TcpTransportSocket>(shared_from_this()),
-                                 "Disconnection requested"));
-  }
-
-  bool TcpTransportSocket::send(const qi::Message &msg)
-  {
-    // Check that once before locking in case some idiot tries to send
-    // from a disconnect notification.
-    if (_status != qi::TransportSocket::Status_Connected)
-      return false;
-    boost::recursive_mutex::scoped_lock lockc(_closingMutex);
-
-    if (!_socket || _status != qi::TransportSocket::Status_Connected)
-    {
-      qiLogDebug() << this << "Send on closed socket";
-      return false;
-    }
-
-    qiLogDebug() << this << " Send (" << msg.type() << "):" << msg.address();
-    boost::mutex::scoped_lock lock(_sendQueueMutex);
-
-    if (!_sending)
-    {
-      _sending = true;
-      send_(msg);
-    }
-    else
-      _sendQueue.push_back(msg);
-    return true;
-  }
-
-  void TcpTransportSocket::send_(qi::Message msg)
-  {
-    using boost::asio::buffer;
-    std::vector<boost::asio::const_buffer> b;
-    msg._p->complete();
-    // Send header
-    b.push_back(buffer(msg._p->getHeader(), sizeof(qi::MessagePrivate::MessageHeader)));
-    const qi::Buffer& buf = msg.buffer();
-    size_t sz = buf.size();
-    const std::vector<std::pair<size_t, Buffer> >& subs = buf.subBuffers();
-    size_t pos = 0;
-    // Handle subbuffers
-    for (unsigned i=0; i< subs.size(); ++i)
-    {
-      // Send parent buffer between pos and start of sub
-      size_t end = subs[i].first+4;
-      if (end != pos)
-        b.push_back(buffer((const char*)buf.data() + pos, end-pos));
-      pos = end;
-      // Send subbuffer
-      b.push_back(buffer(subs[i].second.data(), subs[i].second.size()));
-    }
-    b.push_back(buffer((const char*)buf.data() + pos, sz - pos));
-
-    boost::recursive_mutex::scoped_lock l(_closingMutex);
-
-    if (_abort)
-    {
-      qiLogWarning() << "send aborted";
-      return;
-    }
-
-    _dispatcher.sent(msg);
-
-#ifdef WITH_SSL
-    if (_ssl)
-    {
-      boost::asio::async_write(*_socket, b,
-        boost::bind(&TcpTransportSocket::sendCont, shared_from_this(), _1, msg, _socket));
-    }
-    else
-    {
-      boost::asio::async_write(_socket->next_layer(), b,
-        boost::bind(&TcpTransportSocket::sendCont, shared_from_this(), _1, msg, _socket));
-    }
-#else
-    boost::asio::async_write(*_socket, b,
-      boost::bind(&TcpTransportSocket::sendCont, shared_from_this(), _1, msg, _socket));
-#endif
-  }
-
-  /*
-   * warning: msg is given to the callback so as not to drop buffers refcount
-   */
-  void TcpTransportSocket::sendCont(const boost::system::error_code& erc, qi::Message msg, SocketPtr)
-  {
-    // The class does not wait for us to terminate, but it will set abort to true.
-    // So do not use this before checking abort.
-    if (erc || _abort)
-      return; // read-callback will also get the error, avoid dup and ignore it
-
-    qi::Message m;
-    {
-      boost::mutex::scoped_lock lock(_sendQueueMutex);
-      if (_sendQueue.empty())
-      {
-        _sending = false;
-        return;
-      }
-
-      m = _sendQueue.front();
-      _sendQueue.pop_front();
-    }
-
-    send_(m);
-  }
-
-  void TcpTransportSocket::advertiseCapabilities(const CapabilityMap& cm)
-  {
-    Message msg;
-    msg.setType(Message::Type_Capability);
-    msg.setValue(cm, typeOf<CapabilityMap>()->signature());
-    send(msg);
-    boost::mutex::scoped_lock lock(_contextMutex);
-    _localCapabilityMap.insert(cm.begin(), cm.end());
-  }
-
 }
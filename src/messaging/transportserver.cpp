@@ -28,6 +28,9 @@
 #include "transportserver.hpp"
 #include "transportsocket.hpp"
 #include "transportserverasio_p.hpp"
+#ifndef _WIN32
+# include "transportserverunix_p.hpp"
+#endif
 
 qiLogCategory("qimessaging.transportserver");
 
@@ -55,6 +58,12 @@ namespace qi
     {
       impl = new TransportServerAsioPrivate(this, ctx);
     }
+#endif
+#ifndef _WIN32
+    else if (url.protocol() == "unix")
+    {
+      impl = new TransportServerUnixPrivate(this, ctx);
+    }
 #endif
     else
     {
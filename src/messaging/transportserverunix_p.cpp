@@ -0,0 +1,173 @@
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <qi/log.hpp>
+#include <qi/os.hpp>
+#include <qi/atomic.hpp>
+
+#include "transportserver.hpp"
+#include "unixtransportsocket.hpp"
+#include "transportserverunix_p.hpp"
+
+qiLogCategory("qimessaging.transportserver");
+
+namespace qi
+{
+  static void _onUnixAccept(TransportServerImplPtr p,
+                            const boost::system::error_code& erc,
+                            boost::asio::local::stream_protocol::socket* s)
+  {
+    boost::shared_ptr<TransportServerUnixPrivate> ts = boost::dynamic_pointer_cast<TransportServerUnixPrivate>(p);
+    ts->onAccept(erc, s);
+  }
+
+  static std::string uniqueSocketPath()
+  {
+    static qi::Atomic<int> counter;
+    std::string dir = qi::os::tmp();
+    if (!dir.empty() && dir[dir.size() - 1] != '/')
+      dir += '/';
+    std::stringstream ss;
+    ss << dir << "qi-" << qi::os::getpid() << "-" << ++counter << ".sock";
+    return ss.str();
+  }
+
+  /*
+   * A socket file left by a crashed process would make bind fail. Remove
+   * path only if it is a socket nobody listens on anymore.
+   * Returns false if path exists and must be kept.
+   */
+  static bool removeStaleSocket(const std::string& path)
+  {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0)
+      return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode))
+      return false;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if (path.size() >= sizeof(addr.sun_path))
+      return false;
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      return false;
+    bool stale = ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+      && errno == ECONNREFUSED;
+    ::close(fd);
+    return stale && ::unlink(path.c_str()) == 0;
+  }
+
+  TransportServerUnixPrivate::TransportServerUnixPrivate(TransportServer* self,
+                                                         EventLoop* ctx)
+    : TransportServerImpl(self, ctx)
+    , _acceptor(new boost::asio::local::stream_protocol::acceptor(*(boost::asio::io_service*)ctx->nativeHandle()))
+    , _live(true)
+  {
+  }
+
+  TransportServerUnixPrivate::~TransportServerUnixPrivate()
+  {
+    delete _acceptor;
+    _acceptor = 0;
+  }
+
+  void TransportServerUnixPrivate::onAccept(const boost::system::error_code& erc,
+                                            boost::asio::local::stream_protocol::socket* s)
+  {
+    qiLogDebug() << this << " onAccept";
+    if (!_live)
+    {
+      delete s;
+      return;
+    }
+    if (erc)
+    {
+      qiLogDebug() << "accept error " << erc.message();
+      delete s;
+      self->acceptError(erc.value());
+      if (erc == boost::asio::error::operation_aborted
+          || erc == boost::asio::error::bad_descriptor)
+        return;
+    }
+    else
+    {
+      qi::TransportSocketPtr socket = qi::UnixTransportSocketPtr(new UnixTransportSocket(context, s));
+      self->newConnection(socket);
+
+      if (socket.unique()) {
+        qiLogError() << "bug: socket not stored by the newConnection handler (usecount:" << socket.use_count() << ")";
+      }
+    }
+    s = new boost::asio::local::stream_protocol::socket(_acceptor->get_io_service());
+    _acceptor->async_accept(*s, boost::bind(_onUnixAccept, shared_from_this(), _1, s));
+  }
+
+  qi::Future<void> TransportServerUnixPrivate::listen(const qi::Url& url)
+  {
+    std::string path = url.host().empty() ? uniqueSocketPath() : url.host();
+    if (!removeStaleSocket(path))
+    {
+      std::string err = path + " already exists and is not a stale socket";
+      qiLogError("qimessaging.server.listen") << err;
+      return qi::makeFutureError<void>(err);
+    }
+
+    boost::system::error_code ec;
+    boost::asio::local::stream_protocol::endpoint ep(path);
+    bool bound = false;
+    _acceptor->open(ep.protocol(), ec);
+    if (!ec)
+    {
+      fcntl(_acceptor->native_handle(), F_SETFD, FD_CLOEXEC);
+      _acceptor->bind(ep, ec);
+      bound = !ec;
+    }
+    if (!ec)
+      _acceptor->listen(boost::asio::socket_base::max_connections, ec);
+    if (ec)
+    {
+      if (bound)
+        ::unlink(path.c_str());
+      qiLogError("qimessaging.server.listen") << path << ": " << ec.message();
+      return qi::makeFutureError<void>(ec.message());
+    }
+    // Only unlinked by close once it is ours
+    _path = path;
+
+    {
+      boost::mutex::scoped_lock l(_endpointsMutex);
+      _endpoints.push_back(qi::Url("unix://" + _path));
+    }
+    qiLogInfo() << "TransportServer will listen on: unix://" << _path;
+
+    boost::asio::local::stream_protocol::socket* s =
+      new boost::asio::local::stream_protocol::socket(_acceptor->get_io_service());
+    _acceptor->async_accept(*s, boost::bind(_onUnixAccept, shared_from_this(), _1, s));
+    _connectionPromise.setValue(0);
+    return _connectionPromise.future();
+  }
+
+  void TransportServerUnixPrivate::close()
+  {
+    qiLogDebug() << this << " close";
+    _live = false;
+    if (_acceptor)
+      _acceptor->close();
+    if (!_path.empty())
+      ::unlink(_path.c_str());
+  }
+}
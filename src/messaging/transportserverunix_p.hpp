@@ -0,0 +1,40 @@
+#pragma once
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#ifndef _SRC_TRANSPORTSERVERUNIX_P_HPP_
+#define _SRC_TRANSPORTSERVERUNIX_P_HPP_
+
+# include <boost/asio.hpp>
+
+# include <qi/api.hpp>
+# include <qi/url.hpp>
+# include "transportserver.hpp"
+
+namespace qi
+{
+  /** Accepts local connections on a unix:///path url.
+   * An empty path (unix://) picks a unique socket file in qi::os::tmp().
+   */
+  class TransportServerUnixPrivate : public TransportServerImpl
+  {
+  public:
+    TransportServerUnixPrivate(TransportServer* self,
+                               EventLoop* ctx);
+    virtual ~TransportServerUnixPrivate();
+
+    virtual qi::Future<void> listen(const qi::Url& listenUrl);
+    virtual void close();
+
+    void onAccept(const boost::system::error_code& erc,
+                  boost::asio::local::stream_protocol::socket* s);
+
+    boost::asio::local::stream_protocol::acceptor* _acceptor;
+    bool _live;
+    std::string _path;
+  };
+}
+
+#endif  // _SRC_TRANSPORTSERVERUNIX_P_HPP_
@@ -15,6 +15,9 @@
 
 #include "transportsocket.hpp"
 #include "tcptransportsocket.hpp"
+#ifndef _WIN32
+# include "unixtransportsocket.hpp"
+#endif
 
 qiLogCategory("qimessaging.transportsocket");
 
@@ -39,6 +42,12 @@ namespace qi
     {
       return TcpTransportSocketPtr(new TcpTransportSocket(eventLoop, true));
     }
+#endif
+#ifndef _WIN32
+    else if (protocol == "unix")
+    {
+      return UnixTransportSocketPtr(new UnixTransportSocket(eventLoop));
+    }
 #endif
     else
     {
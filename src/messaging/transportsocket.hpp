@@ -8,6 +8,7 @@
 #define _SRC_TRANSPORTSOCKET_HPP_
 
 # include <boost/noncopyable.hpp>
+# include <boost/function.hpp>
 # include <qi/future.hpp>
 # include "message.hpp"
 # include <qi/url.hpp>
@@ -36,6 +37,7 @@ namespace qi
       : _eventLoop(NULL)
       , _err(0)
       , _status(Status_Disconnected)
+      , _relayThreshold(0)
     {
       connected.setCallType(MetaCallType_Queued);
       disconnected.setCallType(MetaCallType_Queued);
@@ -80,6 +82,25 @@ namespace qi
       return _dispatcher.messagePendingDisconnect(serviceId, objectId, linkId);
     }
 
+    typedef boost::function<TransportSocketPtr (MessagePrivate::MessageHeader&)> RelayHook;
+
+    /** Give the header of messages with a payload of at least threshold bytes
+     * to hook, before the payload is read. The hook may rewrite the header and
+     * return the socket to forward the message to instead of dispatching it.
+     * Between stream sockets, TCP or unix, the payload is written as it is
+     * read, without being gathered in one buffer. A relayed reply is no
+     * longer a pending call of this socket. Must be set before reading
+     * starts.
+     *
+     * Only messages bigger than a read chunk (64 KiB) are given to the hook,
+     * and only with buffered reads, see StreamTransportSocket.
+     */
+    void setRelayHook(size_t threshold, const RelayHook& hook)
+    {
+      _relayThreshold = threshold;
+      _relayHook = hook;
+    }
+
   protected:
     qi::EventLoop*          _eventLoop;
     qi::MessageDispatcher   _dispatcher;
@@ -88,6 +109,9 @@ namespace qi
     TransportSocket::Status _status;
     qi::Url                 _url;
 
+    size_t                  _relayThreshold;
+    RelayHook               _relayHook;
+
   public:
     // C4251
     qi::Signal<>                   connected;
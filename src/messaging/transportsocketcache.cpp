@@ -85,10 +85,22 @@ namespace qi {
     // This filters endpoints. If we are on the same machine, we just try to
     // connect on the loopback address, else we will try on all endpoints we
     // have that are not loopback.
+    //
+    // A local socket (unix://) is tried first when we are on the same
+    // machine, and is meaningless otherwise. The loopback endpoint is tried
+    // along with it, in case the local socket cannot be reached.
+    if (local && (protocol == "" || protocol == "unix")) {
+      for (urlIt = servInfo.endpoints().begin(); urlIt != servInfo.endpoints().end(); ++urlIt) {
+        if (urlIt->protocol() == "unix" && urlIt->isValid()) {
+          endpoints.push_back(*urlIt);
+          break;
+        }
+      }
+    }
     for (urlIt = servInfo.endpoints().begin(); urlIt != servInfo.endpoints().end(); ++urlIt) {
       qi::Url url = *urlIt;
       qiLogDebug() << "testing url " << url.str();
-      if (!url.isValid())
+      if (!url.isValid() || url.protocol() == "unix")
         continue;
       if (url.host().substr(0, 4) == "127." || url.host() == "localhost") {
         if (local && (protocol == "" || url.protocol() == protocol)) {
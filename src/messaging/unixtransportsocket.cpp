@@ -0,0 +1,535 @@
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include "unixtransportsocket.hpp"
+#include "../buffer_p.hpp"
+
+#include <qi/log.hpp>
+#include <qi/os.hpp>
+
+qiLogCategory("qimessaging.unixtransportsocket");
+
+// HAVE_MEMFD_CREATE is set by the build when the kernel headers know memfd_create
+#if defined(HAVE_MEMFD_CREATE) && defined(__NR_memfd_create)
+# define QI_HAVE_MEMFD
+# ifndef MFD_CLOEXEC
+#  define MFD_CLOEXEC 0x0001U
+#  define MFD_ALLOW_SEALING 0x0002U
+# endif
+# ifndef F_ADD_SEALS
+#  define F_ADD_SEALS 1033
+#  define F_SEAL_SEAL 0x0001
+#  define F_SEAL_SHRINK 0x0002
+#  define F_SEAL_GROW 0x0004
+#  define F_SEAL_WRITE 0x0008
+# endif
+#endif
+
+#ifndef MSG_CMSG_CLOEXEC
+# define MSG_CMSG_CLOEXEC 0
+#endif
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+// Maximum number of descriptors attached to a single message
+static const unsigned int maxFds = 64;
+
+static size_t fdThreshold()
+{
+  static size_t threshold = qi::os::getenv("QI_UNIX_FD_THRESHOLD").empty()
+    ? 1024 * 1024
+    : strtol(qi::os::getenv("QI_UNIX_FD_THRESHOLD").c_str(), 0, 0);
+  return threshold;
+}
+
+#ifdef QI_HAVE_MEMFD
+/// Copy size bytes of data into a new sealed memfd, returns -1 on failure.
+static int makeMemfd(const void* data, size_t size)
+{
+  int fd = syscall(__NR_memfd_create, "qi-buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    return -1;
+  const char* p = static_cast<const char*>(data);
+  size_t written = 0;
+  while (written < size)
+  {
+    ssize_t n = ::write(fd, p + written, size - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      ::close(fd);
+      return -1;
+    }
+    written += n;
+  }
+  // The receiver maps it and refuses it unless it can neither shrink nor change.
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+  {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+#endif
+
+namespace qi
+{
+  /// Header, payload and descriptors of a message using fd passing
+  struct UnixTransportSocket::FdFrame
+  {
+    ~FdFrame()
+    {
+      for (unsigned i = 0; i < fds.size(); ++i)
+        ::close(fds[i]);
+    }
+
+    MessagePrivate::MessageHeader header;
+    std::vector<boost::asio::const_buffer> body;
+    // (offset, size) of each descriptor, followed by the descriptor count
+    std::vector<qi::uint32_t> table;
+    std::vector<int> fds;
+  };
+
+  UnixTransportSocket::UnixTransportSocket(EventLoop* eventLoop, void* s)
+    : StreamTransportSocket(eventLoop)
+  {
+    if (s != 0)
+    {
+      _socket = SocketPtr((boost::asio::local::stream_protocol::socket*) s);
+      _status = qi::TransportSocket::Status_Connected;
+    }
+  }
+
+  UnixTransportSocket::~UnixTransportSocket()
+  {
+    qiLogDebug() << this;
+    error("Destroying UnixTransportSocket");
+    closePendingFds();
+    qiLogVerbose() << "deleted " << this;
+  }
+
+  boost::shared_ptr<UnixTransportSocket> UnixTransportSocket::self()
+  {
+    return boost::static_pointer_cast<UnixTransportSocket>(shared_from_this());
+  }
+
+  void UnixTransportSocket::startReading()
+  {
+    _continueReading();
+    CapabilityMap cm = defaultCapabilities();
+#ifdef QI_HAVE_MEMFD
+    if (fdThreshold())
+      cm["FdSubBuffers"] = AnyValue::from(true);
+#endif
+    advertiseCapabilities(cm);
+  }
+
+  qi::Url UnixTransportSocket::remoteEndpoint() const
+  {
+    // Peer address of an accepted local socket is anonymous.
+    return _url;
+  }
+
+  /*
+   * Reads go through recvmsg: descriptors are attached to the first byte of
+   * the header they come with, and a plain read would drop them.
+   */
+  void UnixTransportSocket::asyncReadSome(void* data, size_t size, const IoHandler& handler)
+  {
+    _socket->async_read_some(boost::asio::null_buffers(),
+      boost::bind(&UnixTransportSocket::onReadable, self(), _1, data, size, handler, _socket));
+  }
+
+  void UnixTransportSocket::onReadable(const boost::system::error_code& erc,
+    void* data, size_t size, IoHandler handler, SocketPtr s)
+  {
+    if (erc)
+    {
+      handler(erc, 0);
+      return;
+    }
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = size;
+    union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(maxFds * sizeof(int))];
+    } control;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do
+      n = ::recvmsg(s->native_handle(), &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      s->async_read_some(boost::asio::null_buffers(),
+        boost::bind(&UnixTransportSocket::onReadable, self(), _1, data, size, handler, s));
+      return;
+    }
+    if (n < 0)
+    {
+      handler(boost::system::error_code(errno, boost::system::system_category()), 0);
+      return;
+    }
+    if (n == 0)
+    {
+      handler(boost::asio::error::eof, 0);
+      return;
+    }
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c))
+    {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+        continue;
+      const int* fds = reinterpret_cast<const int*>(CMSG_DATA(c));
+      size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      _pendingFds.insert(_pendingFds.end(), fds, fds + count);
+    }
+    // Only the message being read and the ones after it in the chunk may
+    // have descriptors pending.
+    if ((mh.msg_flags & MSG_CTRUNC) || _pendingFds.size() > 2 * maxFds)
+    {
+      qiLogWarning() << "Too many descriptors received on local socket, disconnecting.";
+      handler(boost::asio::error::message_size, 0);
+      return;
+    }
+    handler(boost::system::error_code(), n);
+  }
+
+  void UnixTransportSocket::asyncRead(void* data, size_t size, const IoHandler& handler)
+  {
+    asyncReadSome(data, size,
+      boost::bind(&UnixTransportSocket::onReadPart, self(), _1, _2,
+                  static_cast<char*>(data), size, 0, handler));
+  }
+
+  void UnixTransportSocket::onReadPart(const boost::system::error_code& erc, std::size_t len,
+    char* data, size_t size, size_t done, IoHandler handler)
+  {
+    done += len;
+    if (erc || done == size)
+    {
+      handler(erc, done);
+      return;
+    }
+    boost::recursive_mutex::scoped_lock l(_closingMutex);
+    if (!_socket)
+    {
+      handler(boost::asio::error::operation_aborted, done);
+      return;
+    }
+    asyncReadSome(data + done, size - done,
+      boost::bind(&UnixTransportSocket::onReadPart, self(), _1, _2, data, size, done, handler));
+  }
+
+  void UnixTransportSocket::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, const IoHandler& handler)
+  {
+    boost::asio::async_write(*_socket, buffers, boost::bind(&holding<SocketPtr>, handler, _socket, _1, _2));
+  }
+
+  void UnixTransportSocket::closeSocket()
+  {
+    boost::system::error_code er;
+    if (_socket)
+    {
+      _socket->shutdown(boost::asio::local::stream_protocol::socket::shutdown_both, er);
+      _socket->close(er);
+    }
+    _socket.reset();
+  }
+
+  bool UnixTransportSocket::isOpen() const
+  {
+    return _socket.get() != 0;
+  }
+
+  bool UnixTransportSocket::finishMessage(qi::Message& msg)
+  {
+    if (!(msg.flags() & TypeFlag_FdSubBuffers))
+      return true;
+    if (restoreSubBuffers(msg))
+      return true;
+    qiLogWarning() << "Invalid descriptor table on local socket, disconnecting.";
+    closePendingFds();
+    return false;
+  }
+
+  bool UnixTransportSocket::canRelay(const MessagePrivate::MessageHeader& header)
+  {
+    // The descriptors would not follow the payload
+    return !(header.flags & TypeFlag_FdSubBuffers);
+  }
+
+  /*
+   * Payload layout is the streamed payload minus the data of descriptor-backed
+   * sub-buffers, followed by a table: (offset, size) per descriptor, then the
+   * descriptor count, all uint32. offset is where the sub-buffer data would
+   * have started, right after its size field. The descriptors are the
+   * first ones received and not claimed by a previous message.
+   */
+  bool UnixTransportSocket::restoreSubBuffers(qi::Message& msg)
+  {
+    const Buffer& wire = msg._p->buffer;
+    const char* data = static_cast<const char*>(wire.data());
+    size_t size = wire.size();
+    qi::uint32_t count;
+    if (size < sizeof(count))
+      return false;
+    memcpy(&count, data + size - sizeof(count), sizeof(count));
+    if (count > _pendingFds.size())
+      return false;
+    size_t tableSize = sizeof(count) * (1 + 2 * count);
+    if (tableSize > size)
+      return false;
+    size_t bodySize = size - tableSize;
+    const char* table = data + bodySize;
+
+    Buffer body;
+    size_t pos = 0;
+    for (unsigned i = 0; i < count; ++i)
+    {
+      qi::uint32_t entry[2];
+      memcpy(entry, table + i * sizeof(entry), sizeof(entry));
+      if (entry[0] < pos + sizeof(qi::uint32_t) || entry[0] > bodySize)
+        return false;
+      body.write(data + pos, entry[0] - sizeof(qi::uint32_t) - pos);
+      Buffer sub;
+      if (!BufferPrivate::fromFd(_pendingFds[i], entry[1], sub))
+        return false;
+      body.addSubBuffer(sub);
+      pos = entry[0];
+    }
+    body.write(data + pos, bodySize - pos);
+    for (unsigned i = 0; i < count; ++i)
+    {
+      ::close(_pendingFds.front());
+      _pendingFds.pop_front();
+    }
+
+    msg._p->buffer = body;
+    msg._p->header.size = body.totalSize();
+    msg._p->header.flags &= ~TypeFlag_FdSubBuffers;
+    return true;
+  }
+
+  void UnixTransportSocket::closePendingFds()
+  {
+    for (unsigned i = 0; i < _pendingFds.size(); ++i)
+      ::close(_pendingFds[i]);
+    _pendingFds.clear();
+  }
+
+  qi::FutureSync<void> UnixTransportSocket::connect(const qi::Url &url)
+  {
+    boost::recursive_mutex::scoped_lock l(_closingMutex);
+
+    if (_status == qi::TransportSocket::Status_Connected || _connecting)
+    {
+      const char* s = "connection already in progress";
+      qiLogError() << s;
+      return makeFutureError<void>(s);
+    }
+    if (url.host().empty())
+    {
+      qiLogError() << "Error try to connect to a bad address: " << url.str();
+      return qi::makeFutureError<void>(std::string("Bad address ") + url.str());
+    }
+    _socket = SocketPtr(new boost::asio::local::stream_protocol::socket(*(boost::asio::io_service*)_eventLoop->nativeHandle()));
+    _url = url;
+    _status = qi::TransportSocket::Status_Connecting;
+    _connecting = true;
+    _err = 0;
+    qiLogVerbose() << "Trying to connect to " << _url.host();
+
+    qi::Promise<void> connectPromise;
+    _socket->async_connect(boost::asio::local::stream_protocol::endpoint(_url.host()),
+                           boost::bind(&UnixTransportSocket::onConnected,
+                                       self(),
+                                       boost::asio::placeholders::error,
+                                       _socket,
+                                       connectPromise));
+    return connectPromise.future();
+  }
+
+  void UnixTransportSocket::onConnected(const boost::system::error_code& erc,
+      SocketPtr, qi::Promise<void> connectPromise)
+  {
+    _connecting = false;
+    if (erc)
+    {
+      qiLogVerbose() << "connect: " << erc.message();
+      _status = qi::TransportSocket::Status_Disconnected;
+      error("System error: " + erc.message());
+      pSetError(connectPromise, "System error: " + erc.message());
+      return;
+    }
+    _status = qi::TransportSocket::Status_Connected;
+    pSetValue(connectPromise);
+    connected();
+    {
+      boost::recursive_mutex::scoped_lock l(_closingMutex);
+      if (_abort)
+        return;
+    }
+    startReading();
+  }
+
+  bool UnixTransportSocket::writesAlone(const qi::Message& msg)
+  {
+#ifdef QI_HAVE_MEMFD
+    size_t threshold = fdThreshold();
+    if (!threshold)
+      return false;
+    const std::vector<std::pair<size_t, Buffer> >& subs = msg.buffer().subBuffers();
+    for (unsigned i = 0; i < subs.size(); ++i)
+      if (subs[i].second.size() >= threshold)
+        return sharedCapability<bool>("FdSubBuffers", false);
+#endif
+    return false;
+  }
+
+  bool UnixTransportSocket::writeAlone(const qi::Message& msg, const IoHandler& done)
+  {
+    FdFramePtr frame = makeFdFrame(msg);
+    if (!frame)
+      return false;
+    _dispatcher.sent(msg);
+    sendFdFrame(boost::system::error_code(), frame, done, _socket);
+    return true;
+  }
+
+  /// Returns the fd-passing layout of msg, or null if it should be streamed.
+  UnixTransportSocket::FdFramePtr UnixTransportSocket::makeFdFrame(const qi::Message& msg)
+  {
+#ifdef QI_HAVE_MEMFD
+    size_t threshold = fdThreshold();
+    const qi::Buffer& buf = msg.buffer();
+    const std::vector<std::pair<size_t, Buffer> >& subs = buf.subBuffers();
+    unsigned bigSubs = 0;
+    for (unsigned i = 0; i < subs.size(); ++i)
+      if (subs[i].second.size() >= threshold)
+        ++bigSubs;
+    if (!threshold || !bigSubs || bigSubs > maxFds
+        || !sharedCapability<bool>("FdSubBuffers", false))
+      return FdFramePtr();
+
+    using boost::asio::buffer;
+    FdFramePtr frame = boost::make_shared<FdFrame>();
+    frame->header = msg._p->header;
+    size_t pos = 0;
+    size_t wirePos = 0;
+    for (unsigned i = 0; i < subs.size(); ++i)
+    {
+      size_t end = subs[i].first + 4;
+      if (end != pos)
+        frame->body.push_back(buffer((const char*)buf.data() + pos, end - pos));
+      wirePos += end - pos;
+      pos = end;
+      const Buffer& sub = subs[i].second;
+      int fd = -1;
+      if (sub.size() >= threshold)
+        fd = makeMemfd(sub.data(), sub.size());
+      if (fd < 0)
+      {
+        frame->body.push_back(buffer(sub.data(), sub.size()));
+        wirePos += sub.size();
+        continue;
+      }
+      frame->fds.push_back(fd);
+      frame->table.push_back(static_cast<qi::uint32_t>(wirePos));
+      frame->table.push_back(static_cast<qi::uint32_t>(sub.size()));
+    }
+    if (frame->fds.empty())
+      return FdFramePtr();
+    frame->body.push_back(buffer((const char*)buf.data() + pos, buf.size() - pos));
+    wirePos += buf.size() - pos;
+    frame->table.push_back(static_cast<qi::uint32_t>(frame->fds.size()));
+    frame->body.push_back(buffer(&frame->table[0], frame->table.size() * sizeof(qi::uint32_t)));
+    frame->header.size = wirePos + frame->table.size() * sizeof(qi::uint32_t);
+    frame->header.flags |= TypeFlag_FdSubBuffers;
+    return frame;
+#else
+    return FdFramePtr();
+#endif
+  }
+
+  /*
+   * The header goes through sendmsg with the descriptors, the rest of the
+   * frame is a regular asynchronous write.
+   * On failure we only shut the socket down and let the read side report
+   * the error.
+   */
+  void UnixTransportSocket::sendFdFrame(const boost::system::error_code& erc, FdFramePtr frame, IoHandler done, SocketPtr s)
+  {
+    boost::recursive_mutex::scoped_lock l(_closingMutex);
+    if (erc || _abort)
+      return;
+
+    struct iovec iov;
+    iov.iov_base = &frame->header;
+    iov.iov_len = sizeof(frame->header);
+    std::vector<char> control(CMSG_SPACE(frame->fds.size() * sizeof(int)));
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = &control[0];
+    mh.msg_controllen = control.size();
+    struct cmsghdr* c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(frame->fds.size() * sizeof(int));
+    memcpy(CMSG_DATA(c), &frame->fds[0], frame->fds.size() * sizeof(int));
+
+    ssize_t n;
+    do
+      n = ::sendmsg(s->native_handle(), &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      s->async_write_some(boost::asio::null_buffers(),
+        boost::bind(&UnixTransportSocket::sendFdFrame, self(), _1, frame, done, s));
+      return;
+    }
+    if (n < 0)
+    {
+      qiLogVerbose() << "sendmsg: " << strerror(errno);
+      boost::system::error_code ec;
+      s->shutdown(boost::asio::local::stream_protocol::socket::shutdown_both, ec);
+      return;
+    }
+    // The peer holds its own references now.
+    for (unsigned i = 0; i < frame->fds.size(); ++i)
+      ::close(frame->fds[i]);
+    frame->fds.clear();
+
+    std::vector<boost::asio::const_buffer> b;
+    if ((size_t)n < sizeof(frame->header))
+      b.push_back(boost::asio::buffer((const char*)&frame->header + n, sizeof(frame->header) - n));
+    b.insert(b.end(), frame->body.begin(), frame->body.end());
+    boost::asio::async_write(*s, b, boost::bind(&holding<FdFramePtr>, done, frame, _1, _2));
+  }
+}
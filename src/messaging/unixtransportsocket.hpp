@@ -0,0 +1,81 @@
+#pragma once
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#ifndef _SRC_UNIXTRANSPORTSOCKET_HPP_
+#define _SRC_UNIXTRANSPORTSOCKET_HPP_
+
+# include <string>
+# include <deque>
+# include <boost/asio.hpp>
+# include <qi/api.hpp>
+# include <qi/url.hpp>
+# include <qi/eventloop.hpp>
+# include "streamtransportsocket.hpp"
+
+namespace qi
+{
+  /** TransportSocket over a local (AF_UNIX) stream socket.
+   *
+   * Used for peers running on the same machine: same framing as
+   * TcpTransportSocket, see StreamTransportSocket, but without going
+   * through the TCP/IP stack.
+   * Urls are of the form unix:///path/to/socket.
+   *
+   * Sub-buffers (see Buffer::addSubBuffer) bigger than QI_UNIX_FD_THRESHOLD
+   * bytes (default 1MB, 0 disables) are not streamed: they are copied once
+   * into a sealed memfd passed with SCM_RIGHTS, and the receiving end maps
+   * it. Only used when both ends advertise the FdSubBuffers capability.
+   */
+  class UnixTransportSocket : public StreamTransportSocket
+  {
+  public:
+    explicit UnixTransportSocket(EventLoop* eventloop = getEventLoop(), void* s = 0);
+    virtual ~UnixTransportSocket();
+
+    virtual qi::FutureSync<void> connect(const qi::Url &url);
+    virtual void startReading();
+    virtual qi::Url remoteEndpoint() const;
+
+    /// Set on the wire when the payload ends with a descriptor table
+    static const unsigned int TypeFlag_FdSubBuffers = 0x80;
+
+  protected:
+    virtual void asyncReadSome(void* data, size_t size, const IoHandler& handler);
+    virtual void asyncRead(void* data, size_t size, const IoHandler& handler);
+    virtual void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, const IoHandler& handler);
+    virtual void closeSocket();
+    virtual bool isOpen() const;
+    virtual bool finishMessage(qi::Message& msg);
+    virtual bool canRelay(const MessagePrivate::MessageHeader& header);
+    virtual bool writesAlone(const qi::Message& msg);
+    virtual bool writeAlone(const qi::Message& msg, const IoHandler& done);
+
+  private:
+    typedef boost::shared_ptr<boost::asio::local::stream_protocol::socket> SocketPtr;
+    struct FdFrame;
+    typedef boost::shared_ptr<FdFrame> FdFramePtr;
+
+    void onConnected(const boost::system::error_code& erc, SocketPtr s,
+                     qi::Promise<void> connectPromise);
+    void onReadable(const boost::system::error_code& erc, void* data, size_t size,
+                    IoHandler handler, SocketPtr s);
+    void onReadPart(const boost::system::error_code& erc, std::size_t len,
+                    char* data, size_t size, size_t done, IoHandler handler);
+    FdFramePtr makeFdFrame(const qi::Message& msg);
+    void sendFdFrame(const boost::system::error_code& erc, FdFramePtr frame, IoHandler done, SocketPtr s);
+    bool restoreSubBuffers(qi::Message& msg);
+    void closePendingFds();
+    boost::shared_ptr<UnixTransportSocket> self();
+
+    SocketPtr           _socket;
+    // Descriptors received and not yet claimed by a message, in order
+    std::deque<int>     _pendingFds;
+  };
+
+  typedef boost::shared_ptr<UnixTransportSocket> UnixTransportSocketPtr;
+}
+
+#endif  // _SRC_UNIXTRANSPORTSOCKET_HPP_
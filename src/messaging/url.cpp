@@ -202,6 +202,9 @@ namespace qi {
   }
 
   bool UrlPrivate::isValid() const {
+    // local sockets are addressed by a path and have no port
+    if (protocol == "unix")
+      return (components & (HOST | SCHEME)) == (HOST | SCHEME);
     return (components & (PORT | SCHEME)) == (PORT | SCHEME);
   }
 
@@ -102,6 +102,9 @@ namespace qi {
     /* MessageFlags: remote ends support Message flags (flags in 'type' header field)
     */
     (*_defaultCapabilities)["MessageFlags"] = AnyValue::from(true);
+    /* RemoteCancelableCalls: remote ends understand Type_Cancel messages
+    */
+    (*_defaultCapabilities)["RemoteCancelableCalls"] = AnyValue::from(true);
     // Process override from environment
     std::string capstring = qi::os::getenv("QI_TRANSPORT_CAPABILITIES");
     std::vector<std::string> caps;
@@ -298,9 +301,9 @@ namespace qi {
       uint32_t sz;
       read(sz);
       qiLogDebug() << "Extracting buffer of size " << sz <<" at " << reader.position();
-      meta.clear();
-      void* ptr = meta.reserve(sz);
-      memcpy(ptr, readRaw(sz), sz);
+      // Share the bytes with the buffer we are reading from
+      if (!reader.readSlice(sz, meta))
+        setStatus(Status_ReadPastEnd);
     }
   }
 
@@ -480,6 +483,123 @@ namespace qi {
 
   namespace details {
 
+    /* A std::vector of fixed-size primitives is contiguous and has the same
+     * layout as its serialized form (host byte order, no padding), so it can
+     * be encoded and decoded with a single copy instead of one typeDispatch
+     * per element.
+     */
+    template<typename T>
+    static bool isPodVector(TypeInterface* listType)
+    {
+      static TypeInterface* vtype = 0;
+      QI_ONCE(vtype = typeOf<std::vector<T> >());
+      return listType == vtype || listType->info() == vtype->info();
+    }
+
+    class PodListWriter
+    {
+    public:
+      PodListWriter(BinaryEncoder& out, AnyReference value)
+        : out(out)
+        , value(value)
+      {}
+
+      template<typename T> bool apply(TypeInterface* listType)
+      {
+        if (!isPodVector<T>(listType))
+          return false;
+        const std::vector<T>& v = *value.ptr<std::vector<T> >(false);
+        out.beginList(v.size(), static_cast<ListTypeInterface*>(listType)->elementType()->signature());
+        if (!v.empty())
+          out.write((const char*)&v[0], v.size() * sizeof(T));
+        out.endList();
+        return true;
+      }
+
+      BinaryEncoder& out;
+      AnyReference value;
+    };
+
+    class PodListReader
+    {
+    public:
+      PodListReader(BinaryDecoder& in, AnyReference result)
+        : in(in)
+        , result(result)
+      {}
+
+      template<typename T> bool apply(TypeInterface* listType)
+      {
+        if (!isPodVector<T>(listType))
+          return false;
+        qi::uint32_t sz = 0;
+        in.read(sz);
+        if (in.status() != BinaryDecoder::Status_Ok || !sz)
+          return true;
+        // Check the data is there before allocating anything
+        void* data = 0;
+        if (sz <= (size_t)-1 / sizeof(T))
+          data = in.readRaw(sz * sizeof(T));
+        if (!data)
+        {
+          in.setStatus(BinaryDecoder::Status_ReadPastEnd);
+          return true;
+        }
+        std::vector<T>& v = *result.ptr<std::vector<T> >(false);
+        size_t offset = v.size();
+        v.resize(offset + sz);
+        // data may be unaligned
+        memcpy(&v[offset], data, sz * sizeof(T));
+        return true;
+      }
+
+      BinaryDecoder& in;
+      AnyReference result;
+    };
+
+    /// Run \p codec on \p listType if it is a std::vector of fixed-size primitives.
+    /// @return false if it is not.
+    template<typename Codec>
+    static bool visitPodList(Codec& codec, TypeInterface* listType)
+    {
+      TypeInterface* elementType = static_cast<ListTypeInterface*>(listType)->elementType();
+      switch (elementType->kind())
+      {
+      case TypeKind_Int: {
+        IntTypeInterface* itype = static_cast<IntTypeInterface*>(elementType);
+        // std::vector<bool> is not contiguous, byteSize 0 is bool
+        switch ((itype->isSigned() ? 1 : -1) * (int)itype->size())
+        {
+        case 1:  return codec.template apply<char>(listType)
+                     || codec.template apply<signed char>(listType);
+        case -1: return codec.template apply<unsigned char>(listType)
+                     || codec.template apply<char>(listType);
+        case 2:  return codec.template apply<short>(listType);
+        case -2: return codec.template apply<unsigned short>(listType);
+        case 4:  return codec.template apply<int>(listType)
+                     || codec.template apply<long>(listType);
+        case -4: return codec.template apply<unsigned int>(listType)
+                     || codec.template apply<unsigned long>(listType);
+        case 8:  return codec.template apply<long long>(listType)
+                     || codec.template apply<long>(listType);
+        case -8: return codec.template apply<unsigned long long>(listType)
+                     || codec.template apply<unsigned long>(listType);
+        default: return false;
+        }
+      }
+      case TypeKind_Float: {
+        FloatTypeInterface* ftype = static_cast<FloatTypeInterface*>(elementType);
+        if (ftype->size() == 4)
+          return codec.template apply<float>(listType);
+        if (ftype->size() == 8)
+          return codec.template apply<double>(listType);
+        return false;
+      }
+      default:
+        return false;
+      }
+    }
+
     class SerializeTypeVisitor
     {
     public:
@@ -543,6 +663,9 @@ namespace qi {
 
       void visitList(AnyIterator it, AnyIterator end)
       {
+        PodListWriter writer(out, value);
+        if (visitPodList(writer, value.type()))
+          return;
         out.beginList(value.size(), static_cast<ListTypeInterface*>(value.type())->elementType()->signature());
         for (; it != end; ++it)
           serialize(*it, out, serializeObjectCb, streamContext);
@@ -719,6 +842,22 @@ namespace qi {
 
       void visitString(char*, size_t)
       {
+        //StringView points to the data being decoded, no copy
+        static TypeInterface* tview = 0;
+        QI_ONCE(tview = qi::typeOf<StringView>());
+        if ((result.type() == tview) || (result.type()->info() == tview->info())) {
+          qi::uint32_t sz = 0;
+          in.read(sz);
+          Buffer data;
+          if (in.status() != BinaryDecoder::Status_Ok)
+            return;
+          if (!in.bufferReader().readSlice(sz, data))
+            in.setStatus(BinaryDecoder::Status_ReadPastEnd);
+          else
+            *result.ptr<StringView>(false) = StringView(data);
+          return;
+        }
+
         std::string s;
         in.read(s);
 
@@ -735,6 +874,9 @@ namespace qi {
 
       void visitList(AnyIterator, AnyIterator)
       {
+        PodListReader reader(in, result);
+        if (visitPodList(reader, result.type()))
+          return;
         TypeInterface* elementType = static_cast<ListTypeInterface*>(result.type())->elementType();
         qi::uint32_t sz = 0;
         in.read(sz);
@@ -864,6 +1006,13 @@ namespace qi {
       {
         Buffer b;
         in.read(b);
+        //optimise when result is a Buffer: keep sharing the data
+        static TypeInterface* tbuffer = 0;
+        QI_ONCE(tbuffer = qi::typeOf<Buffer>());
+        if ((result.type() == tbuffer) || (result.type()->info() == tbuffer->info())) {
+          *result.ptr<Buffer>(false) = b;
+          return;
+        }
         result.setRaw((char*)b.data(), b.size());
       }
       AnyReference result;
@@ -872,10 +1021,42 @@ namespace qi {
       StreamContext* streamContext;
     }; //class
 
+    /* Structs declared with QI_TYPE_STRUCT_EXTENSION_BINARY_CODEC are written
+     * and read directly, without building the per-field references that
+     * typeDispatch would pass to visitTuple.
+     * Return false if \p val must go through the visitors.
+     */
+    static bool serializeStruct(AnyReference val, BinaryEncoder& out)
+    {
+      if (val.kind() != TypeKind_Tuple)
+        return false;
+      StructTypeInterface* type = static_cast<StructTypeInterface*>(val.type());
+      if (!type->hasBinaryCodec())
+        return false;
+      if (!type->binaryEncode(val.rawValue(), out.buffer()))
+        out.setStatus(BinaryEncoder::Status_WriteError);
+      return true;
+    }
+
+    static bool deserializeStruct(AnyReference what, BinaryDecoder& in)
+    {
+      if (what.kind() != TypeKind_Tuple)
+        return false;
+      StructTypeInterface* type = static_cast<StructTypeInterface*>(what.type());
+      if (!type->hasBinaryCodec())
+        return false;
+      if (!type->binaryDecode(what.rawValue(), in.bufferReader()))
+        in.setStatus(BinaryDecoder::Status_ReadPastEnd);
+      return true;
+    }
+
     void serialize(AnyReference val, BinaryEncoder& out, SerializeObjectCallback context, StreamContext* sctx)
     {
-      details::SerializeTypeVisitor stv(out, context, val, sctx);
-      qi::typeDispatch(stv, val);
+      if (!serializeStruct(val, out))
+      {
+        details::SerializeTypeVisitor stv(out, context, val, sctx);
+        qi::typeDispatch(stv, val);
+      }
       if (out.status() != BinaryEncoder::Status_Ok) {
         std::stringstream ss;
         ss << "OSerialization error " << BinaryEncoder::statusToStr(out.status());
@@ -885,9 +1066,12 @@ namespace qi {
 
     void deserialize(AnyReference what, BinaryDecoder& in, DeserializeObjectCallback context, StreamContext* sctx)
     {
-      details::DeserializeTypeVisitor dtv(in, context, sctx);
-      dtv.result = what;
-      qi::typeDispatch(dtv, dtv.result);
+      if (!deserializeStruct(what, in))
+      {
+        details::DeserializeTypeVisitor dtv(in, context, sctx);
+        dtv.result = what;
+        qi::typeDispatch(dtv, dtv.result);
+      }
       if (in.status() != BinaryDecoder::Status_Ok) {
         std::stringstream ss;
         ss << "ISerialization error " << BinaryDecoder::statusToStr(in.status());
@@ -911,8 +1095,11 @@ namespace qi {
 
   void encodeBinary(qi::Buffer *buf, const qi::AutoAnyReference &gvp, SerializeObjectCallback onObject, StreamContext* sctx) {
     BinaryEncoder be(*buf);
-    details::SerializeTypeVisitor stv(be, onObject, gvp, sctx);
-    qi::typeDispatch(stv, gvp);
+    if (!details::serializeStruct(gvp, be))
+    {
+      details::SerializeTypeVisitor stv(be, onObject, gvp, sctx);
+      qi::typeDispatch(stv, gvp);
+    }
     if (be.status() != BinaryEncoder::Status_Ok) {
       std::stringstream ss;
       ss << "OSerialization error " << be.status();
@@ -924,9 +1111,12 @@ namespace qi {
   void decodeBinary(qi::BufferReader *buf, qi::AnyReference gvp,
     DeserializeObjectCallback onObject, StreamContext* sctx) {
     BinaryDecoder in(buf);
-    details::DeserializeTypeVisitor dtv(in, onObject, sctx);
-    dtv.result = gvp;
-    qi::typeDispatch(dtv, dtv.result);
+    if (!details::deserializeStruct(gvp, in))
+    {
+      details::DeserializeTypeVisitor dtv(in, onObject, sctx);
+      dtv.result = gvp;
+      qi::typeDispatch(dtv, dtv.result);
+    }
     if (in.status() != BinaryDecoder::Status_Ok) {
       std::stringstream ss;
       ss << "ISerialization error " << in.status();
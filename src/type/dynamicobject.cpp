@@ -16,6 +16,8 @@
 #include <qi/signal.hpp>
 #include <qi/type/dynamicobject.hpp>
 
+#include "staticobjecttype.hpp"
+
 
 qiLogCategory("qitype.dynamicobject");
 
@@ -280,7 +282,7 @@ namespace qi
     SignalBase * s = _p->createSignal(event);
     if (s)
     { // signal is declared, create if needed
-      s->trigger(params);
+      triggerSignal(context, event, s, params);
       return;
     }
 
@@ -531,7 +533,11 @@ namespace qi
     }
     void operator()()
     {
-      call(*out, context, lock, params, methodId, func, callerId, postTimestamp);
+      // Canceled while waiting in the queue: do not run it at all.
+      if (out->isCancelRequested())
+        out->setCanceled();
+      else
+        call(*out, context, lock, params, methodId, func, callerId, postTimestamp);
       params.destroy(noCloneFirst);
       delete out;
     }
@@ -581,7 +587,9 @@ namespace qi
     {
       // If call is handled by our thread pool, we can safely switch the promise
       // to synchronous mode.
+      // Cancel requests are honored if the call did not start yet.
       qi::Promise<AnyReference>* out = new qi::Promise<AnyReference>(
+        &PromiseNoop<AnyReference>,
         elForced?FutureCallbackType_Async:FutureCallbackType_Sync);
       GenericFunctionParameters pCopy = params.copy(noCloneFirst);
       qi::Future<AnyReference> result = out->future();
@@ -59,6 +59,15 @@ int GenericObject::findMethod(const std::string& nameWithOptionalSignature, cons
   return metaObject().findMethod(nameWithOptionalSignature, args);
 }
 
+int GenericObject::resolve(const std::string& name, const std::vector<TypeInterface*>& argTypes)
+{
+  GenericFunctionParameters args;
+  args.reserve(argTypes.size());
+  for (unsigned i = 0; i < argTypes.size(); ++i)
+    args.push_back(AnyReference(argTypes[i], 0));
+  return metaObject()._p->findMethod(name, args, 0, false);
+}
+
 qi::Future<AnyReference>
 GenericObject::metaCall(const std::string &nameWithOptionalSignature, const GenericFunctionParameters& args, MetaCallType callType, Signature returnSignature)
 {
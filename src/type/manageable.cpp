@@ -1,10 +1,133 @@
 #include <qi/type/detail/manageable.hpp>
 #include <qi/type/objecttypebuilder.hpp>
 
+#include <cmath>
+#include <limits>
+
+#include <boost/atomic.hpp>
+#include <boost/make_shared.hpp>
+
 #include "staticobjecttype.hpp"
 
 namespace qi
 {
+  namespace
+  {
+    /* Log-linear histogram of durations in microseconds. Values below
+     * SubBuckets have their own bucket, then each power of two is split
+     * in SubBuckets buckets, which bounds the relative error to
+     * 1/SubBuckets. Longer durations are clamped to 2^MaxBits us.
+     */
+    const unsigned int SubBucketBits = 4;
+    const unsigned int SubBuckets = 1 << SubBucketBits;
+    const unsigned int MaxBits = 36; // about 19 hours
+    const unsigned int BucketCount = SubBuckets * (MaxBits - SubBucketBits + 1);
+
+    unsigned int bucketIndex(qi::uint64_t us)
+    {
+      if (us >> MaxBits)
+        us = (qi::uint64_t(1) << MaxBits) - 1;
+      if (us < SubBuckets)
+        return static_cast<unsigned int>(us);
+      unsigned int highBit = SubBucketBits;
+      while (us >> (highBit + 1))
+        ++highBit;
+      unsigned int shift = highBit - SubBucketBits;
+      return SubBuckets * (shift + 1) + static_cast<unsigned int>((us >> shift) - SubBuckets);
+    }
+
+    // Middle of the range of values counted in bucket \p index
+    qi::uint64_t bucketValue(unsigned int index)
+    {
+      if (index < SubBuckets)
+        return index;
+      unsigned int shift = index / SubBuckets - 1;
+      qi::uint64_t low = qi::uint64_t(SubBuckets + index % SubBuckets) << shift;
+      return low + ((qi::uint64_t(1) << shift) >> 1);
+    }
+
+    class Histogram
+    {
+    public:
+      Histogram()
+        : _sum(0)
+        , _min(std::numeric_limits<qi::int64_t>::max())
+        , _max(0)
+      {
+        for (unsigned int i = 0; i < BucketCount; ++i)
+          _buckets[i].store(0, boost::memory_order_relaxed);
+      }
+
+      void push(qi::int64_t us)
+      {
+        if (us < 0)
+          us = 0;
+        _buckets[bucketIndex(us)].fetch_add(1, boost::memory_order_relaxed);
+        _sum.fetch_add(us, boost::memory_order_relaxed);
+        qi::int64_t cur = _min.load(boost::memory_order_relaxed);
+        while (us < cur && !_min.compare_exchange_weak(cur, us, boost::memory_order_relaxed))
+          ;
+        cur = _max.load(boost::memory_order_relaxed);
+        while (us > cur && !_max.compare_exchange_weak(cur, us, boost::memory_order_relaxed))
+          ;
+      }
+
+      // Values are converted to seconds, as pushed to Manageable::pushStats
+      void snapshot(MinMaxSum* mms, Percentiles* percentiles) const
+      {
+        qi::int64_t min = _min.load(boost::memory_order_relaxed);
+        qi::int64_t max = _max.load(boost::memory_order_relaxed);
+        if (min > max)
+          min = max;
+        *mms = MinMaxSum(min / 1e6f, max / 1e6f, _sum.load(boost::memory_order_relaxed) / 1e6f);
+
+        qi::uint32_t counts[BucketCount];
+        qi::uint64_t total = 0;
+        for (unsigned int i = 0; i < BucketCount; ++i)
+          total += (counts[i] = _buckets[i].load(boost::memory_order_relaxed));
+        *percentiles = Percentiles(percentile(counts, total, 0.5, min, max),
+                                   percentile(counts, total, 0.99, min, max),
+                                   percentile(counts, total, 0.999, min, max));
+      }
+
+    private:
+      static float percentile(const qi::uint32_t* counts, qi::uint64_t total, double q,
+                              qi::int64_t min, qi::int64_t max)
+      {
+        if (!total)
+          return 0;
+        qi::uint64_t rank = static_cast<qi::uint64_t>(std::ceil(q * total));
+        qi::uint64_t seen = 0;
+        unsigned int i = 0;
+        for (; i < BucketCount - 1; ++i)
+          if ((seen += counts[i]) >= rank)
+            break;
+        // the exact extrema are known, do not report beyond them
+        qi::int64_t value = static_cast<qi::int64_t>(bucketValue(i));
+        value = (std::max)(min, (std::min)(max, value));
+        return value / 1e6f;
+      }
+
+      boost::atomic<qi::uint32_t> _buckets[BucketCount];
+      boost::atomic<qi::int64_t>  _sum;
+      boost::atomic<qi::int64_t>  _min;
+      boost::atomic<qi::int64_t>  _max;
+    };
+
+    struct SlotStatistics
+    {
+      SlotStatistics()
+        : count(0)
+      {}
+
+      boost::atomic<qi::uint32_t> count;
+      Histogram wall;
+      Histogram user;
+      Histogram system;
+    };
+    typedef boost::shared_ptr<SlotStatistics> SlotStatisticsPtr;
+    typedef std::map<unsigned int, SlotStatisticsPtr> SlotStatisticsMap;
+  }
 
   class ManageablePrivate
   {
@@ -20,7 +143,10 @@ namespace qi
 
     bool statsEnabled;
     bool traceEnabled;
-    ObjectStatistics stats;
+    // Copied on insertion so that pushStats does not lock once the slot
+    // is known. Use atomic_load/store, statsMutex serializes writers.
+    boost::shared_ptr<const SlotStatisticsMap> stats;
+    boost::mutex                statsMutex;
     qi::Atomic<int> traceId;
   };
 
@@ -30,6 +156,7 @@ namespace qi
     , eventLoop(NULL)
     , statsEnabled(false)
     , traceEnabled(false)
+    , stats(boost::make_shared<SlotStatisticsMap>())
   {
   }
 
@@ -96,21 +223,58 @@ namespace qi
 
   void Manageable::pushStats(int slotId, float wallTime, float userTime, float systemTime)
   {
-    boost::mutex::scoped_lock(_p->registrationsMutex);
-    MethodStatistics& ms = _p->stats[slotId];
-    ms.push(wallTime, userTime, systemTime);
+    boost::shared_ptr<const SlotStatisticsMap> stats = boost::atomic_load(&_p->stats);
+    SlotStatisticsMap::const_iterator it = stats->find(slotId);
+    SlotStatisticsPtr slot;
+    if (it != stats->end())
+      slot = it->second;
+    else
+    {
+      boost::mutex::scoped_lock lock(_p->statsMutex);
+      stats = boost::atomic_load(&_p->stats);
+      it = stats->find(slotId);
+      if (it != stats->end())
+        slot = it->second;
+      else
+      {
+        boost::shared_ptr<SlotStatisticsMap> copy = boost::make_shared<SlotStatisticsMap>(*stats);
+        slot = boost::make_shared<SlotStatistics>();
+        (*copy)[slotId] = slot;
+        boost::atomic_store(&_p->stats, boost::shared_ptr<const SlotStatisticsMap>(copy));
+      }
+    }
+    slot->wall.push(static_cast<qi::int64_t>(wallTime * 1e6f + 0.5f));
+    slot->user.push(static_cast<qi::int64_t>(userTime * 1e6f + 0.5f));
+    slot->system.push(static_cast<qi::int64_t>(systemTime * 1e6f + 0.5f));
+    slot->count.fetch_add(1, boost::memory_order_release);
   }
 
   ObjectStatistics Manageable::stats() const
   {
-    boost::mutex::scoped_lock(_p->registrationsMutex);
-    return _p->stats;
+    boost::shared_ptr<const SlotStatisticsMap> stats = boost::atomic_load(&_p->stats);
+    ObjectStatistics result;
+    for (SlotStatisticsMap::const_iterator it = stats->begin(); it != stats->end(); ++it)
+    {
+      const SlotStatistics& slot = *it->second;
+      unsigned int count = slot.count.load(boost::memory_order_acquire);
+      if (!count)
+        continue; // first push still in progress
+      MinMaxSum wall, user, system;
+      Percentiles wallPercentiles, userPercentiles, systemPercentiles;
+      slot.wall.snapshot(&wall, &wallPercentiles);
+      slot.user.snapshot(&user, &userPercentiles);
+      slot.system.snapshot(&system, &systemPercentiles);
+      result[it->first] = MethodStatistics(count, wall, user, system,
+                                           wallPercentiles, userPercentiles, systemPercentiles);
+    }
+    return result;
   }
 
   void Manageable::clearStats()
   {
-    boost::mutex::scoped_lock(_p->registrationsMutex);
-    _p->stats.clear();
+    boost::mutex::scoped_lock lock(_p->statsMutex);
+    boost::atomic_store(&_p->stats, boost::shared_ptr<const SlotStatisticsMap>(
+                          boost::make_shared<SlotStatisticsMap>()));
   }
 
   bool Manageable::isTraceEnabled() const
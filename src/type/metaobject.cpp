@@ -148,11 +148,21 @@ namespace qi {
    *  -2 : arguments do not matches
    *  -3 : ambiguous matches
    */
-  int MetaObjectPrivate::findMethod(const std::string& nameWithOptionalSignature, const GenericFunctionParameters& args, bool* canCache) const
+  int MetaObjectPrivate::cacheResolution(const ResolutionKey& key, unsigned int id) const
+  {
+    // Bound the cache for callers with ever changing argument types
+    if (_resolutionCache.size() >= 1024)
+      _resolutionCache.clear();
+    _resolutionCache[key] = id;
+    return id;
+  }
+
+  int MetaObjectPrivate::findMethod(const std::string& nameWithOptionalSignature, const GenericFunctionParameters& args, bool* canCache, bool dynamicResolution) const
   {
     // We can keep this outside the lock because we assume MetaMethods can't be
     // removed
     MetaMethod* firstOverload = 0;
+    ResolutionKey key;
     {
       boost::recursive_mutex::scoped_lock sl(_methodsMutex);
       if (_dirtyCache)
@@ -209,16 +219,26 @@ namespace qi {
         //TODO....
         return -2; // no match for a correct overload (bad number of args)
       }
-      if (!ambiguous) {
+      // A call checks the arguments against the single candidate when it is
+      // invoked, resolving from types alone has to check them here.
+      if (!ambiguous && dynamicResolution) {
 
         return firstMatch->uid();
       }
       firstOverload = overloadIt->second;
+      // Resolution with argument types only does not depend on their values
+      key.first = nameWithOptionalSignature;
+      key.second.reserve(nargs);
+      for (unsigned i = 0; i < nargs; ++i)
+        key.second.push_back(args[i].type());
+      ResolutionCache::const_iterator cached = _resolutionCache.find(key);
+      if (cached != _resolutionCache.end())
+        return cached->second;
     }
 
     int retval = -2;
     // resolve ambiguity by using arguments
-    for (unsigned dyn = 0; dyn < 2; ++dyn)
+    for (unsigned dyn = 0; dyn < (dynamicResolution ? 2u : 1u); ++dyn)
     {
       // DO *NOT* hold the lock while resolving signatures dynamically. This
       // may block (and in case of python need the GIL)
@@ -229,9 +249,9 @@ namespace qi {
         std::string fullSig = nameWithOptionalSignature + "::" + resolvedSig;
         qiLogDebug() << "Finding method for resolved signature " << fullSig;
         // First try an exact match, which is much faster if we're lucky.
-        NameToIdx::const_iterator itRev =  _methodsNameToIdx.find(nameWithOptionalSignature);
+        NameToIdx::const_iterator itRev =  _methodsNameToIdx.find(fullSig);
         if (itRev != _methodsNameToIdx.end())
-          return itRev->second;
+          return dyn ? itRev->second : cacheResolution(key, itRev->second);
         typedef std::vector<std::pair<MetaMethod, float> > Methods;
 
         typedef std::vector<std::pair<const MetaMethod*, float> > MethodsPtr;
@@ -248,7 +268,7 @@ namespace qi {
         if (mml.empty())
           continue;
         if (mml.size() == 1)
-          return mml.front().first->uid();
+          return dyn ? mml.front().first->uid() : cacheResolution(key, mml.front().first->uid());
 
         // get best match
         MethodsPtr::iterator it = std::max_element(mml.begin(), mml.end(), less_pair_second());
@@ -263,7 +283,7 @@ namespace qi {
           qiLogVerbose() << generateErrorString(nameWithOptionalSignature, fullSig, const_cast<MetaObjectPrivate*>(this)->findCompatibleMethod(nameWithOptionalSignature), -3, false);
           retval = -3;
         } else
-          return it->first->uid();
+          return dyn ? it->first->uid() : cacheResolution(key, it->first->uid());
       }
     }
     return retval;
@@ -474,6 +494,7 @@ namespace qi {
     }
     // never lower index
     _index = std::max(idx, *_index);
+    _resolutionCache.clear();
     _dirtyCache = false;
   }
 
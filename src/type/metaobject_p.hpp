@@ -77,7 +77,10 @@ namespace qi {
 
     void setDescription(const std::string& desc);
 
-    int findMethod(const std::string& nameWithOptionalSignature, const GenericFunctionParameters& args, bool* canCache) const;
+    /* If dynamicResolution is false, only the type of args is used: their
+     * value can be null.
+     */
+    int findMethod(const std::string& nameWithOptionalSignature, const GenericFunctionParameters& args, bool* canCache, bool dynamicResolution = true) const;
 
   private:
     friend class MetaObject;
@@ -113,6 +116,16 @@ namespace qi {
     // true if cache must be refreshed
     mutable bool                        _dirtyCache;
 
+    // (name, argument types) -> method, for overloads resolved by argument
+    // types. Protected by _methodsMutex, cleared by refreshCache().
+    // TypeInterface instances are never deleted once created (typeOf<T>()
+    // singletons, or cached by the make*Type() factories), so their address
+    // cannot be reused by an other type while a key refers to it.
+    typedef std::pair<std::string, std::vector<TypeInterface*> > ResolutionKey;
+    typedef std::map<ResolutionKey, unsigned int> ResolutionCache;
+    mutable ResolutionCache             _resolutionCache;
+    int cacheResolution(const ResolutionKey& key, unsigned int id) const;
+
     // Global uid for event subscribers.
     static qi::Atomic<int> uid;
 
@@ -124,61 +124,48 @@ namespace qi {
 
     if (mct == qi::MetaCallType_Auto)
       mct = _p->defaultCallType;
-    SignalSubscriberMap copy;
-    {
-      boost::recursive_mutex::scoped_lock sl(_p->mutex);
-      copy = _p->subscriberMap;
-    }
-    qiLogDebug() << (void*)this << " Invoking signal subscribers: " << copy.size();
-    SignalSubscriberMap::iterator i;
-    for (i = copy.begin(); i != copy.end(); ++i)
+    // Snapshot is immutable: no need to lock or copy it to call subscribers
+    SignalSubscriberListPtr subs = _p->subscribers();
+    if (!subs)
+      return;
+    qiLogDebug() << (void*)this << " Invoking signal subscribers: " << subs->size();
+    // One copy of params for all queued subscribers
+    boost::shared_ptr<GenericFunctionParameters> sharedParams;
+    for (SignalSubscriberList::const_iterator i = subs->begin(); i != subs->end(); ++i)
     {
       qiLogDebug() << (void*)this << " Invoking signal subscriber";
-      SignalSubscriberPtr s = i->second; // hold s alive
-      s->call(params, mct);
+      (*i)->call(params, mct, sharedParams); // held alive by subs
     }
     qiLogDebug() << (void*)this << " done invoking signal subscribers";
   }
 
+  static void destroyParameters(GenericFunctionParameters* params)
+  {
+    params->destroy();
+    delete params;
+  }
+
   class FunctorCall
   {
   public:
-    FunctorCall(GenericFunctionParameters* params, SignalSubscriberPtr* sub)
+    FunctorCall(const boost::shared_ptr<GenericFunctionParameters>& params, const SignalSubscriberPtr& sub)
     : params(params)
     , sub(sub)
     {
     }
 
-    FunctorCall(const FunctorCall& b)
-    {
-      *this = b;
-    }
-
-    void operator=(const FunctorCall& b)
-    {
-      params = b.params;
-      sub = b.sub;
-    }
-
     void operator() ()
     {
       try
       {
         {
-          SignalSubscriberPtr s;
-          boost::mutex::scoped_lock sl((*sub)->mutex);
+          boost::mutex::scoped_lock sl(sub->mutex);
           // verify-enabled-then-register-active op must be locked
-          if (!(*sub)->enabled)
-          {
-            s = *sub; // delay destruction until after we leave the scoped_lock
-            delete sub;
-            params->destroy();
-            delete params;
+          if (!sub->enabled)
             return;
-          }
-          (*sub)->addActive(false);
+          sub->addActive(false);
         } // end mutex-protected scope
-        (*sub)->handler(*params);
+        sub->handler(*params);
       }
       catch(const qi::PointerLockException&)
       {
@@ -192,18 +179,23 @@ namespace qi {
         qiLogWarning() << "Unknown exception caught from signal subscriber";
       }
 
-      (*sub)->removeActive(true);
-      params->destroy();
-      delete params;
-      delete sub;
+      sub->removeActive(true);
     }
 
   public:
-    GenericFunctionParameters* params;
-    SignalSubscriberPtr*         sub;
+    // Shared by all queued subscribers of one trigger
+    boost::shared_ptr<GenericFunctionParameters> params;
+    SignalSubscriberPtr                          sub;
   };
 
   void SignalSubscriber::call(const GenericFunctionParameters& args, MetaCallType callType)
+  {
+    boost::shared_ptr<GenericFunctionParameters> sharedArgs;
+    call(args, callType, sharedArgs);
+  }
+
+  void SignalSubscriber::call(const GenericFunctionParameters& args, MetaCallType callType,
+                              boost::shared_ptr<GenericFunctionParameters>& sharedArgs)
   {
     // this is held alive by caller
     if (handler)
@@ -217,7 +209,8 @@ namespace qi {
       qiLogDebug() << "subscriber call async=" << async <<" ct " << callType <<" tm " << threadingModel;
       if (async)
       {
-        GenericFunctionParameters* copy = new GenericFunctionParameters(args.copy());
+        if (!sharedArgs)
+          sharedArgs.reset(new GenericFunctionParameters(args.copy()), &destroyParameters);
         // We will check enabled when we will be scheduled in the target
         // thread, and we hold this SignalSubscriber alive, so no need to
         // explicitly track the asynccall
@@ -226,7 +219,7 @@ namespace qi {
         qi::EventLoop* el = getEventLoop();
         if (!el) // this is an assert basicaly, no sense trying to do something clever.
           throw std::runtime_error("Event loop was destroyed");
-        el->post(FunctorCall(copy, new SignalSubscriberPtr(shared_from_this())));
+        el->post(FunctorCall(sharedArgs, shared_from_this()));
       }
       else
       {
@@ -395,6 +388,7 @@ namespace qi {
     s->source = this;
     bool first = _p->subscriberMap.empty();
     _p->subscriberMap[res] = s;
+    _p->updateSubscribers();
     if (first && _p->onSubscribers)
       _p->onSubscribers(true);
     return *s.get();
@@ -416,6 +410,7 @@ namespace qi {
       return;
 
     _p->subscriberMap.erase(it->second);
+    _p->updateSubscribers();
     _p->trackMap.erase(it);
   }
 
@@ -464,6 +459,7 @@ namespace qi {
       s = it->second;
       // Remove from map (but SignalSubscriber object still good)
       subscriberMap.erase(it);
+      updateSubscribers();
       // Acquire subscriber mutex before releasing mutex
       boost::mutex::scoped_lock subLock(s->mutex);
       // Release signal mutex
@@ -487,6 +483,25 @@ namespace qi {
     return true;
   }
 
+  void SignalBasePrivate::updateSubscribers()
+  {
+    SignalSubscriberListPtr list;
+    if (!subscriberMap.empty())
+    {
+      boost::shared_ptr<SignalSubscriberList> l = boost::make_shared<SignalSubscriberList>();
+      l->reserve(subscriberMap.size());
+      for (SignalSubscriberMap::iterator i = subscriberMap.begin(); i != subscriberMap.end(); ++i)
+        l->push_back(i->second);
+      list = l;
+    }
+    boost::atomic_store(&subscriberList, list);
+  }
+
+  SignalSubscriberListPtr SignalBasePrivate::subscribers() const
+  {
+    return boost::atomic_load(&subscriberList);
+  }
+
   bool SignalBase::disconnect(const SignalLink &link) {
     if (!_p)
       return false;
@@ -527,8 +542,7 @@ namespace qi {
   {
     if (!_p)
       return false;
-    boost::recursive_mutex::scoped_lock sl(_p->mutex);
-    return !_p->subscriberMap.empty();
+    return _p->subscribers().get() != 0;
   }
 
   bool SignalBasePrivate::reset() {
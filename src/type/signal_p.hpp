@@ -10,11 +10,15 @@
 #include <qi/signal.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace qi {
 
   typedef std::map<SignalLink, SignalSubscriberPtr> SignalSubscriberMap;
   typedef std::map<int, SignalLink> TrackMap;
+  // Immutable once published, replaced as a whole on (dis)connection
+  typedef std::vector<SignalSubscriberPtr> SignalSubscriberList;
+  typedef boost::shared_ptr<const SignalSubscriberList> SignalSubscriberListPtr;
 
   class SignalBasePrivate
   {
@@ -27,10 +31,15 @@ namespace qi {
     bool disconnect(const SignalLink& l);
     bool disconnectTrackLink(const SignalLink& l);
     bool reset();
+    // Publish a new subscribers snapshot from subscriberMap. Must hold mutex.
+    void updateSubscribers();
+    // Current snapshot, null if there are no subscribers. Does not lock.
+    SignalSubscriberListPtr subscribers() const;
 
   public:
     SignalBase::OnSubscribers      onSubscribers;
     SignalSubscriberMap            subscriberMap;
+    SignalSubscriberListPtr        subscriberList;
     TrackMap                       trackMap;
     qi::Atomic<int>                trackId;
     qi::Signature                  signature;
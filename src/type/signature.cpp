@@ -7,7 +7,11 @@
 #include <qi/signature.hpp>
 #include <qi/type/typeinterface.hpp>
 #include <qi/jsoncodec.hpp>
+#include <qi/atomic.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include "signatureconvertor.hpp"
 
 qiLogCategory("qitype.signature");
@@ -92,7 +96,7 @@ namespace qi {
 
 #define RET_CALC (1.0f * childErr * ((float)(100 - error)) / 100.0f)
 
-  float qi::Signature::isConvertibleTo(const qi::Signature& b) const
+  static float computeConvertibility(const qi::Signature& a, const qi::Signature& b)
   {
     /* The returned float is just a basic heuristic, it does not handle:
      * - comparison between integral types
@@ -105,27 +109,27 @@ namespace qi {
     static const char floating[] = "fd";
     static const char container[] = "[{(";
 
-    Signature::Type s = type();
+    Signature::Type s = a.type();
     Signature::Type d = b.type();
     //varargs are just vector, handle them that way
-    if (s == Type_VarArgs)
-      s = Type_List;
-    if (d == Type_VarArgs)
-      d = Type_List;
-    if (d == Type_Void)
+    if (s == Signature::Type_VarArgs)
+      s = Signature::Type_List;
+    if (d == Signature::Type_VarArgs)
+      d = Signature::Type_List;
+    if (d == Signature::Type_Void)
       return RET_CALC;
-    if (d == Type_Unknown)
+    if (d == Signature::Type_Unknown)
     {
       // We cannot anwser the question for unknown types. So let it pass
       // and the conversion code will decide.
       // Type_Unknown is not serializable anyway.
-      if (s != Type_Unknown)
+      if (s != Signature::Type_Unknown)
         error += 10; // Weird but can happen with object pointers
       return RET_CALC;
     }
 
-    if (d == Type_Dynamic || // Dynamic can convert to whatever
-        s == Type_None) // None means parent is empty container
+    if (d == Signature::Type_Dynamic || // Dynamic can convert to whatever
+        s == Signature::Type_None) // None means parent is empty container
     {
       error += 5; // big malus for dynamic
       return RET_CALC;
@@ -148,12 +152,12 @@ namespace qi {
     { // Container, list or map
       if (d != s)
         return 0; // Must be same container
-      if (children().size() != b.children().size())
+      if (a.children().size() != b.children().size())
       {
-        if (s != Type_Tuple)
+        if (s != Signature::Type_Tuple)
           return 0;
         // Special case for same-named tuples that might be compatible
-        std::string aSrc = annotation();
+        std::string aSrc = a.annotation();
         std::string aDst = b.annotation();
         // This mode is recommended only for tests where it is more
         // conveniant to have differently named structs
@@ -171,7 +175,7 @@ namespace qi {
       SignatureVector::const_iterator its;
       SignatureVector::const_iterator itd;
       itd = b.children().begin();
-      for (its = children().begin(); its != children().end(); ++its, ++itd) {
+      for (its = a.children().begin(); its != a.children().end(); ++its, ++itd) {
         float childRes = its->isConvertibleTo(*itd);
         if (!childRes)
           return 0; // Just check subtype compatibility
@@ -179,7 +183,7 @@ namespace qi {
         // [s] -> m should have a greater convertibility than [s] -> [m]
         childErr *= 1 - (1 - childRes) * 0.95;
       }
-      assert(its==children().end() && itd==b.children().end()); // we already exited on size mismatch
+      assert(its==a.children().end() && itd==b.children().end()); // we already exited on size mismatch
     }
     else if (d != s)
       return 0;
@@ -247,14 +251,106 @@ namespace qi {
 
   class SignaturePrivate {
   public:
+    SignaturePrivate()
+      : _id(0)
+    {}
+
     void parseChildren(const std::string &signature, size_t index);
     void eatChildren(const std::string &signature, int idxStart, int expectedEnd, int elementCount);
     void init(const std::string &signature, int begin, int end);
 
     std::string            _signature;
     std::vector<Signature> _children;
+    // Index in the interned signature table, 0 if not interned
+    unsigned int           _id;
   };
 
+  /* Parsed signatures are immutable, so all Signature instances built from
+   * the same string share one interned SignaturePrivate. Interned signatures
+   * have a stable id used to memoize isConvertibleTo() results.
+   * The table is bounded: once full, new signatures are parsed as before.
+   * Each thread keeps a copy of the entries it looked up, so that only the
+   * first lookup of a signature in a thread takes the table lock.
+   */
+  static const unsigned int MaxInternedSignatures = 4096;
+
+  typedef std::map<std::string, boost::shared_ptr<SignaturePrivate> > SignatureTable;
+
+  static boost::mutex* _signatureTableMutex = 0;
+  static SignatureTable* _signatureTable = 0;
+
+  static SignatureTable& threadSignatureTable()
+  {
+    static boost::thread_specific_ptr<SignatureTable>* tls;
+    QI_THREADSAFE_NEW(tls);
+    SignatureTable* table = tls->get();
+    if (!table)
+    {
+      table = new SignatureTable();
+      tls->reset(table);
+    }
+    return *table;
+  }
+
+  static boost::shared_ptr<SignaturePrivate> internSignature(const std::string &signature, size_t begin, size_t end)
+  {
+    std::string key(signature, begin, end - begin);
+    SignatureTable& local = threadSignatureTable();
+    SignatureTable::iterator lit = local.find(key);
+    if (lit != local.end())
+      return lit->second;
+
+    QI_THREADSAFE_NEW(_signatureTableMutex, _signatureTable);
+    {
+      boost::mutex::scoped_lock lock(*_signatureTableMutex);
+      SignatureTable::iterator it = _signatureTable->find(key);
+      if (it != _signatureTable->end())
+        return local[key] = it->second;
+    }
+    // Parse outside the lock: children are interned recursively
+    boost::shared_ptr<SignaturePrivate> p = boost::make_shared<SignaturePrivate>();
+    p->init(signature, begin, end);
+
+    boost::mutex::scoped_lock lock(*_signatureTableMutex);
+    if (_signatureTable->size() >= MaxInternedSignatures)
+      return p;
+    p->_id = _signatureTable->size() + 1;
+    return local[key] = _signatureTable->insert(std::make_pair(key, p)).first->second;
+  }
+
+  /* Direct-mapped memo of isConvertibleTo() between interned signatures.
+   * Each slot packs (from id, to id, score) in a single word so that it can
+   * be read and written without locking. Colliding entries overwrite each
+   * other.
+   */
+  static const unsigned int ConvertibilityMemoSize = 4096;
+  static boost::atomic<qi::uint64_t> _convertibilityMemo[ConvertibilityMemoSize];
+
+  float Signature::isConvertibleTo(const Signature& b) const
+  {
+    unsigned int from = _p->_id;
+    unsigned int to = b._p->_id;
+    if (!from || !to)
+      return computeConvertibility(*this, b);
+
+    qi::uint32_t key = (from << 16) | to;
+    boost::atomic<qi::uint64_t>& slot =
+      _convertibilityMemo[(from * 131 + to) & (ConvertibilityMemoSize - 1)];
+    qi::uint64_t entry = slot.load(boost::memory_order_relaxed);
+    float score;
+    if ((qi::uint32_t)(entry >> 32) == key)
+    {
+      qi::uint32_t bits = (qi::uint32_t)entry;
+      memcpy(&score, &bits, sizeof(score));
+      return score;
+    }
+    score = computeConvertibility(*this, b);
+    qi::uint32_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    slot.store(((qi::uint64_t)key << 32) | bits, boost::memory_order_relaxed);
+    return score;
+  }
+
   static size_t findNext(const std::string &signature, size_t index) {
 
     if (index >= signature.size())
@@ -434,23 +530,20 @@ namespace qi {
   }
 
   Signature::Signature(const char *signature)
-    : _p(boost::make_shared<SignaturePrivate>())
   {
-    _p->_signature.assign(signature);
-    _p->init(_p->_signature, 0, _p->_signature.size());
+    std::string sig(signature);
+    _p = internSignature(sig, 0, sig.size());
   }
 
 
   Signature::Signature(const std::string &signature)
-    : _p(boost::make_shared<SignaturePrivate>())
+    : _p(internSignature(signature, 0, signature.size()))
   {
-    _p->init(signature, 0, signature.size());
   }
 
   Signature::Signature(const std::string &signature, size_t begin, size_t end)
-    : _p(boost::make_shared<SignaturePrivate>())
+    : _p(internSignature(signature, begin, end))
   {
-    _p->init(signature, begin, end);
   }
 
   bool Signature::isValid() const {
@@ -555,6 +648,8 @@ namespace qi {
   //compare signature without taking annotation into account
   bool operator==(const Signature& lhs, const Signature& rhs)
   {
+    if (lhs._p == rhs._p)
+      return true;
     if (lhs.type() != rhs.type())
       return false;
     if (lhs.children().size() != rhs.children().size())
@@ -126,13 +126,30 @@ static void reportError(qi::Future<AnyReference> fut) {
   ref.destroy();
 }
 
+void triggerSignal(AnyObject context, unsigned int event, SignalBase* signal,
+                   const GenericFunctionParameters& params)
+{
+  if (!context || !context.isStatsEnabled())
+  {
+    signal->trigger(params);
+    return;
+  }
+  qi::int64_t time = qi::os::ustime();
+  std::pair<qi::int64_t, qi::int64_t> cputime = qi::os::cputime();
+  signal->trigger(params);
+  std::pair<qi::int64_t, qi::int64_t> cpuendtime = qi::os::cputime();
+  context.asGenericObject()->pushStats(event, (float)(qi::os::ustime() - time) / 1e6f,
+                                       (float)(cpuendtime.first - cputime.first) / 1e6f,
+                                       (float)(cpuendtime.second - cputime.second) / 1e6f);
+}
+
 void StaticObjectTypeBase::metaPost(void* instance, AnyObject context, unsigned int signal,
                                     const GenericFunctionParameters& params)
 {
   SignalBase* sb = getSignal(_data, instance, signal);
   if (sb)
   {
-    sb->trigger(params);
+    triggerSignal(context, signal, sb, params);
   }
   else
   { // try method
@@ -83,5 +83,9 @@ private:
   ObjectTypeData _data;
 };
 
+/// Trigger \p signal, recording the time it took in \p context statistics if enabled.
+void triggerSignal(AnyObject context, unsigned int event, SignalBase* signal,
+                   const GenericFunctionParameters& params);
+
 }
 #endif  // _SRC_STATICOBJECTTYPE_HPP_
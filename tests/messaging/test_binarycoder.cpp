@@ -7,6 +7,7 @@
 
 #include <gtest/gtest.h>
 #include <map>
+#include <list>
 #include <qi/buffer.hpp>
 #include <qi/binarycodec.hpp>
 #include <qi/session.hpp>
@@ -369,6 +370,56 @@ TEST(TestBind, serializeVectorStrings)
   EXPECT_EQ(vs[2], vs2[2]);
 }
 
+TEST(TestBind, serializeVectorFloats)
+{
+  qi::Buffer      buf;
+  qi::BufferReader bufr(buf);
+  std::vector<float> vf;
+  for (unsigned i = 0; i < 100000; ++i)
+    vf.push_back(i * 0.5f);
+  qi::encodeBinary(&buf, vf);
+  EXPECT_EQ(sizeof(qi::uint32_t) + vf.size() * sizeof(float), buf.size());
+
+  std::vector<float> vf1;
+  qi::decodeBinary(&bufr, &vf1);
+  EXPECT_EQ(vf, vf1);
+}
+
+TEST(TestBind, serializePodListsCompatibility)
+{
+  // Contiguous lists use a bulk copy, other containers go element-wise:
+  // both must produce and accept the same bytes
+  qi::Buffer      buf;
+  qi::BufferReader bufr(buf);
+  std::vector<qi::int16_t> vs;
+  vs.push_back(-3);
+  vs.push_back(SHRT_MAX);
+  std::list<double> ld;
+  ld.push_back(1.5);
+  ld.push_back(-2.25);
+  qi::encodeBinary(&buf, vs);
+  qi::encodeBinary(&buf, ld);
+
+  std::list<qi::int16_t> ls;
+  qi::decodeBinary(&bufr, &ls);
+  std::vector<double> vd;
+  qi::decodeBinary(&bufr, &vd);
+  EXPECT_EQ(std::list<qi::int16_t>(vs.begin(), vs.end()), ls);
+  EXPECT_EQ(std::vector<double>(ld.begin(), ld.end()), vd);
+}
+
+TEST(TestBind, serializeVectorTruncated)
+{
+  qi::Buffer      buf;
+  qi::encodeBinary(&buf, std::vector<int>(10, 42));
+  qi::Buffer      truncated;
+  truncated.write(buf.data(), buf.size() - 1);
+  qi::BufferReader bufr(truncated);
+
+  std::vector<int> vi;
+  EXPECT_ANY_THROW(qi::decodeBinary(&bufr, &vi));
+}
+
 TEST(TestBind, serializeBuffer)
 {
   qi::Buffer buf;
@@ -387,6 +438,82 @@ TEST(TestBind, serializeBuffer)
 
 }
 
+TEST(TestBind, deserializeBufferNoCopy)
+{
+  // Buffers received from the network are flat: size then data
+  std::string payload(1000, 'x');
+  qi::uint32_t sz = payload.size();
+  qi::Buffer flat;
+  flat.write(&sz, sizeof(sz));
+  flat.write(payload.data(), payload.size());
+
+  qi::BufferReader bufr(flat);
+  qi::Buffer out;
+  qi::decodeBinary(&bufr, &out);
+  ASSERT_EQ(payload.size(), out.size());
+  EXPECT_EQ((const char*)flat.data() + sizeof(sz), out.data());
+
+  // Modifying the source leaves the slice untouched
+  flat.write("z", 1);
+  flat.clear();
+  flat.write(&sz, sizeof(sz));
+  flat.write(std::string(1000, 'z').data(), 1000);
+  EXPECT_EQ(payload, std::string((const char*)out.data(), out.size()));
+
+  // Modifying the slice leaves the original data untouched
+  qi::Buffer out2;
+  qi::BufferReader bufr2(flat);
+  qi::decodeBinary(&bufr2, &out2);
+  out2.clear();
+  out2.write("y", 1);
+  EXPECT_EQ('z', ((const char*)flat.data())[sizeof(sz)]);
+  EXPECT_EQ('y', *(const char*)out2.data());
+}
+
+TEST(TestBind, deserializeBufferSmall)
+{
+  // Small buffers keep their bytes inline: slices get a copy
+  qi::uint32_t sz = 3;
+  qi::Buffer flat;
+  flat.write(&sz, sizeof(sz));
+  flat.write("abc", 3);
+
+  qi::BufferReader bufr(flat);
+  qi::Buffer out;
+  qi::decodeBinary(&bufr, &out);
+  ASSERT_EQ(3u, out.size());
+  flat.clear();
+  flat.write("xxxxxxx", 7);
+  EXPECT_EQ("abc", std::string((const char*)out.data(), out.size()));
+}
+
+TEST(TestBind, deserializeStringView)
+{
+  const std::string text(1000, 'h');
+  qi::Buffer buf;
+  qi::encodeBinary(&buf, text);
+  qi::BufferReader bufr(buf);
+  qi::StringView view;
+  qi::decodeBinary(&bufr, &view);
+  EXPECT_EQ(text, view.str());
+  EXPECT_EQ((const char*)buf.data() + sizeof(qi::uint32_t), view.data());
+  EXPECT_EQ(qi::StringView(text), view);
+  // The view outlives changes to the buffer it was read from
+  buf.clear();
+  buf.write("x", 1);
+  EXPECT_EQ(text, view.str());
+
+  // A view serializes as a string
+  qi::Buffer buf2;
+  qi::encodeBinary(&buf2, view);
+  qi::BufferReader bufr2(buf2);
+  std::string s;
+  qi::decodeBinary(&bufr2, &s);
+  EXPECT_EQ(text, s);
+  EXPECT_EQ(text, qi::AnyReference::from(view).toString());
+  EXPECT_EQ("foo", qi::AnyValue::from(std::string("foo")).to<qi::StringView>().str());
+}
+
 TEST(TestBind, serializeAllTypes)
 {
   qi::Buffer      buf;
@@ -540,6 +667,135 @@ TEST(TestBind, SerializeCustomComplex)
   ASSERT_EQ(comp, compout);
 }
 
+struct FastPoint
+{
+  bool operator == (const FastPoint& b) const { return x==b.x && y==b.y;}
+  int x, y;
+};
+
+QI_TYPE_STRUCT_EXTENSION_BINARY_CODEC(FastPoint);
+QI_TYPE_STRUCT(FastPoint, x, y);
+
+struct FastScan
+{
+  bool operator == (const FastScan& b) const {
+    return points == b.points && ranges == b.ranges && frame == b.frame
+      && valid == b.valid && stamp == b.stamp && names == b.names;
+  }
+  std::vector<FastPoint> points;
+  std::vector<float> ranges;
+  std::string frame;
+  bool valid;
+  qi::int64_t stamp;
+  std::vector<std::string> names;
+};
+
+QI_TYPE_STRUCT_EXTENSION_BINARY_CODEC(FastScan);
+QI_TYPE_STRUCT(FastScan, points, ranges, frame, valid, stamp, names);
+
+// Same fields, serialized by the generic code
+struct SlowScan
+{
+  std::vector<Point> points;
+  std::vector<float> ranges;
+  std::string frame;
+  bool valid;
+  qi::int64_t stamp;
+  std::vector<std::string> names;
+};
+
+QI_TYPE_STRUCT(SlowScan, points, ranges, frame, valid, stamp, names);
+
+struct FastDynamic
+{
+  int i;
+  qi::AnyValue v;
+};
+
+QI_TYPE_STRUCT_EXTENSION_BINARY_CODEC(FastDynamic);
+QI_TYPE_STRUCT(FastDynamic, i, v);
+
+TEST(TestBind, SerializeStructBinaryCodec)
+{
+  FastScan fast;
+  SlowScan slow;
+  for (int i = 0; i < 10; ++i)
+  {
+    FastPoint fp; fp.x = i; fp.y = -i;
+    fast.points.push_back(fp);
+    slow.points.push_back(point(i, -i));
+    fast.ranges.push_back(i * 0.25f);
+    fast.names.push_back(std::string(i, 'n'));
+  }
+  slow.ranges = fast.ranges;
+  slow.names = fast.names;
+  fast.frame = slow.frame = "laser";
+  fast.valid = slow.valid = true;
+  fast.stamp = slow.stamp = 1234567890123LL;
+
+  EXPECT_TRUE(static_cast<qi::StructTypeInterface*>(qi::typeOf<FastScan>())->hasBinaryCodec());
+  EXPECT_FALSE(static_cast<qi::StructTypeInterface*>(qi::typeOf<SlowScan>())->hasBinaryCodec());
+
+  qi::Buffer fastBuf;
+  qi::Buffer slowBuf;
+  qi::encodeBinary(&fastBuf, fast);
+  qi::encodeBinary(&slowBuf, slow);
+  ASSERT_EQ(slowBuf.size(), fastBuf.size());
+  EXPECT_EQ(0, memcmp(slowBuf.data(), fastBuf.data(), fastBuf.size()));
+
+  qi::BufferReader slowReader(slowBuf);
+  FastScan fastOut;
+  qi::decodeBinary(&slowReader, &fastOut);
+  EXPECT_EQ(fast, fastOut);
+
+  // inside a list of structs
+  std::vector<FastScan> scans(3, fast);
+  qi::Buffer listBuf;
+  qi::encodeBinary(&listBuf, scans);
+  qi::BufferReader listReader(listBuf);
+  std::vector<FastScan> scansOut;
+  qi::decodeBinary(&listReader, &scansOut);
+  EXPECT_EQ(scans, scansOut);
+}
+
+TEST(TestBind, SerializeStructBinaryCodecTruncated)
+{
+  FastScan fast;
+  fast.frame = "laser";
+  fast.valid = false;
+  fast.stamp = 0;
+  fast.ranges.resize(4, 1.0f);
+  qi::Buffer buf;
+  qi::encodeBinary(&buf, fast);
+  qi::Buffer truncated;
+  truncated.write(buf.data(), buf.size() - 1);
+  qi::BufferReader reader(truncated);
+  FastScan out;
+  out.frame = "before";
+  out.valid = true;
+  out.stamp = 42;
+  FastScan before = out;
+  EXPECT_ANY_THROW(qi::decodeBinary(&reader, &out));
+  // Fields read before the end of the data were not written
+  EXPECT_EQ(before, out);
+}
+
+TEST(TestBind, SerializeStructBinaryCodecFallback)
+{
+  // AnyValue has no direct encoding: the generic code is used
+  EXPECT_FALSE(static_cast<qi::StructTypeInterface*>(qi::typeOf<FastDynamic>())->hasBinaryCodec());
+  FastDynamic d;
+  d.i = 12;
+  d.v = qi::AnyValue::from(std::string("foo"));
+  qi::Buffer buf;
+  qi::encodeBinary(&buf, d);
+  qi::BufferReader reader(buf);
+  FastDynamic out;
+  qi::decodeBinary(&reader, &out);
+  EXPECT_EQ(12, out.i);
+  EXPECT_EQ("foo", out.v.toString());
+}
+
 //compilation of weird case. C++ typesystem Hell.
 TEST(TestBind, TestShPtr) {
   boost::shared_ptr<int> sh1;
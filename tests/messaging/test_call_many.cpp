@@ -8,8 +8,14 @@
 #include <qi/anyobject.hpp>
 #include <qi/type/dynamicobjectbuilder.hpp>
 #include <qi/session.hpp>
+#include <boost/make_shared.hpp>
 #include <testsession/testsessionpair.hpp>
 
+#include "src/messaging/boundobject.hpp"
+#include "src/messaging/remoteobject_p.hpp"
+#include "src/messaging/server.hpp"
+#include "src/messaging/transportsocket.hpp"
+
 qi::AnyObject          oclient1, oclient2;
 static qi::Promise<bool> payload;
 
@@ -66,6 +72,60 @@ TEST(Test, Recurse)
   oclient2.reset();
 }
 
+static qi::ServiceBoundObject*  bound;
+static qi::Promise<void>        arrived[2];
+static qi::TransportSocketPtr   callerSockets[2];
+
+// Only returns true if the other call runs at the same time, and each call
+// sees its own caller socket
+bool waitForOtherCall(int caller)
+{
+  qi::TransportSocketPtr socket = bound->currentSocket();
+  callerSockets[caller] = socket;
+  arrived[caller].setValue(0);
+  if (arrived[1 - caller].future().wait(3000) != qi::FutureState_FinishedWithValue)
+    return false;
+  return socket && bound->currentSocket() == socket && callerSockets[1 - caller] != socket;
+}
+
+TEST(Test, ParallelDirectCalls)
+{
+  qi::DynamicObjectBuilder ob;
+  ob.setThreadingModel(qi::ObjectThreadingModel_MultiThread);
+  ob.advertiseMethod("waitForOtherCall", &waitForOtherCall);
+
+  // Direct: each call runs on the thread reading its socket
+  qi::Server server;
+  ASSERT_FALSE(server.listen("tcp://127.0.0.1:0").hasError());
+  boost::shared_ptr<qi::ServiceBoundObject> sbo = boost::make_shared<qi::ServiceBoundObject>(
+        1, qi::Message::GenericObject_Main, ob.object(), qi::MetaCallType_Direct);
+  bound = sbo.get();
+  ASSERT_TRUE(server.addObject(1, qi::BoundAnyObject(sbo)));
+
+  // one socket per caller
+  qi::TransportSocketPtr sockets[2];
+  boost::shared_ptr<qi::RemoteObject> remotes[2];
+  qi::Future<bool> calls[2];
+  for (int i = 0; i < 2; ++i)
+  {
+    sockets[i] = qi::makeTransportSocket("tcp");
+    ASSERT_FALSE(sockets[i]->connect(server.endpoints()[0]).hasError());
+    remotes[i] = boost::make_shared<qi::RemoteObject>(1, sockets[i]);
+    ASSERT_FALSE(remotes[i]->fetchMetaObject().hasError());
+  }
+  for (int i = 0; i < 2; ++i)
+    calls[i] = qi::makeDynamicAnyObject(remotes[i].get(), false).async<bool>("waitForOtherCall", i);
+  EXPECT_TRUE(calls[0].value());
+  EXPECT_TRUE(calls[1].value());
+
+  for (int i = 0; i < 2; ++i)
+  {
+    remotes[i]->close();
+    sockets[i]->disconnect();
+  }
+  server.close();
+  bound = 0;
+}
 
 int main(int argc, char **argv) {
   qi::Application app(argc, argv);
@@ -171,9 +171,9 @@ int main(int argc, char **argv) {
 #ifdef WITH_GATEWAY_
 
   qi::Gateway gate;
-  gate.attachToServiceDirectory(sd.endpoints()[0]);
-  gate.listen(gatewayAddr.str());
-  connectionAddr = gate.endpoints()[0];
+  gate.attachToServiceDirectory(session.endpoints()[0]);
+  gate.listen("tcp://127.0.0.1:0");
+  connectionAddr = gate.endpoints()[0].str();
 #endif
 
   int res = RUN_ALL_TESTS();
@@ -8,8 +8,12 @@
 #include <qi/anyobject.hpp>
 #include <qi/type/dynamicobjectbuilder.hpp>
 #include <qi/session.hpp>
+#include <qi/os.hpp>
+#include <boost/make_shared.hpp>
 #include <testsession/testsessionpair.hpp>
 
+#include "src/messaging/boundobject.hpp"
+
 qiLogCategory("test");
 static qi::Promise<int> *payload;
 
@@ -110,6 +114,56 @@ TEST_F(TestObject, CoDeco)
   }
 }
 
+static const int nclients = 4;
+
+// Each client gets the payload once per emission
+struct FireReceivers
+{
+  void onFire(int client, int pl)
+  {
+    if (pl != 44)
+      return;
+    int emission = ++calls[client] - 1;
+    if (emission < 2)
+      received[emission][client].setValue(0);
+  }
+
+  qi::Atomic<int>   calls[nclients];
+  qi::Promise<void> received[2][nclients];
+};
+
+TEST_F(TestObject, SeveralClients)
+{
+  // All remote subscribers get the payload, serialized once for them
+  FireReceivers receivers;
+  std::vector<boost::shared_ptr<qi::Session> > sessions;
+  for (int i = 0; i < nclients; ++i)
+  {
+    boost::shared_ptr<qi::Session> session = boost::make_shared<qi::Session>();
+    session->connect(p.serviceDirectoryEndpoints()[0]);
+    qi::AnyObject proxy = session->service("coin");
+    ASSERT_TRUE(proxy);
+    proxy.connect("fire", boost::function<void(int)>(boost::bind(&FireReceivers::onFire, &receivers, i, _1))).wait();
+    sessions.push_back(session);
+  }
+  int encoded = *qi::ServiceBoundObject::encodedEvents;
+  oserver.post("fire", 44);
+  for (int i = 0; i < nclients; ++i)
+    ASSERT_EQ(qi::FutureState_FinishedWithValue, receivers.received[0][i].future().wait(2000));
+  EXPECT_EQ(encoded + 1, *qi::ServiceBoundObject::encodedEvents);
+
+  // A client going away does not disturb the others
+  sessions[0]->close();
+  encoded = *qi::ServiceBoundObject::encodedEvents;
+  oserver.post("fire", 44);
+  for (int i = 1; i < nclients; ++i)
+    ASSERT_EQ(qi::FutureState_FinishedWithValue, receivers.received[1][i].future().wait(2000));
+  EXPECT_EQ(encoded + 1, *qi::ServiceBoundObject::encodedEvents);
+  EXPECT_EQ(1, *receivers.calls[0]);
+  for (int i = 1; i < nclients; ++i)
+    EXPECT_EQ(2, *receivers.calls[i]);
+}
+
 int verifA = 0;
 int verifB = 0;
 
@@ -8,24 +8,167 @@
 #include <string>
 
 #include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
 
+#include <qi/application.hpp>
+#include <qi/anyobject.hpp>
+#include <qi/atomic.hpp>
 #include <qi/session.hpp>
-#include <qi/messaging/servicedirectory.hpp>
+#include <qi/type/dynamicobjectbuilder.hpp>
 #include <qi/messaging/gateway.hpp>
 
-TEST(QiGateway, testConnection)
+qiLogCategory("test.gateway");
+
+static std::string reply(const std::string &msg)
+{
+  return msg;
+}
+
+static int add(int a, int b)
+{
+  return a + b;
+}
+
+static void waitFor(qi::Promise<void> started, qi::Future<void> f)
+{
+  started.setValue(0);
+  f.wait();
+}
+
+/* A Service Directory, a service and a gateway attached to them */
+class TestGateway : public ::testing::Test
+{
+protected:
+  void SetUp()
+  {
+    ASSERT_FALSE(sd.listenStandalone("tcp://127.0.0.1:0").hasError());
+
+    qi::DynamicObjectBuilder ob;
+    ob.advertiseMethod("reply", &reply);
+    ob.advertiseMethod("add", &add);
+    ob.advertiseMethod("block", boost::function<void()>(boost::bind(&waitFor, started, unblock.future())));
+    ASSERT_FALSE(service.connect(sd.endpoints()[0]).hasError());
+    ASSERT_FALSE(service.listen("tcp://127.0.0.1:0").hasError());
+    ASSERT_FALSE(service.registerService("serviceTest", ob.object()).hasError());
+
+    ASSERT_TRUE(gw.attachToServiceDirectory(sd.endpoints()[0]));
+    ASSERT_TRUE(gw.listen("tcp://127.0.0.1:0"));
+  }
+
+  void TearDown()
+  {
+    unblock.setValue(0);
+    service.close();
+    sd.close();
+  }
+
+  qi::Session       sd;
+  qi::Session       service;
+  qi::Promise<void> started;
+  qi::Promise<void> unblock;
+  qi::Gateway       gw;
+};
+
+TEST_F(TestGateway, testConnection)
 {
   qi::Session session;
-  qi::ServiceDirectory sd;
-  qi::Gateway gw;
+  EXPECT_FALSE(session.connect(gw.endpoints()[0]).hasError());
+}
+
+TEST_F(TestGateway, forwardsCalls)
+{
+  qi::Session client;
+  ASSERT_FALSE(client.connect(gw.endpoints()[0]).hasError());
+  qi::AnyObject obj = client.service("serviceTest");
+  ASSERT_TRUE(obj);
+
+  EXPECT_EQ("question", obj.call<std::string>("reply", "question"));
+  EXPECT_EQ(42, obj.call<int>("add", 40, 2));
+  // Big arguments are forwarded as they are
+  std::string big(1000000, 'x');
+  EXPECT_EQ(big, obj.call<std::string>("reply", big));
+}
+
+TEST_F(TestGateway, serviceInfoPointsToGateway)
+{
+  qi::Session client;
+  ASSERT_FALSE(client.connect(gw.endpoints()[0]).hasError());
+  qi::AnyObject sdObj = client.service("ServiceDirectory");
+  ASSERT_TRUE(sdObj);
+
+  // The client must reach the service through the gateway
+  qi::ServiceInfo info = sdObj.call<qi::ServiceInfo>("service", "serviceTest");
+  EXPECT_EQ("serviceTest", info.name());
+  EXPECT_EQ(gw.endpoints(), info.endpoints());
+  EXPECT_EQ(qi::os::getMachineId(), info.machineId());
+
+  // Other calls to the Service Directory are not rewritten
+  std::vector<qi::ServiceInfo> services = sdObj.call<std::vector<qi::ServiceInfo> >("services");
+  bool found = false;
+  for (unsigned int i = 0; i < services.size(); ++i)
+  {
+    if (services[i].name() == "serviceTest")
+    {
+      EXPECT_EQ(service.endpoints(), services[i].endpoints());
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST_F(TestGateway, pendingCallsFailOnServiceLoss)
+{
+  qi::Session client;
+  ASSERT_FALSE(client.connect(gw.endpoints()[0]).hasError());
+  qi::AnyObject obj = client.service("serviceTest");
+  ASSERT_TRUE(obj);
 
-  sd.listen("tcp://127.0.0.1:0");
+  qi::Future<void> blocked = obj.async<void>("block");
+  started.future().wait();
+  service.close();
 
-  bool attached = gw.attachToServiceDirectory(sd.endpoints()[0]);
-  ASSERT_TRUE(attached);
+  blocked.wait(5000);
+  ASSERT_TRUE(blocked.isFinished());
+  ASSERT_TRUE(blocked.hasError());
+  EXPECT_NE(std::string::npos, blocked.error().find("Connection to the service was lost"));
+  // The client connection to the gateway survives
+  EXPECT_TRUE(client.isConnected());
+}
 
-  gw.listen("tcp://127.0.0.1:0");
+static void callMany(const qi::Url &url, int client, int calls, qi::Atomic<int> *succeeded)
+{
+  qi::Session session;
+  if (session.connect(url).hasError())
+    return;
+  qi::AnyObject obj = session.service("serviceTest");
+  if (!obj)
+    return;
+  for (int i = 0; i < calls; ++i)
+  {
+    qi::Future<int> f = obj.async<int>("add", client, i);
+    if (!f.hasError() && f.value() == client + i)
+      ++*succeeded;
+  }
+}
 
-  bool connect = session.connect(gw.endpoints()[0]);
-  ASSERT_TRUE(connect);
+TEST_F(TestGateway, concurrentClients)
+{
+  // Each answer goes back to the client that asked for it
+  const int clients = 8;
+  const int calls = 100;
+  qi::Atomic<int> succeeded;
+  boost::thread_group threads;
+  for (int i = 0; i < clients; ++i)
+    threads.create_thread(boost::bind(&callMany, gw.endpoints()[0], i * 1000, calls, &succeeded));
+  threads.join_all();
+  EXPECT_EQ(clients * calls, *succeeded);
+}
+
+int main(int argc, char **argv)
+{
+  qi::Application app(argc, argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
 }
@@ -0,0 +1,174 @@
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+
+#include "src/messaging/message.hpp"
+#include "src/messaging/messagedispatcher.hpp"
+
+static const unsigned int slots = 256; // MessageDispatcher::SentSlotCount
+
+struct Recorder
+{
+  void onMessage(const qi::Message& msg)
+  {
+    if (!errorsOnly || msg.type() == qi::Message::Type_Error)
+      ids.push_back(msg.id());
+  }
+
+  std::vector<unsigned int> sorted() const
+  {
+    std::vector<unsigned int> res(ids);
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  bool                      errorsOnly;
+  std::vector<unsigned int> ids;
+};
+
+// Listen to (service, object) with synchronous delivery
+static qi::SignalLink listen(qi::MessageDispatcher& d, unsigned int service, unsigned int object, Recorder& r)
+{
+  qi::SignalLink link = d.messagePendingConnect(service, object,
+      boost::bind(&Recorder::onMessage, &r, _1));
+  d._signalMap[qi::MessageDispatcher::Target(service, object)]->setCallType(qi::MetaCallType_Direct);
+  return link;
+}
+
+static qi::Message message(qi::Message::Type type, unsigned int id,
+                           unsigned int service = 1, unsigned int object = 1)
+{
+  return qi::Message(type, qi::MessageAddress(id, service, object, 100));
+}
+
+static std::vector<unsigned int> pendingCalls(qi::MessageDispatcher& d)
+{
+  Recorder r;
+  r.errorsOnly = true;
+  qi::SignalLink link = listen(d, 1, 1, r);
+  d.cleanPendingMessages();
+  d.messagePendingDisconnect(1, 1, link);
+  return r.sorted();
+}
+
+TEST(MessageDispatcher, answerClearsCall)
+{
+  qi::MessageDispatcher d;
+  d.sent(message(qi::Message::Type_Call, 1));
+  d.sent(message(qi::Message::Type_Call, 2));
+  d.sent(message(qi::Message::Type_Call, 3));
+  d.sent(message(qi::Message::Type_Post, 4)); // nothing to wait for
+  d.dispatch(message(qi::Message::Type_Reply, 1));
+  d.dispatch(message(qi::Message::Type_Error, 3));
+
+  std::vector<unsigned int> pending = pendingCalls(d);
+  ASSERT_EQ(1u, pending.size());
+  EXPECT_EQ(2u, pending[0]);
+  EXPECT_TRUE(pendingCalls(d).empty());
+}
+
+TEST(MessageDispatcher, slotOverflowGoesToMap)
+{
+  qi::MessageDispatcher d;
+  d.sent(message(qi::Message::Type_Call, 7));
+  d.sent(message(qi::Message::Type_Call, 7 + slots));
+  d.sent(message(qi::Message::Type_Call, 7 + 2 * slots));
+  EXPECT_EQ(2u, d._messageSent.size());
+
+  d.dispatch(message(qi::Message::Type_Reply, 7 + slots));
+  EXPECT_EQ(1u, d._messageSent.size());
+  // Frees the slot for the next call using it
+  d.dispatch(message(qi::Message::Type_Reply, 7));
+  d.sent(message(qi::Message::Type_Call, 7 + 3 * slots));
+  EXPECT_EQ(1u, d._messageSent.size());
+
+  std::vector<unsigned int> pending = pendingCalls(d);
+  ASSERT_EQ(2u, pending.size());
+  EXPECT_EQ(7 + 2 * slots, pending[0]);
+  EXPECT_EQ(7 + 3 * slots, pending[1]);
+  EXPECT_TRUE(d._messageSent.empty());
+}
+
+TEST(MessageDispatcher, idCollision)
+{
+  qi::MessageDispatcher d;
+  // In a slot
+  d.sent(message(qi::Message::Type_Call, 3));
+  d.sent(message(qi::Message::Type_Call, 3));
+  // In the map
+  d.sent(message(qi::Message::Type_Call, 3 + slots));
+  d.sent(message(qi::Message::Type_Call, 3 + slots));
+  EXPECT_EQ(1u, d._messageSent.size());
+
+  std::vector<unsigned int> pending = pendingCalls(d);
+  ASSERT_EQ(2u, pending.size());
+  EXPECT_EQ(3u, pending[0]);
+  EXPECT_EQ(3 + slots, pending[1]);
+}
+
+TEST(MessageDispatcher, unknownAnswer)
+{
+  qi::MessageDispatcher d;
+  d.sent(message(qi::Message::Type_Call, 5 + slots));
+  // Same slot, not the same call
+  d.dispatch(message(qi::Message::Type_Reply, 5));
+  d.dispatch(message(qi::Message::Type_Reply, 5 + 2 * slots));
+
+  std::vector<unsigned int> pending = pendingCalls(d);
+  ASSERT_EQ(1u, pending.size());
+  EXPECT_EQ(5 + slots, pending[0]);
+}
+
+TEST(MessageDispatcher, manyCallsInFlight)
+{
+  qi::MessageDispatcher d;
+  const unsigned int count = 4 * slots;
+  for (unsigned int id = 1; id <= count; ++id)
+    d.sent(message(qi::Message::Type_Call, id));
+  EXPECT_EQ(count - slots, d._messageSent.size());
+  for (unsigned int id = 2; id <= count; id += 2)
+    d.dispatch(message(qi::Message::Type_Reply, id));
+
+  std::vector<unsigned int> pending = pendingCalls(d);
+  ASSERT_EQ(count / 2, pending.size());
+  for (unsigned int i = 0; i < pending.size(); ++i)
+    EXPECT_EQ(2 * i + 1, pending[i]);
+}
+
+TEST(MessageDispatcher, routes)
+{
+  qi::MessageDispatcher d;
+  Recorder object2, anyObject, service2;
+  object2.errorsOnly = anyObject.errorsOnly = service2.errorsOnly = false;
+  listen(d, 1, 2, object2);
+  qi::SignalLink anyLink = listen(d, 1, qi::MessageDispatcher::ALL_OBJECTS, anyObject);
+  listen(d, 2, 2, service2);
+
+  d.dispatch(message(qi::Message::Type_Event, 1, 1, 2));
+  d.dispatch(message(qi::Message::Type_Event, 2, 1, 3));
+  d.dispatch(message(qi::Message::Type_Event, 3, 2, 2));
+  d.dispatch(message(qi::Message::Type_Event, 4, 3, 2)); // nobody listens
+
+  ASSERT_EQ(1u, object2.ids.size());
+  EXPECT_EQ(1u, object2.ids[0]);
+  ASSERT_EQ(2u, anyObject.ids.size());
+  EXPECT_EQ(1u, anyObject.ids[0]);
+  EXPECT_EQ(2u, anyObject.ids[1]);
+  ASSERT_EQ(1u, service2.ids.size());
+  EXPECT_EQ(3u, service2.ids[0]);
+
+  // Removing the last subscriber removes the route
+  EXPECT_TRUE(d.messagePendingDisconnect(1, qi::MessageDispatcher::ALL_OBJECTS, anyLink));
+  d.dispatch(message(qi::Message::Type_Event, 5, 1, 2));
+  d.dispatch(message(qi::Message::Type_Event, 6, 1, 3));
+  EXPECT_EQ(2u, anyObject.ids.size());
+  ASSERT_EQ(2u, object2.ids.size());
+  EXPECT_EQ(5u, object2.ids[1]);
+}
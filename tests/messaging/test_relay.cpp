@@ -0,0 +1,336 @@
+/*
+**  Copyright (C) 2014 Aldebaran Robotics
+**  See COPYING for the license
+*/
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <qi/application.hpp>
+
+#include "src/messaging/message.hpp"
+#include "src/messaging/messagedispatcher.hpp"
+#include "src/messaging/transportserver.hpp"
+#include "src/messaging/transportsocket.hpp"
+
+/*
+ * Relay between TCP sockets: raw bytes are written to the input socket, the
+ * tests wait for the hook where they need a read boundary after a header.
+ * Relayed messages are received by a sink socket behind the output socket.
+ */
+
+static const size_t bigPayload = 200 * 1024; // more than a read chunk
+static const unsigned int relayedIdOffset = 1000;
+
+struct Collector
+{
+  void onMessage(const qi::Message& msg)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    messages.push_back(msg);
+    cond.notify_all();
+  }
+
+  // Wait until count messages arrived
+  bool waitFor(size_t count)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    while (messages.size() < count)
+    {
+      if (!cond.timed_wait(lock, boost::posix_time::seconds(5)))
+        return messages.size() >= count;
+    }
+    return true;
+  }
+
+  size_t size()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    return messages.size();
+  }
+
+  boost::mutex              mutex;
+  boost::condition_variable cond;
+  std::vector<qi::Message>  messages;
+};
+
+static qi::Message makeMessage(unsigned int id, size_t payload)
+{
+  qi::Message msg(qi::Message::Type_Reply, qi::MessageAddress(id, 1, 1, 100));
+  std::string data(payload, '\0');
+  for (size_t i = 0; i < payload; ++i)
+    data[i] = static_cast<char>((id + i) % 251);
+  qi::Buffer buffer;
+  buffer.write(data.data(), data.size());
+  msg.setBuffer(buffer);
+  msg._p->complete();
+  return msg;
+}
+
+static std::string bytes(const qi::Message& msg)
+{
+  std::string res(static_cast<const char*>(msg._p->getHeader()), sizeof(qi::MessagePrivate::MessageHeader));
+  res.append(static_cast<const char*>(msg.buffer().data()), msg.buffer().size());
+  return res;
+}
+
+static bool samePayload(const qi::Message& a, const qi::Message& b)
+{
+  return a.buffer().size() == b.buffer().size()
+    && memcmp(a.buffer().data(), b.buffer().data(), a.buffer().size()) == 0;
+}
+
+// The dispatcher of a socket, to look at its pending calls
+struct DispatcherOf : qi::TransportSocket
+{
+  static qi::MessageDispatcher& get(qi::TransportSocket& socket)
+  {
+    return socket.*(&DispatcherOf::_dispatcher);
+  }
+};
+
+// Fail the pending calls of service 1 object 1 and return their ids
+static std::vector<unsigned int> pendingCalls(qi::TransportSocket& socket)
+{
+  qi::MessageDispatcher& d = DispatcherOf::get(socket);
+  Collector errors;
+  qi::SignalLink link = d.messagePendingConnect(1, 1, boost::bind(&Collector::onMessage, &errors, _1));
+  d._signalMap[qi::MessageDispatcher::Target(1, 1)]->setCallType(qi::MetaCallType_Direct);
+  d.cleanPendingMessages();
+  d.messagePendingDisconnect(1, 1, link);
+  std::vector<unsigned int> ids;
+  for (unsigned i = 0; i < errors.messages.size(); ++i)
+    ids.push_back(errors.messages[i].id());
+  return ids;
+}
+
+static qi::TransportSocketPtr relayTo(qi::MessagePrivate::MessageHeader& header, qi::TransportSocketPtr out,
+                                      Collector* hooked)
+{
+  qi::Message msg;
+  memcpy(msg._p->getHeader(), &header, sizeof(header));
+  hooked->onMessage(msg);
+  header.id += relayedIdOffset;
+  return out;
+}
+
+static void onSocket(qi::TransportSocketPtr socket, qi::Promise<qi::TransportSocketPtr> accepted)
+{
+  accepted.setValue(socket);
+}
+
+static void onDisconnected(const std::string&, qi::Promise<void> disconnected)
+{
+  try
+  {
+    disconnected.setValue(0);
+  }
+  catch (const qi::FutureException&)
+  {
+  }
+}
+
+class TestRelay : public ::testing::Test
+{
+protected:
+  TestRelay()
+    : raw(io)
+  {
+  }
+
+  void SetUp()
+  {
+    // sink <- out
+    qi::Promise<qi::TransportSocketPtr> acceptedSink;
+    sinkServer.newConnection.connect(boost::bind(&onSocket, _1, acceptedSink));
+    ASSERT_FALSE(sinkServer.listen("tcp://127.0.0.1:0").hasError());
+    out = qi::makeTransportSocket("tcp");
+    out->disconnected.connect(boost::bind(&onDisconnected, _1, outDisconnected));
+    ASSERT_FALSE(out->connect(sinkServer.endpoints()[0]).hasError());
+    ASSERT_TRUE(acceptedSink.future().wait(5000) == qi::FutureState_FinishedWithValue);
+    sink = acceptedSink.future().value();
+    sink->messageReady.setCallType(qi::MetaCallType_Direct);
+    sink->messageReady.connect(boost::bind(&Collector::onMessage, &relayed, _1));
+    sink->startReading();
+
+    // raw -> in -> out
+    qi::Promise<qi::TransportSocketPtr> acceptedIn;
+    inServer.newConnection.connect(boost::bind(&onSocket, _1, acceptedIn));
+    ASSERT_FALSE(inServer.listen("tcp://127.0.0.1:0").hasError());
+    qi::Url url = inServer.endpoints()[0];
+    raw.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(url.host()), url.port()));
+    raw.set_option(boost::asio::ip::tcp::no_delay(true));
+    ASSERT_TRUE(acceptedIn.future().wait(5000) == qi::FutureState_FinishedWithValue);
+    in = acceptedIn.future().value();
+    in->setRelayHook(1, boost::bind(&relayTo, _1, out, &hooked));
+    in->messageReady.setCallType(qi::MetaCallType_Direct);
+    in->messageReady.connect(boost::bind(&Collector::onMessage, &dispatched, _1));
+    in->disconnected.connect(boost::bind(&onDisconnected, _1, inDisconnected));
+    in->startReading();
+  }
+
+  void TearDown()
+  {
+    boost::system::error_code erc;
+    raw.close(erc);
+    in->disconnect();
+    out->disconnect();
+    sink->disconnect();
+    inServer.close();
+    sinkServer.close();
+  }
+
+  void write(const std::string& data)
+  {
+    boost::asio::write(raw, boost::asio::buffer(data));
+  }
+
+  boost::asio::io_service      io;
+  boost::asio::ip::tcp::socket raw;
+  qi::TransportServer          inServer;
+  qi::TransportServer          sinkServer;
+  qi::TransportSocketPtr       in;
+  qi::TransportSocketPtr       out;
+  qi::TransportSocketPtr       sink;
+  qi::Promise<void>            inDisconnected;
+  qi::Promise<void>            outDisconnected;
+  Collector                    hooked;     // headers given to the hook
+  Collector                    dispatched; // by in
+  Collector                    relayed;    // received by sink
+};
+
+TEST_F(TestRelay, payloadSplitAcrossReads)
+{
+  qi::Message big = makeMessage(1, bigPayload);
+  std::string data = bytes(big);
+  write(data.substr(0, 100));
+  // The header is read alone, the payload comes in later reads
+  ASSERT_TRUE(hooked.waitFor(1));
+  write(data.substr(100, 10000));
+  write(data.substr(10100, 100000));
+  write(data.substr(110100));
+
+  ASSERT_TRUE(relayed.waitFor(1));
+  EXPECT_EQ(1 + relayedIdOffset, relayed.messages[0].id());
+  EXPECT_TRUE(samePayload(big, relayed.messages[0]));
+  EXPECT_EQ(0u, dispatched.size());
+}
+
+TEST_F(TestRelay, nextMessagesInSameRead)
+{
+  // The read completing the payload holds a small message and the next
+  // relayed message
+  qi::Message big = makeMessage(1, bigPayload);
+  qi::Message small = makeMessage(2, 100);
+  qi::Message big2 = makeMessage(3, bigPayload);
+  std::string data = bytes(big);
+  write(data.substr(0, data.size() - 1000));
+  ASSERT_TRUE(hooked.waitFor(1));
+  write(data.substr(data.size() - 1000) + bytes(small) + bytes(big2));
+
+  ASSERT_TRUE(relayed.waitFor(2));
+  EXPECT_EQ(1 + relayedIdOffset, relayed.messages[0].id());
+  EXPECT_TRUE(samePayload(big, relayed.messages[0]));
+  EXPECT_EQ(3 + relayedIdOffset, relayed.messages[1].id());
+  EXPECT_TRUE(samePayload(big2, relayed.messages[1]));
+  ASSERT_TRUE(dispatched.waitFor(1));
+  EXPECT_EQ(2u, dispatched.messages[0].id());
+  EXPECT_TRUE(samePayload(small, dispatched.messages[0]));
+}
+
+TEST_F(TestRelay, inputDiesMidRelay)
+{
+  // The output stream cannot be completed: it must be closed
+  qi::Message big = makeMessage(1, bigPayload);
+  write(bytes(big).substr(0, 100000));
+  ASSERT_TRUE(hooked.waitFor(1));
+  boost::system::error_code erc;
+  raw.close(erc);
+
+  EXPECT_EQ(qi::FutureState_FinishedWithValue, inDisconnected.future().wait(5000));
+  EXPECT_EQ(qi::FutureState_FinishedWithValue, outDisconnected.future().wait(5000));
+  EXPECT_EQ(0u, relayed.size());
+}
+
+TEST_F(TestRelay, outputClosedBeforeRelayBegin)
+{
+  // The payload is read and dropped, the input keeps working
+  out->disconnect();
+  ASSERT_EQ(qi::FutureState_FinishedWithValue, outDisconnected.future().wait(5000));
+
+  qi::Message big = makeMessage(1, bigPayload);
+  qi::Message small = makeMessage(2, 100);
+  std::string data = bytes(big);
+  write(data.substr(0, 50000));
+  ASSERT_TRUE(hooked.waitFor(1));
+  write(data.substr(50000) + bytes(small));
+
+  ASSERT_TRUE(dispatched.waitFor(1));
+  EXPECT_EQ(2u, dispatched.messages[0].id());
+  EXPECT_TRUE(samePayload(small, dispatched.messages[0]));
+  EXPECT_TRUE(in->isConnected());
+  EXPECT_EQ(0u, relayed.size());
+}
+
+TEST_F(TestRelay, relayedReplyIsNotPending)
+{
+  // The reply leaves with another id: the call it answers must not stay
+  // pending on the input socket
+  DispatcherOf::get(*in).sent(qi::Message(qi::Message::Type_Call, qi::MessageAddress(1, 1, 1, 100)));
+  DispatcherOf::get(*in).sent(qi::Message(qi::Message::Type_Call, qi::MessageAddress(2, 1, 1, 100)));
+  qi::Message big = makeMessage(1, bigPayload);
+  write(bytes(big));
+
+  ASSERT_TRUE(relayed.waitFor(1));
+  EXPECT_EQ(1 + relayedIdOffset, relayed.messages[0].id());
+  std::vector<unsigned int> pending = pendingCalls(*in);
+  ASSERT_EQ(1u, pending.size());
+  EXPECT_EQ(2u, pending[0]);
+}
+
+TEST_F(TestRelay, interleavingWithQueuedSends)
+{
+  // Messages sent while a payload is relayed are written after it
+  qi::Message before = makeMessage(10, 100);
+  ASSERT_TRUE(out->send(before));
+  ASSERT_TRUE(relayed.waitFor(1));
+
+  qi::Message big = makeMessage(1, bigPayload);
+  std::string data = bytes(big);
+  write(data.substr(0, 100000));
+  // The relay started, the end of the payload is not written yet
+  ASSERT_TRUE(hooked.waitFor(1));
+  std::vector<qi::Message> during;
+  for (unsigned int i = 0; i < 10; ++i)
+  {
+    during.push_back(makeMessage(20 + i, i % 2 ? 100 : 100000));
+    ASSERT_TRUE(out->send(during.back()));
+  }
+  // Nothing but the payload may be written yet
+  EXPECT_EQ(1u, relayed.size());
+  write(data.substr(100000));
+
+  ASSERT_TRUE(relayed.waitFor(2 + during.size()));
+  EXPECT_EQ(10u, relayed.messages[0].id());
+  EXPECT_EQ(1 + relayedIdOffset, relayed.messages[1].id());
+  EXPECT_TRUE(samePayload(big, relayed.messages[1]));
+  for (unsigned int i = 0; i < during.size(); ++i)
+  {
+    EXPECT_EQ(during[i].id(), relayed.messages[2 + i].id());
+    EXPECT_TRUE(samePayload(during[i], relayed.messages[2 + i]));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  qi::Application app(argc, argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
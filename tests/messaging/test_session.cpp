@@ -10,12 +10,15 @@
 #include <string>
 
 #include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <qi/session.hpp>
 #include <qi/anyobject.hpp>
 #include <qi/type/dynamicobjectbuilder.hpp>
 #include <qi/messaging/gateway.hpp>
 #include <qi/os.hpp>
+#include <qi/eventloop.hpp>
 #include <qi/application.hpp>
 
 #include <testsession/testsessionpair.hpp>
@@ -246,6 +249,251 @@ TEST(QiSession, getSimpleService)
   EXPECT_TRUE(object);
 }
 
+#ifndef _WIN32
+TEST(QiSession, getServiceOverLocalSocket)
+{
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("tcp://127.0.0.1:0").hasError());
+
+  qi::Session server;
+  ASSERT_FALSE(server.connect(sd.endpoints()[0]).hasError());
+  ASSERT_FALSE(server.listen("unix://").hasError());
+  ASSERT_FALSE(server.listen("tcp://127.0.0.1:0").hasError());
+
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("reply", &reply);
+  server.registerService("serviceTest", ob.object());
+
+  qi::Session client;
+  ASSERT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+  qi::AnyObject object = client.service("serviceTest");
+  ASSERT_TRUE(object);
+  EXPECT_EQ("plop", object.call<std::string>("reply", "plop"));
+}
+
+TEST(QiSession, getServiceWithUnreachableLocalSocket)
+{
+  std::string path = qi::os::tmp() + "/qi-test-unreachable-" +
+    boost::lexical_cast<std::string>(qi::os::getpid());
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("tcp://127.0.0.1:0").hasError());
+
+  qi::Session server;
+  ASSERT_FALSE(server.connect(sd.endpoints()[0]).hasError());
+  ASSERT_FALSE(server.listen("unix://" + path).hasError());
+  ASSERT_FALSE(server.listen("tcp://127.0.0.1:0").hasError());
+
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("reply", &reply);
+  server.registerService("serviceTest", ob.object());
+  // The advertised local socket cannot be reached: loopback TCP is used
+  boost::filesystem::remove(path);
+
+  qi::Session client;
+  ASSERT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+  qi::AnyObject object = client.service("serviceTest");
+  ASSERT_TRUE(object);
+  EXPECT_EQ("plop", object.call<std::string>("reply", "plop"));
+}
+
+static qi::Buffer replyBuffer(const qi::Buffer& b)
+{
+  return b;
+}
+
+TEST(QiSession, bigBufferOverLocalSocket)
+{
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("unix://").hasError());
+
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("reply", &replyBuffer);
+  sd.registerService("serviceTest", ob.object());
+
+  qi::Session client;
+  ASSERT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+  qi::AnyObject object = client.service("serviceTest");
+  ASSERT_TRUE(object);
+
+  // Above the default descriptor passing threshold
+  std::vector<char> data(3 * 1024 * 1024);
+  for (unsigned i = 0; i < data.size(); ++i)
+    data[i] = (char)i;
+  qi::Buffer buffer;
+  buffer.write(&data[0], data.size());
+  qi::Buffer result = object.call<qi::Buffer>("reply", buffer);
+  ASSERT_EQ(data.size(), result.size());
+  EXPECT_EQ(0, memcmp(&data[0], result.data(), data.size()));
+}
+
+TEST(QiSession, listenOnLocalSocketKeepsExistingFiles)
+{
+  std::string path = qi::os::tmp() + "/qi-test-listen-" +
+    boost::lexical_cast<std::string>(qi::os::getpid());
+
+  // Not a socket: left alone
+  FILE* f = qi::os::fopen(path.c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fclose(f);
+  qi::Session s1;
+  EXPECT_TRUE(s1.listenStandalone("unix://" + path).hasError());
+  EXPECT_TRUE(boost::filesystem::exists(path));
+  boost::filesystem::remove(path);
+
+  // A live server keeps its socket
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("unix://" + path).hasError());
+  qi::Session s2;
+  EXPECT_TRUE(s2.listenStandalone("unix://" + path).hasError());
+  qi::Session client;
+  EXPECT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+}
+#endif
+
+static std::string replyString(const std::string& s)
+{
+  return s;
+}
+
+TEST(QiSession, pipelinedCallsOfMixedSizes)
+{
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("tcp://127.0.0.1:0").hasError());
+
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("reply", &replyString);
+  sd.registerService("serviceTest", ob.object());
+
+  qi::Session client;
+  ASSERT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+  qi::AnyObject object = client.service("serviceTest");
+  ASSERT_TRUE(object);
+
+  // Many messages per read, some sliced, some bigger than a read chunk
+  static const size_t sizes[] = { 1, 100, 3000, 5000, 70000, 200000 };
+  std::vector<std::string> args;
+  std::vector<qi::Future<std::string> > results;
+  for (unsigned i = 0; i < 300; ++i)
+  {
+    args.push_back(std::string(sizes[i % 6], (char)('a' + i % 26)));
+    results.push_back(object.async<std::string>("reply", args.back()));
+  }
+  for (unsigned i = 0; i < results.size(); ++i)
+    EXPECT_EQ(args[i], results[i].value());
+}
+
+static void waitFor(qi::Promise<void> started, qi::Future<void> f)
+{
+  started.setValue(0);
+  f.wait();
+}
+
+TEST(QiSession, callTimeout)
+{
+  // Read when the sockets are created
+  qi::os::setenv("QI_MESSAGE_TIMEOUT", "0.2");
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("tcp://127.0.0.1:0").hasError());
+
+  qi::Promise<void> unblock;
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("reply", &reply);
+  ob.advertiseMethod("block", boost::function<void()>(boost::bind(&waitFor, qi::Promise<void>(), unblock.future())));
+  sd.registerService("serviceTest", ob.object());
+
+  qi::Session client;
+  ASSERT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+  qi::AnyObject object = client.service("serviceTest");
+  qi::os::setenv("QI_MESSAGE_TIMEOUT", "");
+  ASSERT_TRUE(object);
+
+  EXPECT_EQ("plop", object.call<std::string>("reply", "plop"));
+  qi::Future<void> f = object.async<void>("block");
+  ASSERT_TRUE(f.hasError());
+  EXPECT_NE(std::string::npos, f.error().find("timed out"));
+  unblock.setValue(0);
+}
+
+TEST(QiSession, cancelOnTimeout)
+{
+  TestSessionPair p;
+  qi::Promise<void> unblock;
+  qi::Promise<void> started;
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("reply", &reply);
+  ob.advertiseMethod("block", boost::function<void()>(boost::bind(&waitFor, started, unblock.future())));
+  p.server()->registerService("serviceTest", ob.object());
+  qi::AnyObject object = p.client()->service("serviceTest");
+  ASSERT_TRUE(object);
+
+  qi::Future<void> f = qi::cancelOnTimeout(object.async<void>("block"), qi::MilliSeconds(200));
+  ASSERT_TRUE(f.hasError());
+  EXPECT_NE(std::string::npos, f.error().find("timed out"));
+  EXPECT_TRUE(started.future().isFinished());
+
+  // Calls answered in time are left alone
+  qi::Future<std::string> r = qi::cancelOnTimeout(object.async<std::string>("reply", "plop"), qi::Seconds(60));
+  ASSERT_FALSE(r.hasError());
+  EXPECT_EQ("plop", r.value());
+  unblock.setValue(0);
+}
+
+static void count(qi::Atomic<int>* counter)
+{
+  ++*counter;
+}
+
+static void ping()
+{
+}
+
+TEST(QiSession, cancelQueuedCall)
+{
+  // Single thread service: calls queue up behind the blocking one
+  qi::EventLoop el;
+  el.start(1);
+  el.setMaxThreads(1);
+
+  qi::Session sd;
+  ASSERT_FALSE(sd.listenStandalone("tcp://127.0.0.1:0").hasError());
+  qi::Promise<void> unblock;
+  qi::Promise<void> started;
+  qi::Atomic<int> counter;
+  qi::DynamicObjectBuilder ob;
+  ob.advertiseMethod("block", boost::function<void()>(boost::bind(&waitFor, started, unblock.future())));
+  ob.advertiseMethod("count", boost::function<void()>(boost::bind(&count, &counter)));
+  qi::AnyObject service = ob.object();
+  service.asGenericObject()->forceEventLoop(&el);
+  sd.registerService("serviceTest", service);
+  // Not on the blocked event loop
+  qi::DynamicObjectBuilder pingOb;
+  pingOb.advertiseMethod("ping", &ping);
+  sd.registerService("ping", pingOb.object());
+
+  qi::Session client;
+  ASSERT_FALSE(client.connect(sd.endpoints()[0]).hasError());
+  qi::AnyObject object = client.service("serviceTest");
+  ASSERT_TRUE(object);
+  qi::AnyObject pinger = client.service("ping");
+  ASSERT_TRUE(pinger);
+
+  qi::Future<void> blocked = object.async<void>("block");
+  qi::Future<void> canceled = object.async<void>("count");
+  started.future().wait();
+  // The cancel request follows the call on the socket
+  ASSERT_TRUE(canceled.isCancelable());
+  canceled.cancel();
+  EXPECT_TRUE(canceled.isCanceled());
+  // The service handles the messages of a socket in order: once the ping is
+  // answered, the cancel request was handled.
+  ASSERT_FALSE(pinger.async<void>("ping").hasError());
+  unblock.setValue(0);
+  ASSERT_FALSE(blocked.hasError());
+  // Queued after the canceled one on the same thread
+  ASSERT_FALSE(object.async<void>("count").hasError());
+  EXPECT_EQ(1, *counter);
+}
+
 TEST(QiSession, getSimpleServiceTwice)
 {
   TestSessionPair pair;
@@ -132,6 +132,20 @@ TEST(TestURL, ValidUrl)
   EXPECT_EQ("tcp://example.com:5", url.str());
 }
 
+TEST(TestURL, UnixUrl)
+{
+  qi::Url url("unix:///tmp/qi.sock");
+
+  EXPECT_EQ("unix", url.protocol());
+  EXPECT_EQ("/tmp/qi.sock", url.host());
+  EXPECT_EQ(0, url.port());
+  EXPECT_TRUE(url.isValid());
+
+  url = "unix://";
+  EXPECT_EQ("unix", url.protocol());
+  EXPECT_FALSE(url.isValid());
+}
+
 TEST(TestURL, CopyUrl)
 {
   qi::Url url("tcp://example.com:5");
@@ -6,6 +6,7 @@
  */
 
 #include <cstdlib>
+#include <cstring>
 #include <string>
 
 #include <gtest/gtest.h>
@@ -79,3 +80,25 @@ TEST(TestBuffer, TestSubBuffer)
   ASSERT_EQ(buffer.size(), 0u);
   ASSERT_EQ(buffer.totalSize(), 0u);
 }
+
+TEST(TestBuffer, TestPoolRecycles)
+{
+  std::string data(10000, 'x');
+  {
+    // Warm up: leave a block of each size in this thread's free lists
+    qi::Buffer buffer;
+    buffer.write(data.c_str(), data.size());
+  }
+  qi::BufferPoolStats before = qi::bufferPoolStats();
+  for (int i = 0; i < 100; ++i)
+  {
+    qi::Buffer buffer;
+    buffer.write(data.c_str(), data.size());
+    ASSERT_EQ(0, memcmp(data.c_str(), buffer.data(), data.size()));
+  }
+  qi::BufferPoolStats after = qi::bufferPoolStats();
+  // Both the buffer and its payload block are recycled
+  EXPECT_GE(after.allocations - before.allocations, 200);
+  EXPECT_EQ(after.allocations - before.allocations, after.hits - before.hits);
+  EXPECT_GT(after.peakCachedBytes, 0);
+}
@@ -7,7 +7,12 @@
 
 #include <gtest/gtest.h>
 #include <qi/buffer.hpp>
+#include <cstring>
 #include <stdexcept>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
 
 TEST(TestBufferReader, TestSubBuffer)
 {
@@ -82,3 +87,37 @@ TEST(TestBufferReader, TestPeekSeek)
 
   ASSERT_STREQ("bla", str);
 }
+
+static void sliceAll(const qi::Buffer& buffer, boost::barrier* start, std::vector<qi::Buffer>* slices)
+{
+  qi::BufferReader reader(buffer);
+  start->wait();
+  qi::Buffer slice;
+  while (reader.readSlice(1000, slice))
+    slices->push_back(slice);
+}
+
+TEST(TestBufferReader, ConcurrentSlices)
+{
+  // Readers of copies of one buffer share its bytes only once
+  std::vector<char> data(100000);
+  for (unsigned i = 0; i < data.size(); ++i)
+    data[i] = (char)i;
+  for (int round = 0; round < 100; ++round)
+  {
+    qi::Buffer buffer;
+    buffer.write(&data[0], data.size());
+    boost::barrier start(2);
+    std::vector<qi::Buffer> slices1, slices2;
+    boost::thread t(boost::bind(&sliceAll, buffer, &start, &slices1));
+    sliceAll(buffer, &start, &slices2);
+    t.join();
+    ASSERT_EQ(100u, slices1.size());
+    ASSERT_EQ(100u, slices2.size());
+    for (unsigned i = 0; i < slices1.size(); ++i)
+    {
+      EXPECT_EQ(slices1[i].data(), slices2[i].data());
+      EXPECT_EQ(0, memcmp(&data[i * 1000], slices1[i].data(), 1000));
+    }
+  }
+}
@@ -0,0 +1,121 @@
+/*
+** Copyright (C) 2014 Aldebaran Robotics
+** See COPYING for the license
+*/
+
+#include <vector>
+#include <gtest/gtest.h>
+#include <boost/thread/mutex.hpp>
+#include <qi/application.hpp>
+#include <qi/eventloop.hpp>
+#include <qi/future.hpp>
+#include <qi/atomic.hpp>
+#include <qi/os.hpp>
+
+class EventLoopBackend: public ::testing::TestWithParam<qi::EventLoop::Backend>
+{
+};
+
+static void push(boost::mutex* mutex, std::vector<int>* v, int i)
+{
+  boost::mutex::scoped_lock lock(*mutex);
+  v->push_back(i);
+}
+
+TEST_P(EventLoopBackend, SingleThreadKeepsOrder)
+{
+  qi::EventLoop el;
+  el.start(1, GetParam());
+  boost::mutex mutex;
+  std::vector<int> v;
+  for (int i = 0; i < 100; ++i)
+    el.post(boost::bind(&push, &mutex, &v, i));
+  el.async(boost::bind(&push, &mutex, &v, 100)).wait();
+  ASSERT_EQ(101u, v.size());
+  for (int i = 0; i < 101; ++i)
+    EXPECT_EQ(i, v[i]);
+}
+
+static void fanOut(qi::EventLoop* el, qi::Atomic<int>* count, int depth)
+{
+  ++*count;
+  if (depth == 0)
+    return;
+  el->post(boost::bind(&fanOut, el, count, depth - 1));
+  el->post(boost::bind(&fanOut, el, count, depth - 1));
+}
+
+TEST_P(EventLoopBackend, PostFromTasks)
+{
+  qi::EventLoop el;
+  el.start(4, GetParam());
+  qi::Atomic<int> count;
+  el.post(boost::bind(&fanOut, &el, &count, 10));
+  // 2^11 - 1 tasks in total
+  for (int i = 0; i < 500 && *count != 2047; ++i)
+    qi::os::msleep(10);
+  EXPECT_EQ(2047, *count);
+}
+
+static void waitFor(qi::Future<void> f)
+{
+  f.wait();
+}
+
+static void setValue(qi::Promise<void> p)
+{
+  p.setValue(0);
+}
+
+TEST_P(EventLoopBackend, BlockedWorkersGetHelp)
+{
+  // The only worker blocks on a task posted after it: the pool must grow
+  qi::EventLoop el;
+  el.start(1, GetParam());
+  qi::Promise<void> p;
+  qi::Future<void> blocked = el.async(boost::bind(&waitFor, p.future()));
+  el.post(boost::bind(&setValue, p));
+  EXPECT_EQ(qi::FutureState_FinishedWithValue, blocked.wait(5000));
+}
+
+static void setTrue(bool* b)
+{
+  *b = true;
+}
+
+TEST_P(EventLoopBackend, CancelDelayed)
+{
+  qi::EventLoop el;
+  el.start(2, GetParam());
+  bool b = false;
+  qi::Future<void> f = el.async(boost::bind(&setTrue, &b), qi::MilliSeconds(200));
+  f.cancel();
+  f.wait();
+  EXPECT_TRUE(f.isCanceled());
+  qi::os::msleep(300);
+  EXPECT_FALSE(b);
+
+  qi::Future<void> f2 = el.async(boost::bind(&setTrue, &b), qi::MilliSeconds(10));
+  EXPECT_EQ(qi::FutureState_FinishedWithValue, f2.wait());
+  EXPECT_TRUE(b);
+}
+
+TEST_P(EventLoopBackend, StopDrainsTasks)
+{
+  qi::EventLoop el;
+  el.start(2, GetParam());
+  qi::Atomic<int> count;
+  el.post(boost::bind(&fanOut, &el, &count, 0), qi::MilliSeconds(50));
+  el.stop();
+  el.join();
+  EXPECT_EQ(1, *count);
+}
+
+INSTANTIATE_TEST_CASE_P(Backends, EventLoopBackend,
+    ::testing::Values(qi::EventLoop::Backend_Asio, qi::EventLoop::Backend_WorkStealing));
+
+int main(int argc, char **argv) {
+  qi::Application app(argc, argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -694,6 +694,35 @@ TEST(TestFutureSync, NoThrow) {
   EXPECT_NO_THROW(qi::FutureSync<int>(prom.future()).isCancelable());
 }
 
+static void slowCallback(qi::Promise<void> started, qi::Atomic<int>* done, qi::Future<int>)
+{
+  started.setValue(0);
+  qi::os::msleep(100);
+  ++*done;
+}
+
+static void setValueTo(qi::Promise<int> p, int value)
+{
+  p.setValue(value);
+}
+
+TEST(TestFutureSync, WaitAfterCallbacks)
+{
+  // wait() returns once the synchronous callbacks ran, even if the state
+  // is already finished
+  qi::Promise<int> p(qi::FutureCallbackType_Sync);
+  qi::Promise<void> started;
+  qi::Atomic<int> done;
+  p.future().connect(boost::bind(&slowCallback, started, &done, _1));
+  boost::thread setter(boost::bind(&setValueTo, p, 42));
+  started.future().wait();
+  EXPECT_TRUE(p.future().isFinished());
+  EXPECT_EQ(qi::FutureState_FinishedWithValue, p.future().wait(0));
+  EXPECT_EQ(1, *done);
+  EXPECT_EQ(42, p.future().value());
+  setter.join();
+}
+
 void do_nothing(TestFutureI*) {}
 
 TEST(TestFutureError, MultipleSetValue)
@@ -1040,6 +1069,112 @@ TEST(TestAdaptFuture, PromiseCancel) {
   ASSERT_FALSE(prom2.future().hasError());
 }
 
+static int futureLength(qi::Future<std::string> f)
+{
+  return static_cast<int>(f.value().size());
+}
+
+static int twice(const int& v)
+{
+  if (v < 0)
+    throw std::runtime_error("negative");
+  return v * 2;
+}
+
+static boost::thread::id callerId(qi::Future<int>)
+{
+  return boost::this_thread::get_id();
+}
+
+TEST(TestFutureThen, Then)
+{
+  qi::Promise<std::string> p;
+  qi::Future<int> f = p.future().then<int>(&futureLength);
+  EXPECT_TRUE(f.isRunning());
+  p.setValue("abcd");
+  EXPECT_EQ(4, f.value());
+
+  // the continuation sees the error, and throws
+  qi::Promise<std::string> perr;
+  f = perr.future().then<int>(&futureLength);
+  perr.setError("paf");
+  EXPECT_TRUE(f.hasError());
+}
+
+TEST(TestFutureThen, AndThen)
+{
+  qi::Promise<int> p;
+  qi::Future<int> f = p.future()
+      .andThen<int>(&twice)
+      .andThen<int>(&twice);
+  p.setValue(3);
+  EXPECT_EQ(12, f.value());
+
+  qi::Promise<int> perr;
+  f = perr.future().andThen<int>(&twice);
+  perr.setError("paf");
+  EXPECT_EQ("paf", f.error());
+
+  qi::Promise<int> pthrow;
+  f = pthrow.future().andThen<int>(&twice);
+  pthrow.setValue(-1);
+  EXPECT_EQ("negative", f.error());
+
+  qi::Promise<int> pcancel(&doCancel);
+  f = pcancel.future().andThen<int>(&twice);
+  f.cancel();
+  EXPECT_EQ(qi::FutureState_Canceled, f.wait());
+  EXPECT_TRUE(pcancel.future().isCanceled());
+}
+
+TEST(TestFutureThen, SyncRunsInline)
+{
+  // even if the promise is async
+  qi::Promise<int> p;
+  qi::Future<boost::thread::id> f = p.future()
+      .then<boost::thread::id>(&callerId, qi::FutureCallbackType_Sync);
+  p.setValue(1);
+  EXPECT_TRUE(f.isFinished());
+  EXPECT_EQ(boost::this_thread::get_id(), f.value());
+
+  // already finished
+  f = p.future().then<boost::thread::id>(&callerId, qi::FutureCallbackType_Sync);
+  EXPECT_TRUE(f.isFinished());
+  EXPECT_EQ(boost::this_thread::get_id(), f.value());
+}
+
+static qi::Future<int> delayedTwice(const int& v, qi::Promise<int>* inner)
+{
+  (void)v;
+  return inner->future();
+}
+
+TEST(TestFutureThen, Unwrap)
+{
+  qi::Promise<int> p;
+  qi::Promise<int> inner;
+  qi::Future<int> f = qi::unwrapFuture(p.future()
+      .andThen<qi::Future<int> >(boost::bind(&delayedTwice, _1, &inner)));
+  p.setValue(1);
+  qi::os::msleep(10);
+  EXPECT_TRUE(f.isRunning());
+  inner.setValue(42);
+  EXPECT_EQ(42, f.value());
+
+  qi::Promise<qi::Future<int> > perr;
+  f = qi::unwrapFuture(perr.future());
+  perr.setError("paf");
+  EXPECT_EQ("paf", f.error());
+
+  qi::Promise<qi::Future<int> > pvalue;
+  qi::Promise<int> icancel(&doCancel);
+  f = qi::unwrapFuture(pvalue.future());
+  pvalue.setValue(icancel.future());
+  f.cancel();
+  EXPECT_TRUE(f.isCanceled());
+  EXPECT_TRUE(icancel.future().isCanceled());
+}
+
 int ping(int v)
 {
   if (v>= 0)
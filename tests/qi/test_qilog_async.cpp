@@ -5,7 +5,14 @@
  */
 #include <gtest/gtest.h>
 #include <qi/log.hpp>
+#include <qi/atomic.hpp>
 #include <cstring>
+#include <string>
+#include <iomanip>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 TEST(log, logasync)
 {
@@ -23,3 +30,138 @@ TEST(log, cats)
   qiLogWarningF("canard %s", 12);
   qi::os::msleep(100);
 }
+
+
+static boost::mutex     gate;
+static qi::Atomic<int>  received;
+static size_t           lastSize = 0;
+
+static void countLog(const char* expectedCategory,
+                     const qi::LogLevel,
+                     const qi::os::timeval,
+                     const char* category,
+                     const char* msg,
+                     const char*,
+                     const char*,
+                     int)
+{
+  if (strcmp(category, expectedCategory) != 0)
+    return;
+  boost::mutex::scoped_lock lock(gate);
+  lastSize = strlen(msg);
+  ++received;
+}
+
+TEST(log, asyncNoTruncation)
+{
+  qi::log::setSynchronousLog(false);
+  received = 0;
+  qi::log::addLogHandler("counter", boost::bind(&countLog, "test.long", _1, _2, _3, _4, _5, _6, _7),
+                         qi::LogLevel_Verbose);
+
+  qiLogVerbose("test.long") << std::string(5000, 'x');
+  qi::log::flush();
+  EXPECT_EQ(1, *received);
+  EXPECT_EQ(5000u, lastSize);
+
+  // larger than a thread buffer
+  qiLogVerbose("test.long") << std::string(1000000, 'y');
+  qi::log::flush();
+  EXPECT_EQ(2, *received);
+  EXPECT_EQ(1000000u, lastSize);
+
+  qi::log::removeLogHandler("counter");
+}
+
+static void logMany(int count)
+{
+  for (int i = 0; i < count; ++i)
+    qiLogVerbose("test.threads") << "message " << i;
+}
+
+TEST(log, asyncManyThreads)
+{
+  qi::log::setSynchronousLog(false);
+  received = 0;
+  qi::log::addLogHandler("counter", boost::bind(&countLog, "test.threads", _1, _2, _3, _4, _5, _6, _7),
+                         qi::LogLevel_Verbose);
+
+  boost::thread_group threads;
+  for (int i = 0; i < 8; ++i)
+    threads.create_thread(boost::bind(&logMany, 2000));
+  threads.join_all();
+  qi::log::flush();
+  // blocking policy: nothing is lost
+  EXPECT_EQ(16000, *received);
+
+  qi::log::removeLogHandler("counter");
+}
+
+TEST(log, asyncDropWhenFull)
+{
+  qi::log::setSynchronousLog(false);
+  qi::log::setAsyncLogOverflowPolicy(qi::LogOverflowPolicy_Drop);
+  EXPECT_EQ(qi::LogOverflowPolicy_Drop, qi::log::asyncLogOverflowPolicy());
+  received = 0;
+  qi::log::addLogHandler("counter", boost::bind(&countLog, "test.drop", _1, _2, _3, _4, _5, _6, _7),
+                         qi::LogLevel_Verbose);
+  qi::uint64_t droppedBefore = qi::log::droppedLogs();
+
+  const int count = 5000;
+  {
+    // stall the log thread so that our buffer fills up
+    boost::mutex::scoped_lock lock(gate);
+    for (int i = 0; i < count; ++i)
+      qiLogVerbose("test.drop") << std::string(200, 'z');
+  }
+  qi::log::flush();
+
+  qi::uint64_t dropped = qi::log::droppedLogs() - droppedBefore;
+  EXPECT_GT(dropped, 0u);
+  EXPECT_EQ(static_cast<qi::uint64_t>(count), *received + dropped);
+
+  qi::log::removeLogHandler("counter");
+  qi::log::setAsyncLogOverflowPolicy(qi::LogOverflowPolicy_Block);
+}
+
+static std::string lastMessage;
+
+static void copyLog(const qi::LogLevel,
+                    const qi::os::timeval,
+                    const char* category,
+                    const char* msg,
+                    const char*,
+                    const char*,
+                    int)
+{
+  if (strcmp(category, "test.deferred") != 0)
+    return;
+  lastMessage = msg;
+}
+
+TEST(log, asyncDeferredFormat)
+{
+  qiLogCategory("test.deferred");
+  qi::log::setSynchronousLog(false);
+  qi::log::addLogHandler("copy", &copyLog, qi::LogLevel_Verbose);
+
+  std::string name("deferred");
+  qiLogVerboseF("%s %d %.1f %x", name, 42, 2.5, 255);
+  qi::log::flush();
+  EXPECT_EQ("deferred 42 2.5 ff", lastMessage);
+
+  // larger than a thread buffer: formatted by the caller
+  qiLogVerboseF("%s", std::string(100000, 'd'));
+  qi::log::flush();
+  EXPECT_EQ(100000u, lastMessage.size());
+
+  qiLogVerbose() << name << " " << std::hex << std::setw(4) << std::setfill('0') << 255 << " " << 255;
+  qi::log::flush();
+  EXPECT_EQ("deferred 00ff ff", lastMessage);
+
+  qiLogVerbose("test.deferred") << std::setprecision(3) << 3.14159;
+  qi::log::flush();
+  EXPECT_EQ("3.14", lastMessage);
+
+  qi::log::removeLogHandler("copy");
+}
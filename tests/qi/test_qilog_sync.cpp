@@ -14,8 +14,12 @@
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iomanip>
 
 #include <qi/log.hpp>
+#include <qi/log/bufferedfileloghandler.hpp>
 #include <qi/atomic.hpp>
 
 #include "../src/log_p.hpp"
@@ -125,6 +129,77 @@ TEST(log, formatting)
   qi::log::removeLogHandler("copy");
 }
 
+enum Color { Red, Green, Blue };
+
+struct Streamable {};
+std::ostream& operator<<(std::ostream& o, const Streamable&)
+{
+  return o << "streamable";
+}
+
+// Like qi::StreamColor: an enum with its own stream operator
+enum Shade { Light, Dark };
+std::ostream& operator<<(std::ostream& o, Shade s)
+{
+  return o << (s == Light ? "light" : "dark");
+}
+
+TEST(log, formattingDeferred)
+{
+  // qiLog*F capture raw arguments: formatting must match boost::format
+  qiLogCategory("qi.test");
+  std::string lastMessage;
+  qi::log::removeLogHandler("consoleloghandler");
+  qi::log::addLogHandler("copy", boost::bind(&copy, boost::ref(lastMessage), _4));
+
+  qiLogErrorF("%s %s %s", true, 'c', (unsigned char)200);
+  EXPECT_EQ(boost::str(boost::format("%s %s %s") % true % 'c' % (unsigned char)200), lastMessage);
+  qiLogErrorF("%x %x %d", (short)-1, -1, 42L);
+  EXPECT_EQ(boost::str(boost::format("%x %x %d") % (short)-1 % -1 % 42L), lastMessage);
+  qiLogErrorF("%d %u", -((qi::int64_t)1 << 40), (qi::uint64_t)1 << 40);
+  EXPECT_EQ(boost::str(boost::format("%d %u") % (-((qi::int64_t)1 << 40)) % ((qi::uint64_t)1 << 40)), lastMessage);
+  qiLogErrorF("%s %.2f %e", 0.1f, 3.14159, 1e100);
+  EXPECT_EQ(boost::str(boost::format("%s %.2f %e") % 0.1f % 3.14159 % 1e100), lastMessage);
+  std::string str("string");
+  const char* cstr = "cstring";
+  char buffer[16] = "buffer";
+  qiLogErrorF("%s %s %s %s", str, cstr, buffer, "literal");
+  EXPECT_EQ("string cstring buffer literal", lastMessage);
+  qiLogErrorF(std::string("%s %s"), Blue, Streamable());
+  EXPECT_EQ("2 streamable", lastMessage);
+  qiLogErrorF("%1% %1% %2%", 1, std::string(300, 'x'));
+  EXPECT_EQ("1 1 " + std::string(300, 'x'), lastMessage);
+  qiLogErrorF("%s %s", Dark, Light);
+  EXPECT_EQ("dark light", lastMessage);
+
+  qi::log::removeLogHandler("copy");
+}
+
+TEST(log, streamDeferred)
+{
+  // qiLog*() << capture values with the stream state they are written with
+  qiLogCategory("qi.test");
+  std::string lastMessage;
+  qi::log::removeLogHandler("consoleloghandler");
+  qi::log::addLogHandler("copy", boost::bind(&copy, boost::ref(lastMessage), _4));
+
+  qiLogError() << std::hex << 255 << " " << std::showbase << 255 << std::dec << std::noshowbase << " " << 255;
+  EXPECT_EQ("ff 0xff 255", lastMessage);
+  qiLogError() << "[" << std::setw(4) << std::setfill('0') << 7 << 7 << "]" << std::setw(4) << "ab" << "|";
+  EXPECT_EQ("[00077]00ab|", lastMessage);
+  qiLogError() << std::fixed << std::setprecision(2) << 3.14159 << " " << std::boolalpha << true << ' ' << 'c';
+  EXPECT_EQ("3.14 true c", lastMessage);
+  qiLogError() << Dark << " " << Blue << " " << Streamable() << " " << std::string(300, 'x');
+  EXPECT_EQ("dark 2 streamable " + std::string(300, 'x'), lastMessage);
+  const char* null = 0;
+  qiLogError("qi.test") << "line" << std::endl << null;
+  EXPECT_EQ("line\n(null)", lastMessage);
+  qiLogError("qi.test", "%d %s", 1, "format") << " " << 2;
+  EXPECT_EQ("1 format 2", lastMessage);
+
+  qi::log::removeLogHandler("copy");
+}
+
 void set (const char* cat, bool& b)
 {
   //remove log from the logger itself
@@ -445,3 +520,92 @@ TEST(log, threadSafeness)
     qi::os::msleep(50);
   EXPECT_TRUE(true);
 }
+
+static std::string readFile(const std::string& path)
+{
+  std::ifstream f(path.c_str(), std::ios::binary);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+TEST(log, bufferedFileHandler)
+{
+  namespace fs = boost::filesystem;
+  std::string dir = qi::os::mktmpdir("bufferedlog");
+  std::string path = (fs::path(dir) / "test.log").string();
+  qi::os::timeval date;
+  qi::os::gettimeofday(&date);
+  {
+    qi::log::BufferedFileLogHandler handler(path);
+    handler.log(qi::LogLevel_Info, date, "qi.test", "first", "", "", 0);
+    handler.log(qi::LogLevel_Info, date, "qi.test", "second", "", "", 0);
+    // nothing written until the buffer is full or flushed
+    EXPECT_EQ("", readFile(path));
+    handler.flush();
+    std::string content = readFile(path);
+    EXPECT_NE(std::string::npos, content.find("first"));
+    EXPECT_NE(std::string::npos, content.find("second"));
+    handler.log(qi::LogLevel_Info, date, "qi.test", "third", "", "", 0);
+  }
+  // destruction writes pending logs
+  EXPECT_NE(std::string::npos, readFile(path).find("third"));
+  fs::remove_all(dir);
+}
+
+TEST(log, bufferedFileHandlerRotation)
+{
+  namespace fs = boost::filesystem;
+  std::string dir = qi::os::mktmpdir("bufferedlog");
+  std::string path = (fs::path(dir) / "test.log").string();
+  qi::os::timeval date;
+  qi::os::gettimeofday(&date);
+  {
+    qi::log::BufferedFileLogHandler handler(path, 1000, 2);
+    handler.setBufferSize(100);
+    const std::string msg(200, 'r');
+    for (int i = 0; i < 50; ++i)
+      handler.log(qi::LogLevel_Info, date, "qi.test", msg.c_str(), "", "", 0);
+    handler.flush();
+    handler.log(qi::LogLevel_Info, date, "qi.test", "last", "", "", 0);
+  }
+  EXPECT_TRUE(fs::exists(path + ".1"));
+  EXPECT_TRUE(fs::exists(path + ".2"));
+  EXPECT_FALSE(fs::exists(path + ".3"));
+  EXPECT_LE(fs::file_size(path), 1000u);
+  EXPECT_LE(fs::file_size(path + ".1"), 1000u);
+  EXPECT_GT(fs::file_size(path + ".1"), 0u);
+  EXPECT_NE(std::string::npos, readFile(path).find("last"));
+  fs::remove_all(dir);
+}
+
+TEST(log, bufferedFileHandlerCompression)
+{
+  namespace fs = boost::filesystem;
+  std::string dir = qi::os::mktmpdir("bufferedlog");
+  std::string path = (fs::path(dir) / "test.log").string();
+  qi::os::timeval date;
+  qi::os::gettimeofday(&date);
+  {
+    qi::log::BufferedFileLogHandler handler(path, 1000, 3);
+    if (!handler.setCompression(true))
+    {
+      fs::remove_all(dir);
+      return;
+    }
+    handler.setBufferSize(100);
+    const std::string msg(200, 'z');
+    for (int i = 0; i < 50; ++i)
+      handler.log(qi::LogLevel_Info, date, "qi.test", msg.c_str(), "", "", 0);
+    handler.log(qi::LogLevel_Info, date, "qi.test", "last", "", "", 0);
+  }
+  // destruction waits for pending compressions
+  for (int i = 1; i <= 3; ++i)
+  {
+    std::string backup = path + "." + boost::lexical_cast<std::string>(i);
+    EXPECT_TRUE(fs::exists(backup + ".gz"));
+    EXPECT_FALSE(fs::exists(backup));
+  }
+  EXPECT_NE(std::string::npos, readFile(path).find("last"));
+  fs::remove_all(dir);
+}
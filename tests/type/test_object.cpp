@@ -866,6 +866,35 @@ TEST(TestObject, statisticsType)
   EXPECT_EQ(2u, stats[mid].count());
 }
 
+TEST(TestObject, statisticsPercentiles)
+{
+  qi::Signal<int> sig;
+  qi::DynamicObjectBuilder gob;
+  unsigned int sid = gob.advertiseSignal("sig", &sig);
+  qi::AnyObject obj = gob.object();
+  obj.enableStats(true);
+
+  // 1000 values from 1ms to 1s
+  for (int i = 1; i <= 1000; ++i)
+    obj.asGenericObject()->pushStats(42, i / 1000.0f, 0, 0);
+  qi::MethodStatistics m = obj.stats()[42];
+  EXPECT_EQ(1000u, m.count());
+  EXPECT_FLOAT_EQ(0.001f, m.wall().minValue());
+  EXPECT_FLOAT_EQ(1.0f, m.wall().maxValue());
+  // Histogram buckets are precise to 1/16th
+  EXPECT_NEAR(0.5, m.wallPercentiles().p50(), 0.5 / 16);
+  EXPECT_NEAR(0.99, m.wallPercentiles().p99(), 0.99 / 16);
+  EXPECT_NEAR(0.999, m.wallPercentiles().p999(), 0.999 / 16);
+  EXPECT_GE(m.wall().maxValue(), m.wallPercentiles().p999());
+  EXPECT_EQ(0.0f, m.userPercentiles().p99());
+
+  // Signal triggers are accounted too
+  obj.post("sig", 42);
+  qi::ObjectStatistics stats = obj.call<qi::ObjectStatistics>("stats");
+  EXPECT_EQ(1u, stats[sid].count());
+  EXPECT_EQ(1000u, stats[42].count());
+}
+
 void pushTrace(std::vector<qi::EventTrace>& target,
     boost::mutex& mutex,
     const qi::EventTrace& trace)
@@ -1350,6 +1379,46 @@ TEST(TestObject, findMethodErr)
   //EXPECT_EQ(-3, ao.findMethod("callc", args(1)));
 }
 
+static int overInt(int i) { return i; }
+static int overString(const std::string& s) { return s.size(); }
+
+TEST(TestObject, resolve)
+{
+  qi::DynamicObjectBuilder gob;
+  unsigned int hi = gob.advertiseMethod("h", &overInt);
+  unsigned int hs = gob.advertiseMethod("h", &overString);
+  qi::AnyObject ao = gob.object();
+
+  std::vector<qi::TypeInterface*> types;
+  types.push_back(qi::typeOf<int>());
+  EXPECT_EQ((int)hi, ao.resolve("h", types));
+  types[0] = qi::typeOf<std::string>();
+  EXPECT_EQ((int)hs, ao.resolve("h", types));
+  types.push_back(qi::typeOf<int>());
+  EXPECT_EQ(-2, ao.resolve("h", types));
+  EXPECT_EQ(-1, ao.resolve("nope", types));
+
+  // Repeated resolution by name goes through the cache and gives the same answer
+  for (unsigned i = 0; i < 3; ++i)
+  {
+    EXPECT_EQ((int)hi, ao.findMethod("h", args(1)));
+    EXPECT_EQ((int)hs, ao.findMethod("h", args("foo")));
+    EXPECT_EQ(3, ao.call<int>("h", "foo"));
+    EXPECT_EQ(12, ao.call<int>("h", 12));
+  }
+  EXPECT_EQ(12, ao.metaCall(hi, args(12)).value().to<int>());
+
+  // A single overload of the right arity still needs compatible arguments
+  qi::DynamicObjectBuilder sob;
+  unsigned int si = sob.advertiseMethod("single", &overInt);
+  qi::AnyObject so = sob.object();
+  types.resize(1);
+  types[0] = qi::typeOf<double>();
+  EXPECT_EQ((int)si, so.resolve("single", types));
+  types[0] = qi::typeOf<std::string>();
+  EXPECT_EQ(-2, so.resolve("single", types));
+}
+
 TEST(TestObject, WeakObject)
 {
   qi::AnyObject obj;
@@ -5,6 +5,7 @@
 ** Copyright (C) 2012 Aldebaran Robotics
 */
 
+#include <set>
 #include <gtest/gtest.h>
 #include <qi/signal.hpp>
 #include <qi/future.hpp>
@@ -266,6 +267,54 @@ TEST(TestSignal, OnSubscriber)
   ASSERT_FALSE(subscribers);
 }
 
+static void disconnectSelf(qi::Signal<int>* sig, qi::SignalLink* link, qi::Atomic<int>* r)
+{
+  ++*r;
+  sig->disconnect(*link);
+}
+
+TEST(TestSignal, DisconnectWhileTriggering)
+{
+  qi::Atomic<int> r = 0;
+  qi::Signal<int> sig;
+  qi::SignalLink l1 = qi::SignalBase::invalidSignalLink;
+  qi::SignalLink l2 = qi::SignalBase::invalidSignalLink;
+  l1 = sig.connect(boost::bind(&disconnectSelf, &sig, &l1, &r)).setCallType(qi::MetaCallType_Direct);
+  l2 = sig.connect(boost::bind(&disconnectSelf, &sig, &l2, &r)).setCallType(qi::MetaCallType_Direct);
+  ASSERT_TRUE(sig.hasSubscribers());
+  sig(0);
+  // Both were called by the emission which disconnected them
+  EXPECT_EQ(2, *r);
+  EXPECT_FALSE(sig.hasSubscribers());
+  sig(0);
+  EXPECT_EQ(2, *r);
+}
+
+static void recordAddress(const std::vector<int>& v, boost::mutex* mutex, std::set<const void*>* addresses, qi::Atomic<int>* r)
+{
+  {
+    boost::mutex::scoped_lock lock(*mutex);
+    addresses->insert(&v);
+  }
+  ++*r;
+}
+
+TEST(TestSignal, QueuedSubscribersShareArguments)
+{
+  qi::Atomic<int> r = 0;
+  boost::mutex mutex;
+  std::set<const void*> addresses;
+  qi::Signal<std::vector<int> > sig;
+  for (unsigned i = 0; i < 3; ++i)
+    sig.connect(qi::AnyFunction::from(boost::function<void(const std::vector<int>&)>(
+          boost::bind(&recordAddress, _1, &mutex, &addresses, &r)))).setCallType(qi::MetaCallType_Queued);
+  sig(std::vector<int>(1000, 42));
+  while (*r != 3)
+    qi::os::msleep(10);
+  // A single copy of the argument for all queued subscribers
+  EXPECT_EQ(1u, addresses.size());
+}
+
 
 int main(int argc, char **argv) {
   qi::Application app(argc, argv);
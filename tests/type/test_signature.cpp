@@ -309,6 +309,28 @@ TEST(TestSignature, IsCompatible) {
   EXPECT_GT(s3.isConvertibleTo("([m])"), s3.isConvertibleTo("(m)"));
 }
 
+TEST(TestSignature, IsCompatibleMemoized) {
+  // Results must not depend on whether the pair was already scored
+  qi::Signature s("({is}[f])");
+  float first = s.isConvertibleTo("({im}[d])");
+  EXPECT_GT(first, 0.);
+  EXPECT_EQ(first, s.isConvertibleTo("({im}[d])"));
+  EXPECT_EQ(first, qi::Signature("({is}[f])").isConvertibleTo(qi::Signature("({im}[d])")));
+  EXPECT_EQ(0., s.isConvertibleTo("({is}[s])"));
+  EXPECT_EQ(0., s.isConvertibleTo("({is}[s])"));
+
+  // Go past the interned signature table capacity
+  for (unsigned int i = 0; i < 5000; ++i)
+  {
+    std::stringstream ss;
+    ss << "(i)<Tuple" << i << ",a>";
+    qi::Signature t(ss.str());
+    EXPECT_GT(t.isConvertibleTo("(l)"), 0.);
+    EXPECT_EQ(0., t.isConvertibleTo("(s)"));
+  }
+  EXPECT_EQ(first, s.isConvertibleTo("({im}[d])"));
+}
+
 TEST(TestSignature, SignatureSplit) {
   std::vector<std::string> sigInfo;
 